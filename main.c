@@ -27,6 +27,8 @@
  * 03/08/2023:				RC2	+ Enhanced low-level keyboard functionality
  * 27/09/2023:					+ Updated RTC
  * 11/11/2023:				RC3	+ See Github for full list of changes
+ * 17/10/2026:					+ Hot routines are copied to internal SRAM at boot
+ * 17/10/2026:					+ Deferred file system work runs after each command
  */
 
 #include <eZ80.h>
@@ -48,6 +50,7 @@
 #include "mos.h"
 #include "i2c.h"
 #include "umm_malloc.h"
+#include "iram.h"
 
 extern BYTE scrcolours, scrpixelIndex;  // In globals.asm
 
@@ -163,6 +166,7 @@ int main(void) {
 	//void *  empty = NULL;
 
 	DI();											// Ensure interrupts are disabled before we do anything
+	iram_install();									// Copy the hot routines to internal SRAM before anything calls them
 	init_interrupts();								// Initialise the interrupt vectors
 	init_rtc();										// Initialise the real time clock
 	init_spi();										// Initialise SPI comms for the SD card interface
@@ -223,6 +227,7 @@ int main(void) {
 			if(err > 0) {
 				mos_error(err);
 			}
+			ff_run_deferred();		// Work queued by interrupt handlers while the command ran
 		}
 		else {
 			printf("Escape\n\r");
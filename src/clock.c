@@ -9,6 +9,7 @@
  * 21/03/2023:		Uses VDP values from defines.h
  * 05/06/2023:		Added RTC enable flag
  * 26/09/2023:		Timestamps now packed into 6 bytes
+ * 17/10/2026:		rtc_update uses vdp_query, so no longer hangs if the VDP doesn't reply
  */
 
 #include <ez80.h>
@@ -21,8 +22,8 @@
 #include "defines.h"
 #include "uart.h"
 #include "clock.h"
+#include "vdp_query.h"
 
-extern volatile BYTE vpd_protocol_flags;		// In globals.asm
 extern volatile BYTE rtc_enable;				// In globals.asm
 
 const char * rtc_days[7][2] = {	
@@ -53,17 +54,12 @@ const char * rtc_months[12][2] = {
 // Request an update of the RTC from the ESP32
 //
 void rtc_update() {
+	BYTE	request[] = { 23, 0, VDP_rtc, 0 };	// 0: Get time
+
 	if(!rtc_enable) {
 		return;
 	}
-	vpd_protocol_flags &= 0xDF;	// Reset bit 5
-
-	putch(23);					// Request the time from the ESP32
-	putch(0);
-	putch(VDP_rtc);
-	putch(0);					// 0: Get time
-
-	while((vpd_protocol_flags & 0x20) == 0);	
+	vdp_queryWait(vdp_query(VDPP_rtc, request, sizeof(request), NULL), NULL);
 }
 
 // Unpack a 6-byte RTC packet into time struct
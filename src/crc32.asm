@@ -0,0 +1,178 @@
+;
+; Title:	AGON MOS - CRC32
+; Author:	Agon MOS contributors
+; Created:	17/10/2026
+; Last Updated:	17/10/2026
+;
+; Modinfo:
+; 17/10/2026:	The kernel and table run from internal SRAM; see iram.inc
+
+			INCLUDE	"iram.inc"
+
+			.ASSUME	ADL = 1
+
+			DEFINE .STARTUP, SPACE = ROM
+			SEGMENT .STARTUP
+
+			XDEF	_crc32_block
+
+			XDEF	crc32_iram_start
+			XDEF	crc32_iram_end
+			XDEF	crc32_block_rom
+			XDEF	CRC32_TABLE
+			XDEF	CRC32_TABLE_END
+
+; The kernel is copied to IRAM_CRC32 and the table to IRAM_CRC32_TABLE by iram_install
+;
+_crc32_block		EQU	IRAM_CRC32 + (crc32_block_rom - crc32_iram_start)
+
+; Update a CRC32 (IEEE 802.3, as used by zip and PNG) with a block of data
+; This is table driven, one table lookup per byte; the table is split into four 256 byte
+; pages holding bits 0-7, 8-15, 16-23 and 24-31 of each entry, so a byte of the table
+; can be fetched by setting L to the index and stepping H between the pages
+;
+; DWORD crc32_block(DWORD crc, BYTE * buffer, UINT24 length)
+; - crc: CRC so far; this is the inverted form, so start with 0xFFFFFFFF and invert the result
+; - buffer: Pointer to the data
+; - length: Number of bytes, 1 to 65535
+; Returns:
+; - E:HL: Updated CRC
+;
+crc32_iram_start:
+crc32_block_rom:	PUSH	IX
+			LD	IX, 0
+			ADD	IX, SP
+			PUSH	IY
+;
+			LD	E, (IX+6)		; BCDE: CRC, B holding bits 24-31
+			LD	D, (IX+7)
+			LD	C, (IX+8)
+			LD	B, (IX+9)
+			LD	A, (IX+15)		; IYH:IYL: Length, counted down with 8-bit decrements
+			LD	IYL, A
+			LD	A, (IX+16)
+			LD	IYH, A
+			LD	A, IYL
+			OR	A, A
+			JR	Z, $F
+			INC	IYH			; So the outer count is right when the low byte isn't 0
+$$:			LD	IX, (IX+12)		; IX: Pointer to the data
+			LD	HL, IRAM_CRC32_TABLE	; HL: Table page for bits 0-7
+;
+crc32_block_loop:	LD	A, (IX+0)		; Index = (CRC XOR byte) AND 0xFF
+			INC	IX
+			XOR	A, E
+			LD	L, A
+			LD	A, (HL)			; CRC = (CRC >> 8) XOR table[index]
+			XOR	A, D
+			LD	E, A
+			INC	H
+			LD	A, (HL)
+			XOR	A, C
+			LD	D, A
+			INC	H
+			LD	A, (HL)
+			XOR	A, B
+			LD	C, A
+			INC	H
+			LD	B, (HL)
+			DEC	H
+			DEC	H
+			DEC	H
+			DEC	IYL
+			JR	NZ, crc32_block_loop
+			DEC	IYH
+			JR	NZ, crc32_block_loop
+;
+			PUSH	DE			; Return the CRC in E:HL
+			LD	HL, 2
+			ADD	HL, SP
+			LD	(HL), C
+			POP	HL			; HL: Bits 0-23
+			LD	E, B			;  E: Bits 24-31
+			POP	IY
+			POP	IX
+			RET
+crc32_iram_end:
+
+; The CRC32 table, split into bytes
+; This is copied to IRAM_CRC32_TABLE, which is aligned on a 1K boundary so that all four pages
+; share the same upper byte (U)
+;
+
+; Bits 0-7
+;
+CRC32_TABLE:			DB	%00, %96, %2C, %BA, %19, %8F, %35, %A3, %32, %A4, %1E, %88, %2B, %BD, %07, %91
+			DB	%64, %F2, %48, %DE, %7D, %EB, %51, %C7, %56, %C0, %7A, %EC, %4F, %D9, %63, %F5
+			DB	%C8, %5E, %E4, %72, %D1, %47, %FD, %6B, %FA, %6C, %D6, %40, %E3, %75, %CF, %59
+			DB	%AC, %3A, %80, %16, %B5, %23, %99, %0F, %9E, %08, %B2, %24, %87, %11, %AB, %3D
+			DB	%90, %06, %BC, %2A, %89, %1F, %A5, %33, %A2, %34, %8E, %18, %BB, %2D, %97, %01
+			DB	%F4, %62, %D8, %4E, %ED, %7B, %C1, %57, %C6, %50, %EA, %7C, %DF, %49, %F3, %65
+			DB	%58, %CE, %74, %E2, %41, %D7, %6D, %FB, %6A, %FC, %46, %D0, %73, %E5, %5F, %C9
+			DB	%3C, %AA, %10, %86, %25, %B3, %09, %9F, %0E, %98, %22, %B4, %17, %81, %3B, %AD
+			DB	%20, %B6, %0C, %9A, %39, %AF, %15, %83, %12, %84, %3E, %A8, %0B, %9D, %27, %B1
+			DB	%44, %D2, %68, %FE, %5D, %CB, %71, %E7, %76, %E0, %5A, %CC, %6F, %F9, %43, %D5
+			DB	%E8, %7E, %C4, %52, %F1, %67, %DD, %4B, %DA, %4C, %F6, %60, %C3, %55, %EF, %79
+			DB	%8C, %1A, %A0, %36, %95, %03, %B9, %2F, %BE, %28, %92, %04, %A7, %31, %8B, %1D
+			DB	%B0, %26, %9C, %0A, %A9, %3F, %85, %13, %82, %14, %AE, %38, %9B, %0D, %B7, %21
+			DB	%D4, %42, %F8, %6E, %CD, %5B, %E1, %77, %E6, %70, %CA, %5C, %FF, %69, %D3, %45
+			DB	%78, %EE, %54, %C2, %61, %F7, %4D, %DB, %4A, %DC, %66, %F0, %53, %C5, %7F, %E9
+			DB	%1C, %8A, %30, %A6, %05, %93, %29, %BF, %2E, %B8, %02, %94, %37, %A1, %1B, %8D
+
+; Bits 8-15
+;
+			DB	%00, %30, %61, %51, %C4, %F4, %A5, %95, %88, %B8, %E9, %D9, %4C, %7C, %2D, %1D
+			DB	%10, %20, %71, %41, %D4, %E4, %B5, %85, %98, %A8, %F9, %C9, %5C, %6C, %3D, %0D
+			DB	%20, %10, %41, %71, %E4, %D4, %85, %B5, %A8, %98, %C9, %F9, %6C, %5C, %0D, %3D
+			DB	%30, %00, %51, %61, %F4, %C4, %95, %A5, %B8, %88, %D9, %E9, %7C, %4C, %1D, %2D
+			DB	%41, %71, %20, %10, %85, %B5, %E4, %D4, %C9, %F9, %A8, %98, %0D, %3D, %6C, %5C
+			DB	%51, %61, %30, %00, %95, %A5, %F4, %C4, %D9, %E9, %B8, %88, %1D, %2D, %7C, %4C
+			DB	%61, %51, %00, %30, %A5, %95, %C4, %F4, %E9, %D9, %88, %B8, %2D, %1D, %4C, %7C
+			DB	%71, %41, %10, %20, %B5, %85, %D4, %E4, %F9, %C9, %98, %A8, %3D, %0D, %5C, %6C
+			DB	%83, %B3, %E2, %D2, %47, %77, %26, %16, %0B, %3B, %6A, %5A, %CF, %FF, %AE, %9E
+			DB	%93, %A3, %F2, %C2, %57, %67, %36, %06, %1B, %2B, %7A, %4A, %DF, %EF, %BE, %8E
+			DB	%A3, %93, %C2, %F2, %67, %57, %06, %36, %2B, %1B, %4A, %7A, %EF, %DF, %8E, %BE
+			DB	%B3, %83, %D2, %E2, %77, %47, %16, %26, %3B, %0B, %5A, %6A, %FF, %CF, %9E, %AE
+			DB	%C2, %F2, %A3, %93, %06, %36, %67, %57, %4A, %7A, %2B, %1B, %8E, %BE, %EF, %DF
+			DB	%D2, %E2, %B3, %83, %16, %26, %77, %47, %5A, %6A, %3B, %0B, %9E, %AE, %FF, %CF
+			DB	%E2, %D2, %83, %B3, %26, %16, %47, %77, %6A, %5A, %0B, %3B, %AE, %9E, %CF, %FF
+			DB	%F2, %C2, %93, %A3, %36, %06, %57, %67, %7A, %4A, %1B, %2B, %BE, %8E, %DF, %EF
+
+; Bits 16-23
+;
+			DB	%00, %07, %0E, %09, %6D, %6A, %63, %64, %DB, %DC, %D5, %D2, %B6, %B1, %B8, %BF
+			DB	%B7, %B0, %B9, %BE, %DA, %DD, %D4, %D3, %6C, %6B, %62, %65, %01, %06, %0F, %08
+			DB	%6E, %69, %60, %67, %03, %04, %0D, %0A, %B5, %B2, %BB, %BC, %D8, %DF, %D6, %D1
+			DB	%D9, %DE, %D7, %D0, %B4, %B3, %BA, %BD, %02, %05, %0C, %0B, %6F, %68, %61, %66
+			DB	%DC, %DB, %D2, %D5, %B1, %B6, %BF, %B8, %07, %00, %09, %0E, %6A, %6D, %64, %63
+			DB	%6B, %6C, %65, %62, %06, %01, %08, %0F, %B0, %B7, %BE, %B9, %DD, %DA, %D3, %D4
+			DB	%B2, %B5, %BC, %BB, %DF, %D8, %D1, %D6, %69, %6E, %67, %60, %04, %03, %0A, %0D
+			DB	%05, %02, %0B, %0C, %68, %6F, %66, %61, %DE, %D9, %D0, %D7, %B3, %B4, %BD, %BA
+			DB	%B8, %BF, %B6, %B1, %D5, %D2, %DB, %DC, %63, %64, %6D, %6A, %0E, %09, %00, %07
+			DB	%0F, %08, %01, %06, %62, %65, %6C, %6B, %D4, %D3, %DA, %DD, %B9, %BE, %B7, %B0
+			DB	%D6, %D1, %D8, %DF, %BB, %BC, %B5, %B2, %0D, %0A, %03, %04, %60, %67, %6E, %69
+			DB	%61, %66, %6F, %68, %0C, %0B, %02, %05, %BA, %BD, %B4, %B3, %D7, %D0, %D9, %DE
+			DB	%64, %63, %6A, %6D, %09, %0E, %07, %00, %BF, %B8, %B1, %B6, %D2, %D5, %DC, %DB
+			DB	%D3, %D4, %DD, %DA, %BE, %B9, %B0, %B7, %08, %0F, %06, %01, %65, %62, %6B, %6C
+			DB	%0A, %0D, %04, %03, %67, %60, %69, %6E, %D1, %D6, %DF, %D8, %BC, %BB, %B2, %B5
+			DB	%BD, %BA, %B3, %B4, %D0, %D7, %DE, %D9, %66, %61, %68, %6F, %0B, %0C, %05, %02
+
+; Bits 24-31
+;
+			DB	%00, %77, %EE, %99, %07, %70, %E9, %9E, %0E, %79, %E0, %97, %09, %7E, %E7, %90
+			DB	%1D, %6A, %F3, %84, %1A, %6D, %F4, %83, %13, %64, %FD, %8A, %14, %63, %FA, %8D
+			DB	%3B, %4C, %D5, %A2, %3C, %4B, %D2, %A5, %35, %42, %DB, %AC, %32, %45, %DC, %AB
+			DB	%26, %51, %C8, %BF, %21, %56, %CF, %B8, %28, %5F, %C6, %B1, %2F, %58, %C1, %B6
+			DB	%76, %01, %98, %EF, %71, %06, %9F, %E8, %78, %0F, %96, %E1, %7F, %08, %91, %E6
+			DB	%6B, %1C, %85, %F2, %6C, %1B, %82, %F5, %65, %12, %8B, %FC, %62, %15, %8C, %FB
+			DB	%4D, %3A, %A3, %D4, %4A, %3D, %A4, %D3, %43, %34, %AD, %DA, %44, %33, %AA, %DD
+			DB	%50, %27, %BE, %C9, %57, %20, %B9, %CE, %5E, %29, %B0, %C7, %59, %2E, %B7, %C0
+			DB	%ED, %9A, %03, %74, %EA, %9D, %04, %73, %E3, %94, %0D, %7A, %E4, %93, %0A, %7D
+			DB	%F0, %87, %1E, %69, %F7, %80, %19, %6E, %FE, %89, %10, %67, %F9, %8E, %17, %60
+			DB	%D6, %A1, %38, %4F, %D1, %A6, %3F, %48, %D8, %AF, %36, %41, %DF, %A8, %31, %46
+			DB	%CB, %BC, %25, %52, %CC, %BB, %22, %55, %C5, %B2, %2B, %5C, %C2, %B5, %2C, %5B
+			DB	%9B, %EC, %75, %02, %9C, %EB, %72, %05, %95, %E2, %7B, %0C, %92, %E5, %7C, %0B
+			DB	%86, %F1, %68, %1F, %81, %F6, %6F, %18, %88, %FF, %66, %11, %8F, %F8, %61, %16
+			DB	%A0, %D7, %4E, %39, %A7, %D0, %49, %3E, %AE, %D9, %40, %37, %A9, %DE, %47, %30
+			DB	%BD, %CA, %53, %24, %BA, %CD, %54, %23, %B3, %C4, %5D, %2A, %B4, %C3, %5A, %2D
+CRC32_TABLE_END:
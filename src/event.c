@@ -0,0 +1,105 @@
+/*
+ * Title:			AGON MOS - Events
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ * 17/10/2026:		event_wait no longer runs the deferred file system work
+ * 17/10/2026:		event_take and event_wait leave interrupts as they found them
+ */
+
+#include <eZ80.h>
+#include <defines.h>
+#include <string.h>
+
+#include "defines.h"
+#include "uart.h"
+#include "ff.h"
+#include "event.h"
+
+extern volatile DWORD clock;					// In globals.asm
+extern volatile BYTE event_flags;				// In globals.asm
+extern volatile BYTE event_data[];				// In globals.asm
+
+extern BYTE di_save(void);					// In misc.asm
+extern void ei_restore(BYTE enabled);		// In misc.asm
+extern void ei_halt(BYTE enabled);			// In misc.asm
+
+// Take the events in a mask that have been posted, clearing them
+// Interrupts must be disabled
+//
+static BYTE event_collect(BYTE mask, BYTE * data) {
+	BYTE	fired;
+	BYTE	i;
+
+	if ((mask & EVENT_uart1) && (serialFlags & 0x10) && (UART1_LSR & UART_LSR_DATA_READY)) {
+		event_flags |= EVENT_uart1;
+	}
+	fired = event_flags & mask;
+	event_flags &= ~fired;
+	for (i = 0; i < EVENT_dataSize; i++) {
+		if (fired & (1 << i)) {
+			if (data) {
+				data[i] = event_data[i];
+			}
+			event_data[i] = 0;
+		}
+		else if (data) {
+			data[i] = 0;
+		}
+	}
+	return fired;
+}
+
+// Take the events in a mask that have been posted, without waiting
+// Parameters:
+// - mask: The events to take
+// - data: Buffer of EVENT_dataSize bytes for their payloads, or NULL
+// Returns:
+// - The events taken
+//
+BYTE event_take(BYTE mask, BYTE * data) {
+	BYTE	fired;
+	BYTE	enabled;
+
+	enabled = di_save();
+	fired = event_collect(mask, data);
+	ei_restore(enabled);
+	return fired;
+}
+
+// Wait for any of a set of events
+// With EVENT_halt the CPU sleeps
+// until the next interrupt instead of polling; VBLANK wakes it at least every frame, which is also how
+// often UART1 is checked. If interrupts are disabled when it is called, it polls instead, and they are
+// left disabled
+// Parameters:
+// - mask: The events to wait for
+// - timeout: Centiseconds to wait; 0 just takes what is there, EVENT_forever waits until one is posted
+// - flags: EVENT_halt
+// - data: Buffer of EVENT_dataSize bytes for the payloads, or NULL; the bytes for events that did not fire are 0
+// Returns:
+// - The events that fired, which are cleared, or 0 if it timed out
+//
+BYTE event_wait(BYTE mask, unsigned short timeout, BYTE flags, BYTE * data) {
+	DWORD	start = clock;
+	BYTE	fired;
+	BYTE	enabled;
+
+	while (1) {
+		enabled = di_save();
+		fired = event_collect(mask, data);
+		if (fired || timeout == 0 || (timeout != EVENT_forever && clock - start >= timeout)) {
+			ei_restore(enabled);
+			break;
+		}
+		if ((flags & EVENT_halt) && enabled) {
+			ei_halt(enabled);					// An interrupt that posts an event now still wakes the HALT
+		}
+		else {
+			ei_restore(enabled);
+		}
+	}
+	return fired;
+}
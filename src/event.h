@@ -0,0 +1,34 @@
+/*
+ * Title:			AGON MOS - Events
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+// Events, posted in event_flags by the interrupt handlers; these must match EVENT_* in equs.inc
+// Each has a payload byte in event_data, at the offset of its bit
+//
+#define EVENT_key			0x01	// Keyboard packet; payload: virtual key code
+#define EVENT_mouse			0x02	// Mouse packet; payload: button state
+#define EVENT_vdp			0x04	// Any other VDP packet; payload: the packet number
+#define EVENT_vblank		0x08	// Vertical blank; payload: number of them, modulo 256
+#define EVENT_uart1			0x10	// UART1 has data; there is no UART1 interrupt, so event_wait checks the port
+#define EVENT_i2c			0x20	// I2C transfer finished; payload: i2c_error
+
+#define EVENT_dataSize		8		// Size of the payload buffer
+
+// Flags for event_wait
+//
+#define EVENT_halt			0x01	// HALT until the next interrupt while there is nothing to return
+
+#define EVENT_forever		0xFFFF	// Timeout that never expires
+
+BYTE	event_take(BYTE mask, BYTE * data);
+BYTE	event_wait(BYTE mask, unsigned short timeout, BYTE flags, BYTE * data);
+
+#endif EVENT_H
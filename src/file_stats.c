@@ -0,0 +1,154 @@
+/*
+ * Title:			AGON MOS - Open file statistics
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ * 17/10/2026:		Times with timer2_since; file_stats_enable disables interrupts around enable_timer2
+ */
+
+#include <eZ80.h>
+#include <defines.h>
+#include <string.h>
+
+#include "defines.h"
+#include "config.h"
+#include "mos.h"
+#include "ff.h"
+#include "timer.h"
+#include "file_stats.h"
+
+extern volatile DWORD clock;					// In globals.asm
+extern DWORD disk_reads;						// In diskio.c
+extern t_mosFileObject mosFileObjects[];		// In mos.c
+
+extern BYTE di_save(void);					// In misc.asm
+extern void ei_restore(BYTE enabled);		// In misc.asm
+
+// Indexed by file handle - 1; these are only changed in the foreground, so need no locking
+//
+static t_fileStats	file_stats[MOS_maxOpenFiles];
+static char			file_paths[MOS_maxOpenFiles][FILE_pathLength];
+static BOOL			file_stats_on = FALSE;
+
+// Clear the statistics for a handle that has just been opened
+// Parameters:
+// - fh: File handle
+// - path: Path the file was opened with; if it is too long only the end is kept
+//
+void file_stats_open(UINT8 fh, char * path) {
+	UINT24	n = strlen(path);
+
+	if (n >= FILE_pathLength) {
+		path += n - (FILE_pathLength - 1);
+	}
+	memset(&file_stats[fh - 1], 0, sizeof(t_fileStats));
+	strcpy(file_paths[fh - 1], path);
+}
+
+// Mark the start of a call on a file handle
+// Parameters:
+// - mark: Filled in with the state to measure the call from
+//
+void file_stats_begin(t_fileMark * mark) {
+	mark->timed = file_stats_on;
+	if (mark->timed) {
+		mark->startClock = clock;
+		mark->start = get_timer2();
+	}
+	mark->diskReads = disk_reads;
+}
+
+// Count a call on a file handle
+// Parameters:
+// - fh: File handle
+// - mark: The state taken by file_stats_begin at the start of the call
+// - op: FILE_read, FILE_write or FILE_seek
+// - bytes: Number of bytes read or written
+//
+void file_stats_end(UINT8 fh, t_fileMark * mark, BYTE op, UINT24 bytes) {
+	t_fileStats *	s = &file_stats[fh - 1];
+
+	switch (op) {
+		case FILE_read:
+			s->reads++;
+			s->bytesRead += bytes;
+			break;
+		case FILE_write:
+			s->writes++;
+			s->bytesWritten += bytes;
+			break;
+		case FILE_seek:
+			s->seeks++;
+			break;
+	}
+	s->misses += disk_reads - mark->diskReads;
+	if (mark->timed && file_stats_on) {
+		s->time += timer2_since(mark->start, mark->startClock);
+	}
+}
+
+// Start or stop timing calls on file handles
+// Starting clears the statistics of the open handles and starts Timer 2
+// Parameters:
+// - enable: TRUE to start, FALSE to stop
+//
+void file_stats_enable(BOOL enable) {
+	int		i;
+	BYTE	ie;
+
+	if (enable != file_stats_on) {
+		ie = di_save();
+		enable_timer2(enable);
+		ei_restore(ie);
+	}
+	file_stats_on = enable;
+	if (enable) {
+		for (i = 0; i < MOS_maxOpenFiles; i++) {
+			memset(&file_stats[i], 0, sizeof(t_fileStats));
+		}
+	}
+}
+
+// Check whether calls on file handles are being timed
+//
+BOOL file_stats_enabled(void) {
+	return file_stats_on;
+}
+
+// Read the statistics for a file handle
+// Parameters:
+// - fh: File handle
+// - info: Filled in with the counts, the time in microseconds and the path
+// Returns:
+// - TRUE, or FALSE if the handle is not open
+//
+BOOL file_stats_get(UINT8 fh, t_fileInfo * info) {
+	t_fileStats *	s;
+
+	if (fh == 0 || fh > MOS_maxOpenFiles || mosFileObjects[fh - 1].free == 0) {
+		return FALSE;
+	}
+	s = &file_stats[fh - 1];
+	info->bytesRead = s->bytesRead;
+	info->bytesWritten = s->bytesWritten;
+	info->reads = s->reads;
+	info->writes = s->writes;
+	info->seeks = s->seeks;
+	info->misses = s->misses;
+	info->time = timer2_us(s->time);
+	strcpy(info->path, file_paths[fh - 1]);
+	return TRUE;
+}
+
+// Read the statistics for a file handle, for the MOS API
+// Parameters:
+// - fh: File handle
+// - info: Filled in with the counts, the time in microseconds and the path
+// Returns:
+// - FR_OK, or FR_INVALID_OBJECT if the handle is not open
+//
+UINT24 mos_FILESTATS(UINT8 fh, t_fileInfo * info) {
+	return file_stats_get(fh, info) ? FR_OK : FR_INVALID_OBJECT;
+}
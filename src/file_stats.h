@@ -0,0 +1,68 @@
+/*
+ * Title:			AGON MOS - Open file statistics
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ */
+
+#ifndef FILE_STATS_H
+#define FILE_STATS_H
+
+#include "ff.h"
+
+#define FILE_pathLength		32		// Characters of the path each handle was opened with, including the terminator
+
+// Operations counted by file_stats_end
+//
+#define FILE_read			0
+#define FILE_write			1
+#define FILE_seek			2
+
+// Statistics for a file handle, cleared when the handle is opened
+// The counts are always kept; the time only while FILES is on
+//
+typedef struct {
+	DWORD		bytesRead;
+	DWORD		bytesWritten;
+	UINT24		reads;						// Read calls
+	UINT24		writes;						// Write calls
+	UINT24		seeks;
+	UINT24		misses;						// Times the calls had to read from the card
+	DWORD		time;						// Time spent in the calls in Timer 2 ticks
+} t_fileStats;
+
+// The statistics as returned by the MOS API, with the time in microseconds
+//
+typedef struct {
+	DWORD		bytesRead;
+	DWORD		bytesWritten;
+	UINT24		reads;
+	UINT24		writes;
+	UINT24		seeks;
+	UINT24		misses;
+	DWORD		time;
+	char		path[FILE_pathLength];		// The tail of the path if it is too long to fit
+} t_fileInfo;
+
+// Taken by file_stats_begin at the start of a call
+//
+typedef struct {
+	BOOL			timed;					// TRUE if timing was on
+	unsigned short	start;					// Timer 2
+	DWORD			startClock;				// Clock
+	DWORD			diskReads;				// disk_reads
+} t_fileMark;
+
+void	file_stats_open(UINT8 fh, char * path);
+void	file_stats_begin(t_fileMark * mark);
+void	file_stats_end(UINT8 fh, t_fileMark * mark, BYTE op, UINT24 bytes);
+
+void	file_stats_enable(BOOL enable);
+BOOL	file_stats_enabled(void);
+BOOL	file_stats_get(UINT8 fh, t_fileInfo * info);
+
+UINT24	mos_FILESTATS(UINT8 fh, t_fileInfo * info);
+
+#endif FILE_STATS_H
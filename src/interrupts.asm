@@ -8,11 +8,17 @@
 ; 09/03/2023:	No longer uses timer interrupt 0 for SD card timing
 ; 29/03/2023:	Added support for UART1
 ; 10/11/2023:	Added support for I2C
+; 17/10/2026:	The VBLANK and UART0 handlers run from internal SRAM; see iram.inc
+; 17/10/2026:	Added optional timing of the handlers; see isr_stats.h
+; 17/10/2026:	VBLANK and the end of an I2C transfer are posted as events for event_wait
+; 17/10/2026:	Added isr_masked_enter and isr_masked_leave for the windows opened by di_save
+; 17/10/2026:	The UART0 handler reads the byte itself rather than calling UART0_serial_RX in flash
 
 			INCLUDE	"macros.inc"
 			INCLUDE	"equs.inc"
 			INCLUDE "ez80f92.inc"
 			INCLUDE "i2c.inc"
+			INCLUDE "iram.inc"
 
 			.ASSUME	ADL = 1
 
@@ -23,10 +29,16 @@
 			XDEF	_uart0_handler
 			XDEF	_i2c_handler
 
+			XDEF	isr_iram_start
+			XDEF	isr_iram_end
+			XDEF	vblank_handler_rom
+			XDEF	uart0_handler_rom
+			XDEF	isr_masked_enter
+			XDEF	isr_masked_leave
+
 			XREF	_clock
 			XREF	_vdp_protocol_data
 			
-			XREF	UART0_serial_RX
 			XREF	UART0_serial_TX
 			XREF	mos_api
 			XREF	vdp_protocol			
@@ -37,14 +49,41 @@
 			XREF	_i2c_msg_ptr
 			XREF	_i2c_msg_size
 
+			XREF	_isr_stats_on
+			XREF	_isr_stats
+			XREF	_event_flags
+			XREF	_event_data
+
+; Interrupt handler statistics; these must match isr_stats.h
+; Each record holds the timer at entry (2 bytes), count (3), total ticks (4) and maximum ticks (2)
+;
+ISR_STATS_size:		EQU	11
+ISR_STATS_VBLANK:	EQU	0
+ISR_STATS_UART0:	EQU	1
+ISR_STATS_I2C:		EQU	2
+ISR_STATS_MASKED:	EQU	3			; Not a handler; the windows opened by di_save in misc.asm
+
+; The handlers from here to isr_iram_end are copied to IRAM_ISR by iram_install
+; and the interrupt vectors point there
+;
+_vblank_handler		EQU	IRAM_ISR + (vblank_handler_rom - isr_iram_start)
+_uart0_handler		EQU	IRAM_ISR + (uart0_handler_rom - isr_iram_start)
+
 ; AGON Vertical Blank Interrupt handler
 ;
-_vblank_handler:	DI
+isr_iram_start:
+vblank_handler_rom:	DI
 			PUSH		AF
 			SET_GPIO 	PB_DR, 2		; Need to set this to 2 for the interrupt to work correctly
 			PUSH		BC
 			PUSH		DE
 			PUSH		HL	
+			LD		A, (_isr_stats_on)	; Time the handler if enabled
+			OR		A, A
+			JR		Z, $F
+			LD		HL, _isr_stats + ISR_STATS_VBLANK * ISR_STATS_size
+			CALL		isr_stats_enter
+$$:
 			LD 		HL, (_clock)		; Increment the 32-bit clock counter
 			LD		BC, 2			; By 2, effectively timing in centiseconds
 			ADD		HL, BC
@@ -52,6 +91,17 @@ _vblank_handler:	DI
 			LD		A, (_clock + 3)
 			ADC		A, 0
 			LD		(_clock + 3), A			
+			LD		HL, _event_data + EVENT_DATA_VBLANK
+			INC		(HL)			; Count the VBLANKs since the event was last taken
+			LD		A, (_event_flags)	; Post the VBLANK event
+			OR		A, EVENT_VBLANK
+			LD		(_event_flags), A
+			LD		A, (_isr_stats_on)	; Add the time taken to the handler's record
+			OR		A, A
+			JR		Z, $F
+			LD		HL, _isr_stats + ISR_STATS_VBLANK * ISR_STATS_size
+			CALL		isr_stats_leave
+$$:
 			POP		HL
 			POP		DE
 			POP		BC
@@ -61,21 +111,37 @@ _vblank_handler:	DI
 			
 ; AGON UART0 Interrupt Handler
 ;
-_uart0_handler:		DI
+uart0_handler_rom:	DI
 			PUSH		AF
 			PUSH		BC
 			PUSH		DE
 			PUSH		HL
-			CALL		UART0_serial_RX
-			LD		C, A		
+			LD		A, (_isr_stats_on)	; Time the handler if enabled
+			OR		A, A
+			JR		Z, $F
+			LD		HL, _isr_stats + ISR_STATS_UART0 * ISR_STATS_size
+			CALL		isr_stats_enter
+$$:
+			IN0		A, (UART0_LSR)		; Read the byte received, as UART0_serial_RX does
+			AND		01h			; Data ready
+			JR		Z, $F			; None, so pass on 0
+			IN0		A, (UART0_RBR)
+$$:			LD		C, A
 			LD		HL, _vdp_protocol_data
 			CALL		vdp_protocol
+			LD		A, (_isr_stats_on)	; Add the time taken to the handler's record
+			OR		A, A
+			JR		Z, $F
+			LD		HL, _isr_stats + ISR_STATS_UART0 * ISR_STATS_size
+			CALL		isr_stats_leave
+$$:
 			POP		HL
 			POP		DE
 			POP		BC
 			POP		AF
 			EI
 			RETI.L	
+isr_iram_end:
 
 ; AGON I2C Interrupt handler
 ;
@@ -84,7 +150,12 @@ _i2c_handler:
 			PUSH	AF
 			PUSH	HL
 			PUSH	DE
-			IN0		A, (I2C_SR)				; input I2C status register - switch case to this status value
+			LD		A, (_isr_stats_on)		; Time the handler if enabled
+			OR		A, A
+			JR		Z, $F
+			LD		HL, _isr_stats + ISR_STATS_I2C * ISR_STATS_size
+			CALL	isr_stats_enter
+$$:			IN0		A, (I2C_SR)				; input I2C status register - switch case to this status value
 			AND		11111000b				; cancel lower 3 bits, so we can use RRA. This will save 1 T-state
 			RRA
 			RRA
@@ -150,11 +221,7 @@ i2c_case_buserror: ; 00h
 			LD		A, I2C_IDLE	; READY state
 			LD		(HL),A
 
-			POP		DE
-			POP		HL
-			POP		AF
-			EI
-			RETI.L
+			JP		i2c_finished
 
 i2c_case_master_start:		; 08h
 i2c_case_master_repstart:	; 10h
@@ -163,11 +230,7 @@ i2c_case_master_repstart:	; 10h
 			LD		A, I2C_CTL_IEN | I2C_CTL_ENAB | I2C_CTL_AAK
 			OUT0	(I2C_CTL),A		; set to Control register
 
-			POP		DE
-			POP		HL
-			POP		AF
-			EI
-			RETI.L
+			JP		i2c_return
 
 i2c_case_aw_acked:	; 18h
 i2c_case_db_acked:	; 28h
@@ -194,11 +257,7 @@ i2c_case_db_acked:	; 28h
 			EX		DE, HL
 			LD		(HL), DE
 
-			POP		DE
-			POP		HL
-			POP		AF
-			EI
-			RETI.L
+			JP		i2c_return
 
 i2c_case_aw_nacked:	; 20h
 i2c_case_mr_ar_nack: ; 48h
@@ -244,11 +303,7 @@ $end:		OUT0	(I2C_CTL),A		; set to Control register
 			DEC		A
 			LD		(_i2c_msg_size), A
 
-			POP		DE
-			POP		HL
-			POP		AF
-			EI
-			RETI.L
+			JP		i2c_return
 			
 i2c_case_mr_dbr_nack: ; 58h
 			; load pointer
@@ -278,10 +333,102 @@ $$:
 			LD		A, I2C_IDLE	; IDLE state
 			LD		(HL),A
 
-			POP		DE
+; The transfer has finished, so post the I2C event with the result
+;
+i2c_finished:	LD		A, (_i2c_error)
+			LD		(_event_data + EVENT_DATA_I2C), A
+			LD		A, (_event_flags)
+			OR		A, EVENT_I2C
+			LD		(_event_flags), A
+
+; All the cases return through here
+;
+i2c_return:	LD		A, (_isr_stats_on)		; Add the time taken to the handler's record
+			OR		A, A
+			JR		Z, $F
+			LD		HL, _isr_stats + ISR_STATS_I2C * ISR_STATS_size
+			CALL	isr_stats_leave
+$$:			POP		DE
 			POP		HL
 			POP		AF
 			EI
 			RETI.L
-	
+
+; Start and stop timing a window with interrupts disabled, opened by di_save and closed by ei_restore
+; Corrupts:
+; - AF, HL (isr_masked_enter); AF, DE, HL (isr_masked_leave)
+;
+isr_masked_enter:	LD		HL, _isr_stats + ISR_STATS_MASKED * ISR_STATS_size
+			JR		isr_stats_enter
+;
+isr_masked_leave:	LD		HL, _isr_stats + ISR_STATS_MASKED * ISR_STATS_size
+			JR		isr_stats_leave
+
+; Start timing an interrupt handler
+; The handlers are timed with Timer 2, counting down in continuous mode; see enable_timer2 in timer.c
+; Parameters:
+; - HL: Pointer to the handler's record
+; Corrupts:
+; - AF, HL
+;
+isr_stats_enter:	IN0		A, (TMR2_DR_L)		; Reading the low byte latches the high byte
+			LD		(HL), A
+			INC		HL
+			IN0		A, (TMR2_DR_H)
+			LD		(HL), A
+			RET
+
+; Stop timing an interrupt handler and add the time taken to its record
+; Parameters:
+; - HL: Pointer to the handler's record
+; Corrupts:
+; - AF, DE, HL
+;
+isr_stats_leave:	PUSH		BC
+			IN0		E, (TMR2_DR_L)		; DE: Timer now
+			IN0		D, (TMR2_DR_H)
+			LD		A, (HL)			; BC: Ticks since entry; the timer counts down
+			SUB		A, E
+			LD		C, A
+			INC		HL
+			LD		A, (HL)
+			SBC		A, D
+			LD		B, A
+			INC		HL
+			LD		DE, (HL)		; Increment the count
+			INC		DE
+			LD		(HL), DE
+			INC		HL
+			INC		HL
+			INC		HL
+			LD		A, (HL)			; Add the ticks to the 32-bit total
+			ADD		A, C
+			LD		(HL), A
+			INC		HL
+			LD		A, (HL)
+			ADC		A, B
+			LD		(HL), A
+			INC		HL
+			LD		A, (HL)
+			ADC		A, 0
+			LD		(HL), A
+			INC		HL
+			LD		A, (HL)
+			ADC		A, 0
+			LD		(HL), A
+			INC		HL
+			LD		E, (HL)			; DE: The maximum so far
+			INC		HL
+			LD		D, (HL)
+			LD		A, E			; Check whether DE < BC
+			SUB		A, C
+			LD		A, D
+			SBC		A, B
+			JR		NC, $F
+			LD		(HL), B			; It is, so this is the new maximum
+			DEC		HL
+			LD		(HL), C
+$$:			POP		BC
+			RET
+
 			END
@@ -0,0 +1,132 @@
+;
+; Title:	AGON MOS - Internal SRAM
+; Author:	Agon MOS contributors
+; Created:	17/10/2026
+; Last Updated:	17/10/2026
+;
+; Modinfo:
+; 17/10/2026:	Added the VDP protocol state machine
+
+			INCLUDE	"iram.inc"
+
+			.ASSUME	ADL = 1
+
+			DEFINE .STARTUP, SPACE = ROM
+			SEGMENT .STARTUP
+
+			XDEF	_iram_install
+			XDEF	_iram_bypass
+			XDEF	_iram_blocks
+
+			XREF	CRC32_TABLE
+			XREF	CRC32_TABLE_END
+			XREF	crc32_iram_start
+			XREF	crc32_iram_end
+			XREF	crc32_block_rom
+			XREF	_crc32_block
+			XREF	spi_iram_start
+			XREF	spi_iram_end
+			XREF	spi_transfer_rom
+			XREF	spi_read_one_rom
+			XREF	spi_read_rom
+			XREF	spi_write_rom
+			XREF	_spi_transfer
+			XREF	_spi_read_one
+			XREF	_spi_read
+			XREF	_spi_write
+			XREF	isr_iram_start
+			XREF	isr_iram_end
+			XREF	vblank_handler_rom
+			XREF	uart0_handler_rom
+			XREF	_vblank_handler
+			XREF	_uart0_handler
+			XREF	vdpp_iram_start
+			XREF	vdpp_iram_end
+			XREF	vdp_protocol_rom
+			XREF	vdp_protocol
+
+; The routines copied to internal SRAM
+; Each block is assembled in flash and runs from its slot in the MOS area (see iram.inc), so the code in
+; a block must only use relative jumps within itself; absolute references are only allowed to things
+; that do not move. Each entry is: start and end in flash, address in SRAM, size of the slot
+;
+_iram_blocks:		DL	CRC32_TABLE, CRC32_TABLE_END, IRAM_CRC32_TABLE, IRAM_CRC32 - IRAM_CRC32_TABLE
+			DL	crc32_iram_start, crc32_iram_end, IRAM_CRC32, IRAM_SPI - IRAM_CRC32
+			DL	spi_iram_start, spi_iram_end, IRAM_SPI, IRAM_ISR - IRAM_SPI
+			DL	isr_iram_start, isr_iram_end, IRAM_ISR, IRAM_VDPP - IRAM_ISR
+			DL	vdpp_iram_start, vdpp_iram_end, IRAM_VDPP, IRAM_FREE - IRAM_VDPP
+			DL	0
+
+; The entry points in SRAM, with their copies in flash, for iram_bypass
+;
+iram_entries:		DL	_crc32_block, crc32_block_rom
+			DL	_spi_transfer, spi_transfer_rom
+			DL	_spi_read_one, spi_read_one_rom
+			DL	_spi_read, spi_read_rom
+			DL	_spi_write, spi_write_rom
+			DL	_vblank_handler, vblank_handler_rom
+			DL	_uart0_handler, uart0_handler_rom
+			DL	vdp_protocol, vdp_protocol_rom
+			DL	0
+
+; Copy the hot routines into internal SRAM
+; This is called on every boot, before the interrupt vectors are set up; calling it again undoes iram_bypass
+; The interrupt state is preserved
+;
+; void iram_install(void)
+;
+_iram_install:		PUSH	IX
+			LD	A, I			; P/V: Interrupts enabled
+			PUSH	AF
+			DI
+			LD	IX, _iram_blocks
+;
+iram_install_loop:	LD	HL, (IX+0)		; HL: Start of the block in flash
+			LD	DE, 0
+			OR	A, A
+			SBC	HL, DE
+			JR	Z, iram_restore		; End of the table
+			EX	DE, HL			; DE: Start of the block
+			LD	HL, (IX+3)		; BC: Length of the block
+			OR	A, A
+			SBC	HL, DE
+			PUSH	HL
+			POP	BC
+			EX	DE, HL			; HL: Start of the block
+			LD	DE, (IX+6)		; DE: Slot in SRAM
+			LDIR
+			LD	DE, 12
+			ADD	IX, DE
+			JR	iram_install_loop
+
+; Restore the interrupt state saved at the start of iram_install or iram_bypass
+;
+iram_restore:		POP	AF
+			JP	PO, $F
+			EI
+$$:			POP	IX
+			RET
+
+; Patch each entry point in SRAM with a jump to its copy in flash
+; This is for benchmarking, so the same code can be timed running from flash and from SRAM
+;
+; void iram_bypass(void)
+;
+_iram_bypass:		PUSH	IX
+			LD	A, I			; P/V: Interrupts enabled
+			PUSH	AF
+			DI
+			LD	IX, iram_entries
+;
+iram_bypass_loop:	LD	HL, (IX+0)		; HL: Entry point in SRAM
+			LD	DE, 0
+			OR	A, A
+			SBC	HL, DE
+			JR	Z, iram_restore		; End of the table
+			LD	(HL), 0C3h		; JP
+			INC	HL
+			LD	DE, (IX+3)		; DE: Entry point in flash
+			LD	(HL), DE
+			LD	DE, 6
+			ADD	IX, DE
+			JR	iram_bypass_loop
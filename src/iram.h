@@ -0,0 +1,33 @@
+/*
+ * Title:			AGON MOS - Internal SRAM
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ */
+
+#ifndef IRAM_H
+#define IRAM_H
+
+// The layout is in iram.inc; these must match it
+//
+#define IRAM_START		0xB7E000	// Start of the internal SRAM
+#define IRAM_MOS		0xB7F800	// Start of the area kept by MOS; USER:HI is IRAM_START to here
+#define IRAM_END		0xB80000	// End of the internal SRAM
+
+// An entry in the table of routines copied to internal SRAM
+//
+typedef struct {
+	BYTE *	romStart;			// The routine in flash
+	BYTE *	romEnd;
+	BYTE *	ram;				// Where it runs from
+	UINT24	slot;				// Bytes set aside for it
+} t_iramBlock;
+
+extern t_iramBlock	iram_blocks[];	// In iram.asm, terminated by a NULL romStart
+
+void	iram_install(void);
+void	iram_bypass(void);
+
+#endif IRAM_H
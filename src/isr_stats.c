@@ -0,0 +1,79 @@
+/*
+ * Title:			AGON MOS - Interrupt handler statistics
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ * 17/10/2026:		Timer 2 is set up by timer.c, so it can be shared
+ * 17/10/2026:		Restores the interrupt state rather than enabling interrupts
+ * 17/10/2026:		The windows opened by di_save are timed as well
+ */
+
+#include <eZ80.h>
+#include <defines.h>
+#include <string.h>
+
+#include "defines.h"
+#include "mos.h"
+#include "isr_stats.h"
+#include "timer.h"
+
+extern BYTE di_save(void);					// In misc.asm
+extern void ei_restore(BYTE enabled);		// In misc.asm
+
+// Start or stop timing the MOS interrupt handlers
+// Starting clears the statistics and starts Timer 2; the handlers read it on entry and exit.
+// Interrupts are disabled within a handler, so its time is also how long other interrupts were held off.
+// The foreground windows between di_save and ei_restore (the FatFS lock and deferred work queue, VDP
+// queries) are timed in the same way, as ISR_STATS_MASKED.
+// A handler longer than 65535 ticks (about 57ms at 18.432MHz) is under-counted
+// Parameters:
+// - enable: TRUE to start, FALSE to stop
+//
+void isr_stats_enable(BOOL enable) {
+	BYTE	ie;
+
+	ie = di_save();
+	if (enable != (isr_stats_on != 0)) {
+		enable_timer2(enable);
+	}
+	isr_stats_on = 0;
+	if (enable) {
+		memset((void *)isr_stats, 0, ISR_STATS_vectors * sizeof(t_isrStats));
+		isr_stats_on = 1;
+	}
+	ei_restore(ie);
+}
+
+// Read the statistics for a handler
+// Parameters:
+// - vector: ISR_STATS_VBLANK, ISR_STATS_UART0, ISR_STATS_I2C or ISR_STATS_MASKED
+// - info: Filled in with the count, and the total and longest time in microseconds
+//
+void isr_stats_get(BYTE vector, t_isrInfo * info) {
+	t_isrStats	s;
+	BYTE		ie;
+
+	ie = di_save();							// So the record isn't changed while it is copied
+	memcpy(&s, (void *)&isr_stats[vector], sizeof(t_isrStats));
+	ei_restore(ie);
+	info->count = s.count;
+	info->total = timer2_us(s.total);
+	info->max = timer2_us(s.max);
+}
+
+// Read the statistics for a handler, for the MOS API
+// Parameters:
+// - vector: ISR_STATS_VBLANK, ISR_STATS_UART0, ISR_STATS_I2C or ISR_STATS_MASKED
+// - info: Filled in with the count, and the total and longest time in microseconds
+// Returns:
+// - FR_OK, or FR_INVALID_PARAMETER if the vector is out of range
+//
+UINT24 mos_ISRSTATS(BYTE vector, t_isrInfo * info) {
+	if (vector >= ISR_STATS_vectors) {
+		return FR_INVALID_PARAMETER;
+	}
+	isr_stats_get(vector, info);
+	return FR_OK;
+}
@@ -0,0 +1,46 @@
+/*
+ * Title:			AGON MOS - Interrupt handler statistics
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ * 17/10/2026:		Added ISR_STATS_MASKED
+ */
+
+#ifndef ISR_STATS_H
+#define ISR_STATS_H
+
+// The MOS interrupt handlers that can be timed; these must match interrupts.asm
+//
+#define ISR_STATS_VBLANK	0
+#define ISR_STATS_UART0		1
+#define ISR_STATS_I2C		2
+#define ISR_STATS_MASKED	3		// Not a handler; the foreground windows with interrupts disabled by di_save
+#define ISR_STATS_vectors	4
+
+// The record kept for each handler by interrupts.asm; this must match the layout there
+//
+typedef struct {
+	unsigned short	start;			// Timer at entry to the handler
+	UINT24			count;			// Number of times the handler has run
+	DWORD			total;			// Ticks spent in the handler
+	unsigned short	max;			// Longest run of the handler, in ticks
+} t_isrStats;
+
+// The statistics for a handler as returned by the MOS API, in microseconds
+//
+typedef struct {
+	UINT24			count;
+	DWORD			total;
+	UINT24			max;
+} t_isrInfo;
+
+extern volatile BYTE		isr_stats_on;		// In globals.asm
+extern volatile t_isrStats	isr_stats[];
+
+void	isr_stats_enable(BOOL enable);
+void	isr_stats_get(BYTE vector, t_isrInfo * info);
+UINT24	mos_ISRSTATS(BYTE vector, t_isrInfo * info);
+
+#endif ISR_STATS_H
@@ -2,7 +2,7 @@
 ; Title:	AGON MOS - Miscellaneous helper functions
 ; Author:	Dean Belfield
 ; Created:	24/07/2022
-; Last Updated: 15/04/2023
+; Last Updated: 17/10/2026
 ;
 ; Modinfo:
 ; 03/08/2022:	Added SET_AHL24 and SET_ADE24
@@ -12,6 +12,9 @@
 ; 09/03/2023:	Added wait_timer0
 ; 20/03/2023:	Function exec24 now preserves MB
 ; 15/04/2023:	Added GET_AHL24
+; 17/10/2026:	Added di_save and ei_restore
+; 17/10/2026:	di_save and ei_restore time the window while the interrupt handlers are timed
+; 17/10/2026:	Added ei_halt
 
 			INCLUDE	"macros.inc"
 			INCLUDE	"equs.inc"
@@ -34,8 +37,14 @@
 			XDEF	_exec24
 			XDEF	_wait_timer0
 			XDEF	_timer0_delay
+			XDEF	_di_save
+			XDEF	_ei_restore
+			XDEF	_ei_halt
 
 			XREF	_callSM
+			XREF	_isr_stats_on
+			XREF	isr_masked_enter
+			XREF	isr_masked_leave
 			
 ; Switch on A - lookup table immediately after call
 ;  A: Index into lookup table
@@ -180,4 +189,56 @@ _timer0_delay:
 			TIMER_WAIT	0
 			JP		(HL)
 
+; Disable interrupts, returning whether they were enabled
+; Safe to call from an interrupt handler, unlike a DI / EI pair
+; While the interrupt handlers are being timed (ISRSTAT ON), the window up to ei_restore is timed too
+; BYTE di_save(void)
+; Returns:
+; - 0 if interrupts were already disabled, 1 if they were enabled, 2 if they were and the window is timed
+;
+_di_save:		LD	A, I			; P/V: Interrupts enabled
+			DI
+			LD	A, 0
+			RET	PO			; They were already disabled
+			LD	A, (_isr_stats_on)
+			OR	A, A
+			LD	A, 1
+			RET	Z			; Not timing
+			CALL	isr_masked_enter	; Corrupts AF, HL
+			LD	A, 2
+			RET
+
+; Enable interrupts again if they were enabled before di_save
+; void ei_restore(BYTE enabled)
+;
+_ei_restore:		LD	HL, 3
+			ADD	HL, SP
+			LD	A, (HL)			; A: The value di_save returned
+			OR	A, A
+			RET	Z
+			CP	A, 2			; Was the window timed?
+			JR	NZ, $F
+			LD	A, (_isr_stats_on)	; And is timing still on? If not, Timer 2 may have been stopped
+			OR	A, A
+			CALL	NZ, isr_masked_leave	; Corrupts AF, DE, HL
+$$:			EI
+			RET
+
+; Enable interrupts again as ei_restore does, then sleep until the next interrupt
+; Interrupts are taken after the instruction following EI, so one that is already pending still wakes the HALT
+; void ei_halt(BYTE enabled)
+; - enabled: The value di_save returned; this must not be 0, as nothing would end the HALT
+;
+_ei_halt:		LD	HL, 3
+			ADD	HL, SP
+			LD	A, (HL)			; A: The value di_save returned
+			CP	A, 2			; Was the window timed?
+			JR	NZ, $F
+			LD	A, (_isr_stats_on)	; And is timing still on?
+			OR	A, A
+			CALL	NZ, isr_masked_leave	; Corrupts AF, DE, HL
+$$:			EI
+			HALT
+			RET
+
 END
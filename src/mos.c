@@ -35,6 +35,26 @@
  * 26/09/2023:		Refactored mos_GETRTC and mos_SETRTC
  * 10/11/2023:		Added CONSOLE to mos_cmdSET
  * 11/11/2023:		Added mos_cmdHELP, mos_cmdTYPE, mos_cmdCLS, mos_cmdMOUNT, mos_mount
+ * 17/10/2026:		The cwd string is cached and updated by mos_CD; f_getcwd is only called once it is invalidated; added mos_GETCWD
+ * 17/10/2026:		Added mos_cmdDEFRAG
+ * 17/10/2026:		Added mos_SOPEN, mos_SWRITE, mos_SSYNC for streaming writes to a preallocated extent
+ * 17/10/2026:		Added mos_DREADBATCH
+ * 17/10/2026:		Added COPY -r, DELETE -r, mos_cmdDU and mos_cmdFIND
+ * 17/10/2026:		Added mos_cmdCHECKSUM and COPY -v
+ * 17/10/2026:		Added mos_HEAPINIT, mos_HEAPALLOC, mos_HEAPFREE, mos_HEAPREALLOC, mos_HEAPSTATS; MEM uses umm_stats_heap
+ * 17/10/2026:		Added mos_cmdSNAPSHOT
+ * 17/10/2026:		MEM shows the internal SRAM kept by MOS
+ * 17/10/2026:		Added mos_cmdISRSTAT
+ * 17/10/2026:		Added mos_cmdVDPSTAT
+ * 17/10/2026:		The ROM filesystem is searched before the SD card by mos_exec, mos_LOAD and mos_EXEC; added mos_cmdROMFS
+ * 17/10/2026:		Added mos_FFOPEN, mos_FFCLOSE; mos_FOPEN takes MOS_FA_BUFFERED
+ * 17/10/2026:		Calls on file handles are counted; added mos_cmdFILES
+ * 17/10/2026:		Added mos_FFOPENAT; wildcard DELETE, RENAME and COPY work relative to the open directory
+ * 17/10/2026:		Added mos_cmdSDSTAT
+ * 17/10/2026:		Added mos_FFRENAMEAT
+ * 17/10/2026:		Only MOS file handles get a sector buffer; mos_FFOPEN ignores MOS_FA_BUFFERED
+ * 17/10/2026:		mos_CD takes the case of each folder it enters from the folder's entry
+ * 17/10/2026:		ISRSTAT shows the windows opened by di_save
  */
 
 #include <eZ80.h>
@@ -48,11 +68,22 @@
 #include "mos.h"
 #include "config.h"
 #include "mos_editor.h"
+#include "mos_defrag.h"
+#include "mos_walk.h"
+#include "mos_checksum.h"
+#include "mos_snapshot.h"
 #include "uart.h"
 #include "clock.h"
 #include "ff.h"
+#include "diskio.h"
 #include "strings.h"
 #include "umm_malloc.h"
+#include "iram.h"
+#include "isr_stats.h"
+#include "vdp_query.h"
+#include "romfs.h"
+#include "file_stats.h"
+#include "sd.h"
 #if DEBUG > 0
 # include "tests.h"
 #endif /* DEBUG */
@@ -73,6 +104,11 @@ static FATFS	fs;					// Handle for the file system
 static char * 	mos_strtok_ptr;		// Pointer for current position in string tokeniser
 
 TCHAR cwd[256];						// Hold current working directory.
+static BOOL cwdValid = FALSE;		// FALSE if cwd needs to be refreshed with f_getcwd
+
+static BOOL	mos_resolveCwd(const char * path, char * newCwd);
+
+static void	mos_closeStream(t_mosFileObject * mfo);
 BOOL sdcardDelay = FALSE;
 
 extern volatile BYTE history_no;
@@ -91,17 +127,23 @@ static t_mosCommand mosCommands[] = {
 	{ "CAT",		&mos_cmdDIR,		HELP_CAT_ARGS,		HELP_CAT },
 	{ "CD", 		&mos_cmdCD,			HELP_CD_ARGS,		HELP_CD },
 	{ "CDIR", 		&mos_cmdCD,			HELP_CD_ARGS,		HELP_CD },
+	{ "CHECKSUM",	&mos_cmdCHECKSUM,	HELP_CHECKSUM_ARGS,	HELP_CHECKSUM },
 	{ "CLS",		&mos_cmdCLS,		NULL,			HELP_CLS },
 	{ "COPY", 		&mos_cmdCOPY,		HELP_COPY_ARGS,		HELP_COPY },
 	{ "CP", 		&mos_cmdCOPY,		HELP_COPY_ARGS,		HELP_COPY },
 	{ "CREDITS",	&mos_cmdCREDITS,	NULL,			HELP_CREDITS },
 	{ "DELETE",		&mos_cmdDEL,		HELP_DELETE_ARGS,	HELP_DELETE },
+	{ "DEFRAG",		&mos_cmdDEFRAG,		HELP_DEFRAG_ARGS,	HELP_DEFRAG },
 	{ "DIR",		&mos_cmdDIR,		HELP_CAT_ARGS,		HELP_CAT },
 	{ "DISC",		&mos_cmdDISC,		NULL,		NULL },
+	{ "DU",			&mos_cmdDU,			HELP_DU_ARGS,		HELP_DU },
 	{ "ECHO",		&mos_cmdECHO,		HELP_ECHO_ARGS,		HELP_ECHO },
 	{ "ERASE",		&mos_cmdDEL,		HELP_DELETE_ARGS,	HELP_DELETE },
 	{ "EXEC",		&mos_cmdEXEC,		HELP_EXEC_ARGS,		HELP_EXEC },
+	{ "FILES",		&mos_cmdFILES,		HELP_FILES_ARGS,	HELP_FILES },
+	{ "FIND",		&mos_cmdFIND,		HELP_FIND_ARGS,		HELP_FIND },
 	{ "HELP",		&mos_cmdHELP,		HELP_HELP_ARGS,		HELP_HELP },
+	{ "ISRSTAT",	&mos_cmdISRSTAT,	HELP_ISRSTAT_ARGS,	HELP_ISRSTAT },
 	{ "JMP",		&mos_cmdJMP,		HELP_JMP_ARGS,		HELP_JMP },
 	{ "LOAD",		&mos_cmdLOAD,		HELP_LOAD_ARGS,		HELP_LOAD },
 	{ "LS",			&mos_cmdDIR,		HELP_CAT_ARGS,		HELP_CAT },
@@ -114,12 +156,16 @@ static t_mosCommand mosCommands[] = {
 	{ "PRINTF",		&mos_cmdPRINTF,		HELP_PRINTF_ARGS,	HELP_PRINTF },
 	{ "RENAME",		&mos_cmdREN,		HELP_RENAME_ARGS,	HELP_RENAME },
 	{ "RM",			&mos_cmdDEL,		HELP_DELETE_ARGS,	HELP_DELETE },
+	{ "ROMFS",		&mos_cmdROMFS,		NULL,			HELP_ROMFS },
 	{ "RUN", 		&mos_cmdRUN,		HELP_RUN_ARGS,		HELP_RUN },
 	{ "SAVE", 		&mos_cmdSAVE,		HELP_SAVE_ARGS,		HELP_SAVE },
+	{ "SDSTAT",		&mos_cmdSDSTAT,		HELP_SDSTAT_ARGS,	HELP_SDSTAT },
 	{ "SET",		&mos_cmdSET,		HELP_SET_ARGS,		HELP_SET },
+	{ "SNAPSHOT",	&mos_cmdSNAPSHOT,	HELP_SNAPSHOT_ARGS,	HELP_SNAPSHOT },
 	{ "TIME", 		&mos_cmdTIME,		HELP_TIME_ARGS,		HELP_TIME },
 	{ "TYPE",		&mos_cmdTYPE,		HELP_TYPE_ARGS,		HELP_TYPE },
 	{ "VDU",		&mos_cmdVDU,		HELP_VDU_ARGS,		HELP_VDU },
+	{ "VDPSTAT",	&mos_cmdVDPSTAT,	HELP_VDPSTAT_ARGS,	HELP_VDPSTAT },
 #if DEBUG > 0
 	{ "RUN_MOS_TESTS",		&mos_cmdTEST,		NULL,		"Run the MOS OS test suite" },
 #endif /* DEBUG */
@@ -157,6 +203,9 @@ static char * mos_errors[] = {
 	"Not implemented",
 	"Load overlaps system area",
 	"Bad string",
+	"Checksum mismatch",
+	"Bad snapshot",
+	"Bad ROM file",
 };
 
 #define mos_errors_count (sizeof(mos_errors)/sizeof(char *))
@@ -194,7 +243,7 @@ BYTE mos_getkey() {
 //
 UINT24 mos_input(char * buffer, int bufferLength) {
 	INT24 retval;
-	printf("%s %c", cwd, MOS_prompt);
+	printf("%s %c", mos_getCwd(), MOS_prompt);
 	retval = mos_EDITLINE(buffer, bufferLength, 3);
 	printf("\n\r");
 	return retval;
@@ -374,6 +423,35 @@ int mos_runBin(UINT24 addr) {
 	}
 }
 
+// Find an executable for a command in the ROM filesystem, in the order mos_exec searches the SD card
+// Parameters:
+// - name: The command
+// - in_mos: TRUE to look in the current directory and /bin as well as /mos
+// - path: Buffer for the path of the executable
+// - address: Set to the address to load it at
+// Returns:
+// - TRUE if found
+//
+static BOOL mos_findRomBin(char * name, BOOL in_mos, char * path, UINT24 * address) {
+	sprintf(path, "/mos/%s.bin", name);
+	*address = MOS_starLoadAddress;
+	if (romfs_find(path)) {
+		return TRUE;
+	}
+	if (in_mos) {
+		*address = MOS_defaultLoadAddress;
+		sprintf(path, "%s.bin", name);
+		if (romfs_find(path)) {
+			return TRUE;
+		}
+		sprintf(path, "/bin/%s.bin", name);
+		if (romfs_find(path)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
 // Execute a MOS command
 // Parameters:
 // - buffer: Pointer to a zero terminated string that contains the MOS command with arguments
@@ -386,6 +464,7 @@ int mos_exec(char * buffer, BOOL in_mos) {
 	int 	(*func)(char * ptr);
 	char	path[256];
 	UINT8	mode;
+	UINT24	addr;
 	t_mosCommand *cmd;
 
 	ptr = mos_trim(buffer);
@@ -405,6 +484,10 @@ int mos_exec(char * buffer, BOOL in_mos) {
 				return MOS_INVALID_COMMAND;
 			}
 			else {
+				if (mos_findRomBin(ptr, in_mos, path, &addr)) {	// Try the ROM filesystem first, so no SD card is needed
+					fr = mos_LOAD(path, addr, 0);
+					return fr == FR_OK ? mos_runBin(addr) : fr;
+				}
 				sprintf(path, "/mos/%s.bin", ptr);
 				fr = mos_LOAD(path, MOS_starLoadAddress, 0);
 				if (fr == FR_OK) {
@@ -794,6 +877,7 @@ int mos_cmdDEL(char * ptr) {
 	char *pattern = NULL;
 	BOOL usePattern = FALSE;
 	BOOL force = FALSE;
+	BOOL recursive = FALSE;
 	char *filename;
 	char *lastSeparator;
 	char verify[7];
@@ -804,13 +888,29 @@ int mos_cmdDEL(char * ptr) {
 		return FR_INVALID_PARAMETER;
 	}
 
-	if (strcasecmp(filename, "-f") == 0) {
-		force = TRUE;
+	while (strcasecmp(filename, "-f") == 0 || strcasecmp(filename, "-r") == 0) {
+		if (strcasecmp(filename, "-f") == 0) {
+			force = TRUE;
+		} else {
+			recursive = TRUE;
+		}
 		if (!mos_parseString(NULL, &filename)) {
 			return FR_INVALID_PARAMETER;
 		}
 	}
 
+	if (recursive) {
+		if (!force) {
+			printf("Delete %s and everything in it? (Yes/No) ", filename);
+			if (mos_EDITLINE(&verify, sizeof(verify), 13) != 13 || (strcasecmp(verify, "Yes") != 0 && strcasecmp(verify, "Y") != 0)) {
+				printf("\n\rCancelled.\r\n");
+				return FR_OK;
+			}
+			printf("\n\r");
+		}
+		return mos_DELTREE(filename, TRUE);
+	}
+
 	fr = FR_INT_ERR;
 
 	lastSeparator = strrchr(filename, '/');
@@ -853,41 +953,29 @@ int mos_cmdDEL(char * ptr) {
 
 		fr = f_findfirst(&dir, &fno, dirPath, pattern);
 		while (fr == FR_OK && fno.fname[0] != '\0') {
-			size_t fullPathLen = strlen(dirPath) + strlen(fno.fname) + 2;
-			char *fullPath = umm_malloc(fullPathLen);
-			if (!fullPath) {
-				fr = FR_INT_ERR;
-				break;
-			}
-
-			sprintf(fullPath, "%s/%s", dirPath, fno.fname);  // Construct full path
-
 			if (!force) {
 				INT24 retval;
 				// we could potentially support "All" here, and when detected changing `force` to true
-				printf("Delete %s? (Yes/No/Cancel) ", fullPath);
+				printf("Delete %s/%s? (Yes/No/Cancel) ", dirPath, fno.fname);
 				retval = mos_EDITLINE(&verify, sizeof(verify), 13);
 				printf("\n\r");
 				if (retval == 13) {
 					if (strcasecmp(verify, "Cancel") == 0 || strcasecmp(verify, "C") == 0) {
 						printf("Cancelled.\r\n");
-						umm_free(fullPath);
 						break;
 					}
 					if (strcasecmp(verify, "Yes") == 0 || strcasecmp(verify, "Y") == 0) {
-						printf("Deleting %s.\r\n", fullPath);
-						fr = f_unlink(fullPath);
+						printf("Deleting %s/%s.\r\n", dirPath, fno.fname);
+						fr = f_unlinkat(&dir, fno.fname);		// Look the name up in the open directory, not from the root
 					}
 				} else {
 					printf("Cancelled.\r\n");
-					umm_free(fullPath);
 					break;
 				}
 			} else {
-				printf("Deleting %s\r\n", fullPath);
-				fr = f_unlink(fullPath);
+				printf("Deleting %s/%s\r\n", dirPath, fno.fname);
+				fr = f_unlinkat(&dir, fno.fname);
 			}
-			umm_free(fullPath);
 
 			if (fr != FR_OK) break;
 			fr = f_findnext(&dir, &fno);
@@ -905,6 +993,31 @@ int mos_cmdDEL(char * ptr) {
 		return fr;
 }
 
+// DEFRAG [-n] [-b] command
+// Parameters:
+// - ptr: Pointer to the argument string in the line edit buffer
+// Returns:
+// - MOS error code
+//
+int mos_cmdDEFRAG(char * ptr) {
+	BOOL	move = TRUE;
+	BOOL	bootFirst = FALSE;
+	char *	option;
+
+	while (mos_parseString(NULL, &option)) {
+		if (strcasecmp(option, "-n") == 0) {
+			move = FALSE;
+		}
+		else if (strcasecmp(option, "-b") == 0) {
+			bootFirst = TRUE;
+		}
+		else {
+			return FR_INVALID_PARAMETER;
+		}
+	}
+	return mos_DEFRAG(move, bootFirst);
+}
+
 // JMP <addr> command
 // Parameters:
 // - ptr: Pointer to the argument string in the line edit buffer
@@ -953,8 +1066,7 @@ int mos_cmdCD(char * ptr) {
 	) {
 		return FR_INVALID_PARAMETER;
 	}
-	fr = f_chdir(path);
-	f_getcwd(cwd, sizeof(cwd)); //Update full path.
+	fr = mos_CD(path);
 	return fr;
 }
 
@@ -986,20 +1098,96 @@ int mos_cmdREN(char *ptr) {
 // - MOS error code
 //
 int mos_cmdCOPY(char *ptr) {
-	FRESULT	fr;
+	UINT24	fr;
 	char *  filename1;
 	char *	filename2;
+	BOOL	recursive = FALSE;
+	BOOL	verify = FALSE;
 	
-	if(
-		!mos_parseString(NULL, &filename1) ||
-		!mos_parseString(NULL, &filename2)
-	) {
+	if(!mos_parseString(NULL, &filename1)) {
 		return FR_INVALID_PARAMETER;
 	}
-	fr = mos_COPY(filename1, filename2, TRUE);
+	while(filename1[0] == '-') {
+		if(strcasecmp(filename1, "-r") == 0) {
+			recursive = TRUE;
+		}
+		else if(strcasecmp(filename1, "-v") == 0) {
+			verify = TRUE;
+		}
+		else {
+			return FR_INVALID_PARAMETER;
+		}
+		if(!mos_parseString(NULL, &filename1)) {
+			return FR_INVALID_PARAMETER;
+		}
+	}
+	if(!mos_parseString(NULL, &filename2)) {
+		return FR_INVALID_PARAMETER;
+	}
+	if(recursive) {
+		fr = mos_COPYTREE(filename1, filename2, TRUE, verify);
+	}
+	else {
+		fr = mos_COPY(filename1, filename2, TRUE, verify);
+	}
 	return fr;
 }
 
+// CHECKSUM [-c] <filename> command
+// Parameters:
+// - ptr: Pointer to the argument string in the line edit buffer
+// Returns:
+// - MOS error code
+//
+int mos_cmdCHECKSUM(char *ptr) {
+	char *	filename;
+
+	if(!mos_parseString(NULL, &filename)) {
+		return FR_INVALID_PARAMETER;
+	}
+	if(strcasecmp(filename, "-c") == 0) {
+		if(!mos_parseString(NULL, &filename)) {
+			return FR_INVALID_PARAMETER;
+		}
+		return mos_CHECKMANIFEST(filename);
+	}
+	return mos_CHECKSUM(filename);
+}
+
+// DU [<path>] command
+// Parameters:
+// - ptr: Pointer to the argument string in the line edit buffer
+// Returns:
+// - MOS error code
+//
+int mos_cmdDU(char *ptr) {
+	char *	path;
+
+	if(!mos_parseString(NULL, &path)) {
+		path = ".";
+	}
+	return mos_DU(path);
+}
+
+// FIND <pattern> [<path>] command
+// Parameters:
+// - ptr: Pointer to the argument string in the line edit buffer
+// Returns:
+// - MOS error code
+//
+int mos_cmdFIND(char *ptr) {
+	char *	pattern;
+	char *	path;
+
+	if(!mos_parseString(NULL, &pattern)) {
+		return FR_INVALID_PARAMETER;
+	}
+	if(!mos_parseString(NULL, &path)) {
+		path = ".";
+	}
+	return mos_FIND(pattern, path);
+}
+
 // MKDIR <filename> command
 // Parameters:
 // - ptr: Pointer to the argument string in the line edit buffer
@@ -1020,6 +1208,201 @@ int mos_cmdMKDIR(char * ptr) {
 	return fr;
 }
 
+// SNAPSHOT SAVE|LOAD <filename> command
+// Parameters:
+// - ptr: Pointer to the argument string in the line edit buffer
+// Returns:
+// - MOS error code
+//
+int mos_cmdSNAPSHOT(char *ptr) {
+	char *	action;
+	char *	filename;
+
+	if(
+		!mos_parseString(NULL, &action) ||
+		!mos_parseString(NULL, &filename)
+	) {
+		return FR_INVALID_PARAMETER;
+	}
+	if(strcasecmp(action, "SAVE") == 0) {
+		return mos_SNAPSHOTSAVE(filename);
+	}
+	if(strcasecmp(action, "LOAD") == 0) {
+		return mos_SNAPSHOTLOAD(filename);
+	}
+	return FR_INVALID_PARAMETER;
+}
+
+// ISRSTAT [ON|OFF] command
+// Parameters:
+// - ptr: Pointer to the argument string in the line edit buffer
+// Returns:
+// - MOS error code
+//
+int mos_cmdISRSTAT(char *ptr) {
+	static char *	names[ISR_STATS_vectors] = { "VBLANK", "UART0", "I2C", "DISAVE" };
+	char *		action;
+	t_isrInfo	info;
+	UINT24		longest = 0;
+	int			worst = 0;
+	int			i;
+
+	if(mos_parseString(NULL, &action)) {
+		if(strcasecmp(action, "ON") == 0) {
+			isr_stats_enable(TRUE);
+			return FR_OK;
+		}
+		if(strcasecmp(action, "OFF") == 0) {
+			isr_stats_enable(FALSE);
+			return FR_OK;
+		}
+		return FR_INVALID_PARAMETER;
+	}
+	printf("Handler     Count   Total us  Max us\r\n");
+	for(i = 0; i < ISR_STATS_vectors; i++) {
+		isr_stats_get(i, &info);
+		printf("%-6s   %8u %10lu %7u\r\n", names[i], info.count, info.total, info.max);
+		if(info.max > longest) {
+			longest = info.max;
+			worst = i;
+		}
+	}
+	printf("Longest with interrupts off: %uus (%s)\r\n", longest, names[worst]);
+	if(!isr_stats_on) {
+		printf("Timing is off\r\n");
+	}
+	return FR_OK;
+}
+
+// ROMFS command
+// Parameters:
+// - ptr: Pointer to the argument string in the line edit buffer
+// Returns:
+// - MOS error code
+//
+int mos_cmdROMFS(char *ptr) {
+	return mos_ROMFS();
+}
+
+// VDPSTAT [ON|OFF] command
+// Parameters:
+// - ptr: Pointer to the argument string in the line edit buffer
+// Returns:
+// - MOS error code
+//
+int mos_cmdVDPSTAT(char *ptr) {
+	static char *	names[VDPQ_packets] = { "GP", "KEY", "CURSOR", "SCRCHAR", "POINT", "AUDIO", "MODE", "RTC" };
+	char *		action;
+	t_vdpInfo	info;
+	int			i;
+
+	if(mos_parseString(NULL, &action)) {
+		if(strcasecmp(action, "ON") == 0) {
+			vdp_stats_enable(TRUE);
+			return FR_OK;
+		}
+		if(strcasecmp(action, "OFF") == 0) {
+			vdp_stats_enable(FALSE);
+			return FR_OK;
+		}
+		return FR_INVALID_PARAMETER;
+	}
+	printf("Reply      Count Timeouts  Mean us   Max us\r\n");
+	for(i = 0; i < VDPQ_packets; i++) {
+		vdp_stats_get(i, &info);
+		if(info.count > 0 || info.timeouts > 0) {
+			printf("%-7s %8u %8u %8lu %8lu\r\n", names[i], info.count, info.timeouts, info.count ? info.total / info.count : 0, info.max);
+		}
+	}
+	if(!vdp_stats_enabled()) {
+		printf("Timing is off\r\n");
+	}
+	return FR_OK;
+}
+
+// FILES [ON|OFF] command
+// Parameters:
+// - ptr: Pointer to the argument string in the line edit buffer
+// Returns:
+// - MOS error code
+//
+int mos_cmdFILES(char *ptr) {
+	char *		action;
+	t_fileInfo	info;
+	int			fh;
+
+	if(mos_parseString(NULL, &action)) {
+		if(strcasecmp(action, "ON") == 0) {
+			file_stats_enable(TRUE);
+			return FR_OK;
+		}
+		if(strcasecmp(action, "OFF") == 0) {
+			file_stats_enable(FALSE);
+			return FR_OK;
+		}
+		return FR_INVALID_PARAMETER;
+	}
+	printf("Fh    Reads     Read   Writes  Written Seeks Misses       us\r\n");
+	for(fh = 1; fh <= MOS_maxOpenFiles; fh++) {
+		if(file_stats_get(fh, &info)) {
+			printf("%2d %s\r\n", fh, info.path);
+			printf("   %8u %8lu %8u %8lu %5u %6u %8lu\r\n", info.reads, info.bytesRead, info.writes, info.bytesWritten, info.seeks, info.misses, info.time);
+		}
+	}
+	if(!file_stats_enabled()) {
+		printf("Timing is off\r\n");
+	}
+	return FR_OK;
+}
+
+// SDSTAT [ON|OFF] command
+// Parameters:
+// - ptr: Pointer to the argument string in the line edit buffer
+// Returns:
+// - MOS error code
+//
+int mos_cmdSDSTAT(char *ptr) {
+	char *		action;
+	t_sdInfo	info;
+	t_sdOpStats	* op;
+	int			i, j;
+
+	if(mos_parseString(NULL, &action)) {
+		if(strcasecmp(action, "ON") == 0) {
+			sd_stats_enable(TRUE);
+			return FR_OK;
+		}
+		if(strcasecmp(action, "OFF") == 0) {
+			sd_stats_enable(FALSE);
+			return FR_OK;
+		}
+		return FR_INVALID_PARAMETER;
+	}
+	sd_stats_get(&info);
+	printf("        Calls   Blocks Errors Retries       us\r\n");
+	for(i = 0; i < 2; i++) {
+		op = i ? &info.write : &info.read;
+		printf("%-5s %7u %8lu %6u %7u %8lu\r\n", i ? "Write" : "Read", op->calls, op->blocks, op->errors, op->retries, op->time);
+	}
+	printf("       <1ms  <4ms <16ms <64ms <256ms Longer\r\n");
+	for(i = 0; i < 2; i++) {
+		op = i ? &info.write : &info.read;
+		printf("%-5s", i ? "Write" : "Read");
+		for(j = 0; j < SD_histBuckets; j++) {
+			printf(j < 4 ? " %5u" : " %6u", op->histogram[j]);
+		}
+		printf("\r\n");
+	}
+	printf("Commands %u, no response %u, token timeouts %u, busy timeouts %u\r\n", info.commands, info.noResponse, info.tokenTimeouts, info.busyTimeouts);
+	printf("Waiting for data %lu us, for programming %lu us\r\n", info.responseWait, info.busyWait);
+	printf("Writes left programming %u: %u hidden, %u waited, %u timed out\r\n", info.deferred, info.hidden, info.waited, info.timeouts);
+	printf("Overlapped at most %lu us, waited %lu us\r\n", info.overlapMax, info.wait);
+	if(!sd_stats_enabled()) {
+		printf("Timing is off\r\n");
+	}
+	return FR_OK;
+}
+
 // SET <option> <value> command
 // Parameters:
 // - ptr: Pointer to the argument string in the line edit buffer
@@ -1161,7 +1544,8 @@ extern void sysvars[];
 // - MOS error code
 //
 int mos_cmdMEM(char * ptr) {
-	int try_len = HEAP_LEN;
+	umm_stats stats;
+	t_romfsHeader * rom = romfs_header();
 
 	printf("ROM      &000000-&01ffff     %2d%% used\r\n", ((int)_low_romdata) / 1311);
 	printf("USER:LO  &%06x-&%06x %6d bytes\r\n", 0x40000, (int)_low_data-1, (int)_low_data - 0x40000);
@@ -1169,20 +1553,18 @@ int mos_cmdMEM(char * ptr) {
 	printf("MOS:DATA &%06x-&%06x %6d bytes\r\n", _low_data, (int)_heapbot - 1, (int)_heapbot - (int)_low_data);
 	printf("MOS:HEAP &%06x-&%06x %6d bytes\r\n", _heapbot, (int)_stack - SPL_STACK_SIZE - 1, HEAP_LEN);
 	printf("STACK24  &%06x-&%06x %6d bytes\r\n", (int)_stack - SPL_STACK_SIZE, _stack-1, SPL_STACK_SIZE);
-	printf("USER:HI  &b7e000-&b7ffff   8192 bytes\r\n");
+	printf("USER:HI  &%06x-&%06x %6d bytes\r\n", IRAM_START, IRAM_MOS - 1, IRAM_MOS - IRAM_START);
+	printf("MOS:IRAM &%06x-&%06x %6d bytes\r\n", IRAM_MOS, IRAM_END - 1, IRAM_END - IRAM_MOS);
 	printf("\r\n");
 
-	// find largest kmalloc contiguous region
-	for (; try_len > 0; try_len-=8) {
-		void *p = umm_malloc(try_len);
-		if (p) {
-			umm_free(p);
-			break;
-		}
-	}
+	umm_stats_heap(&stats);
 
-	printf("Largest free MOS:HEAP fragment: %d bytes\r\n", try_len);
+	printf("Free MOS:HEAP: %d bytes in %d fragments\r\n", stats.free, stats.fragments);
+	printf("Largest free MOS:HEAP fragment: %d bytes\r\n", stats.largest);
 	printf("Sysvars at &%06x\r\n", sysvars);
+	if (rom) {
+		printf("ROMFS at &%06x: %d files, %d bytes\r\n", rom, rom->files, rom->length);
+	}
 	printf("\r\n");
 
 	return 0;
@@ -1242,7 +1624,6 @@ int	mos_cmdMOUNT(char *ptr) {
 	fr = mos_mount();
 	if (fr != FR_OK)
 		mos_error(fr);
-	f_getcwd(cwd, sizeof(cwd)); //Update full path.
 	return 0;
 }
 
@@ -1337,7 +1718,7 @@ int mos_cmdHELP(char *ptr) {
 	return 0;
 }
 
-// Load a file from SD card to memory
+// Load a file from the ROM filesystem or SD card to memory
 // Parameters:
 // - filename: Path of file to load
 // - address: Address in RAM to load the file into
@@ -1350,6 +1731,17 @@ UINT24 mos_LOAD(char * filename, UINT24 address, UINT24 size) {
 	FIL	   	fil;
 	UINT   	br;	
 	FSIZE_t fSize;
+	t_romfsEntry * rom = romfs_find(filename);
+
+	if (rom) {
+		if (size == 0 || size > rom->length) {
+			size = rom->length;
+		}
+		if ((address <= MOS_externLastRAMaddress) && ((address + size) > MOS_systemAddress)) {
+			return MOS_OVERLAPPING_SYSTEM;
+		}
+		return romfs_read(rom, (BYTE *)address, size);
+	}
 	
 	fr = f_open(&fil, filename, FA_READ);
 	if(fr == FR_OK) {
@@ -1426,18 +1818,144 @@ UINT24 mos_TYPE(char * filename) {
 }
 
 // Change directory
+// The cached working directory is updated from the path, so FatFS is not asked to walk back up the tree
 // Parameters:
 // - filename: Path of file to save
 // Returns:
 // - FatFS return code
 // 
 UINT24	mos_CD(char *path) {
-	FRESULT	fr;
+	static char	newCwd[sizeof(cwd)];
+	BOOL		resolved;
+	FRESULT		fr;
 
+	resolved = cwdValid && mos_resolveCwd(path, newCwd);	// First, as the lookups are relative to the old directory
 	fr = f_chdir(path);
+	if (fr == FR_OK) {
+		if (resolved) {
+			strcpy(cwd, newCwd);
+		}
+		else {
+			cwdValid = FALSE;				// It will be refreshed with f_getcwd on the next query
+		}
+	}
 	return fr;
 }
 
+// Work out the working directory a change of directory will give, from the cached copy
+// Each folder entered is looked up on its own, to take its name as stored on the card; .. just
+// strips the last folder, so no parent folder is read
+// Parameters:
+// - path: The path about to be passed to f_chdir
+// - newCwd: Buffer of sizeof(cwd) bytes for the result
+// Returns:
+// - TRUE if newCwd is filled in, FALSE if the path can't be followed (f_getcwd is then used)
+//
+static BOOL mos_resolveCwd(const char * path, char * newCwd) {
+	static FILINFO	fno;
+	static char		prefix[sizeof(cwd)];
+	const char *	p = path;
+	const char *	end;
+	int				len, n;
+
+	if (isdigit(p[0]) && p[1] == ':') {		// Skip the drive number
+		p += 2;
+	}
+	strcpy(newCwd, cwd);
+	len = (*p == '/' || *p == '\\') ? 0 : strlen(newCwd);
+	if (len == 1) {							// The root is "/", so treat it as an empty stem
+		len = 0;
+	}
+	while (*p) {
+		while (*p == '/' || *p == '\\') {
+			p++;
+		}
+		if (*p == 0) {
+			break;
+		}
+		end = p;
+		while (*end && *end != '/' && *end != '\\') {
+			end++;
+		}
+		n = end - p;
+		if (n == 2 && p[0] == '.' && p[1] == '.') {
+			while (len > 0 && newCwd[len - 1] != '/') {	// Strip the last folder
+				len--;
+			}
+			if (len > 0) {						// And its separator
+				len--;
+			}
+		}
+		else {
+			while (n > 0 && (p[n - 1] == '.' || p[n - 1] == ' ')) {	// FatFS ignores trailing dots and spaces
+				n--;
+			}
+			if (n > 0) {						// Look up the path so far, for the folder's name on the card
+				if (end - path >= sizeof(prefix)) {
+					return FALSE;
+				}
+				memcpy(prefix, path, end - path);
+				prefix[end - path] = 0;
+				if (f_stat(prefix, &fno) != FR_OK || !(fno.fattrib & AM_DIR)) {
+					return FALSE;
+				}
+				n = strlen(fno.fname);
+				if (len + n + 2 > sizeof(cwd)) {
+					return FALSE;
+				}
+				newCwd[len++] = '/';
+				memcpy(newCwd + len, fno.fname, n);
+				len += n;
+			}
+		}
+		p = end;
+	}
+	if (len == 0) {
+		newCwd[len++] = '/';
+	}
+	newCwd[len] = 0;
+	return TRUE;
+}
+
+// Get the current working directory
+// This is served from the cached copy; FatFS is only asked to walk the directory
+// tree if the cached copy has been invalidated (for example by a rename)
+// Returns:
+// - Pointer to the current working directory string
+//
+char * mos_getCwd(void) {
+	if (!cwdValid) {
+		cwdValid = (f_getcwd(cwd, sizeof(cwd)) == FR_OK);
+	}
+	return cwd;
+}
+
+// Mark the cached working directory as stale
+//
+void mos_invalidateCwd(void) {
+	cwdValid = FALSE;
+}
+
+// Copy the current working directory into a buffer
+// Parameters:
+// - buffer: Pointer to the buffer to copy the path into
+// - size: Size of the buffer
+// Returns:
+// - FatFS return code
+//
+UINT24 mos_GETCWD(char * buffer, UINT24 size) {
+	char * p = mos_getCwd();
+
+	if (*p == 0) {
+		return FR_NOT_READY;
+	}
+	if (strlen(p) >= size) {
+		return FR_NOT_ENOUGH_CORE;
+	}
+	strcpy(buffer, p);
+	return FR_OK;
+}
+
 
 // Check if a path is a directory
 BOOL isDirectory(char *path) {
@@ -1671,8 +2189,7 @@ UINT24 mos_DIR(char* inputPath, BOOL longListing) {
         printf("\n\r");
 
         if (strcmp(dirPath, ".") == 0) {
-            f_getcwd(cwd, sizeof(cwd));
-            printf("Directory: %s\r\n\r\n", cwd);
+            printf("Directory: %s\r\n\r\n", mos_getCwd());
         } else
             printf("Directory: %s\r\n\r\n", dirPath);
 
@@ -1818,7 +2335,7 @@ UINT24 mos_REN_API(char *srcPath, char *dstPath) {
 // 
 UINT24 mos_REN(char *srcPath, char *dstPath, BOOL verbose) {
     FRESULT fr;
-    DIR dir;
+    DIR dir, ddir;
     static FILINFO fno;
     char *srcDir = NULL, *pattern = NULL, *fullSrcPath = NULL, *fullDstPath = NULL, *srcFilename = NULL;
 	char *asteriskPos, *lastSeparator;
@@ -1858,34 +2375,25 @@ UINT24 mos_REN(char *srcPath, char *dstPath, BOOL verbose) {
         fr = f_opendir(&dir, srcDir);
         if (fr != FR_OK) goto cleanup;
 
+        fr = f_opendir(&ddir, dstPath);
+        if (fr != FR_OK) {
+            f_closedir(&dir);
+            goto cleanup;
+        }
+
         fr = f_findfirst(&dir, &fno, srcDir, pattern);
         while (fr == FR_OK && fno.fname[0] != '\0') {
-            size_t srcPathLen = strlen(srcDir) + strlen(fno.fname) + 1;
-            size_t dstPathLen = strlen(dstPath) + strlen(fno.fname) + 2; // +2 for '/' and null terminator
-			fullSrcPath = umm_malloc(srcPathLen);
-            fullDstPath = umm_malloc(dstPathLen);
-
-            if (!fullSrcPath || !fullDstPath) {
-                fr = FR_INT_ERR; // Out of memory
-                if (fullSrcPath) umm_free(fullSrcPath);
-                if (fullDstPath) umm_free(fullDstPath);
-                break;
-            }
-
-            sprintf(fullSrcPath, "%s%s", srcDir, fno.fname);
-            sprintf(fullDstPath, "%s%s%s", dstPath, (dstPath[strlen(dstPath) - 1] == '/' ? "" : "/"), fno.fname);
-
-            if (verbose) printf("Moving %s to %s\r\n", fullSrcPath, fullDstPath);
-			fr = f_rename(fullSrcPath, fullDstPath);
-            umm_free(fullSrcPath);
-            umm_free(fullDstPath);
-            fullSrcPath = NULL;
-            fullDstPath = NULL;
+            if (verbose) printf("Moving %s%s to %s%s%s\r\n", srcDir, fno.fname, dstPath, (dstPath[strlen(dstPath) - 1] == '/' ? "" : "/"), fno.fname);
+			fr = f_renameat(&dir, fno.fname, &ddir, fno.fname);	// Both names are looked up in the open directories
+			if (fr == FR_OK && (fno.fattrib & AM_DIR)) {
+				mos_invalidateCwd();		// The moved folder may be part of the cwd
+			}
 
             if (fr != FR_OK) break;
             fr = f_findnext(&dir, &fno);
         }
 
+        f_closedir(&ddir);
         f_closedir(&dir);
 		
     } else {
@@ -1906,7 +2414,9 @@ UINT24 mos_REN(char *srcPath, char *dstPath, BOOL verbose) {
 		} else {
 			fr = f_rename(srcPath, dstPath);
 		}
-		
+		if (fr == FR_OK) {
+			mos_invalidateCwd();			// The renamed object may be a folder in the cwd
+		}
     }
 
 cleanup:
@@ -1923,7 +2433,7 @@ cleanup:
 // - FatFS return code
 // 
 UINT24 mos_COPY_API(char *srcPath, char *dstPath) {
-	return mos_COPY(srcPath, dstPath, FALSE);
+	return mos_COPY(srcPath, dstPath, FALSE, FALSE);
 }
 
 // Copy file
@@ -1931,17 +2441,19 @@ UINT24 mos_COPY_API(char *srcPath, char *dstPath) {
 // - srcPath: Source path of file to copy
 // - dstPath: Destination file path
 // - verbose: Print progress messages
+// - verify: Read each copy back and check its CRC32 against the source
 // Returns:
-// - FatFS return code
+// - FatFS or MOS return code
 // 
-UINT24 mos_COPY(char *srcPath, char *dstPath, BOOL verbose) {
-    FRESULT fr;
+UINT24 mos_COPY(char *srcPath, char *dstPath, BOOL verbose, BOOL verify) {
+    UINT24 fr;
     FIL fsrc, fdst;
-    DIR dir;
+    DIR dir, ddir;
     static FILINFO fno;
     BYTE buffer[1024];
     UINT br, bw;
-    char *srcDir = NULL, *pattern = NULL, *fullSrcPath = NULL, *fullDstPath = NULL, *srcFilename = NULL;
+    DWORD crc = 0;
+    char *srcDir = NULL, *pattern = NULL, *fullDstPath = NULL, *srcFilename = NULL;
 	char *asteriskPos, *lastSeparator;
     BOOL usePattern = FALSE;
 
@@ -1978,50 +2490,42 @@ UINT24 mos_COPY(char *srcPath, char *dstPath, BOOL verbose) {
         fr = f_opendir(&dir, srcDir);
         if (fr != FR_OK) goto cleanup;
 
+        fr = f_opendir(&ddir, dstPath);
+        if (fr != FR_OK) {
+            f_closedir(&dir);
+            goto cleanup;
+        }
+
         fr = f_findfirst(&dir, &fno, srcDir, pattern);
         while (fr == FR_OK && fno.fname[0] != '\0') {
-            size_t srcPathLen = strlen(srcDir) + strlen(fno.fname) + 1;
-            size_t dstPathLen = strlen(dstPath) + strlen(fno.fname) + 2; // +2 for '/' and null terminator
-            fullSrcPath = umm_malloc(srcPathLen);
-            fullDstPath = umm_malloc(dstPathLen);
-
-            if (!fullSrcPath || !fullDstPath) {
-                fr = FR_INT_ERR;
-                goto file_cleanup;
-            }
-
-            sprintf(fullSrcPath, "%s%s", srcDir, fno.fname);
-            sprintf(fullDstPath, "%s%s%s", dstPath, (dstPath[strlen(dstPath) - 1] == '/' ? "" : "/"), fno.fname);
-
-            fr = f_open(&fsrc, fullSrcPath, FA_READ);
-            if (fr != FR_OK) goto file_cleanup;
-            fr = f_open(&fdst, fullDstPath, FA_WRITE | FA_CREATE_NEW);
+            // Both files are looked up in the open directories rather than walking each full path from the root
+            fr = f_openat(&fsrc, &dir, fno.fname, FA_READ);
+            if (fr != FR_OK) break;
+            fr = f_openat(&fdst, &ddir, fno.fname, FA_WRITE | FA_CREATE_NEW);
             if (fr != FR_OK) {
                 f_close(&fsrc);
-                goto file_cleanup;
+                break;
             }
 
-			if (verbose) printf("Copying %s to %s\r\n", fullSrcPath, fullDstPath);
+			if (verbose) printf("Copying %s%s to %s%s%s\r\n", srcDir, fno.fname, dstPath, (dstPath[strlen(dstPath) - 1] == '/' ? "" : "/"), fno.fname);
+            crc = 0;
             while (1) {
                 fr = f_read(&fsrc, buffer, sizeof(buffer), &br);
                 if (br == 0 || fr != FR_OK) break;
+                if (verify) crc = mos_CRC32(crc, buffer, br);
                 fr = f_write(&fdst, buffer, br, &bw);
                 if (bw < br || fr != FR_OK) break;
             }
 
             f_close(&fsrc);
             f_close(&fdst);
-
-        file_cleanup:
-            if (fullSrcPath) umm_free(fullSrcPath);
-            if (fullDstPath) umm_free(fullDstPath);
-            fullSrcPath = NULL;
-            fullDstPath = NULL;
+            if (fr == FR_OK && verify) fr = mos_VERIFYAT(&ddir, fno.fname, crc);
 
             if (fr != FR_OK) break;
             fr = f_findnext(&dir, &fno);
         }
 
+        f_closedir(&ddir);
         f_closedir(&dir);
     } else {
         size_t fullDstPathLen = strlen(dstPath) + strlen(srcPath) + 2; // +2 for potential '/' and null terminator
@@ -2052,18 +2556,19 @@ UINT24 mos_COPY(char *srcPath, char *dstPath, BOOL verbose) {
         while (1) {
             fr = f_read(&fsrc, buffer, sizeof(buffer), &br);
             if (br == 0 || fr != FR_OK) break;
+            if (verify) crc = mos_CRC32(crc, buffer, br);
             fr = f_write(&fdst, buffer, br, &bw);
             if (bw < br || fr != FR_OK) break;
         }
 
         f_close(&fsrc);
         f_close(&fdst);
+        if (fr == FR_OK && verify) fr = mos_VERIFY(fullDstPath, crc);
     }
 
 cleanup:
     if (srcDir) umm_free(srcDir);
     if (pattern) umm_free(pattern);
-    if (fullSrcPath) umm_free(fullSrcPath);
     if (fullDstPath) umm_free(fullDstPath);
     return fr;
 }
@@ -2082,6 +2587,48 @@ UINT24 mos_MKDIR(char * filename) {
 	return fr;
 }
 
+// Run a batch file of MOS commands from the ROM filesystem
+// The file is unpacked onto the heap, then each line is copied into the buffer and run, as f_gets would for mos_EXEC
+// Parameters:
+// - rom: Directory entry of the batch file
+// - filename: The batch file, for errors
+// - buffer: Storage for each line
+// - size: Size of buffer (in bytes)
+// Returns:
+// - FatFS or MOS return code (of the last command)
+//
+static UINT24 mos_EXECROM(t_romfsEntry * rom, char * filename, char * buffer, UINT24 size) {
+	UINT24	fr;
+	char *	text;
+	char *	p;
+	char *	end;
+	UINT24	n;
+	int		line = 0;
+
+	text = umm_malloc(rom->length + 1);
+	if (!text) {
+		return MOS_OUT_OF_MEMORY;
+	}
+	fr = romfs_read(rom, (BYTE *)text, rom->length);
+	end = text + rom->length;
+	for (p = text; fr == FR_OK && p < end; ) {
+		line++;
+		for (n = 0; p < end && n < size - 1; ) {
+			buffer[n++] = *p++;
+			if (buffer[n - 1] == '\n') {
+				break;
+			}
+		}
+		buffer[n] = 0;
+		fr = mos_exec(buffer, TRUE);
+		if (fr != FR_OK) {
+			printf("\r\nError executing %s at line %d\r\n", filename, line);
+		}
+	}
+	umm_free(text);
+	return fr;
+}
+
 // Load and run a batch file of MOS commands.
 // Parameters:
 // - filename: The batch file to execute
@@ -2094,6 +2641,11 @@ UINT24 mos_EXEC(char * filename, char * buffer, UINT24 size) {
 	FRESULT	fr;
 	FIL	   	fil;
 	int     line =  0;
+	t_romfsEntry * rom = romfs_find(filename);
+
+	if (rom) {
+		return mos_EXECROM(rom, filename, buffer, size);
+	}
 	
 	fr = f_open(&fil, filename, FA_READ);
 	if (fr == FR_OK) {
@@ -2111,22 +2663,93 @@ UINT24 mos_EXEC(char * filename, char * buffer, UINT24 size) {
 	return fr;	
 }
 
+// Open a file object for the FatFS API
+// Parameters:
+// - fp: The file object
+// - filename: Path of file to open
+// - mode: File open mode; MOS_FA_BUFFERED is ignored, as the caller owns the file object and
+//   MOS could not reclaim a buffer it left attached (only mos_FOPEN handles get one)
+// Returns:
+// - FatFS return code
+//
+UINT24 mos_FFOPEN(FIL * fp, char * filename, UINT8 mode) {
+	return mos_FFOPENAT(fp, NULL, filename, mode);
+}
+
+// Open a file object relative to an open directory, for the FatFS API
+// Parameters:
+// - fp: The file object
+// - dp: The open directory a relative filename is looked up in, or NULL for the current directory
+// - filename: Path of file to open
+// - mode: File open mode, as mos_FFOPEN
+// Returns:
+// - FatFS return code
+//
+UINT24 mos_FFOPENAT(FIL * fp, DIR * dp, char * filename, UINT8 mode) {
+	return f_openat(fp, dp, filename, mode & ~MOS_FA_BUFFERED);
+}
+
+// Rename or move a file or folder relative to open directories, for the FatFS API
+// Parameters:
+// - dp_old: The open directory path_old is looked up in, or NULL for the current directory
+// - path_old: Path of the object to rename
+// - dp_new: The open directory path_new is looked up in, or NULL for the current directory
+// - path_new: The new path
+// Returns:
+// - FatFS return code
+//
+UINT24 mos_FFRENAMEAT(DIR * dp_old, char * path_old, DIR * dp_new, char * path_new) {
+	FRESULT	fr = f_renameat(dp_old, path_old, dp_new, path_new);
+
+	if (fr == FR_OK) {
+		mos_invalidateCwd();				// The renamed object may be a folder in the cwd
+	}
+	return fr;
+}
+
+// Close a file object, freeing the sector buffer mos_FOPEN may have given it
+// Parameters:
+// - fp: The file object
+// Returns:
+// - FatFS return code
+//
+UINT24 mos_FFCLOSE(FIL * fp) {
+	FRESULT	fr;
+	BYTE *	buf = f_getbuf(fp);
+
+	fr = f_close(fp);
+	if (buf && !f_getbuf(fp)) {				// Still attached if the close failed
+		umm_free(buf);
+	}
+	return fr;
+}
+
 // Open a file
 // Parameters:
 // - filename: Path of file to open
 // - mode: File open mode (r, r/w, w, etc) - see FatFS documentation for more details
+//   Add MOS_FA_BUFFERED to give a busy file its own sector buffer
 // Returns:
 // - File handle, or 0 if the file cannot be opened
 // 
 UINT24 mos_FOPEN(char * filename, UINT8 mode) {
 	FRESULT fr;
+	BYTE *	buf;
 	int		i;
 	
 	for(i = 0; i < MOS_maxOpenFiles; i++) {
 		if(mosFileObjects[i].free == 0) {
-			fr = f_open(&mosFileObjects[i].fileObject, filename, mode);
+			fr = mos_FFOPEN(&mosFileObjects[i].fileObject, filename, mode);
+			if(fr == FR_OK && (mode & MOS_FA_BUFFERED)) {
+				buf = umm_malloc(FF_MAX_SS);	// Owned by the handle, and freed by mos_FCLOSE
+				if(buf && f_setbuf(&mosFileObjects[i].fileObject, buf) != FR_OK) {
+					umm_free(buf);				// No free slot, so the file shares the volume window
+				}
+			}
 			if(fr == FR_OK) {
 				mosFileObjects[i].free = 1;
+				mosFileObjects[i].stream = NULL;
+				file_stats_open(i + 1, filename);
 				return i + 1;
 			}
 		}
@@ -2147,14 +2770,16 @@ UINT24 mos_FCLOSE(UINT8 fh) {
 	if(fh > 0 && fh <= MOS_maxOpenFiles) {
 		i = fh - 1;
 		if(mosFileObjects[i].free > 0) {
-			fr = f_close(&mosFileObjects[i].fileObject);
+			mos_closeStream(&mosFileObjects[i]);
+			fr = mos_FFCLOSE(&mosFileObjects[i].fileObject);
 			mosFileObjects[i].free = 0;
 		}
 	}
 	else {
 		for(i = 0; i < MOS_maxOpenFiles; i++) {
 			if(mosFileObjects[i].free > 0) {
-				fr = f_close(&mosFileObjects[i].fileObject);
+				mos_closeStream(&mosFileObjects[i]);
+				fr = mos_FFCLOSE(&mosFileObjects[i].fileObject);
 				mosFileObjects[i].free = 0;
 			}
 		}
@@ -2172,12 +2797,15 @@ UINT24 mos_FCLOSE(UINT8 fh) {
 UINT24	mos_FGETC(UINT8 fh) {
 	FRESULT fr;
 	FIL	*	fo;
-	UINT	br;
+	UINT	br = 0;
 	char	c;
+	t_fileMark	mark;
 
 	fo = (FIL *)mos_GETFIL(fh);
 	if(fo > 0) {
+		file_stats_begin(&mark);
 		fr = f_read(fo, &c, 1, &br); 
+		file_stats_end(fh, &mark, FILE_read, br);
 		if(fr == FR_OK) {
 			return	c | (fat_EOF(fo) << 8);
 		}		
@@ -2192,9 +2820,13 @@ UINT24	mos_FGETC(UINT8 fh) {
 //
 void	mos_FPUTC(UINT8 fh, char c) {
 	FIL * fo = (FIL *)mos_GETFIL(fh);
+	t_fileMark	mark;
+	int		n;
 
 	if(fo > 0) {
-		f_putc(c, fo);
+		file_stats_begin(&mark);
+		n = f_putc(c, fo);
+		file_stats_end(fh, &mark, FILE_write, n > 0 ? n : 0);
 	}
 }
 
@@ -2210,9 +2842,12 @@ UINT24	mos_FREAD(UINT8 fh, UINT24 buffer, UINT24 btr) {
 	FRESULT fr;
 	FIL *	fo = (FIL *)mos_GETFIL(fh);
 	UINT	br = 0;
+	t_fileMark	mark;
 
 	if(fo > 0) {
+		file_stats_begin(&mark);
 		fr = f_read(fo, (const void *)buffer, btr, &br);
+		file_stats_end(fh, &mark, FILE_read, br);
 		if(fr == FR_OK) {
 			return br;
 		}
@@ -2232,9 +2867,12 @@ UINT24	mos_FWRITE(UINT8 fh, UINT24 buffer, UINT24 btw) {
 	FRESULT fr;
 	FIL *	fo = (FIL *)mos_GETFIL(fh);
 	UINT	bw = 0;
+	t_fileMark	mark;
 
 	if(fo > 0) {
+		file_stats_begin(&mark);
 		fr = f_write(fo, (const void *)buffer, btw, &bw);
+		file_stats_end(fh, &mark, FILE_write, bw);
 		if(fr == FR_OK) {
 			return bw;
 		}
@@ -2250,9 +2888,14 @@ UINT24	mos_FWRITE(UINT8 fh, UINT24 buffer, UINT24 btw) {
 // 
 UINT8  	mos_FLSEEK(UINT8 fh, UINT32 offset) {
 	FIL * fo = (FIL *)mos_GETFIL(fh);
+	t_fileMark	mark;
+	FRESULT	fr;
 
 	if(fo > 0) {
-		return f_lseek(fo, offset);
+		file_stats_begin(&mark);
+		fr = f_lseek(fo, offset);
+		file_stats_end(fh, &mark, FILE_seek, 0);
+		return fr;
 	}
 	return FR_INVALID_OBJECT;
 }
@@ -2272,6 +2915,326 @@ UINT8	mos_FEOF(UINT8 fh) {
 	return 0;
 }
 
+// Get the stream state of a file handle
+// Parameters:
+// - fh: File handle
+// Returns:
+// - Pointer to the stream, or NULL if the handle was not opened with mos_SOPEN
+//
+static t_mosStream * mos_getStream(UINT8 fh) {
+	if(fh > 0 && fh <= MOS_maxOpenFiles && mosFileObjects[fh - 1].free > 0) {
+		return mosFileObjects[fh - 1].stream;
+	}
+	return NULL;
+}
+
+// Write out the partly filled sector at the end of a stream
+// The bytes beyond the end of the data are whatever was left in the buffer
+//
+static FRESULT mos_flushStream(FIL * fo, t_mosStream * st) {
+	if(st->fill > 0) {
+		if(disk_write(fo->obj.fs->pdrv, st->buffer, st->sector + (st->length - st->fill) / FF_MAX_SS, 1) != RES_OK) {
+			return FR_DISK_ERR;
+		}
+	}
+	return FR_OK;
+}
+
+// Finish a stream before its file is closed
+// The file size is set to the length written and the unused part of the extent is freed
+//
+static void mos_closeStream(t_mosFileObject * mfo) {
+	t_mosStream * st = mfo->stream;
+	FIL *	fo = &mfo->fileObject;
+
+	if(st == NULL) {
+		return;
+	}
+	if(
+		mos_flushStream(fo, st) == FR_OK &&
+		f_setsize(fo, st->capacity) == FR_OK &&
+		f_lseek(fo, st->length) == FR_OK
+	) {
+		f_truncate(fo);
+	}
+	umm_free(st);
+	mfo->stream = NULL;
+}
+
+// Create a file for streaming writes
+// The whole file is allocated up front as one contiguous extent, so appends never
+// touch the FAT; data goes straight to the card, and the file size is only written
+// to the directory entry by mos_SSYNC and when the file is closed
+// Parameters:
+// - filename: Path of the file to create; an existing file is replaced
+// - size: Number of bytes to allocate
+// Returns:
+// - File handle, or 0 if the file could not be created (or there was no contiguous space)
+//
+UINT24 mos_SOPEN(char * filename, UINT24 size) {
+	t_mosFileObject * mfo;
+	t_mosStream * st;
+	FATFS *	fso;
+	FRESULT	fr = FR_INT_ERR;
+	UINT8	fh;
+
+	if(size == 0) {
+		return 0;
+	}
+	st = umm_malloc(sizeof(t_mosStream));
+	if(st == NULL) {
+		return 0;
+	}
+	fh = mos_FOPEN(filename, FA_WRITE | FA_CREATE_ALWAYS);
+	if(fh > 0) {
+		mfo = &mosFileObjects[fh - 1];
+		fr = f_expand(&mfo->fileObject, size, 1);
+		if(fr == FR_OK) {
+			fso = mfo->fileObject.obj.fs;
+			st->sector = fso->database + (LBA_t)(mfo->fileObject.obj.sclust - 2) * fso->csize;
+			st->capacity = size;
+			st->length = 0;
+			st->fill = 0;
+			fr = f_setsize(&mfo->fileObject, 0);			// Nothing has been written yet
+		}
+		if(fr == FR_OK) {
+			fr = f_sync(&mfo->fileObject);					// Record the extent in the directory entry
+		}
+		if(fr == FR_OK) {
+			mfo->stream = st;
+			return fh;
+		}
+		mos_FCLOSE(fh);
+		f_unlink(filename);
+	}
+	umm_free(st);
+	return 0;
+}
+
+// Append a block of data to a stream
+// Whole sectors are written straight from the buffer in one multiple block write;
+// anything left over waits in the stream buffer for the rest of its sector
+// Parameters:
+// - fh: File handle returned by mos_SOPEN
+// - buffer: Address to read the data from
+// - btw: Number of bytes to write
+// Returns:
+// - Number of bytes written; less than btw if the extent is full or on a disk error
+//
+UINT24 mos_SWRITE(UINT8 fh, UINT24 buffer, UINT24 btw) {
+	t_mosStream * st = mos_getStream(fh);
+	BYTE *	src = (BYTE *)buffer;
+	BYTE	pdrv;
+	UINT24	written = 0;
+	UINT24	n;
+	LBA_t	sect;
+	t_fileMark	mark;
+
+	if(st == NULL) {
+		return 0;
+	}
+	file_stats_begin(&mark);
+	pdrv = mosFileObjects[fh - 1].fileObject.obj.fs->pdrv;
+	if(btw > st->capacity - st->length) {
+		btw = st->capacity - st->length;
+	}
+	while(btw > 0) {
+		sect = st->sector + (st->length - st->fill) / FF_MAX_SS;
+		if(st->fill == 0 && btw >= FF_MAX_SS) {
+			n = btw / FF_MAX_SS;
+			if(disk_write(pdrv, src, sect, n) != RES_OK) {
+				break;
+			}
+			n *= FF_MAX_SS;
+		}
+		else {
+			n = FF_MAX_SS - st->fill;
+			if(n > btw) {
+				n = btw;
+			}
+			memcpy(st->buffer + st->fill, src, n);
+			if(st->fill + n == FF_MAX_SS && disk_write(pdrv, st->buffer, sect, 1) != RES_OK) {
+				break;
+			}
+			st->fill = (st->fill + n) % FF_MAX_SS;
+		}
+		src += n;
+		btw -= n;
+		written += n;
+		st->length += n;
+	}
+	file_stats_end(fh, &mark, FILE_write, written);
+	return written;
+}
+
+// Checkpoint a stream
+// Writes out the partly filled last sector and commits the current length to the directory entry
+// Parameters:
+// - fh: File handle returned by mos_SOPEN
+// Returns:
+// - FRESULT
+//
+UINT24 mos_SSYNC(UINT8 fh) {
+	t_mosStream * st = mos_getStream(fh);
+	FIL *	fo;
+	FRESULT	fr;
+
+	if(st == NULL) {
+		return FR_INVALID_OBJECT;
+	}
+	fo = &mosFileObjects[fh - 1].fileObject;
+	fr = mos_flushStream(fo, st);
+	if(fr == FR_OK) {
+		fr = f_setsize(fo, st->length);
+	}
+	if(fr == FR_OK) {
+		fr = f_sync(fo);
+	}
+	return fr;
+}
+
+// Read a batch of directory entries into a buffer
+// Entries are packed back to back in the following format:
+// - +0: File size (4 bytes, little endian)
+// - +4: Modified date (2 bytes, FAT format)
+// - +6: Modified time (2 bytes, FAT format)
+// - +8: Attributes
+// - +9: Length of the name, n
+// - +10: Name, n characters followed by a NUL terminator
+// Parameters:
+// - dp: Pointer to a directory object opened with f_opendir
+// - buffer: Address of the buffer to store the entries in
+// - size: Size of the buffer
+// - pattern: Glob pattern the names must match, or NULL for all entries
+// - attr: Attribute filter; an entry is returned if (attributes & mask) == value, where mask is bits 0-7 and value is bits 8-15
+// - count: Pointer to store the number of entries returned in; this is 0 at the end of the directory
+// Returns:
+// - FRESULT; FR_NOT_ENOUGH_CORE if the buffer is too small to hold the next entry
+//
+UINT24 mos_DREADBATCH(DIR * dp, BYTE * buffer, UINT24 size, char * pattern, UINT24 attr, UINT24 * count) {
+	static FILINFO	fno;
+	DIR		saved;
+	const TCHAR *	pat = dp->pat;
+	BYTE		mask = attr & 0xFF;
+	BYTE		value = (attr >> 8) & 0xFF;
+	FRESULT		fr;
+	UINT24		used = 0;
+	UINT24		len;
+
+	*count = 0;
+	dp->pat = pattern ? pattern : "*";		// Only a 24-bit NULL; MB:0000 from Z80 mode is a real address
+	for(;;) {
+		memcpy(&saved, dp, sizeof(DIR));		// So an entry that doesn't fit can be read again next time
+		fr = f_findnext(dp, &fno);
+		if(fr != FR_OK || fno.fname[0] == 0) {
+			break;
+		}
+		if((fno.fattrib & mask) != value) {
+			continue;
+		}
+		len = strlen(fno.fname);
+		if(used + len + 11 > size) {
+			memcpy(dp, &saved, sizeof(DIR));
+			if(*count == 0) {
+				fr = FR_NOT_ENOUGH_CORE;
+			}
+			break;
+		}
+		memcpy(buffer + used, &fno.fsize, 4);
+		memcpy(buffer + used + 4, &fno.fdate, 2);
+		memcpy(buffer + used + 6, &fno.ftime, 2);
+		buffer[used + 8] = fno.fattrib;
+		buffer[used + 9] = len;
+		memcpy(buffer + used + 10, fno.fname, len + 1);
+		used += len + 11;
+		(*count)++;
+	}
+	dp->pat = pat;
+	return fr;
+}
+
+#define HEAP_minimumSize	(8 * 8)				// Smallest heap worth having, in bytes
+#define HEAP_maximumSize	(32767 * 8)			// umm_malloc can index 32767 blocks of 8 bytes
+
+// Create a heap in a region of RAM owned by the caller
+// The heap's header is kept at the start of the region, so the caller needs nothing else to track it
+// Parameters:
+// - ptr: Start of the region
+// - size: Size of the region in bytes
+// Returns:
+// - Heap handle (the same as ptr), or NULL if the region is too small
+//
+umm_heap * mos_HEAPINIT(void * ptr, UINT24 size) {
+	umm_heap *	heap = ptr;
+
+	if(ptr == NULL || size < sizeof(umm_heap) + HEAP_minimumSize) {
+		return NULL;
+	}
+	size -= sizeof(umm_heap);
+	if(size > HEAP_maximumSize) {
+		size = HEAP_maximumSize;
+	}
+	umm_multi_init_heap(heap, (BYTE *)ptr + sizeof(umm_heap), size);
+	return heap;
+}
+
+// Allocate memory from a heap created with mos_HEAPINIT
+// Parameters:
+// - heap: Heap handle
+// - size: Number of bytes
+// Returns:
+// - Pointer to the memory, or NULL if there isn't a free block big enough
+//
+void * mos_HEAPALLOC(umm_heap * heap, UINT24 size) {
+	if(heap == NULL) {
+		return NULL;
+	}
+	return umm_multi_malloc(heap, size);
+}
+
+// Free memory allocated with mos_HEAPALLOC or mos_HEAPREALLOC
+// Parameters:
+// - heap: Heap handle
+// - ptr: Pointer to the memory; NULL, and pointers that are not to a block allocated from the heap, are ignored
+//
+void mos_HEAPFREE(umm_heap * heap, void * ptr) {
+	if(heap != NULL) {
+		umm_multi_free(heap, ptr);
+	}
+}
+
+// Resize memory allocated from a heap, moving it if it can't grow in place
+// Parameters:
+// - heap: Heap handle
+// - ptr: Pointer to the memory, or NULL to allocate new memory
+// - size: New size in bytes, or 0 to free the memory
+// Returns:
+// - Pointer to the memory, or NULL if it could not be resized (the original is left as it was)
+//
+void * mos_HEAPREALLOC(umm_heap * heap, void * ptr, UINT24 size) {
+	if(heap == NULL) {
+		return NULL;
+	}
+	return umm_multi_realloc(heap, ptr, size);
+}
+
+// Get the usage of a heap
+// Parameters:
+// - heap: Heap handle, or NULL for the MOS heap
+// - stats: Pointer to a umm_stats struct to fill in
+// Returns:
+// - FRESULT
+//
+UINT24 mos_HEAPSTATS(umm_heap * heap, umm_stats * stats) {
+	if(heap == NULL) {
+		umm_stats_heap(stats);
+	}
+	else {
+		umm_multi_stats(heap, stats);
+	}
+	return FR_OK;
+}
+
 // Copy an error string to RAM
 // Parameters:
 // - errno: The error number
@@ -2358,7 +3321,7 @@ UINT24	mos_GETFIL(UINT8 fh) {
 
 	if(fh > 0 && fh <= MOS_maxOpenFiles) {
 		mfo = &mosFileObjects[fh - 1];
-		if(mfo->free > 0) {
+		if(mfo->free > 0 && mfo->stream == NULL) {	// Streams are only written with mos_SWRITE
 			return (UINT24)(&mfo->fileObject);
 		}
 	}
@@ -2386,7 +3349,13 @@ UINT8 fat_EOF(FIL * fp) {
 //
 int mos_mount(void) {
 	int ret = f_mount(&fs, "", 1);			// Mount the SD card
-	f_getcwd(cwd, sizeof(cwd)); //Update full path.
+	if (ret == FR_OK) {
+		strcpy(cwd, "/");					// A fresh mount always starts in the root directory
+	}
+	else {
+		cwd[0] = 0;
+	}
+	cwdValid = TRUE;						// Don't retry the mount on every prompt if it failed
 	return ret;
 }
 
@@ -29,15 +29,34 @@
  * 30/05/2023:		Function mos_FGETC now returns EOF flag
  * 08/07/2023		Added mos_trim function
  * 11/11/2023:		Added mos_cmdHELP, mos_cmdTYPE, mos_cmdCLS, mos_cmdMOUNT
+ * 17/10/2026:		Added mos_getCwd, mos_invalidateCwd, mos_GETCWD
+ * 17/10/2026:		Added mos_cmdDEFRAG
+ * 17/10/2026:		Added mos_SOPEN, mos_SWRITE, mos_SSYNC
+ * 17/10/2026:		Added mos_DREADBATCH
+ * 17/10/2026:		Added mos_cmdDU, mos_cmdFIND; COPY and DELETE take -r
+ * 17/10/2026:		Added mos_cmdCHECKSUM, MOS_CHECKSUM_MISMATCH; COPY takes -v
+ * 17/10/2026:		Added mos_HEAPINIT, mos_HEAPALLOC, mos_HEAPFREE, mos_HEAPREALLOC, mos_HEAPSTATS
+ * 17/10/2026:		Added mos_cmdSNAPSHOT, MOS_BAD_SNAPSHOT
+ * 17/10/2026:		Added mos_cmdISRSTAT
+ * 17/10/2026:		Added mos_cmdVDPSTAT
+ * 17/10/2026:		Added mos_cmdROMFS, MOS_BAD_ROMFS
+ * 17/10/2026:		Added mos_FFOPEN, mos_FFCLOSE, MOS_FA_BUFFERED
+ * 17/10/2026:		Added mos_cmdFILES
+ * 17/10/2026:		Added mos_FFOPENAT
+ * 17/10/2026:		Added mos_cmdSDSTAT
+ * 17/10/2026:		Added mos_FFRENAMEAT
  */
 
 #ifndef MOS_H
 #define MOS_H
 
 #include "ff.h"
+#include "umm_malloc.h"
 
 extern char  	cmd[256];				// Array for the command line handler
 
+#define MOS_FA_BUFFERED	0x80			// File open mode flag: give the file its own sector buffer (see FF_PRIVATE_BUFS)
+
 typedef struct {
 	char * name;
 	int (*func)(char * ptr);
@@ -45,9 +64,21 @@ typedef struct {
 	char * help;
 } t_mosCommand;
 
+// Streaming write state, for files opened with mos_SOPEN
+// Data is written straight to the sectors of a preallocated contiguous extent
+//
+typedef struct {
+	LBA_t	sector;					// First sector of the extent
+	DWORD	capacity;				// Size of the extent in bytes
+	DWORD	length;					// Bytes appended so far
+	UINT24	fill;					// Bytes in buffer waiting for the rest of their sector
+	BYTE	buffer[FF_MAX_SS];
+} t_mosStream;
+
 typedef struct {
 	UINT8	free;
 	FIL		fileObject;
+	t_mosStream * stream;			// NULL unless opened with mos_SOPEN
 } t_mosFileObject;
 
 /**
@@ -57,10 +88,13 @@ typedef struct {
 typedef enum {
 	MOS_INVALID_COMMAND = 20,	/* (20) Command could not be understood */
 	MOS_INVALID_EXECUTABLE, 	/* (21) Executable file format not recognised */
-	MOS_OUT_OF_MEMORY,			/* (22) Generic out of memory error NB this is currently unused */
+	MOS_OUT_OF_MEMORY,			/* (22) Generic out of memory error */
 	MOS_NOT_IMPLEMENTED,		/* (23) API call not implemented */
 	MOS_OVERLAPPING_SYSTEM,		/* (24) File load prevented to stop overlapping system memory */
 	MOS_BAD_STRING,				/* (25) Bad or incomplete string */
+	MOS_CHECKSUM_MISMATCH,		/* (26) File does not match its checksum */
+	MOS_BAD_SNAPSHOT,			/* (27) Snapshot file not recognised or incomplete */
+	MOS_BAD_ROMFS,				/* (28) ROM filesystem image is damaged */
 } MOSRESULT;
 
 void 	mos_error(int error);
@@ -88,11 +122,21 @@ int		mos_cmdDEL(char * ptr);
 int		mos_cmdJMP(char * ptr);
 int		mos_cmdRUN(char * ptr);
 int		mos_cmdCD(char * ptr);
+int		mos_cmdCHECKSUM(char *ptr);
 int		mos_cmdREN(char *ptr);
 int		mos_cmdCOPY(char *ptr);
+int		mos_cmdDEFRAG(char *ptr);
+int		mos_cmdDU(char *ptr);
+int		mos_cmdFIND(char *ptr);
 int		mos_cmdMKDIR(char *ptr);
+int		mos_cmdISRSTAT(char *ptr);
+int		mos_cmdROMFS(char *ptr);
 int		mos_cmdSET(char *ptr);
+int		mos_cmdSNAPSHOT(char *ptr);
 int		mos_cmdVDU(char *ptr);
+int		mos_cmdVDPSTAT(char *ptr);
+int		mos_cmdFILES(char *ptr);
+int		mos_cmdSDSTAT(char *ptr);
 int		mos_cmdTIME(char *ptr);
 int		mos_cmdCREDITS(char *ptr);
 int		mos_cmdEXEC(char * ptr);
@@ -109,16 +153,22 @@ UINT24	mos_LOAD(char * filename, UINT24 address, UINT24 size);
 UINT24	mos_SAVE(char * filename, UINT24 address, UINT24 size);
 UINT24	mos_TYPE(char * filename);
 UINT24	mos_CD(char * path);
+UINT24	mos_GETCWD(char * buffer, UINT24 size);
 UINT24	mos_DIR_API(char * path);
 UINT24	mos_DIR(char * path, BOOL longListing);
 UINT24	mos_DEL(char * filename);
 UINT24	mos_REN_API(char *srcPath, char *dstPath);
 UINT24	mos_REN(char *srcPath, char *dstPath, BOOL verbose);
 UINT24	mos_COPY_API(char *srcPath, char *dstPath);
-UINT24	mos_COPY(char *srcPath, char *dstPath, BOOL verbose);
+UINT24	mos_COPY(char *srcPath, char *dstPath, BOOL verbose, BOOL verify);
+BOOL	isDirectory(char *path);
 UINT24	mos_MKDIR(char * filename);
 UINT24 	mos_EXEC(char * filename, char * buffer, UINT24 size);
 
+UINT24	mos_FFOPEN(FIL * fp, char * filename, UINT8 mode);
+UINT24	mos_FFOPENAT(FIL * fp, DIR * dp, char * filename, UINT8 mode);
+UINT24	mos_FFRENAMEAT(DIR * dp_old, char * path_old, DIR * dp_new, char * path_new);
+UINT24	mos_FFCLOSE(FIL * fp);
 UINT24	mos_FOPEN(char * filename, UINT8 mode);
 UINT24	mos_FCLOSE(UINT8 fh);
 UINT24	mos_FGETC(UINT8 fh);
@@ -127,6 +177,16 @@ UINT24	mos_FREAD(UINT8 fh, UINT24 buffer, UINT24 btr);
 UINT24	mos_FWRITE(UINT8 fh, UINT24 buffer, UINT24 btw);
 UINT8  	mos_FLSEEK(UINT8 fh, UINT32 offset);
 UINT8	mos_FEOF(UINT8 fh);
+UINT24	mos_SOPEN(char * filename, UINT24 size);
+UINT24	mos_SWRITE(UINT8 fh, UINT24 buffer, UINT24 btw);
+UINT24	mos_SSYNC(UINT8 fh);
+UINT24	mos_DREADBATCH(DIR * dp, BYTE * buffer, UINT24 size, char * pattern, UINT24 attr, UINT24 * count);
+
+umm_heap *	mos_HEAPINIT(void * ptr, UINT24 size);
+void *	mos_HEAPALLOC(umm_heap * heap, UINT24 size);
+void	mos_HEAPFREE(umm_heap * heap, void * ptr);
+void *	mos_HEAPREALLOC(umm_heap * heap, void * ptr, UINT24 size);
+UINT24	mos_HEAPSTATS(umm_heap * heap, umm_stats * stats);
 
 void 	mos_GETERROR(UINT8 errno, UINT24 address, UINT24 size);
 UINT24 	mos_OSCLI(char * cmd);
@@ -136,6 +196,8 @@ UINT24	mos_SETINTVECTOR(UINT8 vector, UINT24 address);
 UINT24	mos_GETFIL(UINT8 fh);
 
 extern TCHAR	cwd[256];
+char *	mos_getCwd(void);
+void	mos_invalidateCwd(void);
 extern BOOL	sdcardDelay;
 
 UINT8	fat_EOF(FIL * fp);
@@ -146,14 +208,30 @@ UINT8	fat_EOF(FIL * fp);
 #define HELP_CD				"Change current directory\r\n"
 #define HELP_CD_ARGS		"<path>"
 
-#define HELP_COPY			"Create a copy of a file\r\n"
-#define HELP_COPY_ARGS		"<filename1> <filename2>"
+#define HELP_CHECKSUM		"Show the CRC32 of a file\r\n" \
+							"-c: Check the files listed in an SFV manifest\r\n"
+#define HELP_CHECKSUM_ARGS	"[-c] <filename>"
+
+#define HELP_COPY			"Create a copy of a file\r\n" \
+							"-r: Copy a folder and everything in it\r\n" \
+							"-v: Check each copy's CRC32 against the original\r\n"
+#define HELP_COPY_ARGS		"[-r] [-v] <filename1> <filename2>"
 
 #define HELP_CREDITS		"Output credits and version numbers for\r\n" \
 							"third-party libraries used in the Agon firmware\r\n"
 
-#define HELP_DELETE			"Delete a file or folder (must be empty)\r\n"
-#define HELP_DELETE_ARGS	"[-f] <filename>"
+#define HELP_DEFRAG			"Make the files and folders on the SD card contiguous\r\n" \
+							"-n: Only report how fragmented the card is\r\n" \
+							"-b: First move autoexec.txt and /mos/*.bin to the start of the card\r\n" \
+							"Press ESC to stop; running DEFRAG again carries on\r\n"
+#define HELP_DEFRAG_ARGS	"[-n] [-b]"
+
+#define HELP_DELETE			"Delete a file or folder (must be empty)\r\n" \
+							"-r: Delete a folder and everything in it\r\n"
+#define HELP_DELETE_ARGS	"[-f] [-r] <filename>"
+
+#define HELP_DU				"Show the space used by a folder and each folder in it\r\n"
+#define HELP_DU_ARGS		"[<path>]"
 
 #define HELP_ECHO			"Echo sends a string to the VDU, after transformation\r\n"
 #define HELP_ECHO_ARGS		"<string>"
@@ -161,6 +239,20 @@ UINT8	fat_EOF(FIL * fp);
 #define HELP_EXEC			"Run a batch file containing MOS commands\r\n"
 #define HELP_EXEC_ARGS		"<filename>"
 
+#define HELP_FIND			"List the files and folders below a folder whose names match a pattern\r\n"
+#define HELP_FIND_ARGS		"<pattern> [<path>]"
+
+#define HELP_FILES			"Show the open file handles, with the calls made on each\r\n" \
+							"ON clears the figures and starts timing the calls, OFF stops it;\r\n" \
+							"Misses are the times the calls had to read from the card\r\n"
+#define HELP_FILES_ARGS		"[ON|OFF]"
+
+#define HELP_ISRSTAT		"Time the MOS interrupt handlers\r\n" \
+							"ON clears the figures and starts timing, OFF stops it; with no\r\n" \
+							"argument the count, total and longest time of each is shown,\r\n" \
+							"and of the windows MOS itself runs with interrupts off (DISAVE)\r\n"
+#define HELP_ISRSTAT_ARGS	"[ON|OFF]"
+
 #define HELP_JMP			"Jump to the specified address in memory\r\n"
 #define HELP_JMP_ARGS		"<addr>"
 
@@ -169,7 +261,9 @@ UINT8	fat_EOF(FIL * fp);
 							"default to &40000\r\n"
 #define HELP_LOAD_ARGS		"<filename> [<addr>]"
 
-#define HELP_MEM			"Output memory statistics\r\n"
+#define HELP_MEM			"Output memory statistics\r\n" \
+							"USER:HI is 6K, down from 8K; apps that use\r\n" \
+							"&B7F800-&B7FFFF will overwrite MOS's interrupt handlers\r\n"
 
 #define HELP_MKDIR			"Create a new folder on the SD card\r\n"
 #define HELP_MKDIR_ARGS		"<filename>"
@@ -180,6 +274,9 @@ UINT8	fat_EOF(FIL * fp);
 #define HELP_RENAME			"Rename a file in the same folder\r\n"
 #define HELP_RENAME_ARGS	"<filename1> <filename2>"
 
+#define HELP_ROMFS			"List the files in the ROM filesystem and check their CRCs.\r\n" \
+							"These are found before the same paths on the SD card\r\n"
+
 #define HELP_RUN			"Call an executable binary loaded in memory.\r\n" \
 							"If no parameters are passed, then addr will " \
 							"default to &40000.\r\n"
@@ -188,6 +285,11 @@ UINT8	fat_EOF(FIL * fp);
 #define HELP_SAVE			"Save a block of memory to the SD card\r\n"
 #define HELP_SAVE_ARGS		"<filename> <addr> <size>"
 
+#define HELP_SDSTAT			"Show the SD card driver counters, and the calls made to read and write\r\n" \
+							"ON clears the figures and starts timing, OFF stops it; the times\r\n" \
+							"and the histogram of call lengths are only kept while timing\r\n"
+#define HELP_SDSTAT_ARGS	"[ON|OFF]"
+
 #define HELP_SET			"Set a system option\r\n\r\n" \
 							"Keyboard Layout\r\n" \
 							"SET KEYBOARD n: Set the keyboard layout\r\n" \
@@ -216,6 +318,11 @@ UINT8	fat_EOF(FIL * fp);
 							"    1: Console on\r\n"
 #define HELP_SET_ARGS		"<option> <value>"
 
+#define HELP_SNAPSHOT		"Save or restore user RAM, the screen mode, keyboard\r\n" \
+							"settings, cursor position and open files\r\n" \
+							"LOAD replaces the program in memory; RUN restarts it\r\n"
+#define HELP_SNAPSHOT_ARGS	"SAVE|LOAD <filename>"
+
 #define HELP_TIME			"Set and read the ESP32 real-time clock\r\n"
 #define HELP_TIME_ARGS		"[ <yyyy> <mm> <dd> <hh> <mm> <ss> ]"
 
@@ -223,6 +330,11 @@ UINT8	fat_EOF(FIL * fp);
 							"Character values are converted to bytes before sending\r\n"
 #define HELP_VDU_ARGS		"<char1> <char2> ... <charN>"
 
+#define HELP_VDPSTAT		"Time the round trips of MOS queries to the VDP\r\n" \
+							"ON clears the figures and starts timing, OFF stops it; with no\r\n" \
+							"argument the count, timeouts and times of each reply are shown\r\n"
+#define HELP_VDPSTAT_ARGS	"[ON|OFF]"
+
 #define HELP_TYPE			"Display the contents of a file on the screen\r\n"
 #define HELP_TYPE_ARGS		"<filename>"
 
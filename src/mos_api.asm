@@ -24,7 +24,28 @@
 ; 03/08/2023:	Added mos_api_setkbvector
 ; 10/08/2023:	Added mos_api_getkbmap
 ; 10/11/2023:	Added mos_api_i2c_close, mos_api_i2c_open, mos_api_i2c_read, mos_api_i2c_write
+; 17/10/2026:	ffs_api_getcwd now returns the cwd cached by MOS
+; 17/10/2026:	Added mos_api_sopen, mos_api_swrite, mos_api_ssync and ffs_api_fexpand
+; 17/10/2026:	Added mos_api_dreadbatch
+; 17/10/2026:	Added mos_api_crc32
+; 17/10/2026:	Added mos_api_heapinit, mos_api_heapalloc, mos_api_heapfree, mos_api_heaprealloc, mos_api_heapstats
+; 17/10/2026:	Added mos_api_iraminfo
+; 17/10/2026:	Added mos_api_isrstats
+; 17/10/2026:	Added mos_api_vdpquery, mos_api_vdppoll
+; 17/10/2026:	Added mos_api_vdpstats
+; 17/10/2026:	Added mos_api_fsdefer
+; 17/10/2026:	Added mos_api_filestats
+; 17/10/2026:	mos_api_fopen and ffs_api_fopen take fa_buffered
+; 17/10/2026:	Added ffs_api_fopenat, ffs_api_statat, ffs_api_unlinkat, ffs_api_renameat
+; 17/10/2026:	Added mos_api_memcopy, mos_api_memfill, mos_api_memcompare
+; 17/10/2026:	Added mos_api_eventwait
+; 17/10/2026:	Added mos_api_sdstats
+; 17/10/2026:	ffs_api_fopen and ffs_api_fopenat ignore fa_buffered
+; 17/10/2026:	File system work queued by mos_fsdefer runs after each API call
+; 17/10/2026:	mos_api_dreadbatch converts the pattern pointer like the others, so only a 24-bit 0 means all entries
+; 17/10/2026:	mos_api_isrstats reports the windows opened by di_save as handler 3
 
+			INCLUDE	"iram.inc"
 
 			.ASSUME	ADL = 1
 			
@@ -47,6 +68,10 @@
 			XREF	_mos_DEL
 			XREF	_mos_REN_API
 			XREF	_mos_FOPEN
+			XREF	_mos_FFOPEN
+			XREF	_mos_FFOPENAT
+			XREF	_mos_FFCLOSE
+			XREF	_mos_FFRENAMEAT
 			XREF	_mos_FCLOSE
 			XREF	_mos_FGETC
 			XREF	_mos_FPUTC
@@ -65,6 +90,27 @@
 			XREF	_mos_I2C_CLOSE
 			XREF	_mos_I2C_WRITE
 			XREF	_mos_I2C_READ
+			XREF	_mos_GETCWD
+			XREF	_mos_SOPEN
+			XREF	_mos_SWRITE
+			XREF	_mos_SSYNC
+			XREF	_mos_DREADBATCH
+			XREF	_mos_CRC32_API
+			XREF	_mos_HEAPINIT
+			XREF	_mos_HEAPALLOC
+			XREF	_mos_HEAPFREE
+			XREF	_mos_HEAPREALLOC
+			XREF	_mos_HEAPSTATS
+			XREF	_mos_ISRSTATS		; In isr_stats.c
+			XREF	_mos_VDPQUERY		; In vdp_query.c
+			XREF	_mos_VDPPOLL
+			XREF	_mos_VDPSTATS
+			XREF	_mos_FILESTATS		; In file_stats.c
+			XREF	_event_wait		; In event.c
+			XREF	_mos_SDSTATS		; In diskio.c
+			XREF	_ff_defer		; In ffsystem.c
+			XREF	_ff_run_deferred
+			XREF	_ff_defer_count
 			
 			XREF	_fat_EOF		; In mos.c
 
@@ -83,9 +129,7 @@
 			XREF	_user_kbvector
 			XREF	_keymap
 
-			XREF	_f_open			; In ff.c
-			XREF	_f_close
-			XREF	_f_read 
+			XREF	_f_read			; In ff.c
 			XREF	_f_write
 			XREF	_f_stat 
 			XREF	_f_lseek
@@ -93,14 +137,19 @@
 			XREF	_f_opendir
 			XREF	_f_closedir
 			XREF	_f_readdir
-			XREF	_f_getcwd
+			XREF	_f_expand
+			XREF	_f_statat
+			XREF	_f_unlinkat
 			
 ; Call a MOS API function
 ; 00h - 7Fh: Reserved for high level MOS calls
 ; 80h - FFh: Reserved for low level calls to FatFS
 ;  A: function to call
 ;
-mos_api:		CP	80h			; Check if it is a FatFS command
+mos_api:		CALL	mos_api_call		; Make the call
+			JP	mos_api_deferred	; Then run any file system work queued meanwhile
+;
+mos_api_call:		CP	80h			; Check if it is a FatFS command
 			JR	NC, $F			; Yes, so jump to next block
 			CP	mos_api_block1_size	; Check if out of bounds
 			JP	NC, mos_api_not_implemented
@@ -141,30 +190,29 @@ mos_api_block1_start:	DW	mos_api_getkey		; 0x00
 			DW	mos_api_i2c_close	; 0x20
 			DW	mos_api_i2c_write	; 0x21
 			DW	mos_api_i2c_read	; 0x22
+			DW	mos_api_sopen		; 0x23
+			DW	mos_api_swrite		; 0x24
+			DW	mos_api_ssync		; 0x25
+			DW	mos_api_dreadbatch	; 0x26
+			DW	mos_api_crc32		; 0x27
+			DW	mos_api_heapinit	; 0x28
+			DW	mos_api_heapalloc	; 0x29
+			DW	mos_api_heapfree	; 0x2a
+			DW	mos_api_heaprealloc	; 0x2b
+			DW	mos_api_heapstats	; 0x2c
+			DW	mos_api_iraminfo	; 0x2d
+			DW	mos_api_isrstats	; 0x2e
+			DW	mos_api_vdpquery	; 0x2f
 
-			DW  mos_api_not_implemented ; 0x23
-			DW  mos_api_not_implemented ; 0x24
-			DW  mos_api_not_implemented ; 0x25
-			DW  mos_api_not_implemented ; 0x26
-			DW  mos_api_not_implemented ; 0x27
-			DW  mos_api_not_implemented ; 0x28
-			DW  mos_api_not_implemented ; 0x29
-			DW  mos_api_not_implemented ; 0x2a
-			DW  mos_api_not_implemented ; 0x2b
-			DW  mos_api_not_implemented ; 0x2c
-			DW  mos_api_not_implemented ; 0x2d
-			DW  mos_api_not_implemented ; 0x2e
-			DW  mos_api_not_implemented ; 0x2f
-
-			DW  mos_api_not_implemented ; 0x30
-			DW  mos_api_not_implemented ; 0x31
-			DW  mos_api_not_implemented ; 0x32
-			DW  mos_api_not_implemented ; 0x33
-			DW  mos_api_not_implemented ; 0x34
-			DW  mos_api_not_implemented ; 0x35
-			DW  mos_api_not_implemented ; 0x36
-			DW  mos_api_not_implemented ; 0x37
-			DW  mos_api_not_implemented ; 0x38
+			DW	mos_api_vdppoll		; 0x30
+			DW	mos_api_vdpstats	; 0x31
+			DW	mos_api_fsdefer		; 0x32
+			DW	mos_api_filestats	; 0x33
+			DW	mos_api_memcopy		; 0x34
+			DW	mos_api_memfill		; 0x35
+			DW	mos_api_memcompare	; 0x36
+			DW	mos_api_eventwait	; 0x37
+			DW	mos_api_sdstats		; 0x38
 			DW  mos_api_not_implemented ; 0x39
 			DW  mos_api_not_implemented ; 0x3a
 			DW  mos_api_not_implemented ; 0x3b
@@ -286,9 +334,37 @@ mos_api_block2_start:	DW	ffs_api_fopen		; 0x80
 			DW	ffs_api_getlabel	; 0xA3
 			DW	ffs_api_setlabel	; 0xA4
 			DW	ffs_api_setcp		; 0xA5
+			DW	ffs_api_fopenat		; 0xA6
+			DW	ffs_api_statat		; 0xA7
+			DW	ffs_api_unlinkat	; 0xA8
+			DW	ffs_api_renameat	; 0xA9
 
 mos_api_block2_size:	EQU 	($ - mos_api_block2_start) / 2
 
+; Run the file system work queued by interrupt handlers (mos_fsdefer), once an API call has returned
+; This is a point where MOS is not part way through a series of FatFS calls, unlike the end of each one
+; Preserves all registers and flags, so the call's results are passed back untouched
+;
+mos_api_deferred:	PUSH	AF
+			LD	A, (_ff_defer_count)
+			OR	A, A
+			JR	NZ, $F			; There is work queued
+			POP	AF
+			RET
+$$:			PUSH	BC
+			PUSH	DE
+			PUSH	HL
+			PUSH	IX
+			PUSH	IY
+			CALL	_ff_run_deferred
+			POP	IY
+			POP	IX
+			POP	HL
+			POP	DE
+			POP	BC
+			POP	AF
+			RET
+
 mos_api_not_implemented:
 			LD	HL, 23			; MOS_NOT_IMPLEMENTED
 			LD	A, 23			; MOS_NOT_IMPLEMENTED
@@ -533,7 +609,7 @@ mos_api_editline:	LD	A, MB		; Check if MBASE is 0
 
 ; Open a file
 ; HLU: Filename
-;   C: Mode
+;   C: Mode (add fa_buffered to give the file its own sector buffer)
 ; Returns:
 ;   A: Filehandle, or 0 if couldn't open
 ;
@@ -879,6 +955,637 @@ mos_api_i2c_read:	PUSH	DE
 			POP	DE
 			RET
 
+; Open a file for streaming writes into a preallocated contiguous extent
+; HLU: Filename
+; DEU: Number of bytes to preallocate
+; Returns:
+;   A: Filehandle, or 0 if couldn't open (or there was no contiguous space)
+;
+mos_api_sopen:		LD	A, MB		; Check if MBASE is 0
+			OR	A, A
+			CALL	NZ, SET_AHL24	; If it is running in classic Z80 mode, set U to MB
+			PUSH	DE		; UINT24 size
+			PUSH	HL		; char * filename
+			CALL	_mos_SOPEN
+			LD	A, L		; Return fh
+			POP	HL
+			POP	DE
+			RET
+
+; Append a block of data to a stream
+;   C: Filehandle returned by mos_api_sopen
+; HLU: Pointer to where the data is
+; DEU: Number of bytes to write
+; Returns:
+; DEU: Number of bytes written
+;
+mos_api_swrite:		LD	A, MB		; Check if MBASE is 0
+			OR	A, A
+			CALL	NZ, SET_AHL24
+			PUSH	DE		; UINT24 btw
+			PUSH	HL		; UINT24 buffer
+			PUSH	BC		; UINT8 fh
+			CALL	_mos_SWRITE
+			LD	(_scratchpad), HL 
+			POP	BC
+			POP	HL
+			POP	DE
+			LD	DE, (_scratchpad)
+			RET
+
+; Checkpoint a stream, committing the length written so far to the directory
+;   C: Filehandle returned by mos_api_sopen
+; Returns:
+;   A: FRESULT
+;
+mos_api_ssync:		PUSH	BC		; UINT8 fh
+			CALL	_mos_SSYNC
+			LD	A, L		; FRESULT
+			POP	BC
+			RET
+
+; Read a batch of directory entries
+; HLU: Pointer to a DIR struct opened with ffs_api_dopen
+; DEU: Pointer to a buffer to store the entries in
+; BCU: Size of the buffer
+; IXU: Pointer to a glob pattern, e.g. "*.bin", or 0 for all entries
+;      In Z80 mode this is converted to an address in segment MB like the other pointers, so MB:0000
+;      is a pattern there; Z80 mode callers pass "*" for all entries
+; IYL: Attribute mask
+; IYH: Attribute value; only entries where (attributes AND mask) = value are returned
+; Returns:
+;   A: FRESULT
+; BCU: Number of entries stored, or 0 if at the end of the directory
+; Each entry is packed as:
+;	+0: File size (32-bit, little endian)
+;	+4: Modified date (16-bit, FAT format)
+;	+6: Modified time (16-bit, FAT format)
+;	+8: Attributes
+;	+9: Length of the name, n
+;      +10: Name, n characters followed by a 0 terminator
+;
+mos_api_dreadbatch:	PUSH	IX		; Preserve IX
+			LD	(_scratchpad), IX
+			LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			CALL 	SET_ADE24	; Convert DE to an address in segment A (MB)
+			CALL	SET_AHL24	; Convert HL to an address in segment A (MB)
+			LD	(_scratchpad+2), A	; Convert the pattern to an address in segment A (MB)
+$$:			LD	IX, (_scratchpad)	; IX: char * pattern, checked against a 24-bit 0 by mos_DREADBATCH
+			PUSH	HL
+			LD	HL, _scratchpad
+			EX	(SP), HL	; UINT24 * count
+			PUSH	IY		; UINT24 attr
+			PUSH	IX		; char * pattern
+			PUSH	BC		; UINT24 size
+			PUSH	DE		; BYTE * buffer
+			PUSH	HL		; DIR * dp
+			CALL	_mos_DREADBATCH
+			LD	A, L		; FRESULT
+			POP	HL
+			POP	DE
+			POP	BC
+			POP	IX
+			POP	IY
+			POP	IX
+			POP	IX		; Restore IX
+			LD	BC, (_scratchpad)	; BCU: Number of entries
+			RET
+
+; Calculate the CRC32 of a block of memory
+; HLU: Pointer to the data
+; DEU: Number of bytes
+; IXU: Pointer to the CRC (32-bit, little endian), which is updated; set it to 0 to start a new CRC
+; Returns:
+;   A: FRESULT
+;
+mos_api_crc32:		PUSH	IX		; Preserve IX
+			LD	(_scratchpad), IX
+			LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			CALL	SET_AHL24	; Convert HL to an address in segment A (MB)
+			LD	(_scratchpad+2), A	; Convert the CRC pointer to an address in segment A (MB)
+$$:			LD	IX, (_scratchpad)	; IX: DWORD * crc
+			PUSH	DE		; UINT24 length
+			PUSH	HL		; BYTE * buffer
+			PUSH	IX		; DWORD * crc
+			CALL	_mos_CRC32_API
+			LD	A, L		; FRESULT
+			POP	IX
+			POP	HL
+			POP	DE
+			POP	IX		; Restore IX
+			RET
+
+; Create a heap in a region of RAM owned by the application
+; HLU: Start of the region
+; DEU: Size of the region in bytes (up to 256K is used)
+; Returns:
+; HLU: Heap handle, or 0 if the region is too small
+;
+mos_api_heapinit:	LD	A, MB		; Check if MBASE is 0
+			OR	A, A
+			CALL	NZ, SET_AHL24	; If it is running in classic Z80 mode, set U to MB
+			PUSH	DE		; UINT24 size
+			PUSH	HL		; void * ptr
+			CALL	_mos_HEAPINIT
+			POP	DE
+			POP	DE
+			RET
+
+; Allocate memory from a heap
+; HLU: Heap handle
+; DEU: Number of bytes
+; Returns:
+; HLU: Pointer to the memory, or 0 if there is not enough free
+;
+mos_api_heapalloc:	LD	A, MB		; Check if MBASE is 0
+			OR	A, A
+			CALL	NZ, SET_AHL24
+			PUSH	DE		; UINT24 size
+			PUSH	HL		; umm_heap * heap
+			CALL	_mos_HEAPALLOC
+			POP	DE
+			POP	DE
+			RET
+
+; Free memory allocated from a heap
+; HLU: Heap handle
+; DEU: Pointer to the memory
+;
+mos_api_heapfree:	LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			CALL 	SET_ADE24	; Convert DE to an address in segment A (MB)
+			CALL	SET_AHL24	; Convert HL to an address in segment A (MB)
+$$:			PUSH	DE		; void * ptr
+			PUSH	HL		; umm_heap * heap
+			CALL	_mos_HEAPFREE
+			POP	HL
+			POP	DE
+			RET
+
+; Resize memory allocated from a heap
+; HLU: Heap handle
+; DEU: Pointer to the memory, or 0 to allocate new memory
+; BCU: New size in bytes, or 0 to free the memory
+; Returns:
+; HLU: Pointer to the memory, or 0 if it could not be resized (the original is left as it was)
+;
+mos_api_heaprealloc:	LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			CALL	SET_AHL24	; Convert HL to an address in segment A (MB)
+			LD	A, D		; A 16-bit null pointer stays null
+			OR	A, E
+			LD	A, MB
+			CALL	NZ, SET_ADE24	; Convert DE to an address in segment A (MB)
+$$:			PUSH	BC		; UINT24 size
+			PUSH	DE		; void * ptr
+			PUSH	HL		; umm_heap * heap
+			CALL	_mos_HEAPREALLOC
+			POP	DE
+			POP	DE
+			POP	BC
+			RET
+
+; Get the usage of a heap
+; HLU: Heap handle, or 0 for the MOS heap
+; DEU: Pointer to a buffer to store the stats in
+; Returns:
+;   A: FRESULT
+; The buffer is filled with six 24-bit values:
+;	+0: Size of the heap in bytes
+;	+3: Bytes allocated, including block headers
+;	+6: Bytes free
+;	+9: Largest allocation that would succeed
+;      +12: Number of allocated blocks
+;      +15: Number of free blocks
+;
+mos_api_heapstats:	LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			CALL 	SET_ADE24	; Convert DE to an address in segment A (MB)
+			LD	A, H		; A 16-bit handle of 0 still means the MOS heap
+			OR	A, L
+			LD	A, MB
+			CALL	NZ, SET_AHL24	; Convert HL to an address in segment A (MB)
+$$:			PUSH	DE		; umm_stats * stats
+			PUSH	HL		; umm_heap * heap
+			CALL	_mos_HEAPSTATS
+			LD	A, L		; FRESULT
+			POP	HL
+			POP	DE
+			RET
+
+; Get the part of the internal SRAM left for applications (USER:HI)
+; This is zero wait state RAM; MOS keeps the area above it for its own routines
+; Returns:
+;   A: FR_OK
+; HLU: Start address
+; DEU: Length in bytes
+;
+mos_api_iraminfo:	LD	HL, IRAM_START
+			LD	DE, IRAM_MOS - IRAM_START
+			XOR	A, A
+			RET
+
+; Get the time spent in a MOS interrupt handler
+; This is only counted while timing is on (*ISRSTAT ON)
+;   C: Handler (0: VBLANK, 1: UART0, 2: I2C, 3: the windows MOS runs with interrupts disabled outside a handler)
+; HLU: Pointer to a buffer to store the statistics in
+; Returns:
+;   A: FRESULT
+; The buffer is filled with:
+;	+0: Number of times the handler has run (24-bit)
+;	+3: Total time in the handler in microseconds (32-bit)
+;	+7: Longest time in the handler in microseconds (24-bit); interrupts are off for all of it
+;
+mos_api_isrstats:	LD	A, MB		; Check if MBASE is 0
+			OR	A, A
+			CALL	NZ, SET_AHL24	; Convert HL to an address in segment A (MB)
+			PUSH	HL		; t_isrInfo * info
+			PUSH	BC		; BYTE vector
+			CALL	_mos_ISRSTATS
+			LD	A, L		; FRESULT
+			POP	BC
+			POP	HL
+			RET
+
+; Send a query to the VDP without waiting for the reply
+; Up to 8 queries can be in flight; the VDP replies to them in order
+;   C: Reply packet expected (2: cursor, 3: screen char, 4: pixel or palette, 5: audio, 6: mode, 7: RTC)
+;   B: Length of the request
+; HLU: Pointer to the request, the VDU bytes starting with 23
+; DEU: Pointer to a callback (24-bit, so 0 when called in Z80 mode), or 0 to collect the reply with mos_vdppoll
+;      The callback is called in ADL mode from the UART0 interrupt as the C function
+;      void callback(BYTE id, BYTE * reply); it must preserve IX and IY, and be short
+; Returns:
+;   A: Query id, or 0 if too many queries are in flight
+;
+mos_api_vdpquery:	LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			CALL	NZ, SET_AHL24	; Convert HL to an address in segment A (MB)
+			PUSH	BC
+			PUSH	DE		; t_vdpQueryCallback callback
+			LD	DE, 0
+			LD	E, B
+			PUSH	DE		; BYTE length
+			PUSH	HL		; BYTE * request
+			LD	E, C
+			PUSH	DE		; BYTE packet
+			CALL	_mos_VDPQUERY
+			LD	A, L		; Query id
+			POP	DE
+			POP	HL
+			POP	DE
+			POP	DE
+			POP	BC
+			RET
+
+; Check whether the reply to a VDP query has arrived
+;   C: Query id
+; HLU: Pointer to an 8 byte buffer for the reply, or 0
+; Returns:
+;   A: 0: Unknown query (already collected, or timed out), 1: Waiting, 2: Reply copied to the buffer
+;
+mos_api_vdppoll:	LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			LD	A, H		; A 16-bit null pointer stays null
+			OR	A, L
+			LD	A, MB
+			CALL	NZ, SET_AHL24	; Convert HL to an address in segment A (MB)
+$$:			PUSH	HL		; BYTE * data
+			PUSH	BC		; BYTE id
+			CALL	_mos_VDPPOLL
+			LD	A, L		; State
+			POP	BC
+			POP	HL
+			RET
+
+; Get the round trip statistics for VDP queries
+; These are only kept while timing is on (*VDPSTAT ON)
+;   C: Reply packet (as for mos_vdpquery)
+; HLU: Pointer to a buffer to store the statistics in
+; Returns:
+;   A: FRESULT
+; The buffer is filled with:
+;	+0: Number of replies (24-bit)
+;	+3: Number of queries that timed out (24-bit)
+;	+6: Total round trip time in microseconds (32-bit)
+;      +10: Longest round trip in microseconds (32-bit)
+;
+mos_api_vdpstats:	LD	A, MB		; Check if MBASE is 0
+			OR	A, A
+			CALL	NZ, SET_AHL24	; Convert HL to an address in segment A (MB)
+			PUSH	HL		; t_vdpInfo * info
+			PUSH	BC		; BYTE packet
+			CALL	_mos_VDPSTATS
+			LD	A, L		; FRESULT
+			POP	BC
+			POP	HL
+			RET
+
+; Queue file system work to run in the foreground when the volume is free
+; This can be called from an interrupt handler, where the FatFS functions cannot be used safely
+; The work is run after the next MOS API call returns, after the current MOS command, or while the
+; line editor waits for a key; never in the middle of a FatFS call
+; HLU: Pointer to the routine (24-bit, so 0 when called in Z80 mode)
+; DEU: Argument passed to the routine
+;      The routine is called in ADL mode as the C function void routine(void * arg); it must
+;      preserve IX and IY. It can use any of the file system functions
+; Returns:
+;   A: 1 if queued, 0 if the routine is 0 or the queue is full
+;
+mos_api_fsdefer:	PUSH	DE
+			PUSH	HL
+			XOR	A, A		; A: 0, and carry clear
+			LD	DE, 0
+			SBC	HL, DE
+			JR	Z, $F		; The routine is 0
+			POP	HL
+			POP	DE
+			PUSH	DE
+			PUSH	HL
+			PUSH	DE		; void * arg
+			PUSH	HL		; void (*func)(void *)
+			CALL	_ff_defer
+			LD	A, L		; 1 if queued
+			POP	HL
+			POP	DE
+$$:			POP	HL
+			POP	DE
+			RET
+
+; Get the statistics for an open file handle
+; The counts are always kept; the time only while timing is on (*FILES ON)
+;   C: File handle
+; HLU: Pointer to a buffer to store the statistics in
+; Returns:
+;   A: FRESULT (FR_INVALID_OBJECT if the handle is not open)
+; The buffer is filled with:
+;	+0: Bytes read (32-bit)
+;	+4: Bytes written (32-bit)
+;	+8: Number of read calls (24-bit)
+;      +11: Number of write calls (24-bit)
+;      +14: Number of seeks (24-bit)
+;      +17: Number of times the calls had to read from the card (24-bit)
+;      +20: Time spent in the calls in microseconds (32-bit)
+;      +24: The path the file was opened with, or its last 31 characters (zero terminated, 32 bytes)
+;
+mos_api_filestats:	LD	A, MB		; Check if MBASE is 0
+			OR	A, A
+			CALL	NZ, SET_AHL24	; Convert HL to an address in segment A (MB)
+			PUSH	HL		; t_fileInfo * info
+			PUSH	BC		; UINT8 fh
+			CALL	_mos_FILESTATS
+			LD	A, L		; FRESULT
+			POP	BC
+			POP	HL
+			RET
+
+; Copy a block of memory anywhere in the 24-bit address space
+; This lets a Z80 mode application use memory outside its own segment; blocks that overlap are copied correctly
+; HLU: Pointer to a parameter block
+;   C: Flags (mem_src_segment, mem_dst_segment); in Z80 mode these put an address in the caller's segment
+; The parameter block is:
+;	+0: Source address (24-bit)
+;	+3: Destination address (24-bit)
+;	+6: Number of bytes (24-bit)
+; Returns:
+;   A: FR_OK, or FR_INVALID_PARAMETER if a block runs past the end of the address space
+;
+mos_api_memcopy:	PUSH	BC
+			PUSH	DE
+			PUSH	HL
+			PUSH	IX
+			CALL	mos_api_memblock	; HL: source, DE: destination, BC: length, IX: parameter block
+			OR	A, A
+			JR	NZ, mos_api_mem_exit
+			PUSH	HL
+			ADD	HL, BC			; Does the source run past the end of memory?
+			POP	HL
+			JR	C, mos_api_mem_bad
+			LD	A, (IX+6)
+			OR	A, (IX+7)
+			OR	A, (IX+8)
+			JR	Z, mos_api_mem_ok	; Nothing to copy
+			PUSH	DE
+			EX	DE, HL			; HL: destination, DE: source
+			OR	A, A
+			SBC	HL, DE			; HL: destination - source
+			JR	C, $F			; The destination is below the source, so copy upwards
+			SBC	HL, BC			; Does the destination start inside the source?
+			JR	NC, $F			; No, so copy upwards
+			EX	DE, HL			; HL: source
+			POP	DE			; DE: destination
+			ADD	HL, BC
+			DEC	HL			; HL: last byte of the source
+			EX	DE, HL
+			ADD	HL, BC
+			DEC	HL			; HL: last byte of the destination
+			EX	DE, HL
+			LDDR				; Copy downwards so the end of the source is read before it is overwritten
+			JR	mos_api_mem_ok
+$$:			EX	DE, HL			; HL: source
+			POP	DE			; DE: destination
+			LDIR
+mos_api_mem_ok:		XOR	A, A			; FR_OK
+mos_api_mem_exit:	POP	IX
+			POP	HL
+			POP	DE
+			POP	BC
+			RET
+mos_api_mem_bad:	LD	A, 19			; FR_INVALID_PARAMETER
+			JR	mos_api_mem_exit
+
+; Fill a block of memory anywhere in the 24-bit address space
+; HLU: Pointer to a parameter block
+;   C: Flags (mem_dst_segment)
+; The parameter block is:
+;	+0: Value to fill with (8-bit)
+;	+3: Destination address (24-bit)
+;	+6: Number of bytes (24-bit)
+; Returns:
+;   A: FR_OK, or FR_INVALID_PARAMETER if the block runs past the end of the address space
+;
+mos_api_memfill:	PUSH	BC
+			PUSH	DE
+			PUSH	HL
+			PUSH	IX
+			CALL	mos_api_memblock	; DE: destination, BC: length, IX: parameter block
+			OR	A, A
+			JR	NZ, mos_api_mem_exit
+			LD	A, (IX+6)
+			OR	A, (IX+7)
+			OR	A, (IX+8)
+			JR	Z, mos_api_mem_ok	; Nothing to fill
+			LD	A, (IX+0)
+			LD	(DE), A			; Write the first byte
+			DEC	BC
+			LD	HL, 0
+			OR	A, A
+			SBC	HL, BC			; Was that the only one?
+			JR	Z, mos_api_mem_ok
+			PUSH	DE
+			POP	HL			; HL: first byte
+			INC	DE			; DE: second byte
+			LDIR				; Each byte copies the one before it
+			JR	mos_api_mem_ok
+
+; Compare two blocks of memory anywhere in the 24-bit address space
+; HLU: Pointer to a parameter block
+;   C: Flags (mem_src_segment, mem_dst_segment)
+; The parameter block is:
+;	+0: Address of the first block (24-bit)
+;	+3: Address of the second block (24-bit)
+;	+6: Number of bytes (24-bit)
+;	+9: Filled in with the offset of the first byte that differs, or the number of bytes if they are the same (24-bit)
+; Returns:
+;   A: 0 if the blocks are the same, 1 if they differ, or FR_INVALID_PARAMETER if a block runs past the end of the address space
+;
+mos_api_memcompare:	PUSH	BC
+			PUSH	DE
+			PUSH	HL
+			PUSH	IX
+			CALL	mos_api_memblock	; HL: first block, DE: second block, BC: length, IX: parameter block
+			OR	A, A
+			JP	NZ, mos_api_mem_exit
+			PUSH	HL
+			ADD	HL, BC			; Does the first block run past the end of memory?
+			POP	HL
+			JP	C, mos_api_mem_bad
+			LD	A, (IX+6)
+			OR	A, (IX+7)
+			OR	A, (IX+8)
+			JR	Z, mos_api_memsame	; Nothing to compare
+$$:			LD	A, (DE)
+			CPI				; Compare with the first block; HL + 1, BC - 1, P/V is clear when BC is 0
+			JR	NZ, mos_api_memdiffer	; They differ
+			INC	DE
+			JP	PE, $B
+mos_api_memsame:	LD	HL, (IX+6)		; They are the same, so store the length
+			LD	(IX+9), HL
+			JP	mos_api_mem_ok
+mos_api_memdiffer:	LD	HL, (IX+6)		; HL: length
+			SCF
+			SBC	HL, BC			; HL: offset of the byte that differs
+			LD	(IX+9), HL
+			LD	A, 1
+			JP	mos_api_mem_exit
+
+; Fetch the addresses and length from the parameter block of mos_api_memcopy, mos_api_memfill and mos_api_memcompare
+; HLU: Pointer to the parameter block
+;   C: Flags
+; Returns:
+;   A: FR_OK, or FR_INVALID_PARAMETER if the destination runs past the end of the address space
+; HLU: Source address
+; DEU: Destination address
+; BCU: Length
+; IXU: Pointer to the parameter block
+;
+mos_api_memblock:	LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			CALL	SET_AHL24	; Convert HL to an address in segment A (MB)
+$$:			PUSH	HL
+			POP	IX		; IX: parameter block
+			LD	HL, (IX+0)	; HL: source
+			LD	DE, (IX+3)	; DE: destination
+			OR	A, A 		; In 24-bit mode the flags are not used
+			JR	Z, $F
+			BIT	0, C		; mem_src_segment
+			CALL	NZ, SET_AHL24	; Convert HL to an address in segment A (MB)
+			BIT	1, C		; mem_dst_segment
+			CALL	NZ, SET_ADE24	; Convert DE to an address in segment A (MB)
+$$:			LD	BC, (IX+6)	; BC: length
+			EX	DE, HL
+			PUSH	HL
+			ADD	HL, BC		; Does the destination run past the end of memory?
+			POP	HL
+			EX	DE, HL
+			LD	A, 19		; FR_INVALID_PARAMETER
+			RET	C
+			XOR	A, A		; FR_OK
+			RET
+
+; Wait for any of a set of events, posted by the interrupt handlers
+;   C: Events to wait for (event_key, event_mouse, event_vdp, event_vblank, event_uart1, event_i2c)
+;   B: Flags: event_halt to HALT until the next interrupt while there is nothing to return
+;  DE: Timeout in centiseconds (16-bit); 0 to check without waiting, FFFFh to wait forever
+; HLU: Pointer to an 8 byte buffer for the payloads, or 0
+; Returns:
+;   A: The events that fired, which are cleared, or 0 if it timed out
+; The buffer is filled with a payload byte for each event, at the offset of its bit (0 if it did not fire):
+;	+0: event_key: Virtual key code
+;	+1: event_mouse: Button state
+;	+2: event_vdp: The packet number
+;	+3: event_vblank: Number of VBLANKs, modulo 256
+;	+5: event_i2c: I2C result (0 if it succeeded)
+;
+mos_api_eventwait:	LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			LD	A, H		; A 16-bit null pointer stays null
+			OR	A, L
+			LD	A, MB
+			CALL	NZ, SET_AHL24	; Convert HL to an address in segment A (MB)
+$$:			PUSH	BC
+			PUSH	HL		; BYTE * data
+			LD	A, C		; A: Mask
+			LD	C, B
+			PUSH	BC		; BYTE flags
+			PUSH	DE		; unsigned short timeout
+			LD	C, A
+			PUSH	BC		; BYTE mask
+			CALL	_event_wait
+			LD	A, L		; Events that fired
+			POP	BC
+			POP	DE
+			POP	BC
+			POP	HL
+			POP	BC
+			RET
+
+; Get the SD card driver statistics
+; The counts are always kept; the times and histograms only while timing is on (*SDSTAT ON)
+; HLU: Pointer to a 110 byte buffer to store the statistics in
+; Returns:
+;   A: FRESULT
+; The buffer is filled with (counts 24-bit, times in microseconds 32-bit):
+;	+0: Writes left programming while MOS carried on
+;	+3: Of those, the ones that finished before the next command
+;	+6: The ones the next command had to wait for
+;	+9: The ones that never finished
+;      +12: Upper bound on the time the card spent programming them while MOS did other work
+;	   (the gap before the next command, capped at 250ms each)
+;      +16: Time spent waiting for them
+;      +20: Commands sent
+;      +23: Commands the card never answered
+;      +26: Reads with no data token, or written blocks with no data response
+;      +29: Times the card stayed busy
+;      +32: Time spent waiting for data tokens and responses
+;      +36: Time spent waiting for the card to finish programming
+;      +40: Reads, then +75: Writes, each:
+;		+0: Calls (24-bit)
+;		+3: Blocks moved by the calls that succeeded (32-bit)
+;		+7: Calls that failed after the retries (24-bit)
+;	       +10: Retries (24-bit)
+;	       +13: Time spent in the calls (32-bit)
+;	       +17: Calls taking under 1, 4, 16, 64 and 256ms, and longer (6 x 24-bit)
+;
+mos_api_sdstats:	LD	A, MB		; Check if MBASE is 0
+			OR	A, A
+			CALL	NZ, SET_AHL24	; Convert HL to an address in segment A (MB)
+			PUSH	HL		; t_sdInfo * info
+			CALL	_mos_SDSTATS
+			LD	A, L		; FRESULT
+			POP	HL
+			RET
+
 ; Open UART1
 ; IXU: Pointer to UART struct
 ;	+0: Baud rate (24-bit, little endian)
@@ -993,7 +1700,7 @@ mos_api_flseek:		PUSH 	DE		; UINT32 offset (msb)
 ; Open a file
 ; HLU: Pointer to a blank FIL struct
 ; DEU: Pointer to the filename (0 terminated)
-;   C: File mode
+;   C: File mode (fa_buffered is ignored here; only mos_fopen file handles get a sector buffer)
 ; Returns:
 ;   A: FRESULT
 ;
@@ -1009,7 +1716,7 @@ ffs_api_fopen:		LD	A, MB		; A: MB
 $$:			PUSH	BC		; BYTE mode
 			PUSH	DE		; const TCHAR * path
 			PUSH	HL		; FIL * fp
-			CALL	_f_open 
+			CALL	_mos_FFOPEN
 			LD	A, L 		; FRESULT
 			POP	HL 		
 			POP	DE
@@ -1030,7 +1737,7 @@ ffs_api_fclose:		LD	A, MB
 			CALL	Z, SET_AHL24
 ;
 $$:			PUSH	HL		; FIL * fp
-			CALL	_f_close 
+			CALL	_mos_FFCLOSE
 			LD	A, L		; FRESULT
 			POP	HL 
 			RET
@@ -1186,6 +1893,38 @@ $$:			PUSH	HL		; FIL * fp
 			POP	HL		
 			RET 
 
+; Allocate a contiguous block to a file
+; HLU: Pointer to a FIL struct
+; DEU: Least significant 3 bytes of the size to allocate (DWORD)
+;   C: Most significant byte of the size
+;   B: Mode (0: find and prepare, 1: find and allocate)
+; Returns:
+;   A: FRESULT
+;
+ffs_api_fexpand:	LD	A, MB
+			OR	A, A 
+			JR	Z, $F
+			CALL	GET_AHL24
+			OR 	A, A 
+			LD	A, MB
+			CALL	Z, SET_AHL24
+;
+$$:			PUSH	HL
+			LD	HL, 0
+			LD	L, B
+			EX	(SP), HL	; BYTE opt
+			PUSH	BC 		; FSIZE_t fsz (msb)
+			PUSH	DE		; FSIZE_t fsz (lsw)
+			PUSH	HL		; FIL * fp
+			CALL	_f_expand 
+			LD	A, L
+			POP	HL		
+			POP	DE
+			POP	BC
+			EX	(SP), HL	; Discard opt
+			POP	HL
+			RET 
+
 ;		
 ; Commands that have not been implemented yet
 ;
@@ -1193,8 +1932,6 @@ ffs_api_fsync:
 			JP mos_api_not_implemented
 ffs_api_fforward:	
 			JP mos_api_not_implemented
-ffs_api_fexpand:	
-			JP mos_api_not_implemented
 ffs_api_fgets:		
 			JP mos_api_not_implemented
 ffs_api_fputc:		
@@ -1282,6 +2019,7 @@ ffs_api_chdir:
 ffs_api_chdrive:	
 			JP mos_api_not_implemented
 ; Copy the current directory (string) into buffer (hl)
+; This is served from the copy maintained by MOS, so does not access the disk
 ; HLU: Pointer to a buffer
 ; BCU: Maximum length of buffer
 ; Returns:
@@ -1293,7 +2031,7 @@ ffs_api_getcwd:		LD	A, MB		; A: MB
 $$:
 			PUSH	BC 		; sizeof(buffer)
 			PUSH    HL		; buffer
-			CALL	_f_getcwd
+			CALL	_mos_GETCWD
 			LD	A, L		; FRESULT
 			POP	HL
 			POP	BC
@@ -1313,3 +2051,134 @@ ffs_api_setlabel:
 			JP mos_api_not_implemented
 ffs_api_setcp:		
 			JP mos_api_not_implemented
+
+; Open a file relative to an open directory
+; HLU: Pointer to a blank FIL struct
+; DEU: Pointer to the filename (0 terminated)
+; IXU: Pointer to an open DIR struct, or 0 for the current directory
+;   C: File mode (fa_buffered is ignored here; only mos_fopen file handles get a sector buffer)
+; Returns:
+;   A: FRESULT
+;
+ffs_api_fopenat:	LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			CALL	SET_AIX24	; Convert IX to an address in segment A (MB)
+			CALL 	SET_ADE24	; Convert DE to an address in segment A (MB)
+			CALL	GET_AHL24	; Get MSB of HL
+			OR	A, A 		; Does it already contain a value? (fetched using mos_api_getfil?)
+			LD	A, MB		; A: MB
+			CALL	Z, SET_AHL24	; No it's zero, so convert HL to an address in segment A (MB)
+;
+$$:			PUSH	BC		; BYTE mode
+			PUSH	DE		; const TCHAR * path
+			PUSH	IX		; DIR * dp
+			PUSH	HL		; FIL * fp
+			CALL	_mos_FFOPENAT
+			LD	A, L 		; FRESULT
+			POP	HL
+			POP	IX
+			POP	DE
+			POP	BC
+			RET
+
+; Check file exists relative to an open directory
+; HLU: Pointer to a FILINFO struct
+; DEU: Pointer to the filename (0 terminated)
+; IXU: Pointer to an open DIR struct, or 0 for the current directory
+; Returns:
+;   A: FRESULT
+;
+ffs_api_statat:		LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			CALL	SET_AIX24	; Convert IX to an address in segment A (MB)
+			CALL 	SET_ADE24	; Convert DE to an address in segment A (MB)
+			CALL	SET_AHL24	; Convert HL to an address in segment A (MB)
+;
+$$:			PUSH	HL		; FILINFO * fno
+			PUSH	DE		; const TCHAR * path
+			PUSH	IX		; const DIR * dp
+			CALL	_f_statat
+			LD	A, L 		; FRESULT
+			POP	IX
+			POP	DE
+			POP	HL
+			RET
+
+; Delete a file or empty folder relative to an open directory
+; HLU: Pointer to the filename (0 terminated)
+; IXU: Pointer to an open DIR struct, or 0 for the current directory
+; Returns:
+;   A: FRESULT
+;
+ffs_api_unlinkat:	LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			CALL	SET_AIX24	; Convert IX to an address in segment A (MB)
+			CALL	SET_AHL24	; Convert HL to an address in segment A (MB)
+;
+$$:			PUSH	HL		; const TCHAR * path
+			PUSH	IX		; const DIR * dp
+			CALL	_f_unlinkat
+			LD	A, L 		; FRESULT
+			POP	IX
+			POP	HL
+			RET
+
+; Rename or move a file or folder between two open directories
+; HLU: Pointer to the old name (0 terminated)
+; DEU: Pointer to the new name (0 terminated)
+; IXU: Pointer to the open DIR struct the old name is in, or 0 for the current directory
+; IYU: Pointer to the open DIR struct the new name goes in, or 0 for the current directory
+; Returns:
+;   A: FRESULT
+;
+ffs_api_renameat:	LD	A, MB		; A: MB
+			OR	A, A 		; Check whether MB is 0, i.e. in 24-bit mode
+			JR	Z, $F		; It is, so skip as all addresses can be assumed to be 24-bit
+			CALL	SET_AIX24	; Convert IX to an address in segment A (MB)
+			PUSH	IX
+			PUSH	IY
+			POP	IX
+			CALL	SET_AIX24	; Convert IY to an address in segment A (MB)
+			PUSH	IX
+			POP	IY
+			POP	IX
+			CALL 	SET_ADE24	; Convert DE to an address in segment A (MB)
+			CALL	SET_AHL24	; Convert HL to an address in segment A (MB)
+;
+$$:			PUSH	DE		; const TCHAR * path_new
+			PUSH	IY		; const DIR * dp_new
+			PUSH	HL		; const TCHAR * path_old
+			PUSH	IX		; const DIR * dp_old
+			CALL	_mos_FFRENAMEAT		; Also drops the cached cwd
+			LD	A, L 		; FRESULT
+			POP	IX
+			POP	HL
+			POP	IY
+			POP	DE
+			RET
+
+; Convert a DIR pointer in IX to an address in segment A (MB)
+; A pointer of 0 is left as 0, as that stands for the current directory
+;   A: Segment
+; Returns:
+; IXU: Segment, or 0
+;
+SET_AIX24:		PUSH	DE
+			PUSH	HL
+			PUSH	IX
+			POP	HL		; HL: IX
+			LD	E, A		; E: Segment
+			LD	A, H
+			OR	A, L
+			JR	Z, $F		; It is 0, so leave it as 0 (A: 0)
+			LD	A, E
+$$:			CALL	SET_AHL24	; HLU: A
+			PUSH	HL
+			POP	IX
+			LD	A, E		; A: Segment
+			POP	HL
+			POP	DE
+			RET
@@ -0,0 +1,268 @@
+/*
+ * Title:			AGON MOS - File checksums
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ */
+
+#include <eZ80.h>
+#include <defines.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "defines.h"
+#include "config.h"
+#include "mos.h"
+#include "mos_checksum.h"
+#include "ff.h"
+#include "umm_malloc.h"
+
+extern volatile BYTE keyascii;					// In globals.asm
+extern volatile DWORD clock;					// In globals.asm
+
+// Calculate the CRC32 of a block of memory
+// The CRC can be carried from one block to the next, starting with 0
+// Parameters:
+// - crc: CRC of the data so far, or 0 to start
+// - buffer: Address of the data
+// - length: Number of bytes
+// Returns:
+// - The updated CRC
+//
+DWORD mos_CRC32(DWORD crc, BYTE * buffer, UINT24 length) {
+	UINT24	n;
+
+	crc = ~crc;
+	while (length > 0) {
+		n = length > 0x8000 ? 0x8000 : length;	// crc32_block counts to 65535 at most
+		crc = crc32_block(crc, buffer, n);
+		buffer += n;
+		length -= n;
+	}
+	return ~crc;
+}
+
+// Calculate the CRC32 of a block of memory, for the MOS API
+// Parameters:
+// - crc: Pointer to the CRC so far, which is updated; set it to 0 to start
+// - buffer: Address of the data
+// - length: Number of bytes
+// Returns:
+// - FR_OK
+//
+UINT24 mos_CRC32_API(DWORD * crc, BYTE * buffer, UINT24 length) {
+	*crc = mos_CRC32(*crc, buffer, length);
+	return FR_OK;
+}
+
+// Calculate the CRC32 of a file
+// Parameters:
+// - filename: Path of the file
+// - crc: Pointer to store the CRC in
+// - size: Pointer to store the number of bytes read in (may be NULL)
+// Returns:
+// - FatFS or MOS return code
+//
+UINT24 mos_fileCRC32(char * filename, DWORD * crc, DWORD * size) {
+	return mos_fileCRC32at(NULL, filename, crc, size);
+}
+
+// Calculate the CRC32 of a file relative to an open directory
+// The file is read CHECKSUM_bufferSize bytes at a time, so FatFS can read whole runs of sectors
+// straight into the buffer
+// Parameters:
+// - dp: The open directory a relative filename is looked up in, or NULL for the current directory
+// - filename: Path of the file
+// - crc: Pointer to store the CRC in
+// - size: Pointer to store the number of bytes read in (may be NULL)
+// Returns:
+// - FatFS or MOS return code
+//
+UINT24 mos_fileCRC32at(DIR * dp, char * filename, DWORD * crc, DWORD * size) {
+	FRESULT	fr;
+	FIL		fil;
+	BYTE *	buffer;
+	UINT	br;
+	DWORD	total = 0;
+
+	*crc = 0;
+	buffer = umm_malloc(CHECKSUM_bufferSize);
+	if (!buffer) {
+		return MOS_OUT_OF_MEMORY;
+	}
+	fr = f_openat(&fil, dp, filename, FA_READ);
+	if (fr == FR_OK) {
+		while (1) {
+			fr = f_read(&fil, buffer, CHECKSUM_bufferSize, &br);
+			if (fr != FR_OK || br == 0) break;
+			*crc = mos_CRC32(*crc, buffer, br);
+			total += br;
+		}
+		f_close(&fil);
+	}
+	umm_free(buffer);
+	if (size) {
+		*size = total;
+	}
+	return fr;
+}
+
+// Check a file against a CRC32
+// Parameters:
+// - filename: Path of the file
+// - crc: The expected CRC
+// Returns:
+// - FatFS or MOS return code; MOS_CHECKSUM_MISMATCH if the CRC is different
+//
+UINT24 mos_VERIFY(char * filename, DWORD crc) {
+	return mos_VERIFYAT(NULL, filename, crc);
+}
+
+// Check a file relative to an open directory against a CRC32
+// Parameters:
+// - dp: The open directory a relative filename is looked up in, or NULL for the current directory
+// - filename: Path of the file
+// - crc: The expected CRC
+// Returns:
+// - FatFS or MOS return code; MOS_CHECKSUM_MISMATCH if the CRC is different
+//
+UINT24 mos_VERIFYAT(DIR * dp, char * filename, DWORD crc) {
+	UINT24	fr;
+	DWORD	actual;
+
+	fr = mos_fileCRC32at(dp, filename, &actual, NULL);
+	if (fr == FR_OK && actual != crc) {
+		fr = MOS_CHECKSUM_MISMATCH;
+	}
+	return fr;
+}
+
+// Print the CRC32 of a file
+// The output is a line of an SFV manifest, so can be checked with mos_CHECKMANIFEST
+// Parameters:
+// - filename: Path of the file
+// Returns:
+// - FatFS or MOS return code
+//
+UINT24 mos_CHECKSUM(char * filename) {
+	UINT24	fr;
+	DWORD	crc;
+
+	fr = mos_fileCRC32(filename, &crc, NULL);
+	if (fr == FR_OK) {
+		printf("%s %08lX\r\n", filename, crc);
+	}
+	return fr;
+}
+
+// Check the files listed in an SFV manifest
+// Each line is a filename followed by a space and its CRC32 in hexadecimal; lines starting with ';' are comments.
+// Relative filenames are relative to the folder the manifest is in
+// Parameters:
+// - filename: Path of the manifest
+// Returns:
+// - FatFS or MOS return code; MOS_CHECKSUM_MISMATCH if any file is missing or has changed
+//
+UINT24 mos_CHECKMANIFEST(char * filename) {
+	UINT24	fr;
+	FIL		fil;
+	char *	line;
+	char *	path;
+	char *	name;
+	char *	p;
+	char *	end;
+	UINT24	dirLength;
+	UINT24	checked = 0;
+	UINT24	failed = 0;
+	DWORD	expected, crc, size;
+	DWORD	bytes = 0;
+	DWORD	start = clock;
+	UINT24	result;
+
+	line = umm_malloc(CHECKSUM_lineLength);
+	path = umm_malloc(CHECKSUM_lineLength);
+	if (!line || !path) {
+		fr = MOS_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+	p = strrchr(filename, '/');
+	dirLength = p ? p - filename + 1 : 0;	// Length of the manifest's folder, including the separator
+	if (dirLength >= CHECKSUM_lineLength) {
+		fr = FR_INVALID_NAME;
+		goto cleanup;
+	}
+	memcpy(path, filename, dirLength);
+
+	fr = f_open(&fil, filename, FA_READ);
+	if (fr != FR_OK) {
+		goto cleanup;
+	}
+	keyascii = 0;
+	while (fr == FR_OK && keyascii != 27 && f_gets(line, CHECKSUM_lineLength, &fil)) {
+		p = line + strlen(line);
+		while (p > line && isspace(p[-1])) {
+			*--p = 0;
+		}
+		if (line[0] == 0 || line[0] == ';') {
+			continue;
+		}
+		p = strrchr(line, ' ');
+		if (p == NULL || strlen(p + 1) != 8) {
+			printf("Bad line: %s\r\n", line);
+			failed++;
+			continue;
+		}
+		*p = 0;
+		expected = strtoul(p + 1, &end, 16);
+		while (p > line && p[-1] == ' ') {
+			*--p = 0;
+		}
+		if (*end != 0 || line[0] == 0) {
+			printf("Bad line: %s\r\n", line);
+			failed++;
+			continue;
+		}
+		if (line[0] == '/' || dirLength + strlen(line) >= CHECKSUM_lineLength) {
+			name = line;
+		}
+		else {
+			strcpy(path + dirLength, line);
+			name = path;
+		}
+		result = mos_fileCRC32(name, &crc, &size);
+		checked++;
+		if (result == FR_NO_FILE || result == FR_NO_PATH) {
+			printf("%s: missing\r\n", name);
+			failed++;
+		}
+		else if (result != FR_OK) {
+			fr = result;
+		}
+		else if (crc != expected) {
+			printf("%s: FAILED (%08lX)\r\n", name, crc);
+			failed++;
+		}
+		else {
+			printf("%s: OK\r\n", name);
+			bytes += size;
+		}
+	}
+	f_close(&fil);
+
+	if (fr == FR_OK) {
+		start = clock - start;
+		printf("%u checked, %u failed; %lu bytes in %lu.%02lus\r\n", checked, failed, bytes, start / 100, start % 100);
+		if (failed > 0) {
+			fr = MOS_CHECKSUM_MISMATCH;
+		}
+	}
+
+cleanup:
+	if (line) umm_free(line);
+	if (path) umm_free(path);
+	return fr;
+}
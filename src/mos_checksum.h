@@ -0,0 +1,29 @@
+/*
+ * Title:			AGON MOS - File checksums
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ */
+
+#ifndef MOS_CHECKSUM_H
+#define MOS_CHECKSUM_H
+
+#include "ff.h"
+
+#define CHECKSUM_bufferSize		8192	// Read size when checksumming a file
+#define CHECKSUM_lineLength		256		// Longest line in a manifest
+
+DWORD	crc32_block(DWORD crc, BYTE * buffer, UINT24 length);	// In crc32.asm
+
+DWORD	mos_CRC32(DWORD crc, BYTE * buffer, UINT24 length);
+UINT24	mos_CRC32_API(DWORD * crc, BYTE * buffer, UINT24 length);
+UINT24	mos_fileCRC32(char * filename, DWORD * crc, DWORD * size);
+UINT24	mos_fileCRC32at(DIR * dp, char * filename, DWORD * crc, DWORD * size);
+UINT24	mos_VERIFY(char * filename, DWORD crc);
+UINT24	mos_VERIFYAT(DIR * dp, char * filename, DWORD crc);
+UINT24	mos_CHECKSUM(char * filename);
+UINT24	mos_CHECKMANIFEST(char * filename);
+
+#endif MOS_CHECKSUM_H
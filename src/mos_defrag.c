@@ -0,0 +1,214 @@
+/*
+ * Title:			AGON MOS - SD card defragmenter
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ * 17/10/2026:		The folder tree is now visited by mos_walk
+ * 17/10/2026:		defrag_boot keeps its DIR off the stack
+ * 17/10/2026:		defrag_boot also moves boot files that are contiguous but not at the start of the card
+ */
+
+#include <eZ80.h>
+#include <defines.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "config.h"
+#include "mos.h"
+#include "mos_defrag.h"
+#include "mos_walk.h"
+#include "ff.h"
+#include "umm_malloc.h"
+
+extern volatile BYTE keyascii;					// In globals.asm
+extern t_mosFileObject mosFileObjects[];		// In mos.c
+
+typedef struct {
+	UINT24	objects;		// Files and folders that hold any clusters
+	UINT24	fragmented;		// How many of those are split into more than one run
+	DWORD	extra;			// Runs beyond the first, across all objects
+} t_defragScore;
+
+typedef struct {
+	char *	path;			// Path buffer for the boot files
+	void *	buffer;			// Copy buffer passed to f_relocate (may be NULL)
+	UINT	bufferSize;
+	DWORD	hint;			// Cluster to start searching for free space from
+	BOOL	move;			// FALSE to only score the card
+	BOOL	stopped;		// Set when ESC is pressed
+	UINT24	moved;
+	UINT24	skipped;		// Objects with no contiguous free space large enough
+	t_defragScore score;
+} t_defragState;
+
+static FILINFO	defrag_fno;
+static DIR		defrag_dir;				// Static, as is defrag_fno, to keep it off the small MOS stack
+
+// Score an object, moving it first if it is fragmented
+// Parameters:
+// - st: Defragmenter state
+// - path: Path of the object
+// - force: TRUE to also move it if it is contiguous, but there are free clusters below it that it fits in
+// Returns:
+// - FatFS return code
+//
+static int defrag_object(t_defragState * st, char * path, BOOL force) {
+	FRESULT	fr;
+	DWORD	nfrag;
+	DWORD	nclst;
+
+	fr = f_fragments(path, &nfrag, &nclst);
+	if (fr != FR_OK || nfrag == 0) {
+		return fr;
+	}
+	if ((nfrag > 1 || force) && st->move) {
+		fr = f_relocate(path, &st->hint, st->buffer, st->bufferSize, force);
+		if (fr == FR_OK) {
+			printf("Moved %s (%lu fragments)\r\n", path, nfrag);
+			st->moved++;
+			nfrag = 1;
+		}
+		else if (fr == FR_DENIED && nfrag == 1) {
+			fr = FR_OK;						// Already as low as it can go
+		}
+		else if (fr == FR_DENIED) {
+			printf("No room to move %s\r\n", path);
+			st->skipped++;
+		}
+		else {
+			return fr;
+		}
+	}
+	st->score.objects++;
+	if (nfrag > 1) {
+		st->score.fragmented++;
+		st->score.extra += nfrag - 1;
+	}
+	return FR_OK;
+}
+
+// Score (and move) each object in the folder tree
+// Folders are visited before their contents, so a folder is moved before the files in it
+// Parameters:
+// - walk: Walker state; walk->context is the defragmenter state
+// - visit: WALK_FILE, WALK_ENTER or WALK_LEAVE
+// Returns:
+// - FatFS return code
+//
+static int defrag_visit(t_mosWalk * walk, BYTE visit) {
+	if (visit == WALK_LEAVE) {
+		return FR_OK;
+	}
+	return defrag_object(walk->context, walk->path, FALSE);
+}
+
+// Move the files needed at boot to the start of the card
+// Parameters:
+// - st: Defragmenter state
+// Returns:
+// - FatFS return code
+//
+static int defrag_boot(t_defragState * st) {
+	FRESULT	fr;
+
+	strcpy(st->path, "/autoexec.txt");
+	fr = defrag_object(st, st->path, TRUE);
+	if (fr == FR_NO_FILE) {
+		fr = FR_OK;
+	}
+	if (fr == FR_OK) {
+		fr = f_findfirst(&defrag_dir, &defrag_fno, "/mos", "*.bin");
+		if (fr == FR_NO_PATH) {
+			fr = FR_OK;						// No /mos folder, so there is nothing more to move
+		}
+		else {
+			while (fr == FR_OK && defrag_fno.fname[0] && keyascii != 27) {
+				sprintf(st->path, "/mos/%s", defrag_fno.fname);
+				fr = defrag_object(st, st->path, TRUE);
+				if (fr == FR_OK) {
+					fr = f_findnext(&defrag_dir, &defrag_fno);
+				}
+			}
+			f_closedir(&defrag_dir);
+		}
+	}
+	st->path[0] = 0;
+	return fr;
+}
+
+static void defrag_report(char * label, t_defragScore * score) {
+	printf("%s: %u%% (%u of %u files and folders fragmented, %lu extra fragments)\r\n",
+		label,
+		score->objects ? (UINT24)((DWORD)score->fragmented * 100 / score->objects) : 0,
+		score->fragmented, score->objects, score->extra
+	);
+}
+
+// Defragment the SD card
+// Every fragmented file and folder is copied into a contiguous block of free clusters by f_relocate,
+// which only switches the directory entry over once the copy is safely on the card.
+// Stopping part way (or a power cut) loses nothing, and running again carries on, as
+// objects that are already contiguous are left alone
+// Parameters:
+// - move: FALSE to just report the fragmentation score
+// - bootFirst: TRUE to move autoexec.txt and /mos/*.bin to the start of the card first
+// Returns:
+// - FatFS or MOS return code
+//
+int mos_DEFRAG(BOOL move, BOOL bootFirst) {
+	t_defragState	st;
+	t_defragScore	before;
+	int				fr;
+	int				i;
+
+	for (i = 0; i < MOS_maxOpenFiles; i++) {
+		if (mosFileObjects[i].free > 0) {
+			return FR_LOCKED;				// Relocating an open file would leave its FIL pointing at freed clusters
+		}
+	}
+
+	memset(&st, 0, sizeof(t_defragState));
+	st.path = umm_malloc(DEFRAG_pathLength);
+	if (!st.path) {
+		return MOS_OUT_OF_MEMORY;
+	}
+	st.path[0] = 0;
+	st.buffer = umm_malloc(DEFRAG_bufferSize);
+	st.bufferSize = st.buffer ? DEFRAG_bufferSize : 0;
+	keyascii = 0;
+
+	fr = mos_walk("/", defrag_visit, &st, &st.stopped);
+	before = st.score;
+
+	if (fr == FR_OK && move && !st.stopped) {
+		st.move = TRUE;
+		st.hint = 2;
+		if (bootFirst) {
+			fr = defrag_boot(&st);
+		}
+		memset(&st.score, 0, sizeof(t_defragScore));
+		if (fr == FR_OK) {
+			fr = mos_walk("/", defrag_visit, &st, &st.stopped);
+		}
+	}
+
+	if (fr == FR_OK) {
+		if (st.stopped) {
+			printf("Stopped; run DEFRAG again to carry on\r\n");
+		}
+		defrag_report("Before", &before);
+		if (move && !st.stopped) {
+			defrag_report("After ", &st.score);
+		}
+		if (move) {
+			printf("%u moved, %u skipped\r\n", st.moved, st.skipped);
+		}
+	}
+
+	if (st.buffer) umm_free(st.buffer);
+	umm_free(st.path);
+	return fr;
+}
@@ -0,0 +1,19 @@
+/*
+ * Title:			AGON MOS - SD card defragmenter
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ * 17/10/2026:		Removed DEFRAG_maxDepth; the walker's WALK_maxDepth applies
+ */
+
+#ifndef MOS_DEFRAG_H
+#define MOS_DEFRAG_H
+
+#define DEFRAG_pathLength	256		// Longest boot file path
+#define DEFRAG_bufferSize	4096	// Copy buffer; FatFS falls back to its sector window if this can't be allocated
+
+int		mos_DEFRAG(BOOL move, BOOL bootFirst);
+
+#endif MOS_DEFRAG_H
@@ -12,6 +12,9 @@
  * 21/03/2023:		Improved backspace, and editing of long lines, after scroll, at bottom of screen
  * 22/03/2023:		Added a single-entry command line history
  * 31/03/2023:		Added timeout for VDP protocol
+ * 17/10/2026:		VDP requests use vdp_query
+ * 17/10/2026:		Run deferred file system work while waiting for a key
+ * 17/10/2026:		waitKey sleeps until a key event instead of polling keycount
  */
 
 #include <eZ80.h>
@@ -27,12 +30,14 @@
 #include "timer.h"
 #include "mos_editor.h"
 #include "umm_malloc.h"
+#include "vdp_query.h"
+#include "ff.h"
+#include "event.h"
 
 extern volatile BYTE vpd_protocol_flags;		// In globals.asm
 extern volatile BYTE keyascii;					// In globals.asm
 extern volatile BYTE keycode;					// In globals.asm
 extern volatile BYTE keydown;					// In globals.asm
-extern volatile BYTE keycount;					// In globals.asm
 
 extern volatile BYTE history_no;
 extern volatile BYTE history_size;
@@ -50,33 +55,34 @@ char *hotkey_strings[12] = NULL;
 // Get the current cursor position from the VPD
 //
 void getCursorPos() {
-	vpd_protocol_flags &= 0xFE;					// Clear the semaphore flag
-	putch(23);									// Request the cursor position
-	putch(0);
-	putch(VDP_cursor);
-	wait_VDP(0x01);								// Wait until the semaphore has been set, or a timeout happens
+	BYTE	request[] = { 23, 0, VDP_cursor };
+
+	vdp_queryWait(vdp_query(VDPP_cursor, request, sizeof(request), NULL), NULL);
 }
 
 // Get the current screen dimensions from the VDU
 //
 void getModeInformation() {
-	vpd_protocol_flags &= 0xEF;					// Clear the semaphore flag
-	putch(23);
-	putch(0);
-	putch(VDP_mode);
-	wait_VDP(0x10);								// Wait until the semaphore has been set, or a timeout happens
+	BYTE	request[] = { 23, 0, VDP_mode };
+
+	vdp_queryWait(vdp_query(VDPP_mode, request, sizeof(request), NULL), NULL);
 }
 
 // Get palette entry
 //
 void readPalette(BYTE entry, BOOL wait) {
-	vpd_protocol_flags &= 0xFB;					// Clear the semaphore flag
-	putch(23);
-	putch(0);
-	putch(VDP_palette);
-	putch(entry);
+	BYTE	request[] = { 23, 0, VDP_palette, 0 };
+
+	request[3] = entry;
 	if (wait) {
-		wait_VDP(0x04);							// Wait until the semaphore has been set, or a timeout happens
+		vdp_queryWait(vdp_query(VDPP_point, request, sizeof(request), NULL), NULL);
+	}
+	else {
+		vpd_protocol_flags &= 0xFB;				// Clear the semaphore flag
+		putch(23);
+		putch(0);
+		putch(VDP_palette);
+		putch(entry);
 	}
 }
 
@@ -170,13 +176,13 @@ BOOL deleteCharacter(char *buffer, int insertPos, int len) {
 }
 
 // Wait for a key to be pressed
+// File system work queued by interrupt handlers is run while waiting
 //
 void waitKey() {
-	BYTE	c;
+	event_take(EVENT_key, NULL);	// Only count keys pressed from now
 	do {
-		c = keycount;				
-		while(c == keycount);		// Wait for a key event
-	} while (keydown == 0);			// Loop until we get a key down value (keydown = 1)
+		ff_run_deferred();			// Nothing is part way through the file system here
+	} while (!event_wait(EVENT_key, 1, EVENT_halt, NULL) || keydown == 0);	// Loop until we get a key down value (keydown = 1)
 }
 
 // handle HOME
@@ -0,0 +1,380 @@
+/*
+ * Title:			AGON MOS - RAM snapshots
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ * 17/10/2026:		USER:HI ends where the internal SRAM kept by MOS starts
+ * 17/10/2026:		Restored handles start new file statistics, as "(restored)"
+ * 17/10/2026:		The keyboard settings and cursor position are restored; LOAD checks the page map before changing anything
+ */
+
+#include <eZ80.h>
+#include <defines.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "config.h"
+#include "mos.h"
+#include "mos_snapshot.h"
+#include "uart.h"
+#include "ff.h"
+#include "umm_malloc.h"
+#include "iram.h"
+#include "file_stats.h"
+
+extern volatile DWORD clock;					// In globals.asm
+extern BYTE scrmode;							// In globals.asm
+extern BYTE cursorX, cursorY;					// In globals.asm
+extern UINT16 keydelay, keyrate;				// In globals.asm
+extern BYTE keyled;								// In globals.asm
+extern t_mosFileObject mosFileObjects[];		// In mos.c
+
+// Fill in the RAM ranges a snapshot holds
+// Parameters:
+// - hdr: Header to fill in
+// Returns:
+// - Number of pages in all the ranges
+//
+static UINT24 snapshot_ranges(t_snapshotHeader * hdr) {
+	UINT24	pages = 0;
+	int		r;
+
+	hdr->ranges = SNAPSHOT_ranges;
+	hdr->start[0] = 0x40000;						// USER:LO
+	hdr->length[0] = (UINT24)_low_data - 0x40000;
+	hdr->start[1] = IRAM_START;						// USER:HI
+	hdr->length[1] = IRAM_MOS - IRAM_START;
+	for (r = 0; r < SNAPSHOT_ranges; r++) {
+		pages += (hdr->length[r] + SNAPSHOT_pageSize - 1) / SNAPSHOT_pageSize;
+	}
+	return pages;
+}
+
+// Build the page map, marking pages where every byte is the same so they need not be stored
+// Parameters:
+// - hdr: Header; dataLength is set to the number of bytes that need to be stored
+// - map: Page map to fill in, two bytes per page
+//
+static void snapshot_map(t_snapshotHeader * hdr, BYTE * map) {
+	BYTE *	p;
+	BYTE *	end;
+	UINT24	n;
+	UINT24	offset;
+	int		r;
+
+	hdr->dataLength = 0;
+	for (r = 0; r < SNAPSHOT_ranges; r++) {
+		for (offset = 0; offset < hdr->length[r]; offset += SNAPSHOT_pageSize, map += 2) {
+			p = (BYTE *)hdr->start[r] + offset;
+			n = hdr->length[r] - offset;
+			if (n > SNAPSHOT_pageSize) {
+				n = SNAPSHOT_pageSize;
+			}
+			for (end = p + n - 1; end > p && *end == *p; end--);
+			if (end == p) {
+				map[0] = SNAPSHOT_fill;
+				map[1] = *p;
+			}
+			else {
+				map[0] = SNAPSHOT_raw;
+				hdr->dataLength += n;
+			}
+		}
+	}
+}
+
+// Count the bytes of the pages a page map says are stored
+// Parameters:
+// - hdr: The snapshot header
+// - map: The page map
+// Returns:
+// - Bytes of stored pages, or 0xFFFFFFFF if a page has a type this MOS does not know
+//
+static DWORD snapshot_stored(t_snapshotHeader * hdr, BYTE * map) {
+	DWORD	stored = 0;
+	UINT24	n;
+	UINT24	offset;
+	int		r;
+
+	for (r = 0; r < SNAPSHOT_ranges; r++) {
+		for (offset = 0; offset < hdr->length[r]; offset += SNAPSHOT_pageSize, map += 2) {
+			n = hdr->length[r] - offset;
+			if (n > SNAPSHOT_pageSize) {
+				n = SNAPSHOT_pageSize;
+			}
+			if (map[0] == SNAPSHOT_raw) {
+				stored += n;
+			}
+			else if (map[0] != SNAPSHOT_fill) {
+				return 0xFFFFFFFF;
+			}
+		}
+	}
+	return stored;
+}
+
+// Transfer a run of stored pages between RAM and the file
+// Parameters:
+// - fil: The snapshot file, positioned at the run
+// - address: Address of the run in RAM
+// - length: Length of the run in bytes
+// - save: TRUE to write the run to the file, FALSE to read it back
+// Returns:
+// - FatFS or MOS return code
+//
+static UINT24 snapshot_run(FIL * fil, BYTE * address, UINT24 length, BOOL save) {
+	FRESULT	fr;
+	UINT	bt;
+
+	if (length == 0) {
+		return FR_OK;
+	}
+	if (save) {
+		fr = f_write(fil, address, length, &bt);
+		if (fr == FR_OK && bt < length) {
+			return FR_DENIED;					// The card is full
+		}
+	}
+	else {
+		fr = f_read(fil, address, length, &bt);
+		if (fr == FR_OK && bt < length) {
+			return MOS_BAD_SNAPSHOT;			// The file has been cut short
+		}
+	}
+	return fr;
+}
+
+// Transfer the stored pages of every range between RAM and the file
+// Consecutive stored pages go in one call, so FatFS moves whole runs of sectors straight to or from RAM
+// Parameters:
+// - fil: The snapshot file, positioned at dataOffset
+// - hdr: The snapshot header
+// - map: The page map
+// - save: TRUE to save the pages, FALSE to load them and fill in the pages that weren't stored
+// Returns:
+// - FatFS or MOS return code
+//
+static UINT24 snapshot_transfer(FIL * fil, t_snapshotHeader * hdr, BYTE * map, BOOL save) {
+	UINT24	fr = FR_OK;
+	BYTE *	start;
+	UINT24	run;
+	UINT24	offset;
+	UINT24	n;
+	int		r;
+
+	for (r = 0; r < SNAPSHOT_ranges && fr == FR_OK; r++) {
+		start = (BYTE *)hdr->start[r];
+		run = 0;
+		for (offset = 0; offset < hdr->length[r] && fr == FR_OK; offset += SNAPSHOT_pageSize, map += 2) {
+			n = hdr->length[r] - offset;
+			if (n > SNAPSHOT_pageSize) {
+				n = SNAPSHOT_pageSize;
+			}
+			if (map[0] == SNAPSHOT_raw) {
+				run += n;
+				continue;
+			}
+			fr = snapshot_run(fil, start + offset - run, run, save);
+			run = 0;
+			if (!save) {
+				memset(start + offset, map[1], n);
+			}
+		}
+		if (fr == FR_OK) {
+			fr = snapshot_run(fil, start + hdr->length[r] - run, run, save);
+		}
+	}
+	return fr;
+}
+
+// Save user RAM, the screen mode, keyboard settings and cursor position, and the open file handles to a snapshot file
+// The file is preallocated as one contiguous extent where the card has room for it
+// Parameters:
+// - filename: Path of the snapshot file; this is replaced if it exists
+// Returns:
+// - FatFS or MOS return code
+//
+UINT24 mos_SNAPSHOTSAVE(char * filename) {
+	t_snapshotHeader	hdr;
+	t_snapshotFile *	files;
+	FIL		fil;
+	BYTE *	head;
+	BYTE *	map;
+	UINT24	fr;
+	UINT24	pages;
+	UINT	bw;
+	DWORD	start = clock;
+	int		i;
+
+	memset(&hdr, 0, sizeof(t_snapshotHeader));
+	memcpy(hdr.magic, "SNAP", 4);
+	hdr.version = SNAPSHOT_version;
+	hdr.scrmode = scrmode;
+	hdr.cursorX = cursorX;
+	hdr.cursorY = cursorY;
+	hdr.keydelay = keydelay;
+	hdr.keyrate = keyrate;
+	hdr.keyled = keyled;
+	pages = snapshot_ranges(&hdr);
+	hdr.mapLength = pages * 2;
+	for (i = 0; i < MOS_maxOpenFiles; i++) {
+		if (mosFileObjects[i].free > 0 && mosFileObjects[i].stream == NULL) {
+			f_sync(&mosFileObjects[i].fileObject);		// So the directory entry matches the saved FIL
+			hdr.files++;
+		}
+	}
+	hdr.dataOffset = sizeof(t_snapshotHeader) + hdr.files * sizeof(t_snapshotFile) + hdr.mapLength;
+	hdr.dataOffset = (hdr.dataOffset + SNAPSHOT_pageSize - 1) & ~(SNAPSHOT_pageSize - 1);
+
+	head = umm_malloc(hdr.dataOffset);
+	if (!head) {
+		return MOS_OUT_OF_MEMORY;
+	}
+	memset(head, 0, hdr.dataOffset);
+	files = (t_snapshotFile *)(head + sizeof(t_snapshotHeader));
+	for (i = 0; i < MOS_maxOpenFiles; i++) {
+		if (mosFileObjects[i].free > 0 && mosFileObjects[i].stream == NULL) {
+			files->handle = i;
+			memcpy(&files->fileObject, &mosFileObjects[i].fileObject, sizeof(FIL));
+			files++;
+		}
+	}
+	map = (BYTE *)files;
+	snapshot_map(&hdr, map);
+	memcpy(head, &hdr, sizeof(t_snapshotHeader));
+
+	fr = f_open(&fil, filename, FA_WRITE | FA_CREATE_ALWAYS);
+	if (fr == FR_OK) {
+		fr = f_expand(&fil, hdr.dataOffset + hdr.dataLength, 1);
+		if (fr == FR_DENIED) {
+			fr = FR_OK;							// No contiguous space, so let it fragment
+		}
+		if (fr == FR_OK) {
+			fr = snapshot_run(&fil, head, hdr.dataOffset, TRUE);
+		}
+		if (fr == FR_OK) {
+			fr = snapshot_transfer(&fil, &hdr, map, TRUE);
+		}
+		f_close(&fil);
+		if (fr != FR_OK) {
+			f_unlink(filename);
+		}
+	}
+	umm_free(head);
+
+	if (fr == FR_OK) {
+		start = clock - start;
+		printf("%u pages, %u stored, %u files; %lu.%02lus\r\n", pages, (UINT24)((hdr.dataLength + SNAPSHOT_pageSize - 1) / SNAPSHOT_pageSize), hdr.files, start / 100, start % 100);
+	}
+	return fr;
+}
+
+// Restore user RAM, the screen mode, keyboard settings and cursor position, and the open file handles from a snapshot file
+// The whole header and page map are checked before anything is changed
+// Files open now are closed first. A saved file that has since been deleted or changed is not reopened
+// Parameters:
+// - filename: Path of the snapshot file
+// Returns:
+// - FatFS or MOS return code
+//
+UINT24 mos_SNAPSHOTLOAD(char * filename) {
+	t_snapshotHeader	hdr;
+	t_snapshotHeader	expected;
+	t_snapshotFile *	files;
+	FIL		fil;
+	BYTE *	head = NULL;
+	BYTE *	map;
+	UINT24	fr;
+	UINT24	pages;
+	UINT	br;
+	int		i, h;
+
+	memset(&expected, 0, sizeof(t_snapshotHeader));
+	pages = snapshot_ranges(&expected);
+
+	fr = f_open(&fil, filename, FA_READ);
+	if (fr != FR_OK) {
+		return fr;
+	}
+	fr = f_read(&fil, &hdr, sizeof(t_snapshotHeader), &br);
+	if (fr == FR_OK) {
+		if (
+			br < sizeof(t_snapshotHeader) ||
+			memcmp(hdr.magic, "SNAP", 4) != 0 ||
+			hdr.version != SNAPSHOT_version ||
+			hdr.ranges != SNAPSHOT_ranges ||
+			memcmp(hdr.start, expected.start, sizeof(hdr.start)) != 0 ||
+			memcmp(hdr.length, expected.length, sizeof(hdr.length)) != 0 ||
+			hdr.mapLength != pages * 2 ||
+			hdr.files > MOS_maxOpenFiles ||
+			hdr.dataOffset < sizeof(t_snapshotHeader) + hdr.files * sizeof(t_snapshotFile) + hdr.mapLength ||
+			f_size(&fil) < hdr.dataOffset + hdr.dataLength
+		) {
+			fr = MOS_BAD_SNAPSHOT;				// Not a snapshot, or saved by a MOS with a different memory map
+		}
+	}
+	if (fr == FR_OK) {
+		head = umm_malloc(hdr.dataOffset - sizeof(t_snapshotHeader));
+		if (!head) {
+			fr = MOS_OUT_OF_MEMORY;
+		}
+	}
+	if (fr == FR_OK) {
+		fr = snapshot_run(&fil, head, hdr.dataOffset - sizeof(t_snapshotHeader), FALSE);
+	}
+	if (fr != FR_OK) {
+		goto cleanup;
+	}
+	files = (t_snapshotFile *)head;
+	map = (BYTE *)(files + hdr.files);
+	for (i = 0; i < hdr.files; i++) {
+		if (files[i].handle >= MOS_maxOpenFiles) {
+			fr = MOS_BAD_SNAPSHOT;
+			goto cleanup;
+		}
+	}
+	if (snapshot_stored(&hdr, map) != hdr.dataLength) {
+		fr = MOS_BAD_SNAPSHOT;					// The map doesn't match the pages stored
+		goto cleanup;
+	}
+
+	mos_FCLOSE(0);
+	fr = snapshot_transfer(&fil, &hdr, map, FALSE);
+	if (fr == FR_OK) {
+		for (i = 0; i < hdr.files; i++) {
+			h = files[i].handle;
+			memcpy(&mosFileObjects[h].fileObject, &files[i].fileObject, sizeof(FIL));
+			mosFileObjects[h].stream = NULL;
+			mosFileObjects[h].free = f_reattach(&mosFileObjects[h].fileObject, fil.obj.fs) == FR_OK;
+			if (mosFileObjects[h].free) {
+				file_stats_open(h + 1, "(restored)");
+			}
+			else {
+				printf("File handle %d has changed and was not reopened\r\n", h + 1);
+			}
+		}
+		if (hdr.scrmode != scrmode) {
+			putch(22);
+			putch(hdr.scrmode);
+		}
+		putch(23);								// VDU 23,0,&88,delay;rate;led
+		putch(0);
+		putch(VDP_keystate);
+		putch(hdr.keydelay & 0xFF);
+		putch(hdr.keydelay >> 8);
+		putch(hdr.keyrate & 0xFF);
+		putch(hdr.keyrate >> 8);
+		putch(hdr.keyled);
+		putch(31);								// VDU 31,x,y
+		putch(hdr.cursorX);
+		putch(hdr.cursorY);
+	}
+
+cleanup:
+	f_close(&fil);
+	if (head) umm_free(head);
+	return fr;
+}
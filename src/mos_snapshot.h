@@ -0,0 +1,54 @@
+/*
+ * Title:			AGON MOS - RAM snapshots
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ * 17/10/2026:		Version 2 holds the keyboard settings and the cursor position
+ */
+
+#ifndef MOS_SNAPSHOT_H
+#define MOS_SNAPSHOT_H
+
+#include "ff.h"
+
+#define SNAPSHOT_version	2
+#define SNAPSHOT_ranges		2		// USER:LO and USER:HI
+#define SNAPSHOT_pageSize	512		// One sector, so stored pages can be transferred straight to and from RAM
+
+// Page types in the page map
+//
+#define SNAPSHOT_raw		0		// Stored in full
+#define SNAPSHOT_fill		1		// Every byte is the same; the value follows the type in the map
+
+// The file starts with this header, followed by the saved file handles, then the page map
+// (two bytes per page), padded to the next sector; the stored pages follow in address order
+//
+typedef struct {
+	char	magic[4];					// "SNAP"
+	BYTE	version;					// SNAPSHOT_version
+	BYTE	scrmode;					// Screen mode when saved
+	BYTE	cursorX;					// Text cursor position when saved
+	BYTE	cursorY;
+	UINT16	keydelay;					// Keyboard repeat delay, repeat rate and LED status when saved
+	UINT16	keyrate;
+	BYTE	keyled;
+	BYTE	files;						// Number of saved file handles
+	BYTE	ranges;						// Number of RAM ranges
+	UINT24	start[SNAPSHOT_ranges];		// Start address of each range
+	UINT24	length[SNAPSHOT_ranges];	// Length of each range
+	UINT24	mapLength;					// Bytes in the page map
+	UINT24	dataOffset;					// Offset of the first stored page in the file
+	DWORD	dataLength;					// Bytes of stored pages
+} t_snapshotHeader;
+
+typedef struct {
+	BYTE	handle;						// Index into mosFileObjects
+	FIL		fileObject;
+} t_snapshotFile;
+
+UINT24	mos_SNAPSHOTSAVE(char * filename);
+UINT24	mos_SNAPSHOTLOAD(char * filename);
+
+#endif MOS_SNAPSHOT_H
@@ -0,0 +1,505 @@
+/*
+ * Title:			AGON MOS - Folder tree walker
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ * 17/10/2026:		The DU total on disk includes the folders' own clusters
+ * 17/10/2026:		COPY -r tells a copy into itself by the destination folder's start cluster
+ */
+
+#include <eZ80.h>
+#include <defines.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "defines.h"
+#include "config.h"
+#include "mos.h"
+#include "mos_walk.h"
+#include "mos_checksum.h"
+#include "ff.h"
+#include "umm_malloc.h"
+
+extern volatile BYTE keyascii;					// In globals.asm
+
+#define WALK_copyBufferSize	1024
+
+typedef struct {
+	char *	dst;			// Destination path; the relative path being visited is appended at dstLength
+	UINT24	dstLength;
+	BYTE *	buffer;			// Copy buffer
+	BOOL	verbose;
+	BOOL	verify;			// Check each copy's CRC32 against its source
+	DWORD	dstCluster;		// Start cluster of the destination folder, which is not copied into itself
+	UINT24	files;
+	UINT24	folders;
+} t_copyTree;
+
+typedef struct {
+	BOOL	verbose;
+	UINT24	files;
+	UINT24	folders;
+} t_delTree;
+
+typedef struct {
+	DWORD	size[WALK_maxDepth];	// Bytes in each open folder and its sub-folders so far
+	DWORD	disk;			// Bytes allocated on the card, to files and folders
+	DWORD	cluster;		// Cluster size in bytes
+	UINT24	files;
+	UINT24	folders;
+} t_du;
+
+typedef struct {
+	char *	pattern;
+	UINT24	found;
+} t_find;
+
+static FILINFO	walk_fno;
+static DIR		walk_dir;				// Static, as is walk_fno, to keep it off the small MOS stack
+
+// Walk a folder tree, calling back for every file and folder in it
+// This is not recursive; a bounded stack of open folders is kept on the heap along with a
+// single path buffer, so a walk costs the same whatever the shape of the tree
+// Folders nested deeper than WALK_maxDepth are reported and skipped
+// Parameters:
+// - path: Folder to start in; the folder itself is not visited
+// - callback: Called with WALK_FILE, WALK_ENTER or WALK_LEAVE; returning anything but FR_OK ends the walk
+// - context: Passed to the callback in the walk structure
+// - stopped: Optional pointer to return TRUE in if ESC was pressed
+// Returns:
+// - FatFS or MOS return code
+//
+int mos_walk(char * path, t_mosWalkCallback callback, void * context, BOOL * stopped) {
+	t_mosWalk	walk;
+	int			fr;
+	UINT24		len;
+
+	if (*path == 0) {
+		path = ".";
+	}
+	len = strlen(path);
+	if (len >= WALK_pathLength) {
+		return FR_INVALID_NAME;
+	}
+	walk.path = umm_malloc(WALK_pathLength);
+	walk.dirs = umm_malloc(WALK_maxDepth * sizeof(DIR));
+	if (!walk.path || !walk.dirs) {
+		if (walk.path) umm_free(walk.path);
+		if (walk.dirs) umm_free(walk.dirs);
+		return MOS_OUT_OF_MEMORY;
+	}
+	strcpy(walk.path, path);
+	while (len > 0 && walk.path[len - 1] == '/') {
+		walk.path[--len] = 0;				// The root folder becomes an empty path
+	}
+	walk.base = len;
+	walk.fno = &walk_fno;
+	walk.depth = 0;
+	walk.length[0] = len;
+	walk.stopped = FALSE;
+	walk.callback = callback;
+	walk.context = context;
+	keyascii = 0;
+
+	fr = f_opendir(&walk.dirs[0], len ? walk.path : "/");
+	if (fr != FR_OK) {
+		walk.depth = -1;
+	}
+	while (fr == FR_OK) {
+		if (keyascii == 27) {
+			walk.stopped = TRUE;
+			break;
+		}
+		fr = f_readdir(&walk.dirs[walk.depth], &walk_fno);
+		if (fr != FR_OK) {
+			break;
+		}
+		len = walk.length[walk.depth];
+		if (walk_fno.fname[0] == 0) {		// End of this folder, so go back up to its parent
+			f_closedir(&walk.dirs[walk.depth--]);
+			if (walk.depth < 0) {
+				break;
+			}
+			fr = callback(&walk, WALK_LEAVE);
+			walk.path[walk.length[walk.depth]] = 0;
+			continue;
+		}
+		if (len + strlen(walk_fno.fname) + 2 > WALK_pathLength) {
+			printf("Path too long, skipped %s/%s\r\n", walk.path, walk_fno.fname);
+			continue;
+		}
+		sprintf(walk.path + len, "/%s", walk_fno.fname);
+		if (walk_fno.fattrib & AM_DIR) {
+			if (walk.depth + 1 >= WALK_maxDepth) {
+				printf("Too deep, skipped %s\r\n", walk.path);
+			}
+			else {
+				walk.descend = TRUE;
+				fr = callback(&walk, WALK_ENTER);
+				if (fr == FR_OK && walk.descend) {
+					fr = f_opendir(&walk.dirs[walk.depth + 1], walk.path);
+					if (fr == FR_OK) {
+						walk.depth++;
+						walk.length[walk.depth] = strlen(walk.path);
+						continue;
+					}
+				}
+			}
+		}
+		else {
+			fr = callback(&walk, WALK_FILE);
+		}
+		walk.path[len] = 0;
+	}
+
+	while (walk.depth >= 0) {
+		f_closedir(&walk.dirs[walk.depth--]);
+	}
+	umm_free(walk.dirs);
+	umm_free(walk.path);
+	if (stopped) {
+		*stopped = walk.stopped;
+	}
+	return fr;
+}
+
+// Copy a single file
+// Parameters:
+// - srcPath: Source file
+// - dstPath: Destination file; this must not already exist
+// - buffer: Copy buffer of WALK_copyBufferSize bytes
+// - verify: Read the copy back and check its CRC32 against the source
+// Returns:
+// - FatFS or MOS return code
+//
+static UINT24 walk_copyFile(char * srcPath, char * dstPath, BYTE * buffer, BOOL verify) {
+	UINT24	fr;
+	FIL		fsrc, fdst;
+	UINT	br = 0, bw = 0;
+	DWORD	crc = 0;
+
+	fr = f_open(&fsrc, srcPath, FA_READ);
+	if (fr != FR_OK) {
+		return fr;
+	}
+	fr = f_open(&fdst, dstPath, FA_WRITE | FA_CREATE_NEW);
+	if (fr == FR_OK) {
+		while (1) {
+			fr = f_read(&fsrc, buffer, WALK_copyBufferSize, &br);
+			if (br == 0 || fr != FR_OK) break;
+			if (verify) crc = mos_CRC32(crc, buffer, br);
+			fr = f_write(&fdst, buffer, br, &bw);
+			if (bw < br || fr != FR_OK) break;
+		}
+		if (fr == FR_OK && bw < br) {
+			fr = FR_DENIED;					// The card is full
+		}
+		f_close(&fdst);
+	}
+	f_close(&fsrc);
+	if (fr == FR_OK && verify) {
+		fr = mos_VERIFY(dstPath, crc);
+	}
+	return fr;
+}
+
+// Get the start cluster of a folder
+// This identifies a folder however its path is written; the root folder's is 0
+// Parameters:
+// - path: Path of the folder
+// - cluster: Pointer to return the cluster in
+// Returns:
+// - FatFS return code
+//
+static UINT24 walk_folderCluster(char * path, DWORD * cluster) {
+	UINT24	fr;
+
+	fr = f_opendir(&walk_dir, path);
+	if (fr == FR_OK) {
+		*cluster = walk_dir.obj.sclust;
+		f_closedir(&walk_dir);
+	}
+	return fr;
+}
+
+static int copyTree_visit(t_mosWalk * walk, BYTE visit) {
+	t_copyTree *	ct = walk->context;
+	char *			rel = walk->path + walk->base;
+	UINT24			fr;
+	DWORD			cluster;
+
+	if (visit == WALK_LEAVE) {
+		return FR_OK;
+	}
+	if (visit == WALK_ENTER) {
+		fr = walk_folderCluster(walk->path, &cluster);
+		if (fr != FR_OK) {
+			return fr;
+		}
+		if (cluster == ct->dstCluster) {
+			walk->descend = FALSE;			// The copy is inside the source, so don't copy it into itself
+			return FR_OK;
+		}
+	}
+	if (ct->dstLength + strlen(rel) >= WALK_pathLength) {
+		printf("Path too long, skipped %s\r\n", walk->path);
+		walk->descend = FALSE;
+		return FR_OK;
+	}
+	strcpy(ct->dst + ct->dstLength, rel);
+	if (visit == WALK_ENTER) {
+		if (ct->verbose) printf("Creating %s\r\n", ct->dst);
+		fr = f_mkdir(ct->dst);
+		if (fr == FR_EXIST) {
+			fr = FR_OK;
+		}
+		ct->folders++;
+	}
+	else {
+		if (ct->verbose) printf("Copying %s to %s\r\n", walk->path, ct->dst);
+		fr = walk_copyFile(walk->path, ct->dst, ct->buffer, ct->verify);
+		ct->files++;
+	}
+	return fr;
+}
+
+// Copy a folder and everything in it
+// If dstPath is an existing folder, the copy is made inside it, keeping the source folder's name
+// If the copy is inside the source folder, it is left out of what is copied
+// Parameters:
+// - srcPath: Folder (or file) to copy
+// - dstPath: Destination path
+// - verbose: Print progress messages
+// - verify: Read each copy back and check its CRC32 against the source
+// Returns:
+// - FatFS or MOS return code
+//
+UINT24 mos_COPYTREE(char * srcPath, char * dstPath, BOOL verbose, BOOL verify) {
+	t_copyTree	ct;
+	char *		name;
+	UINT24		len;
+	UINT24		nameLength;
+	int			fr;
+	BOOL		stopped;
+	DWORD		srcCluster;
+
+	if (!isDirectory(srcPath)) {
+		return mos_COPY(srcPath, dstPath, verbose, verify);
+	}
+	len = strlen(srcPath);
+	while (len > 1 && srcPath[len - 1] == '/') {
+		len--;
+	}
+	name = srcPath + len;					// Find the name of the source folder
+	while (name > srcPath && name[-1] != '/') {
+		name--;
+	}
+	nameLength = srcPath + len - name;
+
+	memset(&ct, 0, sizeof(t_copyTree));
+	ct.verbose = verbose;
+	ct.verify = verify;
+	ct.dst = umm_malloc(WALK_pathLength);
+	ct.buffer = umm_malloc(WALK_copyBufferSize);
+	if (!ct.dst || !ct.buffer) {
+		fr = MOS_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+	strncpy(ct.dst, dstPath, WALK_pathLength - 1);
+	ct.dst[WALK_pathLength - 1] = 0;
+	ct.dstLength = strlen(ct.dst);
+	while (ct.dstLength > 1 && ct.dst[ct.dstLength - 1] == '/') {
+		ct.dst[--ct.dstLength] = 0;
+	}
+	if (isDirectory(ct.dst) && nameLength > 0 && strncmp(name, ".", nameLength) != 0 && strncmp(name, "..", nameLength) != 0) {
+		if (ct.dstLength + nameLength + 2 > WALK_pathLength) {
+			fr = FR_INVALID_NAME;
+			goto cleanup;
+		}
+		if (ct.dst[ct.dstLength - 1] != '/') {
+			ct.dst[ct.dstLength++] = '/';
+		}
+		memcpy(ct.dst + ct.dstLength, name, nameLength);
+		ct.dstLength += nameLength;
+		ct.dst[ct.dstLength] = 0;
+	}
+	fr = walk_folderCluster(srcPath, &srcCluster);
+	if (fr != FR_OK) {
+		goto cleanup;
+	}
+	if (verbose) printf("Creating %s\r\n", ct.dst);
+	fr = f_mkdir(ct.dst);
+	if (fr == FR_EXIST) {
+		fr = FR_OK;
+	}
+	if (fr == FR_OK) {
+		fr = walk_folderCluster(ct.dst, &ct.dstCluster);
+	}
+	if (fr == FR_OK && ct.dstCluster == srcCluster) {
+		fr = FR_INVALID_PARAMETER;			// Can't copy a folder onto itself
+	}
+	if (fr == FR_OK) {
+		fr = mos_walk(srcPath, copyTree_visit, &ct, &stopped);
+	}
+	if (fr == FR_OK) {
+		printf("%s%u files and %u folders copied\r\n", stopped ? "Stopped; " : "", ct.files, ct.folders);
+	}
+
+cleanup:
+	if (ct.dst) umm_free(ct.dst);
+	if (ct.buffer) umm_free(ct.buffer);
+	return fr;
+}
+
+static int delTree_visit(t_mosWalk * walk, BYTE visit) {
+	t_delTree *	dt = walk->context;
+
+	if (visit == WALK_ENTER) {
+		return FR_OK;
+	}
+	if (dt->verbose) printf("Deleting %s\r\n", walk->path);
+	if (visit == WALK_LEAVE) {
+		dt->folders++;
+	}
+	else {
+		dt->files++;
+	}
+	return f_unlink(walk->path);			// Folders are empty by the time they are left
+}
+
+// Delete a folder and everything in it
+// Parameters:
+// - path: Folder (or file) to delete
+// - verbose: Print progress messages
+// Returns:
+// - FatFS or MOS return code
+//
+UINT24 mos_DELTREE(char * path, BOOL verbose) {
+	t_delTree	dt;
+	int			fr;
+	BOOL		stopped;
+
+	if (path[strspn(path, "/")] == 0) {
+		return FR_INVALID_PARAMETER;		// Refuse to delete the root folder
+	}
+	if (!isDirectory(path)) {
+		return f_unlink(path);
+	}
+	memset(&dt, 0, sizeof(t_delTree));
+	dt.verbose = verbose;
+	fr = mos_walk(path, delTree_visit, &dt, &stopped);
+	if (fr == FR_OK && !stopped) {
+		if (verbose) printf("Deleting %s\r\n", path);
+		fr = f_unlink(path);
+		dt.folders++;
+	}
+	if (dt.folders > 0) {
+		mos_invalidateCwd();				// A deleted folder may have been part of the cwd
+	}
+	if (fr == FR_OK) {
+		printf("%s%u files and %u folders deleted\r\n", stopped ? "Stopped; " : "", dt.files, dt.folders);
+	}
+	return fr;
+}
+
+// Add the clusters holding a folder's entries to the total on disk
+// The root folder has no entry of its own to find its clusters from, so nothing is added for it
+// Parameters:
+// - du: The totals
+// - path: Path of the folder
+//
+static void du_addFolder(t_du * du, char * path) {
+	DWORD	nfrag;
+	DWORD	nclst;
+
+	if (f_fragments(path, &nfrag, &nclst) == FR_OK) {
+		du->disk += nclst * du->cluster;
+	}
+}
+
+static int du_visit(t_mosWalk * walk, BYTE visit) {
+	t_du *	du = walk->context;
+	DWORD	size;
+
+	switch (visit) {
+		case WALK_ENTER:
+			du->size[walk->depth + 1] = 0;
+			du->folders++;
+			du_addFolder(du, walk->path);
+			break;
+		case WALK_LEAVE:
+			size = du->size[walk->depth + 1];
+			printf("%10lu %s\r\n", size, walk->path);
+			du->size[walk->depth] += size;
+			break;
+		default:
+			size = walk->fno->fsize;
+			du->size[walk->depth] += size;
+			du->disk += (size + du->cluster - 1) / du->cluster * du->cluster;
+			du->files++;
+			break;
+	}
+	return FR_OK;
+}
+
+// Show how much space a folder tree takes up
+// The total on disk is the clusters allocated to the files and to the folders themselves
+// Parameters:
+// - path: Folder to start in
+// Returns:
+// - FatFS or MOS return code
+//
+UINT24 mos_DU(char * path) {
+	t_du	du;
+	DIR		dir;
+	int		fr;
+	BOOL	stopped;
+
+	memset(&du, 0, sizeof(t_du));
+	fr = f_opendir(&dir, path);				// For the cluster size
+	if (fr != FR_OK) {
+		return fr;
+	}
+	du.cluster = (DWORD)dir.obj.fs->csize * FF_MAX_SS;
+	f_closedir(&dir);
+	du_addFolder(&du, path);
+	fr = mos_walk(path, du_visit, &du, &stopped);
+	if (fr == FR_OK) {
+		printf("%10lu %s\r\n", du.size[0], path);
+		printf("%s%lu bytes in %u files and %u folders, %lu bytes on disk\r\n", stopped ? "Stopped; " : "", du.size[0], du.files, du.folders, du.disk);
+	}
+	return fr;
+}
+
+static int find_visit(t_mosWalk * walk, BYTE visit) {
+	t_find *	fd = walk->context;
+
+	if (visit != WALK_LEAVE && f_match(fd->pattern, walk->fno->fname)) {
+		printf("%s\r\n", walk->path);
+		fd->found++;
+	}
+	return FR_OK;
+}
+
+// Find the files and folders in a folder tree whose names match a pattern
+// Parameters:
+// - pattern: Pattern to match names against, for example "*.bin"
+// - path: Folder to start in
+// Returns:
+// - FatFS or MOS return code
+//
+UINT24 mos_FIND(char * pattern, char * path) {
+	t_find	fd;
+	int		fr;
+	BOOL	stopped;
+
+	fd.pattern = pattern;
+	fd.found = 0;
+	fr = mos_walk(path, find_visit, &fd, &stopped);
+	if (fr == FR_OK) {
+		printf("%s%u found\r\n", stopped ? "Stopped; " : "", fd.found);
+	}
+	return fr;
+}
@@ -0,0 +1,48 @@
+/*
+ * Title:			AGON MOS - Folder tree walker
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ */
+
+#ifndef MOS_WALK_H
+#define MOS_WALK_H
+
+#include "ff.h"
+
+#define WALK_maxDepth		16		// Deepest folder level visited
+#define WALK_pathLength		256		// Longest path visited
+
+// Visits passed to a walker callback
+//
+#define WALK_FILE			0		// A file
+#define WALK_ENTER			1		// A folder, before its contents are visited
+#define WALK_LEAVE			2		// A folder, after its contents are visited (fno is not valid)
+
+typedef struct t_mosWalk t_mosWalk;
+
+typedef int (*t_mosWalkCallback)(t_mosWalk * walk, BYTE visit);
+
+struct t_mosWalk {
+	char *				path;		// Path of the object being visited
+	UINT24				base;		// Length of the starting folder's path; path + base is the relative path
+	FILINFO *			fno;		// Information for the object being visited
+	DIR *				dirs;		// Open folders, dirs[0] being the starting folder
+	int					depth;		// Index of the folder currently being read
+	UINT24				length[WALK_maxDepth];	// Length of the path of each open folder
+	BOOL				descend;	// Cleared by a WALK_ENTER callback to skip the folder's contents
+	BOOL				stopped;	// Set when ESC is pressed
+	t_mosWalkCallback	callback;
+	void *				context;	// Passed through for the callback
+};
+
+int		mos_walk(char * path, t_mosWalkCallback callback, void * context, BOOL * stopped);
+
+UINT24	mos_COPYTREE(char * srcPath, char * dstPath, BOOL verbose, BOOL verify);
+UINT24	mos_DELTREE(char * path, BOOL verbose);
+UINT24	mos_DU(char * path);
+UINT24	mos_FIND(char * pattern, char * path);
+
+#endif MOS_WALK_H
@@ -0,0 +1,231 @@
+/*
+ * Title:			AGON MOS - ROM filesystem
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ */
+
+#include <eZ80.h>
+#include <defines.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "defines.h"
+#include "mos.h"
+#include "romfs.h"
+#include "mos_checksum.h"
+#include "strings.h"
+
+extern BYTE romfs_image[];						// In romfs_image.asm
+
+// Get the header of the ROM filesystem
+// Returns:
+// - Pointer to the header, or NULL if there is no valid image
+//
+t_romfsHeader * romfs_header(void) {
+	t_romfsHeader *	hdr = (t_romfsHeader *)romfs_image;
+
+	if (memcmp(hdr->magic, "ROMF", 4) != 0 || hdr->version != ROMFS_version) {
+		return NULL;
+	}
+	return hdr;
+}
+
+// Apply the components of a path to a name in the image
+// Parameters:
+// - name: The name so far, without a leading '/'
+// - len: Length of the name so far
+// - p: The path to apply; "." and ".." are resolved, and '\' is taken as '/'
+// Returns:
+// - The new length, or -1 if the name is too long to be in the image
+//
+static int romfs_apply(char * name, int len, const char * p) {
+	const char *	end;
+	int				n;
+
+	while (*p) {
+		while (*p == '/' || *p == '\\') {
+			p++;
+		}
+		if (*p == 0) {
+			break;
+		}
+		end = p;
+		while (*end && *end != '/' && *end != '\\') {
+			end++;
+		}
+		n = end - p;
+		if (n == 2 && p[0] == '.' && p[1] == '.') {
+			while (len > 0 && name[len - 1] != '/') {	// Strip the last component
+				len--;
+			}
+			if (len > 0) {								// And its separator
+				len--;
+			}
+		}
+		else if (n != 1 || p[0] != '.') {
+			if (len + n + 1 >= ROMFS_nameLength) {
+				return -1;
+			}
+			if (len > 0) {
+				name[len++] = '/';
+			}
+			memcpy(name + len, p, n);
+			len += n;
+		}
+		p = end;
+	}
+	return len;
+}
+
+// Find a file in the ROM filesystem
+// Relative paths are taken from the current directory, as they would be on the SD card
+// Parameters:
+// - path: Path of the file
+// Returns:
+// - Pointer to the directory entry, or NULL if the file is not in the image
+//
+t_romfsEntry * romfs_find(char * path) {
+	t_romfsHeader *	hdr = romfs_header();
+	t_romfsEntry *	entry;
+	char			name[ROMFS_nameLength];
+	int				len = 0;
+	int				i;
+
+	if (hdr == NULL || hdr->files == 0) {
+		return NULL;
+	}
+	if (isdigit(path[0]) && path[1] == ':') {		// Skip the drive number
+		path += 2;
+	}
+	if (*path != '/' && *path != '\\') {
+		len = romfs_apply(name, 0, mos_getCwd());	// This is empty if there is no SD card
+	}
+	if (len >= 0) {
+		len = romfs_apply(name, len, path);
+	}
+	if (len <= 0) {
+		return NULL;
+	}
+	name[len] = 0;
+
+	entry = (t_romfsEntry *)(hdr + 1);
+	for (i = 0; i < hdr->files; i++, entry++) {
+		if (strcasecmp(entry->name, name) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+// Unpack LZSS data
+// The data is a series of groups, each a flag byte followed by eight items, least significant bit first.
+// A set bit is a literal byte; a clear bit is a reference to a run of 3 to 18 bytes up to 4096 bytes back,
+// in two bytes: the offset - 1 in the low 12 bits, low byte first, and the length - 3 in the top 4 bits
+// Parameters:
+// - src: The packed data
+// - packed: Length of the packed data
+// - dst: Address to unpack to
+// - size: Number of bytes to unpack
+// Returns:
+// - FR_OK, or MOS_BAD_ROMFS if the data is damaged
+//
+UINT24 romfs_unpack(BYTE * src, UINT24 packed, BYTE * dst, UINT24 size) {
+	BYTE *	end = src + packed;
+	BYTE *	start = dst;
+	BYTE *	stop = dst + size;
+	BYTE *	from;
+	UINT24	n;
+	BYTE	flags = 0;
+	BYTE	bits = 0;
+
+	while (dst < stop) {
+		if (bits == 0) {
+			if (src >= end) {
+				return MOS_BAD_ROMFS;
+			}
+			flags = *src++;
+			bits = 8;
+		}
+		if (flags & 1) {
+			if (src >= end) {
+				return MOS_BAD_ROMFS;
+			}
+			*dst++ = *src++;
+		}
+		else {
+			if (src + 1 >= end) {
+				return MOS_BAD_ROMFS;
+			}
+			n = src[0] | ((src[1] & 0x0F) << 8);
+			from = dst - n - 1;
+			if (from < start) {
+				return MOS_BAD_ROMFS;
+			}
+			n = (src[1] >> 4) + 3;
+			if (n > stop - dst) {
+				n = stop - dst;
+			}
+			src += 2;
+			while (n-- > 0) {
+				*dst++ = *from++;
+			}
+		}
+		flags >>= 1;
+		bits--;
+	}
+	return FR_OK;
+}
+
+// Read a file from the ROM filesystem into memory
+// Parameters:
+// - entry: Directory entry of the file
+// - address: Address to read the file into
+// - size: Number of bytes to read, from the start of the file
+// Returns:
+// - FR_OK, or MOS_BAD_ROMFS if the image is damaged
+//
+UINT24 romfs_read(t_romfsEntry * entry, BYTE * address, UINT24 size) {
+	BYTE *	data = romfs_image + entry->offset;
+
+	if (size > entry->length) {
+		size = entry->length;
+	}
+	switch (entry->method) {
+		case ROMFS_stored:
+			memcpy(address, data, size);
+			return FR_OK;
+		case ROMFS_lzss:
+			return romfs_unpack(data, entry->packed, address, size);
+	}
+	return MOS_BAD_ROMFS;
+}
+
+// List the files in the ROM filesystem, checking the data of each against its CRC
+// Returns:
+// - FR_OK, or MOS_BAD_ROMFS if the image is missing or damaged
+//
+UINT24 mos_ROMFS(void) {
+	t_romfsHeader *	hdr = romfs_header();
+	t_romfsEntry *	entry;
+	UINT24			fr = FR_OK;
+	BOOL			ok;
+	int				i;
+
+	if (hdr == NULL) {
+		return MOS_BAD_ROMFS;
+	}
+	entry = (t_romfsEntry *)(hdr + 1);
+	for (i = 0; i < hdr->files; i++, entry++) {
+		ok = entry->offset + entry->packed <= hdr->length && mos_CRC32(0, romfs_image + entry->offset, entry->packed) == entry->crc;
+		printf("%-31s %6u %6u %s\r\n", entry->name, entry->length, entry->packed, ok ? "" : "BAD");
+		if (!ok) {
+			fr = MOS_BAD_ROMFS;
+		}
+	}
+	printf("%d files, %u bytes of flash at &%06x\r\n", hdr->files, hdr->length, romfs_image);
+	return fr;
+}
@@ -0,0 +1,48 @@
+/*
+ * Title:			AGON MOS - ROM filesystem
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ */
+
+#ifndef ROMFS_H
+#define ROMFS_H
+
+#include "ff.h"
+
+#define ROMFS_version		1
+#define ROMFS_nameLength	32		// Longest path in the image, including the terminator
+
+// Compression methods
+//
+#define ROMFS_stored		0		// Not compressed
+#define ROMFS_lzss			1		// LZSS (see romfs_unpack)
+
+// The image is built by tools/mkromfs.py into romfs_image.asm. It starts with this header,
+// followed by a directory entry for each file, then the file data
+//
+typedef struct {
+	char	magic[4];					// "ROMF"
+	BYTE	version;					// ROMFS_version
+	BYTE	files;						// Number of directory entries
+	UINT24	length;						// Length of the whole image
+} t_romfsHeader;
+
+typedef struct {
+	char	name[ROMFS_nameLength];		// Path from the root, without the leading '/'
+	UINT24	offset;						// Offset of the data from the start of the image
+	UINT24	length;						// Length of the file
+	UINT24	packed;						// Length of the data in the image
+	BYTE	method;						// Compression method
+	DWORD	crc;						// CRC32 of the data in the image
+} t_romfsEntry;
+
+t_romfsHeader *	romfs_header(void);
+t_romfsEntry *	romfs_find(char * path);
+UINT24	romfs_unpack(BYTE * src, UINT24 packed, BYTE * dst, UINT24 size);
+UINT24	romfs_read(t_romfsEntry * entry, BYTE * address, UINT24 size);
+UINT24	mos_ROMFS(void);
+
+#endif ROMFS_H
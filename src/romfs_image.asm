@@ -0,0 +1,21 @@
+;
+; Title:	AGON MOS - ROM filesystem image
+; Author:	Agon MOS contributors
+; Created:	17/10/2026
+; Last Updated:	17/10/2026
+;
+; Modinfo:
+;
+; Generated by tools/mkromfs.py with no files; do not edit
+
+			.ASSUME	ADL = 1
+
+			DEFINE ROMFS, SPACE = ROM
+			SEGMENT ROMFS
+
+			XDEF	_romfs_image
+
+_romfs_image:
+			DB	052h, 04Fh, 04Dh, 046h, 001h, 000h, 009h, 000h, 000h
+
+			END
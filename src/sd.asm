@@ -2,9 +2,13 @@
 ; Title:	AGON MOS - SD card low level assembly language
 ; Author:	Leigh Brown
 ; Created:	26/05/2023
-; Last Updated:	26/05/2023
+; Last Updated:	17/10/2026
 
 ; Modinfo
+; 17/10/2026:	SD_writeBlocks uses a single CMD25 multiple block write for more than one block
+; 17/10/2026:	SD_writeBlocks returns while the card programs the last block; added SD_flush
+; 17/10/2026:	Added the command, timeout and wait counters in sd_counters
+; 17/10/2026:	A write left programming that never finishes is latched in sd_write_lost
 ;
 
 		INCLUDE "ez80F92.inc"
@@ -21,25 +25,49 @@ SD_READY	.equ		0
 SD_INIT_CYCLES		.equ	10
 
 SD_START_TOKEN	.equ	%FE
+SD_START_TOKEN_MULTI	.equ	%FC
+SD_STOP_TOKEN	.equ	%FD
 SD_ERROR_TOKEN	.equ	%00
 
 SD_DATA_ACCEPTED	.equ	%05
 SD_DATA_REJECTED_CRC	.equ	%0B
 SD_DATA_REJECTED_WRITE	.equ	%0D
 
+; How a write left programming by SD_writeBlocks ended, passed to sd_busy_end
+SD_BUSY_HIDDEN	.equ	0	; Finished before the next command
+SD_BUSY_WAITED	.equ	1	; The next command had to wait
+SD_BUSY_TIMEOUT	.equ	2	; Never finished
+
 SD_BLOCK_LEN	.equ	512
 
 SD_CMD_LEN	.equ	6
 
+; Offsets into sd_counters; these must match t_sdCounters in sd.h
+SD_COUNT_COMMANDS	.equ	0	; Commands sent
+SD_COUNT_NORESPONSE	.equ	3	; Commands the card never answered
+SD_COUNT_TOKENTIMEOUTS	.equ	6	; Reads with no data token, or written blocks with no data response
+SD_COUNT_BUSYTIMEOUTS	.equ	9	; Times the card stayed busy
+SD_COUNT_RESPONSEWAIT	.equ	12	; Timer 2 ticks waiting for data tokens and responses (32 bit)
+SD_COUNT_BUSYWAIT	.equ	16	; Timer 2 ticks waiting for the card to finish programming (32 bit)
+SD_COUNT_LEN		.equ	20
+
 		XDEF		_SD_init
 		XDEF		_SD_readBlocks
 		XDEF		_SD_writeBlocks
+		XDEF		_SD_flush
+		XDEF		_sd_busy
+		XDEF		_sd_write_lost
+		XDEF		_sd_counters
+		XDEF		_sd_timing
 
 		XREF		_spi_transfer
 		XREF		_spi_read_one
 		XREF		_spi_read
 		XREF		_spi_write
 		XREF		_sdcardDelay
+		XREF		_sd_busy_start	; In diskio.c
+		XREF		_sd_busy_check
+		XREF		_sd_busy_end
 
 		.ASSUME ADL = 1
 
@@ -63,7 +91,10 @@ _SD_init:
 		ADD		HL,SP
 		LD		SP,HL
 
-		; Off we go
+		; Off we go; the power up sequence resets the card, so nothing is left programming
+		XOR		A,A
+		LD		(_sd_busy),A
+		LD		(_sd_write_lost),A
 		CALL		_SD_powerUpSeq
 
 		; Command card to idle
@@ -224,6 +255,7 @@ SD_readSingleBlock:
 		JR		Z,$out3
 
 		; Wait for a response token (timeout = 100ms)
+		CALL		SD_timeStart
 		TIMER_SET	0,100
 		TIMER_START	0
 		
@@ -235,8 +267,11 @@ $loop1:		CALL		_spi_read_one
 		; Continue until the timer expires
 		TIMER_EXP?	0		; (clobbers just A)
 		JR		NC,$loop1
+		CALL		SD_countTokenTimeout
 		
 $out1:		TIMER_RESET	0		; (clobbers just A)
+		LD		HL,_sd_counters+SD_COUNT_RESPONSEWAIT
+		CALL		SD_timeEnd
 
 		; Check if card response is SD_START_TOKEN
 
@@ -288,8 +323,19 @@ _SD_writeBlocks:
 		; sign extend count (it's unsigned, so set top byte to 0)
 		LD		(IX+17),0
 
-		; HL := count, then jump to the check for zero
+		; Write runs of two or more blocks with a single CMD25
 		LD		HL,(IX+15)
+		LD		DE,2
+		OR		A,A
+		SBC		HL,DE
+		JR		C,$single
+		CALL		SD_writeMultipleBlocks
+		OR		A,A
+		JR		NZ,$err_exit
+		JR		$done
+
+		; HL := count, then jump to the check for zero
+$single:	LD		HL,(IX+15)
 		JR		$start
 
 $loop:		CALL		SD_writeSingleBlock
@@ -321,6 +367,28 @@ $err_exit:	LD		A,SD_ERROR
 		JR		$exit
 
 
+; BYTE SD_flush(void)
+;
+; Wait for the card to finish programming the last block written
+; Returns SD_SUCCESS, or SD_ERROR if it never does
+
+		SCOPE
+
+_SD_flush:
+		LD		A,(_sd_busy)
+		OR		A,A
+		RET		Z		; SD_SUCCESS
+		CALL		_SD_CS_enable
+		CALL		SD_waitPending
+		PUSH		AF
+		CALL		_SD_CS_disable
+		POP		AF
+		LD		A,SD_SUCCESS
+		RET		Z
+		LD		A,SD_ERROR
+		RET
+
+
 ; SD_writeSingleBlock
 
 ; This does not use the C calling-convention.
@@ -356,6 +424,7 @@ SD_writeSingleBlock:
 		POP		BC
 
 		; Wait for a response token (timeout = 250ms)
+		CALL		SD_timeStart
 		TIMER_SET	0,250
 		TIMER_START	0
 		
@@ -368,9 +437,12 @@ $loop1:		CALL		_spi_read_one
 		TIMER_EXP?	0		; (clobbers just A)
 		JR		NC,$loop1
 
-		; Timeout - just fall through
+		; Timeout - count it and fall through
+		CALL		SD_countTokenTimeout
 
 $gotit1:	TIMER_RESET	0		; (clobbers just A)
+		LD		HL,_sd_counters+SD_COUNT_RESPONSEWAIT
+		CALL		SD_timeEnd
 
 		; If data accepted
 		LD		A,%1F
@@ -381,33 +453,287 @@ $gotit1:	TIMER_RESET	0		; (clobbers just A)
 		; *token = 0x05 (conveniently left in register A)
 		LD		(IX-1),A
 
-		; Wait for write to finish (timeout = 250ms)
+		; Leave the card programming the block; the next command waits for it
+		CALL		SD_deferBusy
+
+		; Deassert chip select
+$out3:		CALL		_SD_CS_disable
+
+		; Restore res1 to return to caller
+		POP		AF
+		RET
+
+
+; SD_writeMultipleBlocks
+
+; This does not use the C calling-convention.
+; It uses the stack frame pointer set up by _SD_writeBlocks
+; All count blocks are sent after one CMD25, then the transfer is ended with a stop token
+;
+; Output: A := SD_SUCCESS or SD_ERROR
+
+		SCOPE
+
+SD_writeMultipleBlocks:
+		LD		(IX-3),CMD25     | %40
+		LD		(IX-2),CMD25_CRC | %01
+
+		CALL		SD_sendIOCmd	; Sets *token to 0xFF too
+		CP		A,SD_READY
+		JR		NZ,$out_error
+
+		; Leave a byte gap between the response and the first data token
+		CALL		_spi_read_one
+
+$loop:		CALL		SD_delayDisc
+
+		; Send start token
+		LD		C,SD_START_TOKEN_MULTI
+		PUSH		BC
+		CALL		_spi_transfer
+		POP		BC
+
+		; Write buffer to card
+		LD		BC,SD_BLOCK_LEN
+		PUSH		BC
+		LD		BC,(IX+12)
+		PUSH		BC
+		CALL		_spi_write
+		POP		BC
+		POP		BC
+
+		; Wait for a response token (timeout = 250ms)
+		CALL		SD_timeStart
 		TIMER_SET	0,250
 		TIMER_START	0
+		
+$loop1:		CALL		_spi_read_one
+		LD		B,A		; Save byte read
+		CP		A,%FF
+		JR		NZ,$gotit1
 
-$loop2:		CALL		_spi_read_one
-		CP		A,%00
-		JR		NZ,$gotit2
+		; Continue until the timer expires
+		TIMER_EXP?	0		; (clobbers just A)
+		JR		NC,$loop1
+
+		; Timeout - count it and fall through
+		CALL		SD_countTokenTimeout
+
+$gotit1:	TIMER_RESET	0		; (clobbers just A)
+		LD		HL,_sd_counters+SD_COUNT_RESPONSEWAIT
+		CALL		SD_timeEnd
+
+		; Stop the transfer unless the data was accepted
+		LD		A,%1F
+		AND		A,B
+		CP		A,SD_DATA_ACCEPTED
+		JR		NZ,$stop_error
+
+		; Wait for the block to be programmed
+		CALL		SD_waitBusy
+		JR		NZ,$stop_error
+
+		; Update sector, buf and count
+		; HL is set to the updated value of count
+		CALL		SD_updateIOVars
+		LD		A,H
+		OR		A,L
+		JR		NZ,$loop
+
+		; End the transfer, leaving the card programming the last block
+		CALL		SD_sendStop
+		CALL		SD_deferBusy
+		CALL		_SD_CS_disable
+		XOR		A,A	; LD A,SD_SUCCESS
+		RET
+
+$stop_error:	CALL		SD_stopTransfer
+$out_error:	CALL		_SD_CS_disable
+		LD		A,SD_ERROR
+		RET
+
+
+; SD_stopTransfer
+;
+; Send the stop token that ends a multiple block write, then wait for the card
+;
+; Output: Z if the card is ready, NZ on timeout
+
+SD_stopTransfer:
+		CALL		SD_sendStop
+		JR		SD_waitBusy
+
+
+; SD_sendStop
+;
+; Send the stop token that ends a multiple block write
+
+SD_sendStop:
+		LD		C,SD_STOP_TOKEN
+		PUSH		BC
+		CALL		_spi_transfer
+		POP		BC
+		JP		_spi_read_one	; Skip the byte before the busy signal starts
+
+
+; SD_deferBusy
+;
+; Note that the card has been left programming a block. It carries on with chip select
+; deasserted, and shows busy again when it is next selected; SD_waitPending waits for it
+
+SD_deferBusy:
+		LD		A,1
+		LD		(_sd_busy),A
+		JP		_sd_busy_start
+
+
+; SD_waitPending
+;
+; Wait for the card to finish a block left programming by SD_deferBusy, if there is one
+; The card must be selected
+; A timeout means that block was lost, so it is latched in sd_write_lost for the next disk_write
+; or CTRL_SYNC to report; the command being sent fails too, but may be retried
+;
+; Output: Z if the card is ready, NZ on timeout
+
+		SCOPE
+
+SD_waitPending:
+		LD		A,(_sd_busy)
+		OR		A,A
+		RET		Z
+		XOR		A,A
+		LD		(_sd_busy),A
+		CALL		_sd_busy_check
+
+		; Usually the card has finished by now
+		CALL		_spi_read_one
+		LD		C,SD_BUSY_HIDDEN
+		OR		A,A
+		JR		NZ,$done
+		CALL		SD_waitBusy
+		LD		C,SD_BUSY_WAITED
+		JR		Z,$done
+		LD		C,SD_BUSY_TIMEOUT
+
+$done:		PUSH		BC
+		CALL		_sd_busy_end
+		POP		BC
+		LD		A,C
+		SUB		A,SD_BUSY_TIMEOUT
+		JR		Z,$timeout
+		XOR		A,A
+		RET
+$timeout:	INC		A
+		LD		(_sd_write_lost),A
+		RET
+
+
+; SD_waitBusy
+;
+; Wait for the card to release the busy signal (timeout = 250ms)
+;
+; Output: Z if the card is ready, NZ on timeout
+
+		SCOPE
+
+SD_waitBusy:
+		CALL		SD_timeStart
+		TIMER_SET	0,250
+		TIMER_START	0
+
+$loop:		CALL		_spi_read_one
+		OR		A,A
+		JR		NZ,$ready
 
 		; Continue until the timer expires
 		TIMER_EXP?	0
-		JR		NC,$loop2
+		JR		NC,$loop
 
-		; Timeout, skip over setting token
-		JR		$notgot
+		TIMER_RESET	0
+		LD		HL,(_sd_counters+SD_COUNT_BUSYTIMEOUTS)
+		INC		HL
+		LD		(_sd_counters+SD_COUNT_BUSYTIMEOUTS),HL
+		LD		HL,_sd_counters+SD_COUNT_BUSYWAIT
+		CALL		SD_timeEnd
+		LD		A,1
+		OR		A,A
+		RET
 
-$gotit2:	; Success: set token to 0x00
+$ready:		TIMER_RESET	0
+		LD		HL,_sd_counters+SD_COUNT_BUSYWAIT
+		CALL		SD_timeEnd
 		XOR		A,A
-		LD		A,(IX-1)
+		RET
 
-$notgot:	; Reset the timer
-		TIMER_RESET	0
 
-		; Deassert chip select
-$out3:		CALL		_SD_CS_disable
+; SD_countTokenTimeout
+;
+; Count a read that never got its data token, or a written block that never got its data response
+; Clobbers HL
 
-		; Restore res1 to return to caller
-		POP		AF
+SD_countTokenTimeout:
+		LD		HL,(_sd_counters+SD_COUNT_TOKENTIMEOUTS)
+		INC		HL
+		LD		(_sd_counters+SD_COUNT_TOKENTIMEOUTS),HL
+		RET
+
+
+; SD_timeStart
+;
+; Note Timer 2 at the start of a wait, if the waits are being timed (see sd_stats_enable)
+; Clobbers A
+
+SD_timeStart:
+		LD		A,(_sd_timing)
+		OR		A,A
+		RET		Z
+		IN0		A,(TMR2_DR_L)		; Reading the low byte latches the high byte
+		LD		(sd_waitStart),A
+		IN0		A,(TMR2_DR_H)
+		LD		(sd_waitStart+1),A
+		RET
+
+
+; SD_timeEnd
+;
+; Add the Timer 2 ticks since SD_timeStart to a 32-bit total, if the waits are being timed
+; Timer 2 wraps after about 57ms, so only a timed out wait can be undercounted
+;
+; Input: HL: the total
+; Clobbers A, HL
+
+SD_timeEnd:
+		LD		A,(_sd_timing)
+		OR		A,A
+		RET		Z
+		PUSH		BC
+		PUSH		DE
+		IN0		E,(TMR2_DR_L)
+		IN0		D,(TMR2_DR_H)
+		LD		A,(sd_waitStart)	; BC: the ticks since; the timer counts down
+		SUB		A,E
+		LD		C,A
+		LD		A,(sd_waitStart+1)
+		SBC		A,D
+		LD		B,A
+		LD		A,(HL)			; total += BC
+		ADD		A,C
+		LD		(HL),A
+		INC		HL
+		LD		A,(HL)
+		ADC		A,B
+		LD		(HL),A
+		INC		HL
+		LD		A,(HL)
+		ADC		A,0
+		LD		(HL),A
+		INC		HL
+		LD		A,(HL)
+		ADC		A,0
+		LD		(HL),A
+		POP		DE
+		POP		BC
 		RET
 
 
@@ -431,6 +757,11 @@ SD_sendIOCmd:
 		; Assert chip select
 		CALL		_SD_CS_enable
 
+		; Wait for the last write to be programmed; if it never is, return 0xFF as if the card did not respond
+		CALL		SD_waitPending
+		LD		A,%FF
+		RET		NZ
+
 		; Push arguments on to stack first
 		LD		HL,SD_CMD_LEN
 		PUSH		HL
@@ -506,13 +837,21 @@ SD_updateIOVars:
 
 		SCOPE
 
-_SD_readRes1:	LD		B,9
+_SD_readRes1:	LD		HL,(_sd_counters+SD_COUNT_COMMANDS)
+		INC		HL
+		LD		(_sd_counters+SD_COUNT_COMMANDS),HL
+		LD		B,9
 $loop:		PUSH		BC	; save B over call to _spi_read_one
 		CALL		_spi_read_one
 		POP		BC
 		CP		A,%FF
 		JR		NZ,$out
 		DJNZ		$loop
+
+		; The card never answered
+		LD		HL,(_sd_counters+SD_COUNT_NORESPONSE)
+		INC		HL
+		LD		(_sd_counters+SD_COUNT_NORESPONSE),HL
 $out:		RET
 
 
@@ -749,3 +1088,8 @@ cmd58_string:	DB		CMD58 | %40
 
 		SECTION		BSS
 sd_cmd_buffer:	DS		6
+_sd_busy:	DS		1		; 1 if the card was left programming a block
+_sd_write_lost:	DS		1		; 1 if a block left programming never finished; cleared by diskio.c
+_sd_timing:	DS		1		; Non-zero to time the waits; set by sd_stats_enable
+sd_waitStart:	DS		2		; Timer 2 at the start of the current wait
+_sd_counters:	DS		SD_COUNT_LEN	; See SD_COUNT_* above
@@ -3,10 +3,13 @@
  * Author:			RJH
  * Modified By:		Dean Belfield
  * Created:			19/06/2022
- * Last Updated:	08/11/2023
+ * Last Updated:	17/10/2026
  *
  * Modinfo:
  * 08/11/2023:		Removed redundant defines and function prototypes
+ * 17/10/2026:		Added SD_flush and the write busy statistics
+ * 17/10/2026:		Added the driver counters and per operation statistics
+ * 17/10/2026:		Renamed overlap to overlapMax
  */
 
 #ifndef SD_H
@@ -16,9 +19,85 @@
 #define SD_ERROR    1
 #define SD_READY	0
 
+// How a write left programming by SD_writeBlocks ended; see SD_waitPending in sd.asm
+//
+#define SD_BUSY_HIDDEN	0		// Finished before the next command
+#define SD_BUSY_WAITED	1		// The next command had to wait
+#define SD_BUSY_TIMEOUT	2		// Never finished
+
+#define SD_retries		2		// Times disk_read and disk_write try again after an error
+#define SD_histBuckets	6		// Calls taking under 1, 4, 16, 64 and 256ms, and longer
+
+// Counters kept by sd.asm in sd_counters; these must match SD_COUNT_* in sd.asm
+// The counts are always kept; the times only while timing is on
+//
+typedef struct {
+	UINT24	commands;			// Commands sent
+	UINT24	noResponse;			// Commands the card never answered
+	UINT24	tokenTimeouts;		// Reads with no data token, or written blocks with no data response
+	UINT24	busyTimeouts;		// Times the card stayed busy
+	DWORD	responseWait;		// Time spent waiting for data tokens and responses in Timer 2 ticks
+	DWORD	busyWait;			// Time spent waiting for the card to finish programming in Timer 2 ticks
+} t_sdCounters;
+
+// Statistics for disk_read or disk_write
+// The counts are always kept; the time and histogram only while timing is on
+//
+typedef struct {
+	UINT24	calls;
+	DWORD	blocks;				// Blocks moved by the calls that succeeded
+	UINT24	errors;				// Calls that still failed after the retries
+	UINT24	retries;
+	DWORD	time;				// Time spent in the calls, in Timer 2 ticks here and microseconds in t_sdInfo
+	UINT24	histogram[SD_histBuckets];
+} t_sdOpStats;
+
+// Statistics for the writes SD_writeBlocks returns from while the card is still programming
+// The counts are always kept; the times only while timing is on
+//
+typedef struct {
+	UINT24	deferred;			// Writes left programming
+	UINT24	hidden;				// Finished before the next command
+	UINT24	waited;				// The next command had to wait for them
+	UINT24	timeouts;			// Never finished
+	DWORD	overlapMax;			// Upper bound on the time the card spent programming while MOS got on with other work,
+								// in Timer 2 ticks: the gap before the next command, capped at the busy timeout
+	DWORD	wait;				// Time spent waiting for them in Timer 2 ticks
+} t_sdStats;
+
+// The statistics as returned by sd_stats_get, with the times in microseconds
+// This is also the buffer filled by the MOS API call mos_sdstats, so the layout is fixed
+//
+typedef struct {
+	UINT24	deferred;			//   0
+	UINT24	hidden;				//   3
+	UINT24	waited;				//   6
+	UINT24	timeouts;			//   9
+	DWORD	overlapMax;			//  12
+	DWORD	wait;				//  16
+	UINT24	commands;			//  20
+	UINT24	noResponse;			//  23
+	UINT24	tokenTimeouts;		//  26
+	UINT24	busyTimeouts;		//  29
+	DWORD	responseWait;		//  32
+	DWORD	busyWait;			//  36
+	t_sdOpStats	read;			//  40
+	t_sdOpStats	write;			//  75
+} t_sdInfo;						// 110 bytes
+
 BYTE	SD_readBlocks(DWORD addr, BYTE *buf, WORD count);
 BYTE	SD_writeBlocks(DWORD addr, BYTE *buf, WORD count);
+BYTE	SD_flush();
 
 BYTE	SD_init();
 
+void	sd_busy_start(void);			// Called from sd.asm
+void	sd_busy_check(void);
+void	sd_busy_end(BYTE state);
+
+void	sd_stats_enable(BOOL enable);
+BOOL	sd_stats_enabled(void);
+void	sd_stats_get(t_sdInfo * info);
+UINT24	mos_SDSTATS(t_sdInfo * info);
+
 #endif SD_H
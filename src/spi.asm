@@ -5,6 +5,7 @@
 ; Last Updated:	26/05/2023
 
 ; Modinfo
+; 17/10/2026:	The transfer routines run from internal SRAM; see iram.inc
 ;
 
 ; The approach taken to maximise performance is:
@@ -14,6 +15,7 @@
 
 		INCLUDE "ez80F92.inc"
 		INCLUDE "macros.inc"
+		INCLUDE "iram.inc"
 
 SPI_ENA_DELAY	.equ	50
 
@@ -29,6 +31,13 @@ SPI_CLK		.equ	3	; PB3
 		XDEF	_spi_read
 		XDEF	_spi_write
 
+		XDEF	spi_iram_start
+		XDEF	spi_iram_end
+		XDEF	spi_transfer_rom
+		XDEF	spi_read_one_rom
+		XDEF	spi_read_rom
+		XDEF	spi_write_rom
+
 		.ASSUME ADL = 1
 
 
@@ -129,10 +138,19 @@ _init_spi:	;
 		RET
 
 
+; The routines from here to spi_iram_end are copied to IRAM_SPI by iram_install
+; and called there, so they must only use relative jumps between themselves
+;
+_spi_transfer	EQU	IRAM_SPI + (spi_transfer_rom - spi_iram_start)
+_spi_read_one	EQU	IRAM_SPI + (spi_read_one_rom - spi_iram_start)
+_spi_read	EQU	IRAM_SPI + (spi_read_rom - spi_iram_start)
+_spi_write	EQU	IRAM_SPI + (spi_write_rom - spi_iram_start)
+
 ; unsigned char spi_read_one(void);
 ;
 		SCOPE
-_spi_read_one:
+spi_iram_start:
+spi_read_one_rom:
 		LD		C,%FF		; Kick SPI into action before
 		OUT0		(SPI_TSR),C	; anything else...
 		POP		HL		; Pop return address for later
@@ -140,7 +158,7 @@ _spi_read_one:
 
 ; unsigned char spi_transfer(unsigned char d);
 ;
-_spi_transfer:
+spi_transfer_rom:
 		POP		HL		; Pop return address for later
 		POP		DE		; Transmit the byte ASAP...
 		OUT0		(SPI_TSR),E
@@ -162,7 +180,7 @@ $done:		IN0		A,(SPI_RBR)
 ;
 
 		SCOPE
-_spi_read:
+spi_read_rom:
 		; Request the first byte - do first to minimise delay
 		LD		C,%FF
 		OUT0		(SPI_TSR),C
@@ -222,7 +240,7 @@ $gotlast:	IN0		A,(SPI_RBR)
 ; void spi_write(char *buf, unsigned int len);
 
 		SCOPE
-_spi_write:
+spi_write_rom:
 		PUSH		IX
 		LD		IX,0
 		ADD		IX,SP
@@ -277,3 +295,4 @@ $looplast:	IN0		A,(SPI_SR)
 $sentlast:	; Don't bother reading the dummy byte (IN0 A,(SPI_RBR))
 		RET
 
+spi_iram_end:
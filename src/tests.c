@@ -1,9 +1,26 @@
 #include "tests.h"
 #include "umm_malloc.h"
+#include "ff.h"
+#include "mos.h"
+#include "mos_checksum.h"
+#include "mos_walk.h"
+#include "iram.h"
+#include "spi.h"
+#include "sd.h"
+#include "vdp_query.h"
+#include "romfs.h"
+#include "file_stats.h"
+#include "event.h"
+#include "isr_stats.h"
+#include "timer.h"
+#include <eZ80.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+extern volatile DWORD clock;	// In globals.asm
+extern DWORD disk_reads;		// In diskio.c
+
 #if DEBUG > 0
 
 #define MG_MAX_ITEMS	64
@@ -84,9 +101,1224 @@ cleanup:
 	}
 }
 
+// check a small block freed is handed back by the next malloc of its size, and
+// that freeing it twice doesn't hand it out twice
+static void heap_quick_test()
+{
+	void *a, *b, *c;
+	BOOL ok;
+
+	a = umm_malloc(12);
+	umm_free(a);
+	b = umm_malloc(12);
+	ok = a != NULL && a == b;
+	umm_free(b);
+	umm_free(b);
+	b = umm_malloc(12);
+	c = umm_malloc(12);
+	ok = ok && b != c;
+	umm_free(b);
+	umm_free(c);
+	printf("Heap quick lists: %s\r\n", ok ? "OK" : "FAILED");
+}
+
+#if FF_FAT_MIRROR_DEFER
+
+#define FM_FILE		"mos_test.bin"
+#define FM_CHUNK	100
+#define FM_CHUNKS	2048
+
+
+// write a file in small unaligned chunks so the window keeps swapping between
+// data and FAT sectors, and report how many 2nd FAT writes were deferred
+static void fat_mirror_bench()
+{
+	FIL fil;
+	FATFS *fs;
+	DWORD nclst, saved, ticks;
+	UINT bw;
+	int i;
+	FRESULT fr;
+	BYTE *buf = umm_malloc(FM_CHUNK);
+
+	if (buf == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		return;
+	}
+	memset(buf, 0xA5, FM_CHUNK);
+
+	fr = f_getfree("", &nclst, &fs);
+	if (fr == FR_OK) {
+		fr = f_open(&fil, FM_FILE, FA_WRITE | FA_CREATE_ALWAYS);
+	}
+	if (fr == FR_OK) {
+		saved = fs->mirror_saved;
+		ticks = clock;
+		for (i=0; i<FM_CHUNKS && fr == FR_OK; i++) {
+			fr = f_write(&fil, buf, FM_CHUNK, &bw);
+		}
+		if (f_close(&fil) != FR_OK) {
+			fr = FR_DISK_ERR;
+		}
+		ticks = clock - ticks;
+		f_unlink(FM_FILE);
+	}
+	umm_free(buf);
+	if (fr == FR_OK) {
+		printf("FAT mirror test: %lu bytes in %lu cs, %lu 2nd FAT writes deferred\r\n", (DWORD)FM_CHUNK * FM_CHUNKS, ticks, fs->mirror_saved - saved);
+	} else {
+		printf("FAT mirror test FAILED (%d)\r\n", fr);
+	}
+}
+
+#endif /* FF_FAT_MIRROR_DEFER */
+
+#define SB_FILE		"mos_test.log"
+#define SB_RECORD	48			// One logged sample
+#define SB_RECORDS	2048
+#define SB_BUCKETS	8
+
+// Upper bounds of the latency histogram buckets, in timer 1 ticks (256 / 18.432MHz = ~13.9us)
+static const unsigned short sb_bounds[SB_BUCKETS - 1] = { 7, 36, 72, 144, 360, 720, 1440 };
+static const char * sb_labels[SB_BUCKETS] = { "<0.1ms", "<0.5ms", "<1ms", "<2ms", "<5ms", "<10ms", "<20ms", ">=20ms" };
+
+// run timer 1 freely (continuous mode, /256) so appends can be timed without disturbing timer 0
+static void stream_bench_timer(BOOL enable)
+{
+	TMR1_CTL = 0x00;
+	if (enable) {
+		TMR1_RR_L = 0xFF;
+		TMR1_RR_H = 0xFF;
+		TMR1_CTL = 0x1F;
+	}
+}
+
+static unsigned short stream_bench_ticks()
+{
+	unsigned char l = TMR1_DR_L;
+	unsigned char h = TMR1_DR_H;
+	return (h << 8) | l;
+}
+
+// append fixed size records to a log file, once with mos_FWRITE and once with
+// a preallocated stream, and print a histogram of the time taken by each append
+static void stream_bench_run(BOOL stream, BYTE *record)
+{
+	UINT24 hist[SB_BUCKETS];
+	unsigned short t, worst = 0;
+	DWORD ticks = 0;
+	UINT8 fh;
+	int i, b;
+
+	memset(hist, 0, sizeof(hist));
+	if (stream) {
+		fh = mos_SOPEN(SB_FILE, (UINT24)SB_RECORD * SB_RECORDS);
+	} else {
+		fh = mos_FOPEN(SB_FILE, FA_WRITE | FA_CREATE_ALWAYS);
+	}
+	if (fh == 0) {
+		printf("%s: could not create %s\r\n", stream ? "mos_SWRITE" : "mos_FWRITE", SB_FILE);
+		return;
+	}
+	for (i=0; i<SB_RECORDS; i++) {
+		t = stream_bench_ticks();
+		if (stream) {
+			mos_SWRITE(fh, (UINT24)record, SB_RECORD);
+		} else {
+			mos_FWRITE(fh, (UINT24)record, SB_RECORD);
+		}
+		t -= stream_bench_ticks();		// timer counts down
+		for (b=0; b<SB_BUCKETS - 1 && t >= sb_bounds[b]; b++);
+		hist[b]++;
+		ticks += t;
+		if (t > worst) {
+			worst = t;
+		}
+	}
+	mos_FCLOSE(fh);
+	f_unlink(SB_FILE);
+
+	printf("%s: %d x %d bytes, mean %lu us, worst %lu us\r\n", stream ? "mos_SWRITE" : "mos_FWRITE", SB_RECORDS, SB_RECORD, ticks * 139 / 10 / SB_RECORDS, (DWORD)worst * 139 / 10);
+	for (b=0; b<SB_BUCKETS; b++) {
+		printf(" %-6s %5u\r\n", sb_labels[b], hist[b]);
+	}
+}
+
+static void stream_bench()
+{
+	BYTE *record = umm_malloc(SB_RECORD);
+
+	if (record == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		return;
+	}
+	memset(record, 0x5A, SB_RECORD);
+	stream_bench_timer(TRUE);
+	stream_bench_run(FALSE, record);
+	stream_bench_run(TRUE, record);
+	stream_bench_timer(FALSE);
+	umm_free(record);
+}
+
+#if FF_PRIVATE_BUFS
+
+#define PB_FILE1	"mos_test.pb1"
+#define PB_FILE2	"mos_test.pb2"
+#define PB_RECORD	48
+#define PB_RECORDS	2000
+
+// write two files a record at a time, taking turns, which makes a shared sector buffer
+// swap sectors on every record; then read them back the same way and check them
+static void private_buf_run(BOOL buffered)
+{
+	BYTE rec[PB_RECORD];
+	UINT8 mode = buffered ? MOS_FA_BUFFERED : 0;
+	UINT8 fh[2];
+	DWORD wticks, rticks;
+	int i, f, bad = 0;
+
+	fh[0] = mos_FOPEN(PB_FILE1, FA_WRITE | FA_CREATE_ALWAYS | mode);
+	fh[1] = mos_FOPEN(PB_FILE2, FA_WRITE | FA_CREATE_ALWAYS | mode);
+	wticks = clock;
+	for (i=0; i<PB_RECORDS && fh[0] && fh[1]; i++) {
+		for (f=0; f<2; f++) {
+			memset(rec, i + f, PB_RECORD);
+			mos_FWRITE(fh[f], (UINT24)rec, PB_RECORD);
+		}
+	}
+	wticks = clock - wticks;
+	mos_FCLOSE(fh[0]);
+	mos_FCLOSE(fh[1]);
+
+	fh[0] = mos_FOPEN(PB_FILE1, FA_READ | mode);
+	fh[1] = mos_FOPEN(PB_FILE2, FA_READ | mode);
+	if (fh[0] == 0 || fh[1] == 0) {
+		bad++;
+	}
+	rticks = clock;
+	for (i=0; i<PB_RECORDS && !bad; i++) {
+		for (f=0; f<2; f++) {
+			if (mos_FREAD(fh[f], (UINT24)rec, PB_RECORD) != PB_RECORD || rec[0] != (BYTE)(i + f) || rec[PB_RECORD - 1] != (BYTE)(i + f)) {
+				bad++;
+			}
+		}
+	}
+	rticks = clock - rticks;
+	mos_FCLOSE(fh[0]);
+	mos_FCLOSE(fh[1]);
+	f_unlink(PB_FILE1);
+	f_unlink(PB_FILE2);
+
+	printf("%s: 2 files x %d x %d bytes, write %lu cs, read %lu cs %s\r\n", buffered ? "Private buffers" : "Shared window", PB_RECORDS, PB_RECORD, wticks, rticks, bad ? "FAILED" : "OK");
+}
+
+static void private_buf_bench()
+{
+	private_buf_run(FALSE);
+	private_buf_run(TRUE);
+}
+
+#endif /* FF_PRIVATE_BUFS */
+
+#define LB_DIR		"mos_test.dir"
+#define LB_FILES	256
+#define LB_LOOKUPS	32			// Names at the end of the folder, the slowest to find
+
+// fill a folder with long file names, then time looking names up with f_stat,
+// using a different case to the one they were created with so every
+// character has to be up-converted to match
+static void lfn_lookup_bench()
+{
+	static FILINFO fno;
+	char name[48];
+	FIL fil;
+	DWORD ticks = 0;
+	unsigned short t;
+	UINT24 failed = 0;
+	int i, j;
+
+	if (f_mkdir(LB_DIR) != FR_OK) {
+		printf("LFN lookup: could not create %s\r\n", LB_DIR);
+		return;
+	}
+	for (i=0; i<LB_FILES; i++) {
+		sprintf(name, LB_DIR "/Long file name number %03d.txt", i);
+		if (f_open(&fil, name, FA_WRITE | FA_CREATE_NEW) != FR_OK) {
+			break;
+		}
+		f_close(&fil);
+	}
+	if (i < LB_FILES) {
+		printf("LFN lookup: only created %d files\r\n", i);
+	}
+	else {
+		stream_bench_timer(TRUE);
+		for (j=0; j<4; j++) {
+			for (i=LB_FILES - LB_LOOKUPS; i<LB_FILES; i++) {
+				sprintf(name, LB_DIR "/LONG FILE NAME NUMBER %03d.TXT", i);
+				t = stream_bench_ticks();
+				if (f_stat(name, &fno) != FR_OK) {
+					failed++;
+				}
+				t -= stream_bench_ticks();		// timer counts down
+				ticks += t;
+			}
+		}
+		stream_bench_timer(FALSE);
+		printf("LFN lookup: %d entries, mean %lu us, %u not found\r\n", LB_FILES, ticks * 139 / 10 / (4 * LB_LOOKUPS), failed);
+	}
+
+	// CP437 case folding: e acute and sigma, found as E acute and capital sigma
+	if (f_open(&fil, LB_DIR "/Caf\x82 \xE5.txt", FA_WRITE | FA_CREATE_NEW) == FR_OK) {
+		f_close(&fil);
+		printf("LFN lookup: CP437 case folding %s\r\n", f_stat(LB_DIR "/CAF\x90 \xE4.TXT", &fno) == FR_OK ? "OK" : "failed");
+		f_unlink(LB_DIR "/Caf\x82 \xE5.txt");
+	}
+
+	for (i=0; i<LB_FILES; i++) {
+		sprintf(name, LB_DIR "/Long file name number %03d.txt", i);
+		f_unlink(name);
+	}
+	f_unlink(LB_DIR);
+}
+
+#define SA_DIR		"mos_sfn"
+#define SA_FILES	1000
+#define SA_STEP		100
+
+static int sa_compare(const void *a, const void *b)
+{
+	return strcmp((const char *)a, (const char *)b);
+}
+
+// create SA_FILES files whose long names all shorten to the same alias,
+// timing each SA_STEP, then check every short name generated is different
+static void sfn_alias_bench()
+{
+	static FILINFO fno;
+	char name[32];
+	FIL fil;
+	DIR dir;
+	DWORD ticks, total = 0;
+	char *alt;
+	int i, n = 0, dups = 0;
+	FRESULT fr;
+
+	alt = umm_malloc(SA_FILES * FF_SFN_BUF + FF_SFN_BUF);
+	if (alt == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		return;
+	}
+	if (f_mkdir(SA_DIR) != FR_OK) {
+		printf("SFN alias: could not create %s\r\n", SA_DIR);
+		umm_free(alt);
+		return;
+	}
+	printf("SFN alias: creating %d files, cs per %d:", SA_FILES, SA_STEP);
+	fr = FR_OK;
+	for (i=0; i<SA_FILES && fr == FR_OK; i++) {
+		if (i % SA_STEP == 0) {
+			ticks = clock;
+		}
+		sprintf(name, SA_DIR "/frame_%04d.bmp", i);
+		fr = f_open(&fil, name, FA_WRITE | FA_CREATE_NEW);
+		if (fr == FR_OK) {
+			f_close(&fil);
+		}
+		if (i % SA_STEP == SA_STEP - 1) {
+			ticks = clock - ticks;
+			total += ticks;
+			printf(" %lu", ticks);
+		}
+	}
+	printf("\r\n");
+
+	if (fr == FR_OK && f_opendir(&dir, SA_DIR) == FR_OK) {
+		while (n <= SA_FILES && f_readdir(&dir, &fno) == FR_OK && fno.fname[0]) {
+			strcpy(alt + n++ * FF_SFN_BUF, fno.altname);
+		}
+		f_closedir(&dir);
+		qsort(alt, n, FF_SFN_BUF, sa_compare);
+		for (i=1; i<n; i++) {
+			if (strcmp(alt + (i - 1) * FF_SFN_BUF, alt + i * FF_SFN_BUF) == 0) {
+				dups++;
+			}
+		}
+	}
+	if (fr != FR_OK) {
+		printf("SFN alias test FAILED (%d) after %d files\r\n", fr, i - 1);
+	} else {
+		printf("SFN alias: %d files in %lu.%02lus, %d listed, %d duplicate short names %s\r\n", SA_FILES, total / 100, total % 100, n, dups, n == SA_FILES && dups == 0 ? "OK" : "FAILED");
+	}
+
+	for (i=0; i<SA_FILES; i++) {
+		sprintf(name, SA_DIR "/frame_%04d.bmp", i);
+		f_unlink(name);
+	}
+	f_unlink(SA_DIR);
+	umm_free(alt);
+}
+
+#define CB_FILE		"mos_test.crc"
+#define CB_BLOCK	CHECKSUM_bufferSize
+#define CB_BLOCKS	32
+
+static void crc32_bench_rate(char *label, DWORD bytes, DWORD cs)
+{
+	if (cs == 0) {
+		cs = 1;
+	}
+	printf("CRC32 %s: %lu bytes in %lu cs, %lu KB/s\r\n", label, bytes, cs, bytes * 100 / 1024 / cs);
+}
+
+// time the CRC32 kernel on its own over a RAM buffer, then end to end
+// checksumming a file, and check both give the same answer
+static void crc32_bench()
+{
+	BYTE *buf = umm_malloc(CB_BLOCK);
+	DWORD crc = 0, fcrc, size, ticks;
+	FIL fil;
+	UINT bw;
+	int i;
+	UINT24 fr = FR_OK;
+
+	if (buf == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		return;
+	}
+	crc = mos_CRC32(0, (BYTE *)"123456789", 9);
+	printf("CRC32 check value: %08lX %s\r\n", crc, crc == 0xCBF43926 ? "OK" : "FAILED");
+
+	for (i=0; i<CB_BLOCK; i++) {
+		buf[i] = i * 7 + (i >> 8);
+	}
+	crc = 0;
+	ticks = clock;
+	for (i=0; i<CB_BLOCKS; i++) {
+		crc = mos_CRC32(crc, buf, CB_BLOCK);
+	}
+	crc32_bench_rate("kernel", (DWORD)CB_BLOCK * CB_BLOCKS, clock - ticks);
+
+	if (f_open(&fil, CB_FILE, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+		printf("CRC32: could not create %s\r\n", CB_FILE);
+		umm_free(buf);
+		return;
+	}
+	for (i=0; i<CB_BLOCKS && fr == FR_OK; i++) {
+		fr = f_write(&fil, buf, CB_BLOCK, &bw);
+	}
+	f_close(&fil);
+	umm_free(buf);
+	if (fr == FR_OK) {
+		ticks = clock;
+		fr = mos_fileCRC32(CB_FILE, &fcrc, &size);
+		ticks = clock - ticks;
+	}
+	f_unlink(CB_FILE);
+	if (fr != FR_OK) {
+		printf("CRC32 file test FAILED (%d)\r\n", fr);
+		return;
+	}
+	crc32_bench_rate("file", size, ticks);
+	if (fcrc != crc) {
+		printf("CRC32 file test FAILED (%08lX, expected %08lX)\r\n", fcrc, crc);
+	}
+}
+
+#define IB_FILE		"mos_test.ram"
+#define IB_BLOCK	8192
+#define IB_BLOCKS	32
+#define IB_IDLE		100			// Centiseconds to count idle loops for
+
+// time SD writes and reads, the CRC32 kernel and an idle loop (which slows down as
+// the interrupt handlers take longer) with one set of routines in place
+static void iram_bench_run(char *label, BYTE *buf)
+{
+	FIL fil;
+	UINT bw;
+	DWORD ticks, t1, t2, t3, idle = 0;
+	int i;
+	FRESULT fr;
+
+	fr = f_open(&fil, IB_FILE, FA_WRITE | FA_CREATE_ALWAYS);
+	ticks = clock;
+	for (i=0; i<IB_BLOCKS && fr == FR_OK; i++) {
+		fr = f_write(&fil, buf, IB_BLOCK, &bw);
+	}
+	f_close(&fil);
+	t1 = clock - ticks;
+	if (fr == FR_OK) {
+		fr = f_open(&fil, IB_FILE, FA_READ);
+	}
+	ticks = clock;
+	for (i=0; i<IB_BLOCKS && fr == FR_OK; i++) {
+		fr = f_read(&fil, buf, IB_BLOCK, &bw);
+	}
+	f_close(&fil);
+	t2 = clock - ticks;
+	f_unlink(IB_FILE);
+	if (fr != FR_OK) {
+		printf("IRAM %s: SD test FAILED (%d)\r\n", label, fr);
+		return;
+	}
+
+	ticks = clock;
+	for (i=0; i<IB_BLOCKS; i++) {
+		mos_CRC32(0, buf, IB_BLOCK);
+	}
+	t3 = clock - ticks;
+
+	ticks = clock + 1;
+	while (clock < ticks);				// Start on a tick
+	ticks += IB_IDLE;
+	while (clock < ticks) {
+		idle++;
+	}
+
+	printf("IRAM %s: write %lu KB/s, read %lu KB/s, CRC32 %lu KB/s, idle %lu\r\n", label,
+		(DWORD)IB_BLOCK * IB_BLOCKS * 100 / 1024 / (t1 ? t1 : 1),
+		(DWORD)IB_BLOCK * IB_BLOCKS * 100 / 1024 / (t2 ? t2 : 1),
+		(DWORD)IB_BLOCK * IB_BLOCKS * 100 / 1024 / (t3 ? t3 : 1),
+		idle
+	);
+}
+
+// check the routines copied to internal SRAM fit their slots, then run the same
+// benchmarks with them called in flash and in SRAM
+static void iram_bench()
+{
+	BYTE *buf;
+	t_iramBlock *b;
+	UINT24 length;
+	int i;
+
+	for (b = iram_blocks; b->romStart; b++) {
+		length = b->romEnd - b->romStart;
+		printf("IRAM &%06x: %u of %u bytes %s\r\n", b->ram, length, b->slot, length <= b->slot ? "OK" : "OVERFLOWS");
+	}
+	buf = umm_malloc(IB_BLOCK);
+	if (buf == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		return;
+	}
+	for (i=0; i<IB_BLOCK; i++) {
+		buf[i] = i * 13 + (i >> 8);
+	}
+	iram_bypass();
+	iram_bench_run("flash", buf);
+	iram_install();
+	iram_bench_run("SRAM ", buf);
+	umm_free(buf);
+}
+
+#define CY_BYTES	512			// One sector
+#define CY_RUNS		16			// The fastest run is taken, to leave out any interrupted by the VDP
+
+typedef struct {
+	char *name;
+	void (*fn)(BYTE *buf);
+	UINT24 bytes;				// Bytes processed per call, for the cycles per byte figure
+} t_cycleTest;
+
+static void cy_empty(BYTE *buf) { }
+static void cy_spi_transfer(BYTE *buf) { spi_transfer(0xFF); }
+static void cy_spi_read_one(BYTE *buf) { spi_read_one(); }
+static void cy_spi_read(BYTE *buf) { spi_read((char *)buf, CY_BYTES); }
+static void cy_spi_write(BYTE *buf) { spi_write((char *)buf, CY_BYTES); }
+static void cy_crc32_block(BYTE *buf) { crc32_block(0xFFFFFFFF, buf, CY_BYTES); }
+static void cy_sd_read(BYTE *buf) { SD_readBlocks(0, buf, 1); }
+
+static const t_cycleTest cy_tests[] = {
+	{ "spi_transfer",	cy_spi_transfer,	1 },
+	{ "spi_read_one",	cy_spi_read_one,	1 },
+	{ "spi_read",		cy_spi_read,		CY_BYTES },
+	{ "spi_write",		cy_spi_write,		CY_BYTES },
+	{ "crc32_block",	cy_crc32_block,		CY_BYTES },
+	{ "SD_readBlocks",	cy_sd_read,			CY_BYTES },
+};
+
+// run timer 1 freely at the system clock / 4, the finest the PRT allows
+static void cycle_bench_timer(BOOL enable)
+{
+	TMR1_CTL = 0x00;
+	if (enable) {
+		TMR1_RR_L = 0xFF;
+		TMR1_RR_H = 0xFF;
+		TMR1_CTL = 0x13;
+	}
+}
+
+// the fewest timer ticks taken by a call, over CY_RUNS calls
+static unsigned short cycle_bench_min(void (*fn)(BYTE *buf), BYTE *buf)
+{
+	unsigned short t, best = 0xFFFF;
+	int i;
+
+	for (i=0; i<CY_RUNS; i++) {
+		t = stream_bench_ticks();
+		fn(buf);
+		t -= stream_bench_ticks();		// timer counts down
+		if (t < best) {
+			best = t;
+		}
+	}
+	return best;
+}
+
+// count the CPU cycles taken by the assembler hot paths, to 4 cycles, less the
+// cost of calling an empty function; the SPI routines run with the card deselected
+static void cycle_bench_run(char *label, BYTE *buf)
+{
+	unsigned short base = cycle_bench_min(cy_empty, buf);
+	DWORD cycles;
+	int i;
+
+	for (i=0; i<sizeof(cy_tests) / sizeof(t_cycleTest); i++) {
+		cycles = (DWORD)(cycle_bench_min(cy_tests[i].fn, buf) - base) * 4;
+		printf("%s %-14s %7lu cycles", label, cy_tests[i].name, cycles);
+		if (cy_tests[i].bytes > 1) {
+			printf(", %lu.%02lu per byte", cycles / cy_tests[i].bytes, cycles * 100 / cy_tests[i].bytes % 100);
+		}
+		printf("\r\n");
+	}
+}
+
+static void cycle_bench()
+{
+	BYTE *buf = umm_malloc(CY_BYTES);
+
+	if (buf == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		return;
+	}
+	memset(buf, 0xFF, CY_BYTES);
+	cycle_bench_timer(TRUE);
+	iram_bypass();
+	cycle_bench_run("flash", buf);
+	iram_install();
+	cycle_bench_run("SRAM ", buf);
+	cycle_bench_timer(FALSE);
+	umm_free(buf);
+}
+
+#define UB_QUERIES	64
+
+// time the UART0 handler over the replies to a run of cursor queries, with
+// Timer 2 at the system clock / 16; the figures include the timing hooks
+// themselves, which run from flash in both cases
+static void uart0_isr_bench_run(char *label)
+{
+	BYTE request[] = { 23, 0, VDP_cursor };
+	t_isrStats s;
+	int i;
+
+	isr_stats_enable(TRUE);
+	for (i=0; i<UB_QUERIES; i++) {
+		vdp_queryWait(vdp_query(VDPP_cursor, request, sizeof(request), NULL), NULL);
+	}
+	DI();
+	memcpy(&s, (void *)&isr_stats[ISR_STATS_UART0], sizeof(t_isrStats));
+	EI();
+	isr_stats_enable(FALSE);
+
+	printf("UART0 %s: %u interrupts, %lu cycles each, longest %lu cycles\r\n", label, s.count,
+		s.count ? s.total * TIMER2_divider / s.count : 0, (DWORD)s.max * TIMER2_divider
+	);
+}
+
+// the UART0 handler and the VDP protocol state machine, run from flash and from SRAM
+static void uart0_isr_bench()
+{
+	if (isr_stats_on) {
+		printf("UART0 bench skipped, ISRSTAT is on\r\n");
+		return;
+	}
+	iram_bypass();
+	uart0_isr_bench_run("flash");
+	iram_install();
+	uart0_isr_bench_run("SRAM ");
+}
+
+extern BYTE scrcols;	// In globals.asm
+
+// read the top row of the screen one character at a time, waiting for each
+// reply, then with VDPQ_slots queries in flight, and check both agree
+static void vdp_query_bench()
+{
+	BYTE request[] = { 23, 0, VDP_scrchar, 0, 0, 0, 0 };
+	BYTE ids[VDPQ_slots];
+	BYTE data[VDPQ_dataLength];
+	char *serial, *pipelined;
+	DWORD t1, t2;
+	int cols = scrcols, x, n;
+	BOOL ok = TRUE;
+
+	serial = umm_malloc(cols);
+	pipelined = umm_malloc(cols);
+	if (serial == NULL || pipelined == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		goto cleanup;
+	}
+
+	t1 = clock;
+	for (x=0; x<cols && ok; x++) {
+		request[3] = x;
+		ok = vdp_queryWait(vdp_query(VDPP_scrchar, request, sizeof(request), NULL), data);
+		serial[x] = data[0];
+	}
+	t1 = clock - t1;
+
+	t2 = clock;
+	for (x=0, n=0; x<cols + VDPQ_slots && ok; x++) {
+		if (x >= VDPQ_slots) {		// Collect the reply sent VDPQ_slots queries ago
+			ok = vdp_queryWait(ids[x % VDPQ_slots], data);
+			pipelined[x - VDPQ_slots] = data[0];
+		}
+		if (x < cols) {
+			request[3] = x;
+			ids[x % VDPQ_slots] = vdp_query(VDPP_scrchar, request, sizeof(request), NULL);
+		}
+	}
+	t2 = clock - t2;
+
+	if (!ok) {
+		printf("VDP query test FAILED (no reply)\r\n");
+	} else {
+		printf("VDP query: %d characters, one at a time %lu cs, pipelined %lu cs %s\r\n", cols, t1, t2, memcmp(serial, pipelined, cols) == 0 ? "OK" : "FAILED");
+	}
+
+cleanup:
+	if (serial) umm_free(serial);
+	if (pipelined) umm_free(pipelined);
+}
+
+#define VL_QUERIES	32
+#define VL_BUDGET	20000		// Longest acceptable round trip for a cursor query, in us
+
+// check the round trip counts and times recorded by the VDP query statistics
+// against what was sent, and against a latency budget
+static void vdp_latency_test()
+{
+	BYTE request[] = { 23, 0, VDP_cursor };
+	BOOL was_on = vdp_stats_enabled();
+	t_vdpInfo info;
+	int i;
+
+	vdp_stats_enable(TRUE);
+	for (i=0; i<VL_QUERIES; i++) {
+		vdp_queryWait(vdp_query(VDPP_cursor, request, sizeof(request), NULL), NULL);
+	}
+	vdp_stats_get(VDPP_cursor, &info);
+	vdp_stats_enable(was_on);
+
+	printf("VDP latency: %u replies, %u timeouts, mean %lu us, max %lu us %s\r\n", info.count, info.timeouts, info.count ? info.total / info.count : 0, info.max,
+		info.count == VL_QUERIES && info.timeouts == 0 && info.max <= VL_BUDGET ? "OK" : "FAILED"
+	);
+}
+
+#if FF_FS_REENTRANT
+
+#define FL_FILE		"mos_test.bin"
+#define FL_LOG		"mos_test.log"
+#define FL_CHUNK	100
+#define FL_CHUNKS	4096
+#define FL_RELOAD	1152		// TMR1 at /16 interrupts every 1ms
+
+extern void *set_vector(unsigned int vector, void (*handler)(void));	// In vectors16.asm
+
+static FATFS *fl_fs;
+static FIL fl_log;
+static volatile UINT24 fl_ticks, fl_free, fl_busy, fl_posted, fl_full;
+static UINT24 fl_run, fl_last;
+static BOOL fl_order;
+
+// deferred work: append the tick it was queued on to the log
+static void fl_job(void *arg)
+{
+	UINT24 tick = (UINT24)arg;
+	UINT bw;
+
+	if (tick <= fl_last) {
+		fl_order = FALSE;
+	}
+	fl_last = tick;
+	fl_run++;
+	f_write(&fl_log, &tick, sizeof(tick), &bw);
+}
+
+// every millisecond, try to take the volume the way background code would,
+// then queue some file system work for the foreground
+static void interrupt fl_isr(void)
+{
+	BYTE c = TMR1_CTL;			// Clear the interrupt
+
+	fl_ticks++;
+	if (ff_req_grant(fl_fs->sobj)) {
+		fl_free++;
+		ff_rel_grant(fl_fs->sobj);
+	} else {
+		fl_busy++;
+	}
+	if (ff_defer(fl_job, (void *)fl_ticks)) {
+		fl_posted++;
+	} else {
+		fl_full++;
+	}
+}
+
+// check the volume lock turns re-entry away and the deferred queue runs in
+// order once the volume is free, but not on the release itself, then write and
+// verify a file while a timer interrupt keeps taking the lock and queueing work
+static void fs_lock_test()
+{
+	FILINFO fno;
+	FIL fil;
+	DWORD nclst, ticks;
+	UINT24 tick, records = 0;
+	UINT bw;
+	void *vector;
+	int i, j;
+	FRESULT fr;
+	BOOL ok;
+	BYTE *buf = umm_malloc(FL_CHUNK);
+
+	if (buf == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		return;
+	}
+	fr = f_getfree("", &nclst, &fl_fs);
+	if (fr == FR_OK) {
+		fr = f_open(&fl_log, FL_LOG, FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+	}
+	if (fr != FR_OK) {
+		printf("File system lock test FAILED (%d)\r\n", fr);
+		umm_free(buf);
+		return;
+	}
+
+	// Hold the volume as an interrupted FatFS call would
+	fl_run = fl_last = 0;
+	fl_order = TRUE;
+	ff_req_grant(fl_fs->sobj);
+	ok = f_stat(FL_LOG, &fno) == FR_TIMEOUT;
+	for (i=1; i<=FF_DEFER_SLOTS; i++) {
+		ok = ok && ff_defer(fl_job, (void *)i);
+	}
+	ok = ok && !ff_defer(fl_job, (void *)i);
+	ff_run_deferred();
+	ok = ok && fl_run == 0;
+	ff_rel_grant(fl_fs->sobj);
+	ok = ok && fl_run == 0;
+	ff_run_deferred();
+	ok = ok && fl_run == FF_DEFER_SLOTS && fl_order;
+	printf("File system lock: re-entry and deferred queue %s\r\n", ok ? "OK" : "FAILED");
+
+	// Now from a timer interrupt
+	fl_ticks = fl_free = fl_busy = fl_posted = fl_full = 0;
+	fl_run = fl_last = 0;
+	fr = f_open(&fil, FL_FILE, FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+	if (fr == FR_OK) {
+		vector = set_vector(PRT1_IVECT, fl_isr);
+		TMR1_CTL = 0x00;
+		TMR1_RR_L = FL_RELOAD & 0xFF;
+		TMR1_RR_H = FL_RELOAD >> 8;
+		TMR1_CTL = 0x57;		// Interrupt, restart, /16, reload, enable
+		ticks = clock;
+		for (i=0; i<FL_CHUNKS && fr == FR_OK; i++) {
+			memset(buf, i, FL_CHUNK);
+			fr = f_write(&fil, buf, FL_CHUNK, &bw);
+			ff_run_deferred();	// As MOS does after each API call
+		}
+		if (fr == FR_OK) {
+			fr = f_lseek(&fil, 0);
+		}
+		for (i=0; i<FL_CHUNKS && fr == FR_OK; i++) {
+			fr = f_read(&fil, buf, FL_CHUNK, &bw);
+			for (j=0; j<FL_CHUNK && fr == FR_OK; j++) {
+				if (buf[j] != (BYTE)i) {
+					fr = FR_INT_ERR;
+				}
+			}
+			ff_run_deferred();
+		}
+		ticks = clock - ticks;
+		TMR1_CTL = 0x00;
+		set_vector(PRT1_IVECT, vector);
+		ff_run_deferred();		// Anything queued since the last call
+		f_close(&fil);
+		f_unlink(FL_FILE);
+	}
+	if (fr == FR_OK) {
+		fr = f_lseek(&fl_log, FF_DEFER_SLOTS * sizeof(tick));
+	}
+	fl_last = 0;
+	while (fr == FR_OK) {
+		fr = f_read(&fl_log, &tick, sizeof(tick), &bw);
+		if (bw < sizeof(tick)) break;
+		if (tick <= fl_last) {
+			fl_order = FALSE;
+		}
+		fl_last = tick;
+		records++;
+	}
+	f_close(&fl_log);
+	f_unlink(FL_LOG);
+	umm_free(buf);
+
+	if (fr != FR_OK) {
+		printf("File system lock test FAILED (%d)\r\n", fr);
+		return;
+	}
+	printf("File system lock: %lu cs, %u ticks, volume free %u busy %u, %u queued %u run %u dropped %s\r\n", ticks, fl_ticks, fl_free, fl_busy, fl_posted, fl_run, fl_full,
+		fl_posted == fl_run && records == fl_run && fl_posted + fl_full == fl_ticks && fl_order ? "OK" : "FAILED"
+	);
+}
+
+#endif /* FF_FS_REENTRANT */
+
+#define RF_TEXT		"Agon MOS ROM filesystem, Agon MOS ROM filesystem: aaaaaaaaaaaaaaaaaaaaaaaa!"
+
+// packed by tools/mkromfs.py; has literals, a long match, an overlapping run and a cut-off final group
+static const BYTE rf_packed[] = {
+	0xFF, 0x41, 0x67, 0x6F, 0x6E, 0x20, 0x4D, 0x4F, 0x53, 0xFF, 0x20, 0x52, 0x4F, 0x4D, 0x20, 0x66,
+	0x69, 0x6C, 0xFF, 0x65, 0x73, 0x79, 0x73, 0x74, 0x65, 0x6D, 0x2C, 0x39, 0x20, 0x18, 0xF0, 0x18,
+	0x20, 0x3A, 0x20, 0x61, 0x00, 0xF0, 0x00, 0x20, 0x01, 0x21,
+};
+
+// check the unpacker against a known vector and against damaged data, then check and
+// time unpacking every file in the ROM filesystem
+static void romfs_test()
+{
+	t_romfsHeader *hdr = romfs_header();
+	t_romfsEntry *entry;
+	BYTE *buf = umm_malloc(sizeof(RF_TEXT));
+	DWORD ticks, bytes = 0;
+	UINT24 fr;
+	int i, bad = 0;
+
+	if (buf == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		return;
+	}
+	fr = romfs_unpack((BYTE *)rf_packed, sizeof(rf_packed), buf, sizeof(RF_TEXT) - 1);
+	printf("ROMFS unpack: %s\r\n", fr == FR_OK && memcmp(buf, RF_TEXT, sizeof(RF_TEXT) - 1) == 0 ? "OK" : "FAILED");
+	fr = romfs_unpack((BYTE *)rf_packed, sizeof(rf_packed) - 2, buf, sizeof(RF_TEXT) - 1);
+	printf("ROMFS truncated data: %s\r\n", fr == MOS_BAD_ROMFS ? "OK" : "FAILED");
+	umm_free(buf);
+
+	if (hdr == NULL) {
+		printf("ROMFS: no image FAILED\r\n");
+		return;
+	}
+	entry = (t_romfsEntry *)(hdr + 1);
+	ticks = clock;
+	for (i = 0; i < hdr->files; i++, entry++) {
+		if (mos_CRC32(0, (BYTE *)hdr + entry->offset, entry->packed) != entry->crc) {
+			bad++;
+			continue;
+		}
+		buf = umm_malloc(entry->length);
+		if (buf == NULL) {
+			continue;
+		}
+		if (romfs_read(entry, buf, entry->length) != FR_OK) {
+			bad++;
+		}
+		bytes += entry->length;
+		umm_free(buf);
+	}
+	printf("ROMFS: %d files, %lu bytes unpacked in %lu cs %s\r\n", hdr->files, bytes, clock - ticks, bad ? "FAILED" : "OK");
+}
+
+#define FS_FILE		"mos_test.fst"
+#define FS_BYTES	2048		// Four sectors
+
+// read a file a byte at a time and then in one block, checking the counts kept for the handle
+// and timing both; the byte at a time reads should only go to the card about once per sector
+static void file_stats_test()
+{
+	BYTE *buf = umm_malloc(FS_BYTES);
+	t_fileInfo bytewise, block;
+	BOOL timing = file_stats_enabled();
+	UINT8 fh;
+	int i;
+
+	if (buf == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		return;
+	}
+	memset(buf, 0x5A, FS_BYTES);
+	fh = mos_FOPEN(FS_FILE, FA_WRITE | FA_CREATE_ALWAYS);
+	mos_FWRITE(fh, (UINT24)buf, FS_BYTES);
+	mos_FCLOSE(fh);
+
+	if (!timing) {
+		file_stats_enable(TRUE);
+	}
+	fh = mos_FOPEN(FS_FILE, FA_READ);
+	for (i = 0; i < FS_BYTES; i++) {
+		mos_FGETC(fh);
+	}
+	file_stats_get(fh, &bytewise);
+	mos_FLSEEK(fh, 0);
+	mos_FREAD(fh, (UINT24)buf, FS_BYTES);
+	file_stats_get(fh, &block);
+	mos_FCLOSE(fh);
+	if (!timing) {
+		file_stats_enable(FALSE);
+	}
+	f_unlink(FS_FILE);
+	umm_free(buf);
+
+	printf("File statistics: %u bytes, a byte at a time %lu us, %u misses; in one block %lu us %s\r\n", FS_BYTES, bytewise.time, bytewise.misses, block.time - bytewise.time,
+		fh &&
+		bytewise.reads == FS_BYTES && bytewise.bytesRead == FS_BYTES && bytewise.misses >= FS_BYTES / 512 && bytewise.misses <= 2 * FS_BYTES / 512 &&
+		block.reads == FS_BYTES + 1 && block.bytesRead == 2 * FS_BYTES && block.seeks == 1 ? "OK" : "FAILED"
+	);
+}
+
+#define SBT_FILE	"mos_test.sbt"
+#define SBT_SECTORS	64
+
+// write a file a sector at a time, working out a CRC between the writes as the work to overlap
+// with the card programming each sector, and show how much of the busy time was hidden
+static void sd_busy_test()
+{
+	BYTE *buf = umm_malloc(512);
+	BOOL timing = sd_stats_enabled();
+	t_sdInfo info;
+	DWORD ticks;
+	UINT8 fh;
+	int i;
+
+	if (buf == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		return;
+	}
+	SD_flush();						// So every write counted is one made here
+	sd_stats_enable(TRUE);
+	ticks = clock;
+	fh = mos_FOPEN(SBT_FILE, FA_WRITE | FA_CREATE_ALWAYS);
+	for (i = 0; i < SBT_SECTORS && fh; i++) {
+		memset(buf, i, 512);
+		mos_CRC32(0, buf, 512);
+		mos_FWRITE(fh, (UINT24)buf, 512);
+	}
+	mos_FCLOSE(fh);
+	ticks = clock - ticks;
+	sd_stats_get(&info);
+	sd_stats_enable(timing);
+	f_unlink(SBT_FILE);
+	umm_free(buf);
+
+	printf("SD write busy: %d sectors in %lu cs, %u deferred, %u hidden, %u waited, overlap at most %lu us, wait %lu us %s\r\n", SBT_SECTORS, ticks,
+		info.deferred, info.hidden, info.waited, info.overlapMax, info.wait,
+		fh && info.deferred >= SBT_SECTORS && info.timeouts == 0 && info.hidden + info.waited == info.deferred ? "OK" : "FAILED"
+	);
+}
+
+// check the SD driver counters against a file written and read back a sector at a time
+static void sd_counters_test()
+{
+	BYTE *buf = umm_malloc(512);
+	BOOL timing = sd_stats_enabled();
+	t_sdInfo info;
+	UINT24 hist[2];
+	FIL fil;
+	UINT br;
+	int i, j;
+
+	if (buf == NULL) {
+		printf("Insufficient RAM for test\r\n");
+		return;
+	}
+	SD_flush();
+	sd_stats_enable(TRUE);
+	if (f_open(&fil, SBT_FILE, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK) {
+		for (i = 0; i < SBT_SECTORS; i++) {
+			memset(buf, i, 512);
+			f_write(&fil, buf, 512, &br);
+		}
+		f_close(&fil);
+	}
+	if (f_open(&fil, SBT_FILE, FA_READ) == FR_OK) {
+		for (i = 0; i < SBT_SECTORS; i++) {
+			f_read(&fil, buf, 512, &br);
+		}
+		f_close(&fil);
+	}
+	sd_stats_get(&info);
+	sd_stats_enable(timing);
+	f_unlink(SBT_FILE);
+	umm_free(buf);
+
+	for (i = 0; i < 2; i++) {
+		hist[i] = 0;
+		for (j = 0; j < SD_histBuckets; j++) {
+			hist[i] += i ? info.write.histogram[j] : info.read.histogram[j];
+		}
+	}
+	printf("SD counters: %u commands, read %u calls %lu blocks %lu us, write %u calls %lu blocks %lu us %s\r\n",
+		info.commands, info.read.calls, info.read.blocks, info.read.time, info.write.calls, info.write.blocks, info.write.time,
+		info.read.blocks >= SBT_SECTORS && info.write.blocks >= SBT_SECTORS &&
+		info.read.errors == 0 && info.write.errors == 0 && info.noResponse == 0 &&
+		info.commands >= info.read.calls + info.write.calls &&
+		hist[0] == info.read.calls && hist[1] == info.write.calls ? "OK" : "FAILED"
+	);
+}
+
+#define AT_DIR		"mos_at"
+#define AT_SUB		AT_DIR "/Second level folder"
+#define AT_FILES	32
+
+// look up each file in a folder two levels down by its full path and then relative to the open
+// folder with f_statat, counting the sectors read; the relative lookups skip walking the path
+static void at_lookup_bench()
+{
+	static FILINFO fno;
+	char name[64];
+	FIL fil;
+	DIR dir;
+	DWORD byPath, byDir;
+	UINT24 failed = 0;
+	int i;
+
+	f_mkdir(AT_DIR);
+	f_mkdir(AT_SUB);
+	for (i=0; i<AT_FILES; i++) {
+		sprintf(name, AT_SUB "/File number %03d.txt", i);
+		if (f_open(&fil, name, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK) {
+			f_close(&fil);
+		}
+	}
+
+	byPath = disk_reads;
+	for (i=0; i<AT_FILES; i++) {
+		sprintf(name, AT_SUB "/File number %03d.txt", i);
+		if (f_stat(name, &fno) != FR_OK) {
+			failed++;
+		}
+	}
+	byPath = disk_reads - byPath;
+
+	byDir = disk_reads;
+	if (f_opendir(&dir, AT_SUB) == FR_OK) {
+		for (i=0; i<AT_FILES; i++) {
+			sprintf(name, "File number %03d.txt", i);
+			if (f_statat(&dir, name, &fno) != FR_OK) {
+				failed++;
+			}
+		}
+		byDir = disk_reads - byDir;
+		for (i=0; i<AT_FILES; i++) {
+			sprintf(name, "File number %03d.txt", i);
+			f_unlinkat(&dir, name);
+		}
+		f_closedir(&dir);
+	}
+	else {
+		failed += AT_FILES;
+	}
+	f_unlink(AT_SUB);
+	f_unlink(AT_DIR);
+
+	printf("Lookup relative to a folder: %d files, %lu sector reads by path, %lu with the folder open %s\r\n", AT_FILES, byPath, byDir,
+		failed == 0 ? "OK" : "FAILED"
+	);
+}
+
+// wait for VBLANK with the CPU halted, which should take at most a frame and show
+// a payload of at least one VBLANK, then wait on an event that will not come to check the timeout
+static void event_test()
+{
+	BYTE data[EVENT_dataSize];
+	DWORD ticks, waited;
+	BYTE fired, none;
+
+	event_take(EVENT_vblank, NULL);
+	ticks = clock;
+	fired = event_wait(EVENT_vblank, 100, EVENT_halt, data);
+	ticks = clock - ticks;
+	waited = clock;
+	none = event_wait(EVENT_i2c, 10, EVENT_halt, NULL);
+	waited = clock - waited;
+
+	printf("Events: VBLANK after %lu cs (%d), nothing after %lu cs %s\r\n", ticks, data[3], waited,
+		fired == EVENT_vblank && data[3] >= 1 && ticks <= 4 && none == 0 && waited >= 10 && waited <= 14 ? "OK" : "FAILED"
+	);
+}
+
+#define CW_DIR	"MOS_Test_Cwd"
+
+// check CD keeps the cached working directory with folders named as they are
+// on the card, whatever case they were typed in, and that .. takes it back
+static void cwd_test()
+{
+	char before[256];
+	char *p;
+	BOOL named = FALSE, back = FALSE;
+
+	strcpy(before, mos_getCwd());
+	f_mkdir(CW_DIR);
+	if (mos_CD("mos_test_cwd") == FR_OK) {
+		p = mos_getCwd();
+		named = strlen(p) >= strlen(CW_DIR) && strcmp(p + strlen(p) - strlen(CW_DIR), CW_DIR) == 0;
+		back = mos_CD("..") == FR_OK && strcmp(mos_getCwd(), before) == 0;
+	}
+	f_unlink(CW_DIR);
+	printf("CD cached cwd: %s\r\n", named && back ? "OK" : "FAILED");
+}
+
+#define CT_DIR	"MOS_Test_Tree"
+
+// check COPY -r leaves the copy out when it is made inside the folder being copied
+static void copy_tree_test()
+{
+	FIL fil;
+	FILINFO fno;
+	BOOL ok = FALSE;
+
+	f_mkdir(CT_DIR);
+	if (f_open(&fil, CT_DIR "/a.txt", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK) {
+		f_close(&fil);
+		ok = mos_COPYTREE("mos_test_tree", CT_DIR "/Backup", FALSE, FALSE) == FR_OK
+			&& f_stat(CT_DIR "/Backup/a.txt", &fno) == FR_OK
+			&& f_stat(CT_DIR "/Backup/Backup", &fno) == FR_NO_FILE;
+	}
+	mos_DELTREE(CT_DIR, FALSE);
+	printf("COPY -r into itself: %s\r\n", ok ? "OK" : "FAILED");
+}
+
 int mos_cmdTEST(char *ptr)
 {
 	malloc_grind();
+	heap_quick_test();
+#if FF_FAT_MIRROR_DEFER
+	fat_mirror_bench();
+#endif
+	stream_bench();
+#if FF_PRIVATE_BUFS
+	private_buf_bench();
+#endif
+	lfn_lookup_bench();
+	sfn_alias_bench();
+	crc32_bench();
+	iram_bench();
+	cycle_bench();
+	uart0_isr_bench();
+	vdp_query_bench();
+	vdp_latency_test();
+#if FF_FS_REENTRANT
+	fs_lock_test();
+#endif
+	romfs_test();
+	file_stats_test();
+	sd_busy_test();
+	sd_counters_test();
+	at_lookup_bench();
+	event_test();
+	cwd_test();
+	copy_tree_test();
 	return 0;
 }
 
@@ -11,12 +11,19 @@
  * 31/03/2023:		Added wait_VDP
  * 08/04/2023:		Fixed timing loop in wait_VDP
  * 03/08/2023:		Fixed timer0 setup overflow in init_timer0
+ * 17/10/2026:		Added enable_timer2, get_timer2 and timer2_us for profiling
+ * 17/10/2026:		wait_VDP sleeps between VDP packets and times out on the clock
+ * 17/10/2026:		Added timer2_since and timer2_ticksPerCs
  */
 
 #include <eZ80.h>
 #include <defines.h>
+#include <stddef.h>
 
 #include "timer.h"
+#include "event.h"
+
+extern volatile unsigned long clock;			// In globals.asm
 
 // Configure Timer 0
 // Parameters:
@@ -71,6 +78,75 @@ unsigned short get_timer0() {
 	return (h << 8) | l;
 }
 
+// Number of users of Timer 2
+//
+static BYTE timer2_users = 0;
+
+// Timer 2 ticks per centisecond, set when Timer 2 is started
+//
+unsigned long timer2_ticksPerCs = 0;
+
+// Start or stop Timer 2, the profiling timer
+// This runs continuously from 0xFFFF at the system clock / TIMER2_divider while anything is using it,
+// and is shared by the interrupt handler and VDP query statistics. Interrupts must be disabled
+// Parameters:
+// - enable: TRUE to start using it, FALSE to stop
+//
+void enable_timer2(BOOL enable) {
+	if(enable) {
+		if(timer2_users++ == 0) {
+			timer2_ticksPerCs = SysClkFreq / TIMER2_divider / 100;
+			TMR2_CTL = 0x00;
+			TMR2_RR_L = 0xFF;
+			TMR2_RR_H = 0xFF;
+			TMR2_CTL = 0x17;											// Continuous, clock / 16, reload and start
+		}
+	}
+	else if(timer2_users > 0 && --timer2_users == 0) {
+		TMR2_CTL = 0x00;
+	}
+}
+
+// Get data count of Timer 2
+// This counts down, so an interval is the earlier count less the later one
+//
+unsigned short get_timer2() {
+	unsigned char l = TMR2_DR_L;												// Reading the low byte latches the high byte
+	unsigned char h = TMR2_DR_H;
+	return (h << 8) | l;
+}
+
+// Convert Timer 2 ticks to microseconds
+// Done in two parts so a large total doesn't overflow
+// Parameters:
+// - ticks: Number of ticks
+// Returns:
+// - Microseconds
+//
+unsigned long timer2_us(unsigned long ticks) {
+	unsigned long	perMs = SysClkFreq / 1000;									// System clocks per millisecond
+	unsigned long	us = TIMER2_divider * 1000L;								// Microseconds in perMs ticks
+
+	return (ticks / perMs) * us + (ticks % perMs) * us / perMs;
+}
+
+// Get the Timer 2 ticks since a time taken with get_timer2
+// Timer 2 wraps after about 57ms, so a gap of more than 4 centiseconds is timed with the clock instead
+// Parameters:
+// - start: Timer 2 at the time
+// - startClock: The clock at the same time
+// Returns:
+// - Number of ticks
+//
+unsigned long timer2_since(unsigned short start, unsigned long startClock) {
+	unsigned long	cs = clock - startClock;
+
+	if(cs > 4) {
+		return cs * timer2_ticksPerCs;
+	}
+	return (unsigned short)(start - get_timer2());
+}
+
 // Wait for the VDP packet to come in, with a timeout
 // Parameters:
 // - mask: Mask for the packet(s) we're expecting
@@ -78,14 +154,13 @@ unsigned short get_timer0() {
 // - True if the packet is received, False if there is a timeout
 //
 BOOL wait_VDP(unsigned char mask) {
-	int		i;
-	BOOL	retVal = 0;
+	unsigned long	start = clock;
 
-	for(i = 0; i < 250000; i++) {				// A small delay loop (~1s)
-		if(vpd_protocol_flags & mask) {			// If we get a result then
-			retVal = 1;							// Set the return value to true
-			break;								// And exit the loop
+	while ((vpd_protocol_flags & mask) == 0) {	// Until we get a result
+		if (clock - start > 100) {				// Give up after 1s
+			return 0;
 		}
+		event_wait(EVENT_vdp, 1, EVENT_halt, NULL);
 	}
-	return retVal;
+	return 1;
 }
@@ -9,19 +9,29 @@
  * 11/07/2022:		Removed unused functions
  * 13/03/2023:      Refactored
  * 31/03/2023:		Added wait_VDP
+ * 17/10/2026:		Added enable_timer2, get_timer2, timer2_us
+ * 17/10/2026:		Added timer2_since, timer2_ticksPerCs
  */
 
 #ifndef TIMER_H
 #define TIMER_H
 
+#define TIMER2_divider	16		// Timer 2 ticks at the system clock / 16, about 0.87us
+
 extern long 	SysClkFreq;
 extern volatile BYTE vpd_protocol_flags;		// In globals.asm
+extern unsigned long timer2_ticksPerCs;		// In timer.c
 
 unsigned short  init_timer0(int interval, int clkdiv, unsigned char ctrlbits);
 void            enable_timer0(unsigned char enable);
 unsigned short  get_timer0();
 BOOL 			wait_VDP(unsigned char mask);
 
+void			enable_timer2(BOOL enable);
+unsigned short	get_timer2();
+unsigned long	timer2_us(unsigned long ticks);
+unsigned long	timer2_since(unsigned short start, unsigned long startClock);
+
 void            wait_timer0();  // In misc.asm
 
 
@@ -19,9 +19,13 @@
 ; 03/08/2023:	Added user_kbvector in vdp_protocol_KEY
 ; 13/08/2023:	Moved keyboard handling to keyboard.asm
 ; 26/09/2023:	RTC packet length reduced to 6 bytes
+; 17/10/2026:	Completed packets are passed to vdp_query_complete while queries are in flight
+; 17/10/2026:	Packets are posted as events for event_wait
+; 17/10/2026:	The byte by byte state machine runs from internal SRAM; see iram.inc
 
 			INCLUDE	"macros.inc"
 			INCLUDE	"equs.inc"
+			INCLUDE	"iram.inc"
 
 			.ASSUME	ADL = 1
 
@@ -30,6 +34,10 @@
 			
 			XDEF	vdp_protocol
 
+			XDEF	vdpp_iram_start
+			XDEF	vdpp_iram_end
+			XDEF	vdp_protocol_rom
+
 			XREF	_keyascii
 			XREF	_keycode
 			XREF	_keymods
@@ -62,12 +70,24 @@
 			XREF	_vdp_protocol_data
 
 			XREF	_user_kbvector
+			XREF	_event_flags
+			XREF	_event_data
 
 			XREF	keyboard_handler	; In keyboard.asm
+
+			XREF	_vdpq_pending		; In vdp_query.c
+			XREF	_vdp_query_complete
+;
+; The code from here to vdpp_iram_end runs for every byte received, so it is copied to IRAM_VDPP by
+; iram_install and the UART0 handler calls it there. It may only use relative jumps within itself,
+; and absolute jumps to the packet handlers, which stay in flash
+;
+vdp_protocol		EQU	IRAM_VDPP + (vdp_protocol_rom - vdpp_iram_start)
 ;
 ; The UART protocol handler state machine
 ;
-vdp_protocol:		LD	A, (_vdp_protocol_state)
+vdpp_iram_start:
+vdp_protocol_rom:	LD	A, (_vdp_protocol_state)
 			OR	A
 			JR	Z, vdp_protocol_state0
 			DEC	A
@@ -103,7 +123,7 @@ vdp_protocol_state1:	LD	A, C			; Fetch the length byte
 ;
 $$:			LD	(_vdp_protocol_len), A	; Store the length
 			OR	A			; If it is zero
-			JR	Z, vdp_protocol_exec	; Then we can skip fetching bytes, otherwise
+			JP	Z, vdp_protocol_exec	; Then we can skip fetching bytes, otherwise
 			LD	A, 2			; Switch to next state
 			LD	(_vdp_protocol_state), A
 			RET
@@ -118,16 +138,45 @@ vdp_protocol_state2:	LD	HL, (_vdp_protocol_ptr)	; Get the buffer pointer
 			DEC	A
 			LD	(_vdp_protocol_len), A
 			RET	NZ			; Stay in this state if there are still bytes to read
+			JP	vdp_protocol_exec
 ;
-; When len is 0, we can action the packet
+; Discard data (packet too long)
 ;
+vdp_protocol_state3:	LD	A, (_vdp_protocol_len)
+			DEC	A
+			LD	(_vdp_protocol_len), A
+			RET	NZ			; Stay in this state if there are still bytes to read
+			XOR	A			; Reset the state
+			LD	(_vdp_protocol_state), A
+			RET
+vdpp_iram_end:
 
+;
+; When len is 0, we can action the packet
+;
 vdp_protocol_exec:	XOR	A			; Reset the state
 			LD	(_vdp_protocol_state), A
-			LD	A, (_vdp_protocol_cmd)	; Get the command byte...
+			LD	A, (_vdpq_pending)	; Are any queries waiting for a reply?
+			OR	A
+			JR	Z, $F
+			LD	A, (_vdp_protocol_cmd)	; Yes, so pass it the packet first
+			LD	C, A
+			PUSH	BC			; BYTE packet
+			CALL	_vdp_query_complete
+			POP	BC
+$$:			LD	A, (_vdp_protocol_cmd)	; Get the command byte...
 			CP	vdp_protocol_vesize	; Check whether the command is in bounds
 			RET	NC			; Out of bounds, so just ignore
-			LD	DE, vdp_protocol_vector
+			CP	1			; Keyboard and mouse packets are posted as their own events
+			JR	Z, $F
+			CP	9
+			JR	Z, $F
+			LD	(_event_data + EVENT_DATA_VDP), A
+			LD	A, (_event_flags)	; Post anything else as EVENT_VDP
+			OR	EVENT_VDP
+			LD	(_event_flags), A
+			LD	A, (_vdp_protocol_cmd)
+$$:			LD	DE, vdp_protocol_vector
 			LD	HL, 0			; Index into the jump table
 			LD	L, A			; ...in HLU
 			ADD	HL, HL			; Multiply by four, as each entry is 4 bytes
@@ -150,16 +199,6 @@ vdp_protocol_vector:	JP	vdp_protocol_GP
 ;
 vdp_protocol_vesize:	EQU	($-vdp_protocol_vector)/4
 
-;
-; Discard data (packet too long)
-;
-vdp_protocol_state3:	LD	A, (_vdp_protocol_len)
-			DEC	A
-			LD	(_vdp_protocol_len), A
-			RET	NZ			; Stay in this state if there are still bytes to read
-			XOR	A			; Reset the state
-			LD	(_vdp_protocol_state), A
-			RET
 
 ; General Poll
 ;
@@ -194,6 +233,10 @@ $$:			LD	A, (_vdp_protocol_data + 0)	; ASCII key code
 			LD	A, (_vdp_protocol_data + 2)	; Virtual key code
 			LD	B, A 				; B: Virtual keycode
 			LD	(_keycode), A
+			LD	(_event_data + EVENT_DATA_KEY), A
+			LD	A, (_event_flags)		; Post the key event
+			OR	EVENT_KEY
+			LD	(_event_flags), A
 ;
 			JP	keyboard_handler		; Call the handle keyboard routine (in keyboard.asm)
 
@@ -343,4 +386,9 @@ vdp_protocol_MOUSE:	LD	HL, _vdp_protocol_data
 			LD	A, (_vpd_protocol_flags)
 			OR	VDPP_FLAG_MOUSE
 			LD	(_vpd_protocol_flags), A
+			LD	A, (_vdp_protocol_data+4)	; Post the mouse event with the button state
+			LD	(_event_data + EVENT_DATA_MOUSE), A
+			LD	A, (_event_flags)
+			OR	EVENT_MOUSE
+			LD	(_event_flags), A
 			RET
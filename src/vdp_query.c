@@ -0,0 +1,335 @@
+/*
+ * Title:			AGON MOS - Non-blocking VDP queries
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ * 17/10/2026:		Added round trip statistics
+ * 17/10/2026:		vdp_queryWait sleeps between VDP packets
+ * 17/10/2026:		Restores the interrupt state rather than enabling interrupts
+ * 17/10/2026:		Times round trips with timer2_since
+ */
+
+#include <eZ80.h>
+#include <defines.h>
+#include <string.h>
+
+#include "defines.h"
+#include "uart.h"
+#include "ff.h"
+#include "timer.h"
+#include "vdp_query.h"
+#include "event.h"
+
+extern volatile DWORD clock;					// In globals.asm
+extern BYTE vdp_protocol_data[];				// In globals.asm
+
+extern BYTE di_save(void);					// In misc.asm
+extern void ei_restore(BYTE enabled);		// In misc.asm
+
+// The queries in flight, oldest first from vdpq_head
+// The VDP answers queries in the order they are sent, so a reply is for the oldest pending query
+// that expects that packet. These are changed by vdp_query_complete in the UART0 interrupt, so
+// everything else changes them with interrupts disabled, restoring the caller's interrupt state after
+//
+static t_vdpQuery	vdpq[VDPQ_slots];
+static BYTE			vdpq_head = 0;				// Index of the oldest slot in use
+static BYTE			vdpq_count = 0;				// Slots in use, from vdpq_head
+static BYTE			vdpq_nextId = 1;
+volatile BYTE		vdpq_pending = 0;			// Queries waiting for a reply; checked by vdp_protocol.asm
+
+static t_vdpStats	vdpq_stats[VDPQ_packets];
+static BOOL			vdpq_stats_on = FALSE;
+
+static void vdp_stats_timeout(BYTE id);
+
+// Free the oldest slots that are no longer in use
+// Interrupts must be disabled
+//
+static void vdpq_trim() {
+	while (vdpq_count > 0 && vdpq[vdpq_head].state == VDPQ_unknown) {
+		vdpq_head = (vdpq_head + 1) % VDPQ_slots;
+		vdpq_count--;
+	}
+}
+
+// Find the slot for a query
+// Parameters:
+// - id: The query id
+// Returns:
+// - Pointer to the slot, or NULL if the query is not in flight
+//
+static t_vdpQuery * vdpq_find(BYTE id) {
+	BYTE	i;
+	BYTE	slot;
+
+	for (i = 0; i < vdpq_count; i++) {
+		slot = (vdpq_head + i) % VDPQ_slots;
+		if (vdpq[slot].id == id && vdpq[slot].state != VDPQ_unknown) {
+			return &vdpq[slot];
+		}
+	}
+	return NULL;
+}
+
+// Send a query to the VDP without waiting for the reply
+// Several queries can be in flight, so a run of them costs one round trip rather than one each
+// Parameters:
+// - packet: The reply packet expected (VDPP_cursor, etc)
+// - request: The VDU bytes of the query, starting with 23
+// - length: Number of bytes in the request
+// - callback: Function to call with the reply, or NULL to collect it with vdp_queryPoll
+// Returns:
+// - The query id, or 0 if there are already VDPQ_slots queries in flight
+//
+BYTE vdp_query(BYTE packet, BYTE * request, BYTE length, t_vdpQueryCallback callback) {
+	t_vdpQuery *	q;
+	BYTE			id;
+	BYTE			ie;
+
+	ie = di_save();
+	vdpq_trim();
+	if (vdpq_count == VDPQ_slots) {
+		ei_restore(ie);
+		return 0;
+	}
+	q = &vdpq[(vdpq_head + vdpq_count) % VDPQ_slots];
+	vdpq_count++;
+	id = vdpq_nextId;
+	vdpq_nextId = id == 255 ? 1 : id + 1;
+	q->id = id;
+	q->packet = packet;
+	q->state = VDPQ_pending;
+	q->callback = callback;
+	if (vdpq_stats_on) {
+		q->start = get_timer2();
+		q->startClock = clock;
+	}
+	vdpq_pending++;
+	ei_restore(ie);
+
+	while (length-- > 0) {						// Queued first, so the reply can't arrive before it is expected
+		putch(*request++);
+	}
+	return id;
+}
+
+// Check whether the reply to a query has arrived
+// Parameters:
+// - id: The query id
+// - data: Buffer of VDPQ_dataLength bytes for the reply, or NULL
+// Returns:
+// - VDPQ_done if the reply has arrived (the query is then finished with), VDPQ_pending, or VDPQ_unknown
+//
+BYTE vdp_queryPoll(BYTE id, BYTE * data) {
+	t_vdpQuery *	q;
+	BYTE			state;
+	BYTE			ie;
+
+	ie = di_save();
+	q = vdpq_find(id);
+	state = q ? q->state : VDPQ_unknown;
+	if (state == VDPQ_done) {
+		if (data) {
+			memcpy(data, q->data, VDPQ_dataLength);
+		}
+		q->state = VDPQ_unknown;
+		vdpq_trim();
+	}
+	ei_restore(ie);
+	return state;
+}
+
+// Wait for the reply to a query, for up to VDPQ_timeout centiseconds
+// Parameters:
+// - id: The query id
+// - data: Buffer of VDPQ_dataLength bytes for the reply, or NULL
+// Returns:
+// - TRUE if the reply arrived, FALSE if it timed out (the query is then cancelled)
+//
+BOOL vdp_queryWait(BYTE id, BYTE * data) {
+	DWORD	timeout = clock + VDPQ_timeout;
+	BYTE	state;
+
+	while ((state = vdp_queryPoll(id, data)) == VDPQ_pending) {
+		if (clock > timeout) {
+			vdp_stats_timeout(id);
+			vdp_queryCancel(id);
+			return FALSE;
+		}
+		event_wait(EVENT_vdp, 1, EVENT_halt, NULL);
+	}
+	return state == VDPQ_done;
+}
+
+// Give up on a query
+// If its reply arrives later, it is taken as the reply to the next query expecting the same packet,
+// so only cancel a query that has timed out
+// Parameters:
+// - id: The query id
+//
+void vdp_queryCancel(BYTE id) {
+	t_vdpQuery *	q;
+	BYTE			ie;
+
+	ie = di_save();
+	q = vdpq_find(id);
+	if (q) {
+		if (q->state == VDPQ_pending) {
+			vdpq_pending--;
+		}
+		q->state = VDPQ_unknown;
+		vdpq_trim();
+	}
+	ei_restore(ie);
+}
+
+// Add the round trip time of a query to the statistics for its packet
+// Parameters:
+// - q: The query, whose reply has just arrived
+//
+static void vdp_stats_add(t_vdpQuery * q) {
+	t_vdpStats *	s;
+	DWORD			ticks;
+
+	if (q->packet >= VDPQ_packets) {
+		return;
+	}
+	ticks = timer2_since(q->start, q->startClock);
+	s = &vdpq_stats[q->packet];
+	s->count++;
+	s->total += ticks;
+	if (ticks > s->max) {
+		s->max = ticks;
+	}
+}
+
+// Count a query that has timed out
+// Parameters:
+// - id: The query id
+//
+static void vdp_stats_timeout(BYTE id) {
+	t_vdpQuery *	q;
+	BYTE			ie;
+
+	ie = di_save();
+	q = vdpq_find(id);
+	if (vdpq_stats_on && q && q->packet < VDPQ_packets) {
+		vdpq_stats[q->packet].timeouts++;
+	}
+	ei_restore(ie);
+}
+
+// Complete the oldest query waiting for a packet
+// Called by vdp_protocol.asm in the UART0 interrupt when a whole packet has arrived and vdpq_pending
+// is not 0, before the packet is handled as usual
+// Parameters:
+// - packet: The packet received
+//
+void vdp_query_complete(BYTE packet) {
+	t_vdpQuery *	q;
+	BYTE			i;
+
+	for (i = 0; i < vdpq_count; i++) {
+		q = &vdpq[(vdpq_head + i) % VDPQ_slots];
+		if (q->state == VDPQ_pending && q->packet == packet) {
+			vdpq_pending--;
+			if (vdpq_stats_on) {
+				vdp_stats_add(q);
+			}
+			if (q->callback) {
+				q->callback(q->id, vdp_protocol_data);
+				q->state = VDPQ_unknown;
+				vdpq_trim();
+			}
+			else {
+				memcpy(q->data, vdp_protocol_data, VDPQ_dataLength);
+				q->state = VDPQ_done;
+			}
+			return;
+		}
+	}
+}
+
+// Start or stop keeping round trip statistics for VDP queries
+// Starting clears them and starts Timer 2
+// Parameters:
+// - enable: TRUE to start, FALSE to stop
+//
+void vdp_stats_enable(BOOL enable) {
+	BYTE	ie;
+
+	ie = di_save();
+	if (enable != vdpq_stats_on) {
+		enable_timer2(enable);
+	}
+	vdpq_stats_on = enable;
+	if (enable) {
+		memset(vdpq_stats, 0, sizeof(vdpq_stats));
+	}
+	ei_restore(ie);
+}
+
+// Check whether round trip statistics are being kept
+//
+BOOL vdp_stats_enabled(void) {
+	return vdpq_stats_on;
+}
+
+// Read the round trip statistics for a reply packet
+// Parameters:
+// - packet: The reply packet, below VDPQ_packets
+// - info: Filled in with the counts, and the total and longest round trip in microseconds
+//
+void vdp_stats_get(BYTE packet, t_vdpInfo * info) {
+	t_vdpStats	s;
+	BYTE		ie;
+
+	ie = di_save();
+	memcpy(&s, &vdpq_stats[packet], sizeof(t_vdpStats));
+	ei_restore(ie);
+	info->count = s.count;
+	info->timeouts = s.timeouts;
+	info->total = timer2_us(s.total);
+	info->max = timer2_us(s.max);
+}
+
+// Send a query to the VDP, for the MOS API
+// Parameters:
+// - packet: The reply packet expected
+// - request: The VDU bytes of the query
+// - length: Number of bytes in the request
+// - callback: Function to call with the reply (in ADL mode, from the interrupt), or NULL
+// Returns:
+// - The query id, or 0 if too many queries are in flight
+//
+UINT24 mos_VDPQUERY(BYTE packet, BYTE * request, BYTE length, t_vdpQueryCallback callback) {
+	return vdp_query(packet, request, length, callback);
+}
+
+// Check whether the reply to a query has arrived, for the MOS API
+// Parameters:
+// - id: The query id
+// - data: Buffer of VDPQ_dataLength bytes for the reply, or NULL
+// Returns:
+// - VDPQ_done, VDPQ_pending or VDPQ_unknown
+//
+UINT24 mos_VDPPOLL(BYTE id, BYTE * data) {
+	return vdp_queryPoll(id, data);
+}
+
+// Read the round trip statistics for a reply packet, for the MOS API
+// Parameters:
+// - packet: The reply packet
+// - info: Filled in with the counts, and the total and longest round trip in microseconds
+// Returns:
+// - FR_OK, or FR_INVALID_PARAMETER if the packet is out of range
+//
+UINT24 mos_VDPSTATS(BYTE packet, t_vdpInfo * info) {
+	if (packet >= VDPQ_packets) {
+		return FR_INVALID_PARAMETER;
+	}
+	vdp_stats_get(packet, info);
+	return FR_OK;
+}
@@ -0,0 +1,82 @@
+/*
+ * Title:			AGON MOS - Non-blocking VDP queries
+ * Author:			Agon MOS contributors
+ * Created:			17/10/2026
+ * Last Updated:	17/10/2026
+ *
+ * Modinfo:
+ * 17/10/2026:		Added round trip statistics
+ */
+
+#ifndef VDP_QUERY_H
+#define VDP_QUERY_H
+
+#include "ff.h"
+
+#define VDPQ_slots			8		// Queries that can be in flight at once
+#define VDPQ_dataLength		8		// Bytes of each reply kept; the longest reply (mode) is 8 bytes
+#define VDPQ_timeout		100		// Centiseconds vdp_queryWait waits for a reply
+#define VDPQ_packets		8		// Reply packets that statistics are kept for, 0 to 7
+
+// Packets sent by the VDP in reply to a query; see vdp_protocol.asm
+//
+#define VDPP_cursor			2		// VDU 23,0,&82
+#define VDPP_scrchar		3		// VDU 23,0,&83,x;y;
+#define VDPP_point			4		// VDU 23,0,&84,x;y; and VDU 23,0,&94,n
+#define VDPP_audio			5		// VDU 23,0,&85,...
+#define VDPP_mode			6		// VDU 23,0,&86
+#define VDPP_rtc			7		// VDU 23,0,&87,0
+
+// State of a query, as returned by vdp_queryPoll
+//
+#define VDPQ_unknown		0		// Not in flight; already collected, cancelled or never issued
+#define VDPQ_pending		1		// Waiting for the reply
+#define VDPQ_done			2		// The reply has arrived
+
+// Called from the UART0 interrupt with interrupts disabled, so it must be short
+//
+typedef void (*t_vdpQueryCallback)(BYTE id, BYTE * data);
+
+typedef struct {
+	BYTE				id;
+	BYTE				packet;						// The reply packet expected
+	BYTE				state;
+	BYTE				data[VDPQ_dataLength];		// The reply
+	t_vdpQueryCallback	callback;					// Called with the reply instead of storing it, or NULL
+	unsigned short		start;						// Timer 2 when sent, for the statistics
+	DWORD				startClock;					// Clock when sent
+} t_vdpQuery;
+
+// Round trip statistics for a reply packet, kept while VDPSTAT is on
+//
+typedef struct {
+	UINT24				count;						// Replies received
+	UINT24				timeouts;					// Queries that timed out in vdp_queryWait
+	DWORD				total;						// Total round trip time in Timer 2 ticks
+	DWORD				max;						// Longest round trip in Timer 2 ticks
+} t_vdpStats;
+
+// The statistics as returned by the MOS API, in microseconds
+//
+typedef struct {
+	UINT24				count;
+	UINT24				timeouts;
+	DWORD				total;
+	DWORD				max;
+} t_vdpInfo;
+
+BYTE	vdp_query(BYTE packet, BYTE * request, BYTE length, t_vdpQueryCallback callback);
+BYTE	vdp_queryPoll(BYTE id, BYTE * data);
+BOOL	vdp_queryWait(BYTE id, BYTE * data);
+void	vdp_queryCancel(BYTE id);
+void	vdp_query_complete(BYTE packet);			// Called from vdp_protocol.asm
+
+void	vdp_stats_enable(BOOL enable);
+BOOL	vdp_stats_enabled(void);
+void	vdp_stats_get(BYTE packet, t_vdpInfo * info);
+
+UINT24	mos_VDPQUERY(BYTE packet, BYTE * request, BYTE length, t_vdpQueryCallback callback);
+UINT24	mos_VDPPOLL(BYTE id, BYTE * data);
+UINT24	mos_VDPSTATS(BYTE packet, t_vdpInfo * info);
+
+#endif VDP_QUERY_H
@@ -2,7 +2,7 @@
  * Title:			AGON Low level disk I/O module for FatFs 
  * Modified By:		Dean Belfield
  * Created:			19/06/2022
- * Last Updated:	15/03/2023
+ * Last Updated:	17/10/2026
  *
  * Credits:
  * Based upon a skeleton framework (C)ChaN, 2019
@@ -11,6 +11,11 @@
  * 11/07/2023:		Tweaked to compile without ZDL enabled in project settings
  * 15/03/2023:		Added get_fattime
  * 10/05/2024:		Fixed get_fattime for new RTC format.
+ * 17/10/2026:		Added disk_reads
+ * 17/10/2026:		CTRL_SYNC waits for the last write to be programmed; added the write busy statistics
+ * 17/10/2026:		disk_read and disk_write retry after an error; added the per operation statistics
+ * 17/10/2026:		A write lost while programming fails the next disk_write or CTRL_SYNC
+ * 17/10/2026:		Times with timer2_since; sd_stats_enable disables interrupts around enable_timer2
  */
 
 #include "ff.h"			// Obtains integer types
@@ -18,8 +23,33 @@
 
 #include "sd.h"			// Physical SD card layer for eZ80
 #include "clock.h"		// Clock for timestamp
+#include "timer.h"		// Timer 2 for the statistics
+
+#include <string.h>
+
+#define SD_busyTimeout	25		// Centiseconds; SD_waitBusy gives up after 250ms
 
 extern BYTE rtc;		// In globals.asm
+extern volatile DWORD clock;	// In globals.asm
+extern t_sdCounters sd_counters;	// In sd.asm
+extern BYTE sd_timing;
+extern BYTE sd_write_lost;
+
+extern BYTE di_save(void);		// In misc.asm
+extern void ei_restore(BYTE enabled);	// In misc.asm
+
+DWORD	disk_reads = 0;	// Calls to disk_read, for the open file statistics
+
+static t_sdStats		sd_stats;
+static BOOL				sd_stats_on = FALSE;
+static unsigned short	sd_start;			// Timer 2 when the last write was left programming, or the wait started
+static DWORD			sd_startClock;		// Clock at the same time
+
+static t_sdOpStats		sd_readStats;
+static t_sdOpStats		sd_writeStats;
+static DWORD			sd_histLimit[SD_histBuckets - 1];	// Upper bounds of the histogram buckets in Timer 2 ticks
+
+static void sd_op_end(t_sdOpStats * stats, UINT count, BYTE retries, BYTE err, unsigned short start, DWORD startClock);
 
 // Get Drive Status (Not implemented in AGON)
 // Parameters:
@@ -55,7 +85,16 @@ DSTATUS disk_initialize(BYTE pdrv) {
 // - DSTATUS
 //
 DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
-	BYTE err = SD_readBlocks(sector, buff, count);
+	unsigned short	start = sd_stats_on ? get_timer2() : 0;
+	DWORD			startClock = clock;
+	BYTE			retries = 0;
+	BYTE			err;
+
+	while((err = SD_readBlocks(sector, buff, count)) != SD_SUCCESS && retries < SD_retries) {
+		retries++;
+	}
+	disk_reads++;
+	sd_op_end(&sd_readStats, count, retries, err, start, startClock);
 	if(err == SD_SUCCESS) {
 		return RES_OK;
 	}
@@ -74,7 +113,19 @@ DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
 // - DSTATUS
 //
 DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count){
-	BYTE err = SD_writeBlocks(sector, buff, count);
+	unsigned short	start = sd_stats_on ? get_timer2() : 0;
+	DWORD			startClock = clock;
+	BYTE			retries = 0;
+	BYTE			err;
+
+	while((err = SD_writeBlocks(sector, buff, count)) != SD_SUCCESS && retries < SD_retries) {
+		retries++;
+	}
+	if(sd_write_lost) {				// An earlier write never finished programming; report it here
+		sd_write_lost = 0;
+		err = SD_ERROR;
+	}
+	sd_op_end(&sd_writeStats, count, retries, err, start, startClock);
 	if(err == SD_SUCCESS) {
 		return RES_OK;
 	}
@@ -84,7 +135,163 @@ DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count){
 
 #endif
 
-// Disk I/O Control (Not implemented in AGON)
+// Get the Timer 2 ticks since sd_start was taken
+//
+static DWORD sd_elapsed(void) {
+	return timer2_since(sd_start, sd_startClock);
+}
+
+// Count a call to disk_read or disk_write, and time it if timing is on
+// Parameters:
+// - stats: The statistics for the operation
+// - count: Blocks asked for
+// - retries: Times the call was tried again
+// - err: The final result
+// - start: Timer 2 when the call started
+// - startClock: The clock at the same time
+//
+static void sd_op_end(t_sdOpStats * stats, UINT count, BYTE retries, BYTE err, unsigned short start, DWORD startClock) {
+	DWORD	ticks;
+	BYTE	i;
+
+	stats->calls++;
+	stats->retries += retries;
+	if(err == SD_SUCCESS) {
+		stats->blocks += count;
+	}
+	else {
+		stats->errors++;
+	}
+	if(sd_stats_on) {
+		ticks = timer2_since(start, startClock);
+		stats->time += ticks;
+		for(i = 0; i < SD_histBuckets - 1 && ticks >= sd_histLimit[i]; i++);
+		stats->histogram[i]++;
+	}
+}
+
+// Called by sd.asm when SD_writeBlocks returns with the card still programming the last block
+//
+void sd_busy_start(void) {
+	sd_stats.deferred++;
+	if(sd_stats_on) {
+		sd_startClock = clock;
+		sd_start = get_timer2();
+	}
+}
+
+// Called by sd.asm when the next command is about to check that the card has finished
+// The card is not polled until now, so the whole gap is counted as overlap, capped at the
+// busy timeout; the figure is an upper bound on the time the card was actually busy
+//
+void sd_busy_check(void) {
+	DWORD	ticks;
+
+	if(sd_stats_on) {
+		ticks = sd_elapsed();
+		if(ticks > SD_busyTimeout * timer2_ticksPerCs) {
+			ticks = SD_busyTimeout * timer2_ticksPerCs;
+		}
+		sd_stats.overlapMax += ticks;
+		sd_startClock = clock;
+		sd_start = get_timer2();
+	}
+}
+
+// Called by sd.asm once the check is done
+// Parameters:
+// - state: SD_BUSY_HIDDEN, SD_BUSY_WAITED or SD_BUSY_TIMEOUT
+//
+void sd_busy_end(BYTE state) {
+	switch(state) {
+		case SD_BUSY_HIDDEN:
+			sd_stats.hidden++;
+			return;
+		case SD_BUSY_WAITED:
+			sd_stats.waited++;
+			break;
+		default:
+			sd_stats.timeouts++;
+			break;
+	}
+	if(sd_stats_on) {
+		sd_stats.wait += sd_elapsed();
+	}
+}
+
+// Start or stop timing the SD card
+// Starting clears the statistics and the counters kept by sd.asm, and starts Timer 2
+// Parameters:
+// - enable: TRUE to start, FALSE to stop
+//
+void sd_stats_enable(BOOL enable) {
+	BYTE	i;
+	BYTE	ie;
+
+	if(enable != sd_stats_on) {
+		ie = di_save();					// enable_timer2 must be called with interrupts disabled
+		enable_timer2(enable);
+		ei_restore(ie);
+	}
+	if(enable) {
+		memset(&sd_stats, 0, sizeof(t_sdStats));
+		memset(&sd_counters, 0, sizeof(t_sdCounters));
+		memset(&sd_readStats, 0, sizeof(t_sdOpStats));
+		memset(&sd_writeStats, 0, sizeof(t_sdOpStats));
+		sd_histLimit[0] = timer2_ticksPerCs / 10;		// 1ms, then each bucket four times longer
+		for(i = 1; i < SD_histBuckets - 1; i++) {
+			sd_histLimit[i] = sd_histLimit[i - 1] * 4;
+		}
+		sd_startClock = clock;
+		sd_start = get_timer2();
+	}
+	sd_stats_on = enable;
+	sd_timing = enable;
+}
+
+// Check whether the SD card is being timed
+//
+BOOL sd_stats_enabled(void) {
+	return sd_stats_on;
+}
+
+// Read the SD card statistics
+// Parameters:
+// - info: Filled in with the counts, and the times in microseconds
+//
+void sd_stats_get(t_sdInfo * info) {
+	info->deferred = sd_stats.deferred;
+	info->hidden = sd_stats.hidden;
+	info->waited = sd_stats.waited;
+	info->timeouts = sd_stats.timeouts;
+	info->overlapMax = timer2_us(sd_stats.overlapMax);
+	info->wait = timer2_us(sd_stats.wait);
+	info->commands = sd_counters.commands;
+	info->noResponse = sd_counters.noResponse;
+	info->tokenTimeouts = sd_counters.tokenTimeouts;
+	info->busyTimeouts = sd_counters.busyTimeouts;
+	info->responseWait = timer2_us(sd_counters.responseWait);
+	info->busyWait = timer2_us(sd_counters.busyWait);
+	memcpy(&info->read, &sd_readStats, sizeof(t_sdOpStats));
+	info->read.time = timer2_us(sd_readStats.time);
+	memcpy(&info->write, &sd_writeStats, sizeof(t_sdOpStats));
+	info->write.time = timer2_us(sd_writeStats.time);
+}
+
+// Read the SD card statistics for the MOS API
+// Parameters:
+// - info: Filled in as by sd_stats_get
+// Returns:
+// - FR_OK
+//
+UINT24 mos_SDSTATS(t_sdInfo * info) {
+	sd_stats_get(info);
+	return FR_OK;
+}
+
+// Disk I/O Control
+// Only CTRL_SYNC does anything: it waits for the card to finish programming the last block written,
+// and fails if that or any earlier write left programming was lost
 // Parameters:
 // - pdrv: Physical drive nmuber (0..)
 // - cmd: Control code
@@ -93,6 +300,18 @@ DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count){
 // - DSTATUS
 //
 DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+	BYTE	err;
+
+	if(cmd == CTRL_SYNC) {
+		err = SD_flush();
+		if(sd_write_lost) {
+			sd_write_lost = 0;
+			err = SD_ERROR;
+		}
+		if(err != SD_SUCCESS) {
+			return RES_ERROR;
+		}
+	}
 	return RES_OK;
 }
 
@@ -47,6 +47,7 @@
 /* Character code support macros */
 #define IsUpper(c)		((c) >= 'A' && (c) <= 'Z')
 #define IsLower(c)		((c) >= 'a' && (c) <= 'z')
+#define WtoUpper(c)		((c) < 0x80 ? (WCHAR)(IsLower(c) ? (c) - 0x20 : (c)) : (WCHAR)ff_wtoupper(c))	/* ASCII is up-converted in line */
 #define IsDigit(c)		((c) >= '0' && (c) <= '9')
 #define IsSeparator(c)	((c) == '/' || (c) == '\\')
 #define IsTerminator(c)	((UINT)(c) < (FF_USE_LFN ? ' ' : '!'))
@@ -234,6 +235,15 @@
 #define ABORT(fs, res)		{ fp->err = (BYTE)(res); LEAVE_FF(fs, res); }
 
 
+/* Sector buffer of a file (0:the file uses the volume window). At FF_FS_TINY a file only
+   has one if it was attached by f_setbuf, so FIL stays the same size for applications */
+#if !FF_FS_TINY
+#define file_buf(fp)		((fp)->buf)
+#elif !FF_PRIVATE_BUFS
+#define file_buf(fp)		((BYTE*)0)
+#endif
+
+
 /* Re-entrancy related */
 #if FF_FS_REENTRANT
 #if FF_USE_LFN == 1
@@ -472,6 +482,13 @@ static BYTE CurrVol;				/* Current drive */
 static FILESEM Files[FF_FS_LOCK];	/* Open object lock semaphores */
 #endif
 
+#if FF_FS_TINY && FF_PRIVATE_BUFS
+static struct {
+	FIL*	fp;
+	BYTE*	buf;
+} PrivBuf[FF_PRIVATE_BUFS];			/* Private sector buffers attached to files by f_setbuf */
+#endif
+
 #if FF_STR_VOLUME_ID
 #ifdef FF_VOLUME_STRS
 static const char* const VolumeStr[FF_VOLUMES] = {FF_VOLUME_STRS};	/* Pre-defined volume ID */
@@ -785,7 +802,7 @@ static DWORD tchar2uni (	/* Returns a character in UTF-16 encoding (>=0x10000 on
 		if (!dbc_2nd(b)) return 0xFFFFFFFF;	/* Invalid code? */
 		wc = (wc << 8) + b;		/* Make a DBC */
 	}
-	if (wc != 0) {
+	if (wc >= 0x80) {			/* ASCII is the same in Unicode */
 		wc = ff_oem2uni(wc, CODEPAGE);	/* ANSI/OEM ==> Unicode */
 		if (wc == 0) return 0xFFFFFFFF;	/* Invalid code? */
 	}
@@ -868,7 +885,7 @@ static UINT put_utf (	/* Returns number of encoding units written (0:buffer over
 #else						/* ANSI/OEM output */
 	WCHAR wc;
 
-	wc = ff_uni2oem(chr, CODEPAGE);
+	wc = (chr < 0x80) ? (WCHAR)chr : ff_uni2oem(chr, CODEPAGE);	/* ASCII is the same in ANSI/OEM */
 	if (wc >= 0x100) {	/* Is this a DBC? */
 		if (szb < 2) return 0;
 		*buf++ = (char)(wc >> 8);	/* Store DBC 1st byte */
@@ -1022,6 +1039,54 @@ static void clear_lock (	/* Clear lock entries of the volume */
 /* Move/Flush disk access window in the filesystem object                */
 /*-----------------------------------------------------------------------*/
 #if !FF_FS_READONLY
+#if FF_FAT_MIRROR_DEFER
+static FRESULT sync_mirror (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs			/* Filesystem object (the window must be clean) */
+)
+{
+	FRESULT res = FR_OK;
+	BYTE i;
+	LBA_t sect;
+
+
+	for (i = 0; i < fs->n_mirror; i++) {	/* Copy each pending sector of the 1st FAT into the 2nd FAT */
+		sect = fs->fatbase + fs->mirror[i];
+		if (sect != fs->winsect) {			/* Reload it unless it is still in the window */
+			if (disk_read(fs->pdrv, fs->win, sect, 1) != RES_OK) {
+				fs->winsect = (LBA_t)0 - 1;	/* Invalidate window and keep the entries for the next sync */
+				return FR_DISK_ERR;
+			}
+			fs->winsect = sect;
+		}
+		if (disk_write(fs->pdrv, fs->win, sect + fs->fsize, 1) != RES_OK) res = FR_DISK_ERR;
+	}
+	fs->n_mirror = 0;
+	return res;
+}
+
+
+static FRESULT defer_mirror (	/* Returns FR_OK or FR_DISK_ERR */
+	FATFS* fs,			/* Filesystem object (the window must be clean) */
+	DWORD ofs			/* Offset of the written sector in the 1st FAT */
+)
+{
+	FRESULT res = FR_OK;
+	BYTE i;
+
+
+	for (i = 0; i < fs->n_mirror; i++) {
+		if (fs->mirror[i] == ofs) {			/* Already pending? */
+			fs->mirror_saved++;
+			return FR_OK;
+		}
+	}
+	if (fs->n_mirror == FF_FAT_MIRROR_DEFER) res = sync_mirror(fs);	/* Table full: flush it first */
+	if (res == FR_OK) fs->mirror[fs->n_mirror++] = ofs;
+	return res;
+}
+#endif
+
+
 static FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERR */
 	FATFS* fs			/* Filesystem object */
 )
@@ -1033,7 +1098,11 @@ static FRESULT sync_window (	/* Returns FR_OK or FR_DISK_ERR */
 		if (disk_write(fs->pdrv, fs->win, fs->winsect, 1) == RES_OK) {	/* Write it back into the volume */
 			fs->wflag = 0;	/* Clear window dirty flag */
 			if (fs->winsect - fs->fatbase < fs->fsize) {	/* Is it in the 1st FAT? */
+#if FF_FAT_MIRROR_DEFER
+				if (fs->n_fats == 2) res = defer_mirror(fs, fs->winsect - fs->fatbase);	/* Reflect it to 2nd FAT at the next sync */
+#else
 				if (fs->n_fats == 2) disk_write(fs->pdrv, fs->win, fs->winsect + fs->fsize, 1);	/* Reflect it to 2nd FAT if needed */
+#endif
 			}
 		} else {
 			res = FR_DISK_ERR;
@@ -1083,6 +1152,9 @@ static FRESULT sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 	res = sync_window(fs);
+#if FF_FAT_MIRROR_DEFER
+	if (res == FR_OK) res = sync_mirror(fs);	/* Bring the 2nd FAT up to date */
+#endif
 	if (res == FR_OK) {
 		if (fs->fs_type == FS_FAT32 && fs->fsi_flag == 1) {	/* FAT32: Update FSInfo sector if needed */
 			/* Create FSInfo structure */
@@ -1857,7 +1929,7 @@ static int cmp_lfn (		/* 1:matched, 0:not matched */
 )
 {
 	UINT i, s;
-	WCHAR wc, uc;
+	WCHAR wc, uc, lc;
 
 
 	if (ld_word(dir + LDIR_FstClusLO) != 0) return 0;	/* Check LDIR_FstClusLO */
@@ -1867,7 +1939,9 @@ static int cmp_lfn (		/* 1:matched, 0:not matched */
 	for (wc = 1, s = 0; s < 13; s++) {		/* Process all characters in the entry */
 		uc = ld_word(dir + LfnOfs[s]);		/* Pick an LFN character */
 		if (wc != 0) {
-			if (i >= FF_MAX_LFN + 1 || ff_wtoupper(uc) != ff_wtoupper(lfnbuf[i++])) {	/* Compare it */
+			if (i >= FF_MAX_LFN + 1) return 0;	/* Too long? */
+			lc = lfnbuf[i++];
+			if (uc != lc && WtoUpper(uc) != WtoUpper(lc)) {	/* Compare it (no up-conversion needed for an exact match) */
 				return 0;					/* Not matched */
 			}
 			wc = uc;
@@ -2426,6 +2500,69 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 
 
 
+#if !FF_FS_READONLY && FF_USE_LFN && FF_SFN_SCAN
+/*-----------------------------------------------------------------------*/
+/* FAT-LFN: Pick a Numbered SFN and Find Free Entries in One Pass        */
+/*-----------------------------------------------------------------------*/
+/* Only the first FF_SFN_SCAN candidates are checked in the single pass. */
+/* When all of them are in use, *seq is FF_SFN_SCAN + 1 and dir_register */
+/* falls back to one directory pass per further candidate (dir_find), up */
+/* to NAME~99, so a folder with more than FF_SFN_SCAN colliding names    */
+/* costs as much as it did before this function was added. */
+
+static FRESULT scan_numname (	/* FR_OK:succeeded, !=0:error */
+	DIR* dp,			/* Target directory; dp->fn receives the numbered SFN */
+	const BYTE* sn,		/* SFN in directory form to be numbered */
+	UINT n_ent,			/* Number of contiguous entries to find */
+	UINT* seq,			/* Returns the sequence number picked, or FF_SFN_SCAN + 1 if all are in use */
+	DWORD* ofs			/* Returns the offset of the last of the free entries, or 0xFFFFFFFF if not found */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	BYTE cand[FF_SFN_SCAN][11], a, c, eot = 0;
+	DWORD used = 0;
+	UINT i, n = 0;
+
+
+	for (i = 0; i < FF_SFN_SCAN; i++) {	/* Generate the candidates */
+		gen_numname(cand[i], sn, fs->lfnbuf, i + 1);
+	}
+	*ofs = 0xFFFFFFFF;
+	res = dir_sdi(dp, 0);
+	while (res == FR_OK) {
+		res = move_window(fs, dp->sect);
+		if (res != FR_OK) break;
+		c = dp->dir[DIR_Name];
+		if (c == 0) eot = 1;			/* No entry is in use from here */
+		if (eot || c == DDEM) {			/* A free entry */
+			if (*ofs == 0xFFFFFFFF && ++n == n_ent) *ofs = dp->dptr;	/* Is a block of contiguous free entries found? */
+			if (eot && *ofs != 0xFFFFFFFF) break;	/* Nothing more to check */
+		} else {
+			n = 0;
+			a = dp->dir[DIR_Attr] & AM_MASK;
+			if (a != AM_LFN && !(a & AM_VOL) && !memcmp(dp->dir + 8, sn + 8, 3)) {	/* An SFN with the same extension, mark the candidate it matches */
+				for (i = 0; i < FF_SFN_SCAN; i++) {
+					if (!memcmp(dp->dir, cand[i], 8)) used |= (DWORD)1 << i;
+				}
+			}
+		}
+		res = dir_next(dp, eot);		/* Next entry, stretching the table past its end */
+	}
+	if (res == FR_NO_FILE) res = FR_OK;	/* The table is full with no end mark */
+	if (res != FR_OK) return res;
+
+	for (i = 0; i < FF_SFN_SCAN && (used & ((DWORD)1 << i)); i++) ;	/* Pick the first candidate not in use */
+	*seq = i + 1;
+	if (i < FF_SFN_SCAN) memcpy(dp->fn, cand[i], 11);
+	return FR_OK;
+}
+
+#endif	/* !FF_FS_READONLY && FF_USE_LFN && FF_SFN_SCAN */
+
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Register an object to the directory                                   */
@@ -2440,6 +2577,7 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 #if FF_USE_LFN		/* LFN configuration */
 	UINT n, len, n_ent;
 	BYTE sn[12], sum;
+	DWORD ofs = 0xFFFFFFFF;
 
 
 	if (dp->fn[NSFLAG] & (NS_DOT | NS_NONAME)) return FR_INVALID_NAME;	/* Check name validity */
@@ -2478,21 +2616,32 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 #endif
 	/* On the FAT/FAT32 volume */
 	memcpy(sn, dp->fn, 12);
+	n_ent = (sn[NSFLAG] & NS_LFN) ? (len + 12) / 13 + 1 : 1;	/* Number of entries to allocate */
 	if (sn[NSFLAG] & NS_LOSS) {			/* When LFN is out of 8.3 format, generate a numbered name */
-		dp->fn[NSFLAG] = NS_NOLFN;		/* Find only SFN */
-		for (n = 1; n < 100; n++) {
-			gen_numname(dp->fn, sn, fs->lfnbuf, n);	/* Generate a numbered name */
-			res = dir_find(dp);				/* Check if the name collides with existing SFN */
-			if (res != FR_OK) break;
+		n = 1;
+#if FF_SFN_SCAN
+		res = scan_numname(dp, sn, n_ent, &n, &ofs);	/* Check the first candidates and find the entries in one pass */
+		if (res != FR_OK) return res;
+#endif
+		if (n > FF_SFN_SCAN) {			/* Check the rest one at a time, one directory pass per candidate */
+			dp->fn[NSFLAG] = NS_NOLFN;		/* Find only SFN */
+			for ( ; n < 100; n++) {
+				gen_numname(dp->fn, sn, fs->lfnbuf, n);	/* Generate a numbered name */
+				res = dir_find(dp);				/* Check if the name collides with existing SFN */
+				if (res != FR_OK) break;
+			}
+			if (n == 100) return FR_DENIED;		/* Abort if too many collisions */
+			if (res != FR_NO_FILE) return res;	/* Abort if the result is other than 'not collided' */
+			dp->fn[NSFLAG] = sn[NSFLAG];
 		}
-		if (n == 100) return FR_DENIED;		/* Abort if too many collisions */
-		if (res != FR_NO_FILE) return res;	/* Abort if the result is other than 'not collided' */
-		dp->fn[NSFLAG] = sn[NSFLAG];
 	}
 
 	/* Create an SFN with/without LFNs. */
-	n_ent = (sn[NSFLAG] & NS_LFN) ? (len + 12) / 13 + 1 : 1;	/* Number of entries to allocate */
-	res = dir_alloc(dp, n_ent);		/* Allocate entries */
+	if (ofs != 0xFFFFFFFF) {
+		res = dir_sdi(dp, ofs);		/* Entries found by scan_numname */
+	} else {
+		res = dir_alloc(dp, n_ent);	/* Allocate entries */
+	}
 	if (res == FR_OK && --n_ent) {	/* Set LFN entry if needed */
 		res = dir_sdi(dp, dp->dptr - n_ent * SZDIRE);
 		if (res == FR_OK) {
@@ -3000,8 +3149,9 @@ static FRESULT create_name (	/* FR_OK: successful, FR_INVALID_NAME: could not cr
 /* Follow a file path                                                    */
 /*-----------------------------------------------------------------------*/
 
-static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
+static FRESULT follow_path_at (	/* FR_OK(0): successful, !=0: error code */
 	DIR* dp,					/* Directory object to return last directory and found object */
+	const DIR* org,				/* Open directory that a relative path starts at (0:the current directory) */
 	const TCHAR* path			/* Full-path string to find a file or directory */
 )
 {
@@ -3010,6 +3160,12 @@ static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 	FATFS *fs = dp->obj.fs;
 
 
+	if (org && (org->obj.fs != fs || org->obj.id != fs->id)) {	/* The origin must be open on the same volume */
+		return FR_INVALID_OBJECT;
+	}
+	if (org && !IsSeparator(*path)) {		/* Relative to an open directory */
+		dp->obj.sclust = org->obj.sclust;	/* Start at the directory */
+	} else
 #if FF_FS_RPATH != 0
 	if (!IsSeparator(*path) && (FF_STR_VOLUME_ID != 2 || !IsTerminator(*path))) {	/* Without heading separator */
 		dp->obj.sclust = fs->cdir;			/* Start at the current directory */
@@ -3021,8 +3177,15 @@ static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 	}
 #if FF_FS_EXFAT
 	dp->obj.n_frag = 0;	/* Invalidate last fragment counter of the object */
+	if (fs->fs_type == FS_EXFAT && org && dp->obj.sclust == org->obj.sclust) {	/* exFAT: Take the sub-directory's status from the origin */
+		dp->obj.c_scl = org->obj.c_scl;
+		dp->obj.c_size = org->obj.c_size;
+		dp->obj.c_ofs = org->obj.c_ofs;
+		dp->obj.objsize = org->obj.objsize;
+		dp->obj.stat = org->obj.stat;
+	}
 #if FF_FS_RPATH != 0
-	if (fs->fs_type == FS_EXFAT && dp->obj.sclust) {	/* exFAT: Retrieve the sub-directory's status */
+	else if (fs->fs_type == FS_EXFAT && dp->obj.sclust) {	/* exFAT: Retrieve the sub-directory's status */
 		DIR dj;
 
 		dp->obj.c_scl = fs->cdc_scl;
@@ -3083,6 +3246,17 @@ static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 
 
 
+static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
+	DIR* dp,					/* Directory object to return last directory and found object */
+	const TCHAR* path			/* Full-path string to find a file or directory */
+)
+{
+	return follow_path_at(dp, 0, path);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get logical drive number from path name                               */
 /*-----------------------------------------------------------------------*/
@@ -3512,6 +3686,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 		/* Get FSInfo if available */
 		fs->last_clst = fs->free_clst = 0xFFFFFFFF;		/* Initialize cluster allocation information */
 		fs->fsi_flag = 0x80;
+#if FF_FAT_MIRROR_DEFER
+		fs->n_mirror = 0;								/* No pending 2nd FAT updates */
+#endif
 #if (FF_FS_NOFSINFO & 3) != 3
 		if (fmt == FS_FAT32				/* Allow to update FSInfo only if BPB_FSInfo32 == 1 */
 			&& ld_word(fs->win + BPB_FSInfo32) == 1
@@ -3554,6 +3731,74 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 
 
 
+#if FF_FS_TINY && FF_PRIVATE_BUFS
+/*-----------------------------------------------------------------------*/
+/* Get/Set the Private Sector Buffer of a File                           */
+/*-----------------------------------------------------------------------*/
+
+static BYTE* file_buf (	/* Returns the buffer attached by f_setbuf, or 0 if the file uses the window */
+	FIL* fp				/* File object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_PRIVATE_BUFS; i++) {
+		if (PrivBuf[i].fp == fp) return PrivBuf[i].buf;
+	}
+	return 0;
+}
+
+
+static int set_file_buf (	/* Returns 1 if done, or 0 if there is no free slot */
+	FIL* fp,				/* File object */
+	BYTE* buf				/* Buffer to attach (0:detach) */
+)
+{
+	UINT i, n = FF_PRIVATE_BUFS;
+
+
+	for (i = 0; i < FF_PRIVATE_BUFS && PrivBuf[i].fp != fp; i++) {
+		if (!PrivBuf[i].fp && n == FF_PRIVATE_BUFS) n = i;	/* First free slot */
+	}
+	if (i == FF_PRIVATE_BUFS) {		/* Nothing attached yet */
+		if (!buf) return 1;
+		if (n == FF_PRIVATE_BUFS) return 0;
+		i = n;
+	}
+	PrivBuf[i].fp = buf ? fp : 0;
+	PrivBuf[i].buf = buf;
+	return 1;
+}
+
+#endif
+
+
+
+#if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Write Back the Sector Buffer of a File                                */
+/*-----------------------------------------------------------------------*/
+/* The volume window may hold an older copy of the same sector, read     */
+/* through it before the buffer was attached, so it is refreshed too.    */
+
+static FRESULT write_file_buf (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,		/* Filesystem object */
+	FIL* fp,		/* File object whose buffer holds fp->sect */
+	BYTE* fbuf		/* The file's sector buffer */
+)
+{
+	if (disk_write(fs->pdrv, fbuf, fp->sect, 1) != RES_OK) return FR_DISK_ERR;
+	if (fs->winsect == fp->sect) {
+		memcpy(fs->win, fbuf, SS(fs));
+		fs->wflag = 0;
+	}
+	return FR_OK;
+}
+#endif
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Check if the file/directory object is valid or not                    */
 /*-----------------------------------------------------------------------*/
@@ -3655,6 +3900,17 @@ FRESULT f_open (
 	const TCHAR* path,	/* Pointer to the file name */
 	BYTE mode			/* Access mode and open mode flags */
 )
+{
+	return f_openat(fp, 0, path, mode);
+}
+
+
+FRESULT f_openat (
+	FIL* fp,			/* Pointer to the blank file object */
+	const DIR* dp,		/* Open directory that a relative path starts at (0:the current directory) */
+	const TCHAR* path,	/* Pointer to the file name */
+	BYTE mode			/* Access mode and open mode flags */
+)
 {
 	FRESULT res;
 	DIR dj;
@@ -3673,9 +3929,12 @@ FRESULT f_open (
 	mode &= FF_FS_READONLY ? FA_READ : FA_READ | FA_WRITE | FA_CREATE_ALWAYS | FA_CREATE_NEW | FA_OPEN_ALWAYS | FA_OPEN_APPEND;
 	res = mount_volume(&path, &fs, mode);
 	if (res == FR_OK) {
+#if FF_FS_TINY && FF_PRIVATE_BUFS
+		set_file_buf(fp, 0);	/* A buffer attached to an earlier use of this object is dropped */
+#endif
 		dj.obj.fs = fs;
 		INIT_NAMBUF(fs);
-		res = follow_path(&dj, path);	/* Follow the file path */
+		res = follow_path_at(&dj, dp, path);	/* Follow the file path */
 #if !FF_FS_READONLY	/* Read/Write configuration */
 		if (res == FR_OK) {
 			if (dj.fn[NSFLAG] & NS_NONAME) {	/* Origin directory itself? */
@@ -3856,6 +4115,7 @@ FRESULT f_read (
 {
 	FRESULT res;
 	FATFS *fs;
+	BYTE *fbuf;
 	DWORD clst;
 	LBA_t sect;
 	FSIZE_t remain;
@@ -3865,6 +4125,7 @@ FRESULT f_read (
 
 	*br = 0;	/* Clear read byte counter */
 	res = validate(&fp->obj, &fs);				/* Check validity of the file object */
+	fbuf = file_buf(fp);
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
 	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED); /* Check access mode */
 	remain = fp->obj.objsize - fp->fptr;
@@ -3900,40 +4161,38 @@ FRESULT f_read (
 				}
 				if (disk_read(fs->pdrv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace one of the read sectors with cached data if it contains a dirty sector */
-#if FF_FS_TINY
-				if (fs->wflag && fs->winsect - sect < cc) {
-					memcpy(rbuff + ((fs->winsect - sect) * SS(fs)), fs->win, SS(fs));
-				}
-#else
-				if ((fp->flag & FA_DIRTY) && fp->sect - sect < cc) {
-					memcpy(rbuff + ((fp->sect - sect) * SS(fs)), fp->buf, SS(fs));
+				if (!fbuf) {
+					if (fs->wflag && fs->winsect - sect < cc) {
+						memcpy(rbuff + ((fs->winsect - sect) * SS(fs)), fs->win, SS(fs));
+					}
+				} else {
+					if ((fp->flag & FA_DIRTY) && fp->sect - sect < cc) {
+						memcpy(rbuff + ((fp->sect - sect) * SS(fs)), fbuf, SS(fs));
+					}
 				}
-#endif
 #endif
 				rcnt = SS(fs) * cc;				/* Number of bytes transferred */
 				continue;
 			}
-#if !FF_FS_TINY
-			if (fp->sect != sect) {			/* Load data sector if not in cache */
+			if (fbuf && fp->sect != sect) {	/* Load data sector if not in cache */
 #if !FF_FS_READONLY
 				if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
-					if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+					if (write_file_buf(fs, fp, fbuf) != FR_OK) ABORT(fs, FR_DISK_ERR);
 					fp->flag &= (BYTE)~FA_DIRTY;
 				}
 #endif
-				if (disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+				if (disk_read(fs->pdrv, fbuf, sect, 1) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
 			}
-#endif
 			fp->sect = sect;
 		}
 		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
 		if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
-#if FF_FS_TINY
-		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
-		memcpy(rbuff, fs->win + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
-#else
-		memcpy(rbuff, fp->buf + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
-#endif
+		if (!fbuf) {
+			if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
+			memcpy(rbuff, fs->win + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+		} else {
+			memcpy(rbuff, fbuf + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+		}
 	}
 
 	LEAVE_FF(fs, FR_OK);
@@ -3956,6 +4215,7 @@ FRESULT f_write (
 {
 	FRESULT res;
 	FATFS *fs;
+	BYTE *fbuf;
 	DWORD clst;
 	LBA_t sect;
 	UINT wcnt, cc, csect;
@@ -3964,6 +4224,7 @@ FRESULT f_write (
 
 	*bw = 0;	/* Clear write byte counter */
 	res = validate(&fp->obj, &fs);			/* Check validity of the file object */
+	fbuf = file_buf(fp);
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
 	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
 
@@ -3997,14 +4258,12 @@ FRESULT f_write (
 				fp->clust = clst;			/* Update current cluster */
 				if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
 			}
-#if FF_FS_TINY
-			if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back sector cache */
-#else
-			if (fp->flag & FA_DIRTY) {		/* Write-back sector cache */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+			if (!fbuf) {
+				if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back sector cache */
+			} else if (fp->flag & FA_DIRTY) {	/* Write-back sector cache */
+				if (write_file_buf(fs, fp, fbuf) != FR_OK) ABORT(fs, FR_DISK_ERR);
 				fp->flag &= (BYTE)~FA_DIRTY;
 			}
-#endif
 			sect = clst2sect(fs, fp->clust);	/* Get current sector */
 			if (sect == 0) ABORT(fs, FR_INT_ERR);
 			sect += csect;
@@ -4015,45 +4274,40 @@ FRESULT f_write (
 				}
 				if (disk_write(fs->pdrv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if FF_FS_MINIMIZE <= 2
-#if FF_FS_TINY
 				if (fs->winsect - sect < cc) {	/* Refill sector cache if it gets invalidated by the direct write */
 					memcpy(fs->win, wbuff + ((fs->winsect - sect) * SS(fs)), SS(fs));
 					fs->wflag = 0;
 				}
-#else
-				if (fp->sect - sect < cc) { /* Refill sector cache if it gets invalidated by the direct write */
-					memcpy(fp->buf, wbuff + ((fp->sect - sect) * SS(fs)), SS(fs));
+				if (fbuf && fp->sect - sect < cc) { /* Likewise the private sector buffer */
+					memcpy(fbuf, wbuff + ((fp->sect - sect) * SS(fs)), SS(fs));
 					fp->flag &= (BYTE)~FA_DIRTY;
 				}
-#endif
 #endif
 				wcnt = SS(fs) * cc;		/* Number of bytes transferred */
 				continue;
 			}
-#if FF_FS_TINY
-			if (fp->fptr >= fp->obj.objsize) {	/* Avoid silly cache filling on the growing edge */
-				if (sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);
-				fs->winsect = sect;
-			}
-#else
-			if (fp->sect != sect && 		/* Fill sector cache with file data */
+			if (!fbuf) {
+				if (fp->fptr >= fp->obj.objsize) {	/* Avoid silly cache filling on the growing edge */
+					if (sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);
+					fs->winsect = sect;
+				}
+			} else if (fp->sect != sect && 		/* Fill sector cache with file data */
 				fp->fptr < fp->obj.objsize &&
-				disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) {
+				disk_read(fs->pdrv, fbuf, sect, 1) != RES_OK) {
 					ABORT(fs, FR_DISK_ERR);
 			}
-#endif
 			fp->sect = sect;
 		}
 		wcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
 		if (wcnt > btw) wcnt = btw;					/* Clip it by btw if needed */
-#if FF_FS_TINY
-		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
-		memcpy(fs->win + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
-		fs->wflag = 1;
-#else
-		memcpy(fp->buf + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
-		fp->flag |= FA_DIRTY;
-#endif
+		if (!fbuf) {
+			if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
+			memcpy(fs->win + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
+			fs->wflag = 1;
+		} else {
+			memcpy(fbuf + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
+			fp->flag |= FA_DIRTY;
+		}
 	}
 
 	fp->flag |= FA_MODIFIED;				/* Set file change flag */
@@ -4074,19 +4328,19 @@ FRESULT f_sync (
 {
 	FRESULT res;
 	FATFS *fs;
+	BYTE *fbuf;
 	DWORD tm;
 	BYTE *dir;
 
 
 	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	fbuf = file_buf(fp);
 	if (res == FR_OK) {
 		if (fp->flag & FA_MODIFIED) {	/* Is there any change to the file? */
-#if !FF_FS_TINY
-			if (fp->flag & FA_DIRTY) {	/* Write-back cached data if needed */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
+			if (fbuf && (fp->flag & FA_DIRTY)) {	/* Write-back cached data if needed */
+				if (write_file_buf(fs, fp, fbuf) != FR_OK) LEAVE_FF(fs, FR_DISK_ERR);
 				fp->flag &= (BYTE)~FA_DIRTY;
 			}
-#endif
 			/* Update the directory entry */
 			tm = GET_FATTIME();				/* Modified time */
 #if FF_FS_EXFAT
@@ -4169,6 +4423,9 @@ FRESULT f_close (
 #else
 			fp->obj.fs = 0;	/* Invalidate file object */
 #endif
+#if FF_FS_TINY && FF_PRIVATE_BUFS
+			if (!fp->obj.fs) set_file_buf(fp, 0);	/* Detach the private buffer (the caller frees it) */
+#endif
 #if FF_FS_REENTRANT
 			unlock_fs(fs, FR_OK);		/* Unlock volume */
 #endif
@@ -4180,6 +4437,109 @@ FRESULT f_close (
 
 
 
+#if FF_FS_TINY && FF_PRIVATE_BUFS
+/*-----------------------------------------------------------------------*/
+/* Attach or Detach a Private Sector Buffer                              */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_setbuf (
+	FIL* fp,		/* Open file */
+	BYTE* buf		/* FF_MAX_SS bytes for the file's own sector buffer (0:share the volume window) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	BYTE *fbuf;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
+	fbuf = file_buf(fp);
+	if (fbuf == buf) LEAVE_FF(fs, FR_OK);
+	if (fbuf) {						/* Move the current sector out of the old buffer */
+#if !FF_FS_READONLY
+		if (fp->flag & FA_DIRTY) {
+			if (write_file_buf(fs, fp, fbuf) != FR_OK) ABORT(fs, FR_DISK_ERR);
+			fp->flag &= (BYTE)~FA_DIRTY;
+		}
+#endif
+		if (buf && fp->sect) memcpy(buf, fbuf, SS(fs));
+		if (fs->winsect == fp->sect) fs->winsect = (LBA_t)0 - 1;	/* The window may hold an old copy of it */
+	} else if (fp->sect) {			/* Move the current sector out of the volume window */
+		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);
+#if !FF_FS_READONLY
+		if (sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* So a later sync cannot overwrite the private copy */
+#endif
+		memcpy(buf, fs->win, SS(fs));
+	}
+	if (!set_file_buf(fp, buf)) LEAVE_FF(fs, FR_TOO_MANY_OPEN_FILES);
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Get the Private Sector Buffer of a File                               */
+/*-----------------------------------------------------------------------*/
+
+BYTE* f_getbuf (	/* Returns the buffer attached by f_setbuf, or 0 */
+	FIL* fp			/* File object, open or closed */
+)
+{
+	return file_buf(fp);
+}
+#endif
+
+
+
+
+#if !FF_FS_READONLY && FF_FS_LOCK == 0
+/*-----------------------------------------------------------------------*/
+/* Reattach a Saved File Object to the Mounted Volume                    */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_reattach (
+	FIL* fp,		/* File object copied while open (and synced), possibly under an earlier mount */
+	FATFS* fs		/* Filesystem object the file was opened on, now mounted */
+)
+{
+	FRESULT res;
+	BYTE *dir;
+	UINT ofs;
+
+
+	fp->obj.fs = 0;		/* Invalid until the directory entry checks out */
+#if FF_FS_TINY && FF_PRIVATE_BUFS
+	set_file_buf(fp, 0);	/* A saved file object never brings a private buffer with it */
+#endif
+	if (!fs->fs_type) return FR_NOT_ENABLED;
+	ofs = (UINT)(fp->dir_ptr - fs->win);
+	if (ofs >= SS(fs) || ofs % SZDIRE) return FR_INVALID_OBJECT;
+#if FF_FS_REENTRANT
+	if (!lock_fs(fs)) return FR_TIMEOUT;	/* The window is about to be moved */
+#endif
+	res = move_window(fs, fp->dir_sect);
+	if (res == FR_OK) {
+		dir = fs->win + ofs;
+		if (dir[DIR_Name] == DDEM || dir[DIR_Name] == 0 || (dir[DIR_Attr] & AM_DIR)
+			|| ld_clust(fs, dir) != fp->obj.sclust || ld_dword(dir + DIR_FileSize) != (DWORD)fp->obj.objsize) {
+			res = FR_INVALID_OBJECT;	/* Deleted, replaced or resized since it was saved */
+		} else {
+			fp->obj.fs = fs;
+			fp->obj.id = fs->id;	/* Take the current mount ID */
+			fp->dir_ptr = dir;
+		}
+	}
+	LEAVE_FF(fs, res);
+}
+
+#endif /* !FF_FS_READONLY && FF_FS_LOCK == 0 */
+
+
+
+
 #if FF_FS_RPATH >= 1
 /*-----------------------------------------------------------------------*/
 /* Change Current Directory or Current Drive, Get Current Directory      */
@@ -4371,6 +4731,7 @@ FRESULT f_lseek (
 {
 	FRESULT res;
 	FATFS *fs;
+	BYTE *fbuf;
 	DWORD clst, bcs;
 	LBA_t nsect;
 	FSIZE_t ifptr;
@@ -4381,6 +4742,7 @@ FRESULT f_lseek (
 #endif
 
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	fbuf = file_buf(fp);
 	if (res == FR_OK) res = (FRESULT)fp->err;
 #if FF_FS_EXFAT && !FF_FS_READONLY
 	if (res == FR_OK && fs->fs_type == FS_EXFAT) {
@@ -4425,15 +4787,15 @@ FRESULT f_lseek (
 				if (dsc == 0) ABORT(fs, FR_INT_ERR);
 				dsc += (DWORD)((ofs - 1) / SS(fs)) & (fs->csize - 1);
 				if (fp->fptr % SS(fs) && dsc != fp->sect) {	/* Refill sector cache if needed */
-#if !FF_FS_TINY
+					if (fbuf) {
 #if !FF_FS_READONLY
-					if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
-						if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-						fp->flag &= (BYTE)~FA_DIRTY;
-					}
-#endif
-					if (disk_read(fs->pdrv, fp->buf, dsc, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Load current sector */
+						if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
+							if (write_file_buf(fs, fp, fbuf) != FR_OK) ABORT(fs, FR_DISK_ERR);
+							fp->flag &= (BYTE)~FA_DIRTY;
+						}
 #endif
+						if (disk_read(fs->pdrv, fbuf, dsc, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Load current sector */
+					}
 					fp->sect = dsc;
 				}
 			}
@@ -4505,15 +4867,15 @@ FRESULT f_lseek (
 			fp->flag |= FA_MODIFIED;
 		}
 		if (fp->fptr % SS(fs) && nsect != fp->sect) {	/* Fill sector cache if needed */
-#if !FF_FS_TINY
+			if (fbuf) {
 #if !FF_FS_READONLY
-			if (fp->flag & FA_DIRTY) {			/* Write-back dirty sector cache */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-				fp->flag &= (BYTE)~FA_DIRTY;
-			}
-#endif
-			if (disk_read(fs->pdrv, fp->buf, nsect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+				if (fp->flag & FA_DIRTY) {			/* Write-back dirty sector cache */
+					if (write_file_buf(fs, fp, fbuf) != FR_OK) ABORT(fs, FR_DISK_ERR);
+					fp->flag &= (BYTE)~FA_DIRTY;
+				}
 #endif
+				if (disk_read(fs->pdrv, fbuf, nsect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+			}
 			fp->sect = nsect;
 		}
 	}
@@ -4703,6 +5065,20 @@ FRESULT f_findfirst (
 	return res;
 }
 
+
+
+/*-----------------------------------------------------------------------*/
+/* Test a Name Against a Matching Pattern                                */
+/*-----------------------------------------------------------------------*/
+
+int f_match (			/* 0:mismatched, 1:matched */
+	const TCHAR* pattern,	/* Pointer to the matching pattern */
+	const TCHAR* name		/* Pointer to the name to be tested */
+)
+{
+	return pattern_match(pattern, name, 0, FIND_RECURS);
+}
+
 #endif	/* FF_USE_FIND */
 
 
@@ -4716,6 +5092,16 @@ FRESULT f_stat (
 	const TCHAR* path,	/* Pointer to the file path */
 	FILINFO* fno		/* Pointer to file information to return */
 )
+{
+	return f_statat(0, path, fno);
+}
+
+
+FRESULT f_statat (
+	const DIR* dp,		/* Open directory that a relative path starts at (0:the current directory) */
+	const TCHAR* path,	/* Pointer to the file path */
+	FILINFO* fno		/* Pointer to file information to return */
+)
 {
 	FRESULT res;
 	DIR dj;
@@ -4726,7 +5112,7 @@ FRESULT f_stat (
 	res = mount_volume(&path, &dj.obj.fs, 0);
 	if (res == FR_OK) {
 		INIT_NAMBUF(dj.obj.fs);
-		res = follow_path(&dj, path);	/* Follow the file path */
+		res = follow_path_at(&dj, dp, path);	/* Follow the file path */
 		if (res == FR_OK) {				/* Follow completed */
 			if (dj.fn[NSFLAG] & NS_NONAME) {	/* It is origin directory */
 				res = FR_INVALID_NAME;
@@ -4845,10 +5231,12 @@ FRESULT f_truncate (
 {
 	FRESULT res;
 	FATFS *fs;
+	BYTE *fbuf;
 	DWORD ncl;
 
 
 	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	fbuf = file_buf(fp);
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
 	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
 
@@ -4867,15 +5255,13 @@ FRESULT f_truncate (
 		}
 		fp->obj.objsize = fp->fptr;	/* Set file size to current read/write point */
 		fp->flag |= FA_MODIFIED;
-#if !FF_FS_TINY
-		if (res == FR_OK && (fp->flag & FA_DIRTY)) {
-			if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) {
+		if (res == FR_OK && fbuf && (fp->flag & FA_DIRTY)) {
+			if (write_file_buf(fs, fp, fbuf) != FR_OK) {
 				res = FR_DISK_ERR;
 			} else {
 				fp->flag &= (BYTE)~FA_DIRTY;
 			}
 		}
-#endif
 		if (res != FR_OK) ABORT(fs, res);
 	}
 
@@ -4892,6 +5278,15 @@ FRESULT f_truncate (
 FRESULT f_unlink (
 	const TCHAR* path		/* Pointer to the file or directory path */
 )
+{
+	return f_unlinkat(0, path);
+}
+
+
+FRESULT f_unlinkat (
+	const DIR* dp,			/* Open directory that a relative path starts at (0:the current directory) */
+	const TCHAR* path		/* Pointer to the file or directory path */
+)
 {
 	FRESULT res;
 	DIR dj, sdj;
@@ -4908,7 +5303,7 @@ FRESULT f_unlink (
 	if (res == FR_OK) {
 		dj.obj.fs = fs;
 		INIT_NAMBUF(fs);
-		res = follow_path(&dj, path);		/* Follow the file path */
+		res = follow_path_at(&dj, dp, path);	/* Follow the file path */
 		if (FF_FS_RPATH && res == FR_OK && (dj.fn[NSFLAG] & NS_DOT)) {
 			res = FR_INVALID_NAME;			/* Cannot remove dot entry */
 		}
@@ -5071,6 +5466,17 @@ FRESULT f_rename (
 	const TCHAR* path_old,	/* Pointer to the object name to be renamed */
 	const TCHAR* path_new	/* Pointer to the new name */
 )
+{
+	return f_renameat(0, path_old, 0, path_new);
+}
+
+
+FRESULT f_renameat (
+	const DIR* dp_old,		/* Open directory that a relative old name starts at (0:the current directory) */
+	const TCHAR* path_old,	/* Pointer to the object name to be renamed */
+	const DIR* dp_new,		/* Open directory that a relative new name starts at (0:the current directory) */
+	const TCHAR* path_new	/* Pointer to the new name */
+)
 {
 	FRESULT res;
 	DIR djo, djn;
@@ -5085,7 +5491,7 @@ FRESULT f_rename (
 	if (res == FR_OK) {
 		djo.obj.fs = fs;
 		INIT_NAMBUF(fs);
-		res = follow_path(&djo, path_old);			/* Check old object */
+		res = follow_path_at(&djo, dp_old, path_old);	/* Check old object */
 		if (res == FR_OK && (djo.fn[NSFLAG] & (NS_DOT | NS_NONAME))) res = FR_INVALID_NAME;	/* Check validity of name */
 #if FF_FS_LOCK != 0
 		if (res == FR_OK) {
@@ -5100,7 +5506,7 @@ FRESULT f_rename (
 
 				memcpy(buf, fs->dirbuf, SZDIRE * 2);	/* Save 85+C0 entry of old object */
 				memcpy(&djn, &djo, sizeof djo);
-				res = follow_path(&djn, path_new);		/* Make sure if new object name is not in use */
+				res = follow_path_at(&djn, dp_new, path_new);		/* Make sure if new object name is not in use */
 				if (res == FR_OK) {						/* Is new name already in use by any other object? */
 					res = (djn.obj.sclust == djo.obj.sclust && djn.dptr == djo.dptr) ? FR_NO_FILE : FR_EXIST;
 				}
@@ -5122,7 +5528,7 @@ FRESULT f_rename (
 			{	/* At FAT/FAT32 volume */
 				memcpy(buf, djo.dir, SZDIRE);			/* Save directory entry of the object */
 				memcpy(&djn, &djo, sizeof (DIR));		/* Duplicate the directory object */
-				res = follow_path(&djn, path_new);		/* Make sure if new object name is not in use */
+				res = follow_path_at(&djn, dp_new, path_new);		/* Make sure if new object name is not in use */
 				if (res == FR_OK) {						/* Is new name already in use by any other object? */
 					res = (djn.obj.sclust == djo.obj.sclust && djn.dptr == djo.dptr) ? FR_NO_FILE : FR_EXIST;
 				}
@@ -5569,10 +5975,251 @@ FRESULT f_expand (
 	LEAVE_FF(fs, res);
 }
 
+
+/*-----------------------------------------------------------------------*/
+/* Set the Size of a File Written Around FatFs                           */
+/*-----------------------------------------------------------------------*/
+/* For files whose data is written straight to the sectors of an extent  */
+/* allocated by f_expand. The size must not exceed the allocated         */
+/* clusters; it is written to the directory entry by the next f_sync.    */
+
+FRESULT f_setsize (
+	FIL* fp,		/* Pointer to the file object */
+	FSIZE_t fsz		/* New file size */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
+	if (!(fp->flag & FA_WRITE) || fp->obj.sclust == 0 || fp->fptr > fsz) LEAVE_FF(fs, FR_DENIED);
+	fp->obj.objsize = fsz;
+	fp->flag |= FA_MODIFIED;
+
+	LEAVE_FF(fs, FR_OK);
+}
+
 #endif /* FF_USE_EXPAND && !FF_FS_READONLY */
 
 
 
+#if FF_USE_DEFRAG && !FF_FS_READONLY && FF_FS_MINIMIZE == 0
+/*-----------------------------------------------------------------------*/
+/* Count the Fragments of a File or Directory                            */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT chain_frags (	/* FR_OK(0):succeeded, !=0:error */
+	FFOBJID* obj,		/* Object whose volume holds the chain */
+	DWORD clst,			/* Top cluster of the chain (0:no data) */
+	DWORD* nfrag,		/* Pointer to return the number of contiguous runs */
+	DWORD* nclst		/* Pointer to return the number of clusters */
+)
+{
+	FATFS *fs = obj->fs;
+	DWORD nxt, nf = 0, nc = 0;
+
+
+	while (clst >= 2 && clst < fs->n_fatent) {
+		if (++nc >= fs->n_fatent) return FR_INT_ERR;	/* Circular chain? */
+		nxt = get_fat(obj, clst);
+		if (nxt < 2) return FR_INT_ERR;
+		if (nxt == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (nxt != clst + 1) nf++;		/* End of a run */
+		clst = nxt;
+	}
+	*nfrag = nf; *nclst = nc;
+	return FR_OK;
+}
+
+
+FRESULT f_fragments (
+	const TCHAR* path,	/* Pointer to the object name */
+	DWORD* nfrag,		/* Pointer to return the number of contiguous runs (0:empty) */
+	DWORD* nclst		/* Pointer to return the number of clusters */
+)
+{
+	FRESULT res;
+	DIR dj;
+	DEF_NAMBUF
+
+
+	res = mount_volume(&path, &dj.obj.fs, 0);
+	if (res == FR_OK) {
+		INIT_NAMBUF(dj.obj.fs);
+		res = follow_path(&dj, path);
+		if (res == FR_OK && (dj.fn[NSFLAG] & NS_NONAME)) res = FR_INVALID_NAME;	/* Origin directory has no entry */
+		if (res == FR_OK && dj.obj.fs->fs_type == FS_EXFAT) res = FR_DENIED;
+		if (res == FR_OK) res = chain_frags(&dj.obj, ld_clust(dj.obj.fs, dj.dir), nfrag, nclst);
+		FREE_NAMBUF();
+	}
+
+	LEAVE_FF(dj.obj.fs, res);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Move a File or Directory into a Contiguous Cluster Block              */
+/*-----------------------------------------------------------------------*/
+/* The object must not be open. Its data is copied to free clusters, the  */
+/* new chain is built and the dot-dot entries of a directory's children   */
+/* are pointed at the copy before the directory entry is switched over,   */
+/* and the old chain is freed last. A power loss at any point leaves the  */
+/* object intact and nothing pointing at free clusters; the worst case is */
+/* one chain of lost clusters. */
+/* A contiguous object is left alone, unless lower is set and there is a  */
+/* block of free clusters before it that it fits in. FR_DENIED is then    */
+/* returned if there is none, and the object is already as low as it can go. */
+
+FRESULT f_relocate (
+	const TCHAR* path,	/* Pointer to the object name */
+	DWORD* hint,		/* Pointer to the cluster to search from, updated to the cluster after the new block */
+	void* work,			/* Pointer to a work buffer to copy through (null:use the sector window) */
+	UINT len,			/* Size of the work buffer [byte] */
+	BYTE lower			/* 1:Also move a contiguous object down to the lowest block it fits in */
+)
+{
+	FRESULT res;
+	DIR dj;
+	FATFS *fs;
+	BYTE *buf, *dir, attr;
+	UINT doff, ns, bsz, i;
+	LBA_t dsect, sect;
+	DWORD ocl, scl, clst, nxt, ncl, tcl, nf, stcl, n;
+	DEF_NAMBUF
+
+
+	res = mount_volume(&path, &fs, FA_WRITE);
+	dj.obj.fs = fs;
+	if (res == FR_OK) {
+		INIT_NAMBUF(fs);
+		res = follow_path(&dj, path);
+		if (res == FR_OK && (dj.fn[NSFLAG] & (NS_DOT | NS_NONAME))) res = FR_INVALID_NAME;	/* Cannot move the origin directory */
+		if (res == FR_OK && fs->fs_type == FS_EXFAT) res = FR_DENIED;
+		if (res == FR_OK) {
+			dsect = dj.sect; doff = (UINT)(dj.dir - fs->win);	/* Location of the entry */
+			attr = dj.dir[DIR_Attr];
+			ocl = ld_clust(fs, dj.dir);
+			res = chain_frags(&dj.obj, ocl, &nf, &tcl);
+		}
+		if (res == FR_OK && (nf > 1 || (nf == 1 && lower))) {	/* Nothing to do if it is empty or already contiguous */
+			stcl = *hint;
+			if (stcl < 2 || stcl >= fs->n_fatent || nf == 1) stcl = 2;	/* A contiguous object is only moved down */
+			scl = clst = stcl; ncl = 0;
+			for (;;) {	/* Find a contiguous free block */
+				if (nf == 1 && clst == ocl) { res = FR_DENIED; break; }	/* No free block below the object? */
+				n = get_fat(&dj.obj, clst);
+				if (n == 1) { res = FR_INT_ERR; break; }
+				if (n == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+				if (n == 0) {	/* Is it a free cluster? */
+					if (ncl++ == 0) scl = clst;
+					if (ncl == tcl) break;		/* Break if a contiguous cluster block is found */
+				} else {
+					ncl = 0;
+				}
+				if (++clst >= fs->n_fatent) {	/* A block cannot wrap around the end of the FAT */
+					clst = 2; ncl = 0;
+				}
+				if (clst == stcl) { res = FR_DENIED; break; }	/* No contiguous cluster block? */
+			}
+
+			if (res == FR_OK) {	/* Copy the data into the free block */
+				res = sync_window(fs);		/* The raw I/O below must not read around a dirty window */
+				sect = clst2sect(fs, scl);
+				if (fs->winsect >= sect && fs->winsect < sect + tcl * fs->csize) fs->winsect = (LBA_t)0 - 1;	/* Nor leave a copied sector stale in it */
+				if (work && len >= SS(fs)) {
+					buf = (BYTE*)work; bsz = len / SS(fs);
+				} else {
+					buf = fs->win; bsz = 1;
+				}
+				for (clst = ocl, ncl = scl; res == FR_OK && ncl < scl + tcl; clst = nxt, ncl++) {
+					nxt = get_fat(&dj.obj, clst);
+					if (nxt == 1) { res = FR_INT_ERR; break; }
+					if (nxt == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+					if (buf == fs->win) fs->winsect = (LBA_t)0 - 1;	/* Window is to be overwritten */
+					for (i = 0; i < fs->csize; i += ns) {
+						ns = fs->csize - i;
+						if (ns > bsz) ns = bsz;
+						if (disk_read(fs->pdrv, buf, clst2sect(fs, clst) + i, ns) != RES_OK
+							|| disk_write(fs->pdrv, buf, clst2sect(fs, ncl) + i, ns) != RES_OK) {
+							res = FR_DISK_ERR; break;
+						}
+					}
+				}
+			}
+			if (res == FR_OK && (attr & AM_DIR)) {	/* Point the dot entry of the copy at itself */
+				res = move_window(fs, clst2sect(fs, scl));
+				if (res == FR_OK && fs->win[DIR_Name] == '.') {
+					st_clust(fs, fs->win, scl);
+					fs->wflag = 1;
+				}
+			}
+			if (res == FR_OK) {	/* Create the new cluster chain on the FAT */
+				for (clst = scl, n = tcl; n; clst++, n--) {
+					res = put_fat(fs, clst, (n == 1) ? 0xFFFFFFFF : clst + 1);
+					if (res != FR_OK) break;
+				}
+			}
+			if (res == FR_OK) {
+				fs->last_clst = scl + tcl - 1;
+				if (fs->free_clst <= fs->n_fatent - 2) {	/* Update FSINFO */
+					fs->free_clst -= tcl;
+					fs->fsi_flag |= 1;
+				}
+				res = sync_fs(fs);		/* The copy must be on the disk before anything points at it */
+			}
+/* Start of critical section where an interruption can leave lost clusters */
+			if (res == FR_OK && (attr & AM_DIR)) {	/* Point the dot-dot entries of the sub-directories at the new block */
+				sect = clst2sect(fs, scl);
+				for (n = 0; n < tcl * fs->csize * (SS(fs) / SZDIRE); n++) {
+					res = move_window(fs, sect + n / (SS(fs) / SZDIRE));
+					if (res != FR_OK) break;
+					dir = fs->win + n % (SS(fs) / SZDIRE) * SZDIRE;
+					if (dir[DIR_Name] == 0) break;	/* End of table */
+					if (dir[DIR_Name] == DDEM || dir[DIR_Name] == '.' || (dir[DIR_Attr] & AM_MASK) == AM_LFN || !(dir[DIR_Attr] & AM_DIR)) continue;
+					clst = ld_clust(fs, dir);
+					if (clst < 2 || clst >= fs->n_fatent) continue;
+					res = move_window(fs, clst2sect(fs, clst));
+					if (res != FR_OK) break;
+					dir = fs->win + SZDIRE * 1;	/* Ptr to .. entry */
+					if (dir[1] == '.') {
+						st_clust(fs, dir, scl);
+						fs->wflag = 1;
+					}
+				}
+				if (res == FR_OK) res = sync_fs(fs);
+			}
+			if (res == FR_OK) {			/* Switch the entry over to the new chain */
+				res = move_window(fs, dsect);
+				if (res == FR_OK) {
+					st_clust(fs, fs->win + doff, scl);
+					fs->wflag = 1;
+					res = sync_fs(fs);
+				}
+#if FF_FS_RPATH
+				if (res == FR_OK && fs->cdir == ocl) fs->cdir = scl;	/* Follow the current directory */
+#endif
+			}
+			if (res == FR_OK) {			/* Free the old chain */
+				res = remove_chain(&dj.obj, ocl, 0);
+				if (res == FR_OK) res = sync_fs(fs);
+			}
+/* End of the critical section */
+			if (res == FR_OK) *hint = scl + tcl;
+		}
+		FREE_NAMBUF();
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+#endif /* FF_USE_DEFRAG && !FF_FS_READONLY && FF_FS_MINIMIZE == 0 */
+
+
+
 #if FF_USE_FORWARD
 /*-----------------------------------------------------------------------*/
 /* Forward Data to the Stream Directly                                   */
@@ -5587,6 +6234,7 @@ FRESULT f_forward (
 {
 	FRESULT res;
 	FATFS *fs;
+	BYTE *fbuf;
 	DWORD clst;
 	LBA_t sect;
 	FSIZE_t remain;
@@ -5596,6 +6244,7 @@ FRESULT f_forward (
 
 	*bf = 0;	/* Clear transfer byte counter */
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
+	fbuf = file_buf(fp);
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
 	if (!(fp->flag & FA_READ)) LEAVE_FF(fs, FR_DENIED);	/* Check access mode */
 
@@ -5616,21 +6265,21 @@ FRESULT f_forward (
 		sect = clst2sect(fs, fp->clust);			/* Get current data sector */
 		if (sect == 0) ABORT(fs, FR_INT_ERR);
 		sect += csect;
-#if FF_FS_TINY
-		if (move_window(fs, sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window to the file data */
-		dbuf = fs->win;
-#else
-		if (fp->sect != sect) {		/* Fill sector cache with file data */
+		if (!fbuf) {
+			if (move_window(fs, sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window to the file data */
+			dbuf = fs->win;
+		} else {
+			if (fp->sect != sect) {		/* Fill sector cache with file data */
 #if !FF_FS_READONLY
-			if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
-				fp->flag &= (BYTE)~FA_DIRTY;
-			}
+				if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
+					if (write_file_buf(fs, fp, fbuf) != FR_OK) ABORT(fs, FR_DISK_ERR);
+					fp->flag &= (BYTE)~FA_DIRTY;
+				}
 #endif
-			if (disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+				if (disk_read(fs->pdrv, fbuf, sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+			}
+			dbuf = fbuf;
 		}
-		dbuf = fp->buf;
-#endif
 		fp->sect = sect;
 		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
 		if (rcnt > btf) rcnt = btf;					/* Clip it by btr if needed */
@@ -31,6 +31,19 @@ extern "C" {
 #error Wrong configuration file (ffconf.h).
 #endif
 
+#ifndef FF_FAT_MIRROR_DEFER
+#define FF_FAT_MIRROR_DEFER	0	/* Configuration files without the option mirror immediately */
+#endif
+#ifndef FF_DEFER_SLOTS
+#define FF_DEFER_SLOTS	8
+#endif
+#ifndef FF_SFN_SCAN
+#define FF_SFN_SCAN		0	/* Configuration files without the option check one numbered name per pass */
+#endif
+#ifndef FF_PRIVATE_BUFS
+#define FF_PRIVATE_BUFS	0	/* Configuration files without the option share the window between all files */
+#endif
+
 /* Integer types used for FatFs API */
 
 #if defined(_WIN32)		/* Windows VC++ (for development only) */
@@ -157,6 +170,11 @@ typedef struct {
 	DWORD	last_clst;		/* Last allocated cluster */
 	DWORD	free_clst;		/* Number of free clusters */
 #endif
+#if !FF_FS_READONLY && FF_FAT_MIRROR_DEFER
+	BYTE	n_mirror;		/* Number of FAT sectors whose 2nd FAT copy is pending */
+	DWORD	mirror[FF_FAT_MIRROR_DEFER];	/* Offsets in the FAT of the pending sectors */
+	DWORD	mirror_saved;	/* Number of 2nd FAT writes avoided (statistics) */
+#endif
 #if FF_FS_RPATH
 	DWORD	cdir;			/* Current directory start cluster (0:root) */
 #if FF_FS_EXFAT
@@ -307,21 +325,29 @@ typedef enum {
 /* FatFs module application interface                           */
 
 FRESULT f_open (FIL* fp, const TCHAR* path, BYTE mode);				/* Open or create a file */
+FRESULT f_openat (FIL* fp, const DIR* dp, const TCHAR* path, BYTE mode);	/* Open or create a file relative to an open directory */
 FRESULT f_close (FIL* fp);											/* Close an open file object */
 FRESULT f_read (FIL* fp, void* buff, UINT btr, UINT* br);			/* Read data from the file */
 FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data to the file */
 FRESULT f_lseek (FIL* fp, FSIZE_t ofs);								/* Move file pointer of the file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate the file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of the writing file */
+FRESULT f_reattach (FIL* fp, FATFS* fs);							/* Reattach a saved file object to the mounted volume */
+FRESULT f_setbuf (FIL* fp, BYTE* buf);								/* Attach or detach a private sector buffer (FF_PRIVATE_BUFS) */
+BYTE* f_getbuf (FIL* fp);											/* Get the private sector buffer of a file (FF_PRIVATE_BUFS) */
 FRESULT f_opendir (DIR* dp, const TCHAR* path);						/* Open a directory */
 FRESULT f_closedir (DIR* dp);										/* Close an open directory */
 FRESULT f_readdir (DIR* dp, FILINFO* fno);							/* Read a directory item */
 FRESULT f_findfirst (DIR* dp, FILINFO* fno, const TCHAR* path, const TCHAR* pattern);	/* Find first file */
 FRESULT f_findnext (DIR* dp, FILINFO* fno);							/* Find next file */
+int f_match (const TCHAR* pattern, const TCHAR* name);				/* Test a name against a matching pattern */
 FRESULT f_mkdir (const TCHAR* path);								/* Create a sub directory */
 FRESULT f_unlink (const TCHAR* path);								/* Delete an existing file or directory */
+FRESULT f_unlinkat (const DIR* dp, const TCHAR* path);				/* Delete a file or directory relative to an open directory */
 FRESULT f_rename (const TCHAR* path_old, const TCHAR* path_new);	/* Rename/Move a file or directory */
+FRESULT f_renameat (const DIR* dp_old, const TCHAR* path_old, const DIR* dp_new, const TCHAR* path_new);	/* Rename/Move relative to open directories */
 FRESULT f_stat (const TCHAR* path, FILINFO* fno);					/* Get file status */
+FRESULT f_statat (const DIR* dp, const TCHAR* path, FILINFO* fno);	/* Get file status relative to an open directory */
 FRESULT f_chmod (const TCHAR* path, BYTE attr, BYTE mask);			/* Change attribute of a file/dir */
 FRESULT f_utime (const TCHAR* path, const FILINFO* fno);			/* Change timestamp of a file/dir */
 FRESULT f_chdir (const TCHAR* path);								/* Change current directory */
@@ -332,6 +358,9 @@ FRESULT f_getlabel (const TCHAR* path, TCHAR* label, DWORD* vsn);	/* Get volume
 FRESULT f_setlabel (const TCHAR* label);							/* Set volume label */
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
 FRESULT f_expand (FIL* fp, FSIZE_t fsz, BYTE opt);					/* Allocate a contiguous block to the file */
+FRESULT f_setsize (FIL* fp, FSIZE_t fsz);							/* Set the size of a file within its allocation */
+FRESULT f_fragments (const TCHAR* path, DWORD* nfrag, DWORD* nclst);	/* Count the contiguous runs of a file/dir */
+FRESULT f_relocate (const TCHAR* path, DWORD* hint, void* work, UINT len, BYTE lower);	/* Move a file/dir into a contiguous block */
 FRESULT f_mount (FATFS* fs, const TCHAR* path, BYTE opt);			/* Mount/Unmount a logical drive */
 FRESULT f_mkfs (const TCHAR* path, const MKFS_PARM* opt, void* work, UINT len);	/* Create a FAT volume */
 FRESULT f_fdisk (BYTE pdrv, const LBA_t ptbl[], void* work);		/* Divide a physical drive into some partitions */
@@ -378,6 +407,9 @@ int ff_cre_syncobj (BYTE vol, FF_SYNC_t* sobj);	/* Create a sync object */
 int ff_req_grant (FF_SYNC_t sobj);		/* Lock sync object */
 void ff_rel_grant (FF_SYNC_t sobj);		/* Unlock sync object */
 int ff_del_syncobj (FF_SYNC_t sobj);	/* Delete a sync object */
+int ff_defer (void (*func)(void*), void* arg);	/* Queue work to run when the volume is free (MOS) */
+void ff_run_deferred (void);			/* Run the queued work if the volume is free (MOS) */
+extern volatile BYTE ff_defer_count;	/* Number of queued entries (MOS) */
 #endif
 
 
@@ -10,6 +10,12 @@
  * 15/02/2023:		FF_USE_STRFUNC set to 1
  * 09/03/2023:		FF_FS_NORTC set to 0
  * 13/04/2023:		FF_FS_TINY set to 1
+ * 17/10/2026:		Added FF_FAT_MIRROR_DEFER
+ * 17/10/2026:		Added FF_USE_DEFRAG
+ * 17/10/2026:		FF_USE_EXPAND set to 1
+ * 17/10/2026:		FF_FS_REENTRANT set to 1, added FF_DEFER_SLOTS
+ * 17/10/2026:		Added FF_SFN_SCAN
+ * 17/10/2026:		Added FF_PRIVATE_BUFS
  */
  
 /*---------------------------------------------------------------------------/
@@ -52,8 +58,14 @@
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
-#define FF_USE_EXPAND	0
-/* This option switches f_expand function. (0:Disable or 1:Enable) */
+#define FF_USE_EXPAND	1
+/* This option switches f_expand function, and the f_setsize() function used
+/  by MOS streaming writes. (0:Disable or 1:Enable) */
+
+
+#define FF_USE_DEFRAG	1
+/* This option switches f_fragments() and f_relocate() functions, used by the
+/  MOS DEFRAG command. (0:Disable or 1:Enable) FAT12/16/32 volumes only. */
 
 
 #define FF_USE_CHMOD	0
@@ -167,6 +179,15 @@
 /  on character encoding. When LFN is not enabled, these options have no effect. */
 
 
+#define FF_SFN_SCAN		8
+/* This option sets how many numbered short names (NAME~1, NAME~2, ..., then the
+/  hashed NA~XXXX forms) are checked at once when an LFN needs one. (0 or 1-32)
+/  When enabled, the directory is read once to find which of the first FF_SFN_SCAN
+/  candidates are already in use, and the free entries for the new object are found
+/  in the same pass. When 0, or when all the candidates are in use, each further
+/  candidate is checked with a pass of its own, up to NAME~99. */
+
+
 #define FF_FS_RPATH		2
 /* This option configures support for relative path.
 /
@@ -242,7 +263,32 @@
 /* This option switches tiny buffer configuration. (0:Normal or 1:Tiny)
 /  At the tiny configuration, size of file object (FIL) is shrinked FF_MAX_SS bytes.
 /  Instead of private sector buffer eliminated from the file object, common sector
-/  buffer in the filesystem object (FATFS) is used for the file data transfer. */
+/  buffer in the filesystem object (FATFS) is used for the file data transfer.
+/  See FF_PRIVATE_BUFS for giving some files a buffer of their own. */
+
+
+#define FF_PRIVATE_BUFS	8
+/* This option sets how many files can have a private sector buffer attached with
+/  f_setbuf at the tiny configuration. (0:Disable or 1-255:Enable)
+/  A file with one reads and writes partial sectors through it instead of the common
+/  buffer, so busy streams stop evicting each other. The buffers (FF_MAX_SS bytes each)
+/  are supplied by the application, and FIL stays the same size. */
+
+
+#define FF_FAT_MIRROR_DEFER	8
+/* This option defers updates of the 2nd FAT. (0:Disable or 1-255:Enable)
+/  When enabled, a dirty FAT sector flushed from the window is written to the 1st
+/  FAT only, and its offset is recorded in a table of FF_FAT_MIRROR_DEFER entries.
+/  The 2nd FAT is brought up to date in a single pass when the volume is synced
+/  (f_sync, f_close and every function that finishes with a volume sync) or when
+/  the table overflows. A FAT sector rewritten many times while a file grows is
+/  then mirrored once instead of on every flush.
+/
+/  Crash consistency: the 1st FAT is always written before the window is reused
+/  and is the only copy FatFs reads. Until the next sync the 2nd FAT may lag
+/  behind it; a power loss in that window leaves a stale 2nd FAT (a disk checker
+/  may report that the FATs differ) but never a 1st FAT that is out of step with
+/  the directory. Pending entries are dropped by f_mount, like the window. */
 
 
 #define FF_FS_EXFAT		0
@@ -290,9 +336,9 @@
 
 
 /* #include <somertos.h>	// O/S definitions */
-#define FF_FS_REENTRANT	0
-#define FF_FS_TIMEOUT	1000
-#define FF_SYNC_t		HANDLE
+#define FF_FS_REENTRANT	1
+#define FF_FS_TIMEOUT	0
+#define FF_SYNC_t		BYTE*
 /* The option FF_FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
 /  volume is always re-entrant and volume control functions, f_mount(), f_mkfs()
@@ -308,7 +354,19 @@
 /  The FF_FS_TIMEOUT defines timeout period in unit of time tick.
 /  The FF_SYNC_t defines O/S dependent sync object type. e.g. HANDLE, ID, OS_EVENT*,
 /  SemaphoreHandle_t and etc. A header file for O/S definitions needs to be
-/  included somewhere in the scope of ff.h. */
+/  included somewhere in the scope of ff.h.
+/
+/  MOS has no threads, so ffsystem.c implements the sync object as a lock byte per
+/  volume that is never waited on (FF_FS_TIMEOUT is unused): a request made while
+/  the volume is held, which can only come from an interrupt handler, fails with
+/  FR_TIMEOUT. Interrupt handlers and other background code should queue their file
+/  system work with ff_defer() instead; it is run in the foreground while the line
+/  editor waits for a key, after each MOS command and after each MOS API call. */
+
+
+#define FF_DEFER_SLOTS	8
+/* Number of entries in the queue of work waiting for the volume (1-255). Only
+/  used when FF_FS_REENTRANT is 1. */
 
 
 
@@ -37,6 +37,35 @@ void ff_memfree (
 
 #if FF_FS_REENTRANT	/* Mutal exclusion */
 
+/* MOS runs FatFs from a single foreground thread, so the only other callers
+/  are interrupt handlers. Each volume is guarded by a lock byte. A request for
+/  a volume that is already held cannot be waited on, as nothing else runs to
+/  release it, so it fails at once with FR_TIMEOUT and the window and open
+/  objects are left untouched.
+/
+/  Background work that needs the volume is queued with ff_defer() and run in
+/  the foreground by ff_run_deferred(). That is only called at points where no
+/  caller is part way through a series of file functions: while the line
+/  editor waits for a key, after each MOS command, and after each MOS API call.
+/  It is not called when a volume is released, as the work would then run in
+/  the middle of whatever called the file function.
+*/
+
+typedef struct {
+	void (*func)(void*);	/* Work to run */
+	void* arg;				/* Argument passed to it */
+} DEFERRED;
+
+static BYTE Lock[FF_VOLUMES];			/* Lock byte of each volume (1:held) */
+static DEFERRED Deferred[FF_DEFER_SLOTS];	/* Queue of deferred work */
+static BYTE DeferHead;					/* Index of the oldest entry */
+volatile BYTE ff_defer_count;			/* Number of entries; read by the MOS API to skip the call */
+static BYTE Running;					/* The queue is being run further up the stack */
+
+BYTE di_save (void);					/* In misc.asm */
+void ei_restore (BYTE enabled);			/* In misc.asm */
+
+
 /*------------------------------------------------------------------------*/
 /* Create a Synchronization Object                                        */
 /*------------------------------------------------------------------------*/
@@ -45,35 +74,14 @@ void ff_memfree (
 /  When a 0 is returned, the f_mount() function fails with FR_INT_ERR.
 */
 
-//const osMutexDef_t Mutex[FF_VOLUMES];	/* Table of CMSIS-RTOS mutex */
-
-
 int ff_cre_syncobj (	/* 1:Function succeeded, 0:Could not create the sync object */
 	BYTE vol,			/* Corresponding volume (logical drive number) */
 	FF_SYNC_t* sobj		/* Pointer to return the created sync object */
 )
 {
-	/* Win32 */
-	*sobj = CreateMutex(NULL, FALSE, NULL);
-	return (int)(*sobj != INVALID_HANDLE_VALUE);
-
-	/* uITRON */
-//	T_CSEM csem = {TA_TPRI,1,1};
-//	*sobj = acre_sem(&csem);
-//	return (int)(*sobj > 0);
-
-	/* uC/OS-II */
-//	OS_ERR err;
-//	*sobj = OSMutexCreate(0, &err);
-//	return (int)(err == OS_NO_ERR);
-
-	/* FreeRTOS */
-//	*sobj = xSemaphoreCreateMutex();
-//	return (int)(*sobj != NULL);
-
-	/* CMSIS-RTOS */
-//	*sobj = osMutexCreate(&Mutex[vol]);
-//	return (int)(*sobj != NULL);
+	Lock[vol] = 0;
+	*sobj = &Lock[vol];
+	return 1;
 }
 
 
@@ -89,23 +97,7 @@ int ff_del_syncobj (	/* 1:Function succeeded, 0:Could not delete due to an error
 	FF_SYNC_t sobj		/* Sync object tied to the logical drive to be deleted */
 )
 {
-	/* Win32 */
-	return (int)CloseHandle(sobj);
-
-	/* uITRON */
-//	return (int)(del_sem(sobj) == E_OK);
-
-	/* uC/OS-II */
-//	OS_ERR err;
-//	OSMutexDel(sobj, OS_DEL_ALWAYS, &err);
-//	return (int)(err == OS_NO_ERR);
-
-	/* FreeRTOS */
-//  vSemaphoreDelete(sobj);
-//	return 1;
-
-	/* CMSIS-RTOS */
-//	return (int)(osMutexDelete(sobj) == osOK);
+	return (int)(*sobj == 0);	/* The volume must not be in use */
 }
 
 
@@ -120,22 +112,15 @@ int ff_req_grant (	/* 1:Got a grant to access the volume, 0:Could not get a gran
 	FF_SYNC_t sobj	/* Sync object to wait */
 )
 {
-	/* Win32 */
-	return (int)(WaitForSingleObject(sobj, FF_FS_TIMEOUT) == WAIT_OBJECT_0);
-
-	/* uITRON */
-//	return (int)(wai_sem(sobj) == E_OK);
-
-	/* uC/OS-II */
-//	OS_ERR err;
-//	OSMutexPend(sobj, FF_FS_TIMEOUT, &err));
-//	return (int)(err == OS_NO_ERR);
+	BYTE ie;
+	int res;
 
-	/* FreeRTOS */
-//	return (int)(xSemaphoreTake(sobj, FF_FS_TIMEOUT) == pdTRUE);
 
-	/* CMSIS-RTOS */
-//	return (int)(osMutexWait(sobj, FF_FS_TIMEOUT) == osOK);
+	ie = di_save();			/* An interrupt handler could take it between the test and the set */
+	res = (*sobj == 0);
+	if (res) *sobj = 1;
+	ei_restore(ie);
+	return res;
 }
 
 
@@ -149,20 +134,71 @@ void ff_rel_grant (
 	FF_SYNC_t sobj	/* Sync object to be signaled */
 )
 {
-	/* Win32 */
-	ReleaseMutex(sobj);
+	*sobj = 0;
+}
 
-	/* uITRON */
-//	sig_sem(sobj);
 
-	/* uC/OS-II */
-//	OSMutexPost(sobj);
+/*------------------------------------------------------------------------*/
+/* Queue Work to Run when the Volume is Free                              */
+/*------------------------------------------------------------------------*/
+/* This function can be called from an interrupt handler. The work is run
+/  in the foreground, in the order it was queued, with no volume held, so
+/  it can call any file function.
+*/
 
-	/* FreeRTOS */
-//	xSemaphoreGive(sobj);
+int ff_defer (		/* 1:Queued, 0:The queue is full */
+	void (*func)(void*),	/* Work to run */
+	void* arg		/* Argument passed to it */
+)
+{
+	BYTE ie;
+	BYTE i;
+	int res;
+
+
+	ie = di_save();
+	res = (ff_defer_count < FF_DEFER_SLOTS);
+	if (res) {
+		i = (BYTE)((DeferHead + ff_defer_count) % FF_DEFER_SLOTS);
+		Deferred[i].func = func;
+		Deferred[i].arg = arg;
+		ff_defer_count++;
+	}
+	ei_restore(ie);
+	return res;
+}
 
-	/* CMSIS-RTOS */
-//	osMutexRelease(sobj);
+
+/*------------------------------------------------------------------------*/
+/* Run the Queued Work                                                    */
+/*------------------------------------------------------------------------*/
+/* Nothing is run from an interrupt handler (interrupts disabled), while a
+/  volume is held, or from work that is itself being run from the queue.
+*/
+
+void ff_run_deferred (void)
+{
+	DEFERRED job;
+	BYTE ie;
+	BYTE vol;
+
+
+	if (Running) return;
+	Running = 1;
+	for (;;) {
+		ie = di_save();
+		for (vol = 0; vol < FF_VOLUMES && !Lock[vol]; vol++) ;
+		if (!ie || vol < FF_VOLUMES || ff_defer_count == 0) {
+			ei_restore(ie);
+			break;
+		}
+		job = Deferred[DeferHead];
+		DeferHead = (BYTE)((DeferHead + 1) % FF_DEFER_SLOTS);
+		ff_defer_count--;
+		ei_restore(ie);
+		job.func(job.arg);
+	}
+	Running = 0;
 }
 
 #endif
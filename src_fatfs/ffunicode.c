@@ -15015,6 +15015,28 @@ static const WCHAR uc437[] = {	/*  CP437(U.S.) to Unicode conversion table */
 	0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
 	0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
 };
+#if FF_CODE_PAGE == 437
+static const BYTE uni2oem437_lat1[] = {	/* Unicode U+00A0-U+00FF --> CP437, direct indexed (0: not in CP437) */
+	0xFF, 0xAD, 0x9B, 0x9C, 0x00, 0x9D, 0x00, 0x00, 0x00, 0x00, 0xA6, 0xAE, 0xAA, 0x00, 0x00, 0x00,
+	0xF8, 0xF1, 0xFD, 0x00, 0x00, 0xE6, 0x00, 0xFA, 0x00, 0x00, 0xA7, 0xAF, 0xAC, 0xAB, 0x00, 0xA8,
+	0x00, 0x00, 0x00, 0x00, 0x8E, 0x8F, 0x92, 0x80, 0x00, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0xA5, 0x00, 0x00, 0x00, 0x00, 0x99, 0x00, 0x00, 0x00, 0x00, 0x00, 0x9A, 0x00, 0x00, 0xE1,
+	0x85, 0xA0, 0x83, 0x00, 0x84, 0x86, 0x91, 0x87, 0x8A, 0x82, 0x88, 0x89, 0x8D, 0xA1, 0x8C, 0x8B,
+	0x00, 0xA4, 0x95, 0xA2, 0x93, 0x00, 0x94, 0xF6, 0x00, 0x97, 0xA3, 0x96, 0x81, 0x00, 0x00, 0x98
+};
+static const WCHAR uni2oem437_ext[] = {	/* Unicode --> CP437 pairs for the rest of uc437, sorted by Unicode */
+	0x0192, 0x9F, 0x0393, 0xE2, 0x0398, 0xE9, 0x03A3, 0xE4, 0x03A6, 0xE8, 0x03A9, 0xEA, 0x03B1, 0xE0, 0x03B4, 0xEB,
+	0x03B5, 0xEE, 0x03C0, 0xE3, 0x03C3, 0xE5, 0x03C4, 0xE7, 0x03C6, 0xED, 0x207F, 0xFC, 0x20A7, 0x9E, 0x2219, 0xF9,
+	0x221A, 0xFB, 0x221E, 0xEC, 0x2229, 0xEF, 0x2248, 0xF7, 0x2261, 0xF0, 0x2264, 0xF3, 0x2265, 0xF2, 0x2310, 0xA9,
+	0x2320, 0xF4, 0x2321, 0xF5, 0x2500, 0xC4, 0x2502, 0xB3, 0x250C, 0xDA, 0x2510, 0xBF, 0x2514, 0xC0, 0x2518, 0xD9,
+	0x251C, 0xC3, 0x2524, 0xB4, 0x252C, 0xC2, 0x2534, 0xC1, 0x253C, 0xC5, 0x2550, 0xCD, 0x2551, 0xBA, 0x2552, 0xD5,
+	0x2553, 0xD6, 0x2554, 0xC9, 0x2555, 0xB8, 0x2556, 0xB7, 0x2557, 0xBB, 0x2558, 0xD4, 0x2559, 0xD3, 0x255A, 0xC8,
+	0x255B, 0xBE, 0x255C, 0xBD, 0x255D, 0xBC, 0x255E, 0xC6, 0x255F, 0xC7, 0x2560, 0xCC, 0x2561, 0xB5, 0x2562, 0xB6,
+	0x2563, 0xB9, 0x2564, 0xD1, 0x2565, 0xD2, 0x2566, 0xCB, 0x2567, 0xCF, 0x2568, 0xD0, 0x2569, 0xCA, 0x256A, 0xD8,
+	0x256B, 0xD7, 0x256C, 0xCE, 0x2580, 0xDF, 0x2584, 0xDC, 0x2588, 0xDB, 0x258C, 0xDD, 0x2590, 0xDE, 0x2591, 0xB0,
+	0x2592, 0xB1, 0x2593, 0xB2, 0x25A0, 0xFE
+};
+#endif
 #endif
 #if FF_CODE_PAGE == 720 || FF_CODE_PAGE == 0
 static const WCHAR uc720[] = {	/*  CP720(Arabic) to Unicode conversion table */
@@ -15218,6 +15240,43 @@ static const WCHAR uc869[] = {	/*  CP869(Greek 2) to Unicode conversion table */
 /*------------------------------------------------------------------------*/
 
 #if FF_CODE_PAGE != 0 && FF_CODE_PAGE < 900
+#if FF_CODE_PAGE == 437	/* Direct indexed for Latin-1, binary search for the rest of CP437 */
+WCHAR ff_uni2oem (	/* Returns OEM code character, zero on error */
+	DWORD	uni,	/* UTF-16 encoded character to be converted */
+	WORD	cp		/* Code page for the conversion */
+)
+{
+	const WCHAR *p = uni2oem437_ext;
+	WCHAR c = 0;
+	UINT i, li, hi;
+
+
+	if (uni < 0x80) {	/* ASCII? */
+		c = (WCHAR)uni;
+
+	} else if (cp == FF_CODE_PAGE) {	/* Is it a valid code page? */
+		if (uni < 0x100) {	/* Latin-1 (C1 controls are not in CP437) */
+			if (uni >= 0xA0) c = uni2oem437_lat1[uni - 0xA0];
+		} else if (uni < 0x10000) {	/* Greek, box drawing and symbols */
+			li = 0; hi = sizeof uni2oem437_ext / 4;
+			while (li < hi) {
+				i = li + (hi - li) / 2;
+				if (uni == p[i * 2]) {
+					c = p[i * 2 + 1];
+					break;
+				}
+				if (uni > p[i * 2]) {
+					li = i + 1;
+				} else {
+					hi = i;
+				}
+			}
+		}
+	}
+
+	return c;
+}
+#else
 WCHAR ff_uni2oem (	/* Returns OEM code character, zero on error */
 	DWORD	uni,	/* UTF-16 encoded character to be converted */
 	WORD	cp		/* Code page for the conversion */
@@ -15239,6 +15298,7 @@ WCHAR ff_uni2oem (	/* Returns OEM code character, zero on error */
 
 	return c;
 }
+#endif
 
 WCHAR ff_oem2uni (	/* Returns Unicode character in UTF-16, zero on error */
 	WCHAR	oem,	/* OEM code to be converted */
@@ -15460,6 +15520,30 @@ WCHAR ff_oem2uni (	/* Returns Unicode character in UTF-16, zero on error */
 /* Unicode up-case conversion                                             */
 /*------------------------------------------------------------------------*/
 
+#if FF_CODE_PAGE == 437 && FF_LFN_UNICODE == 0 && !FF_FS_EXFAT
+/* Names are only ever given to FatFs in CP437, so a name being looked up holds nothing but ASCII and the
+/  characters in uc437. Up-converting just the characters whose upper case is also the upper case of one
+/  of those is enough to compare any name on the volume with it; everything else is left as it is.
+/  This was derived from the full tables below by checking every code point in the BMP. */
+
+DWORD ff_wtoupper (	/* Returns up-converted code point */
+	DWORD uni		/* Unicode code point to be up-converted */
+)
+{
+	if (uni < 0x80) {		/* ASCII */
+		if (uni >= 'a' && uni <= 'z') uni -= 0x20;
+	} else if (uni < 0x100) {	/* Latin-1 Supplement */
+		if (uni >= 0xE0 && uni != 0xF7) uni = (uni == 0xFF) ? 0x178 : uni - 0x20;
+	} else if (uni >= 0x3B1 && uni <= 0x3CB) {	/* Greek small letters */
+		uni = (uni == 0x3C2) ? 0x3A3 : uni - 0x20;
+	} else if (uni == 0x192) {	/* Latin small letter f with hook */
+		uni = 0x191;
+	}
+
+	return uni;
+}
+
+#else
 DWORD ff_wtoupper (	/* Returns up-converted code point */
 	DWORD uni		/* Unicode code point to be up-converted */
 )
@@ -15587,6 +15671,7 @@ DWORD ff_wtoupper (	/* Returns up-converted code point */
 
 	return uni;
 }
+#endif
 
 
 #endif /* #if FF_USE_LFN */
@@ -21,6 +21,9 @@
 ; 03/08/2023:	Added user_kbvector
 ; 13/08/2023:	Added keymap
 ; 11/11/2023:	Added i2c
+; 17/10/2026:	Added isr_stats_on, isr_stats
+; 17/10/2026:	Added event_flags, event_data
+; 17/10/2026:	Added a statistics record for the windows opened by di_save
 
 			INCLUDE	"../src/equs.inc"
 			
@@ -83,6 +86,12 @@
 			XDEF	_i2c_msg_ptr
 			XDEF	_i2c_msg_size
 
+			XDEF	_isr_stats_on
+			XDEF	_isr_stats
+
+			XDEF	_event_flags
+			XDEF	_event_data
+
 			SEGMENT BSS		; This section is reset to 0 in cstartup.asm
 			
 _sysvars:					; Please make sure the sysvar offsets match those in mos_api.inc
@@ -172,6 +181,16 @@ _i2c_role:		DS	1		; I2C current state
 _i2c_msg_ptr:		DS	3		; Pointer to the current buffer
 _i2c_msg_size:		DS	1		; The (remaining) message size
 
+; Interrupt handler statistics, one record per MOS handler and one for di_save; see isr_stats.h
+;
+_isr_stats_on:		DS	1		; Non-zero when the handlers are being timed
+_isr_stats:		DS	4 * 11		; Timer at entry (2), count (3), total ticks (4), maximum ticks (2)
+
+; Events posted by the interrupt handlers; see EVENT_* in equs.inc
+;
+_event_flags:		DS	1		; One bit per event, cleared by event_wait when it takes them
+_event_data:		DS	EVENT_DATA_SIZE	; A payload byte for each event
+
 ; Command history
 ;
 _history_no:		DS	1
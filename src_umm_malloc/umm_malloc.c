@@ -36,6 +36,10 @@
  * R.Hempel 2021-05-02 - Support explicit memory umm_init_heap() - See Issue 53
  * K.Whitlock 2023-07-06 - Add support for multiple heaps
  * J.Venema 2024-04-04 - Adapted for Agon MOS
+ * 2026-10-17          - Best fit stops at the first exact fit, added
+ *                        umm_multi_stats() for the MOS heap API
+ * 2026-10-17          - Added the quick lists for small sizes; free ignores
+ *                        pointers that are not to an allocated block
  * ----------------------------------------------------------------------------
  */
 
@@ -264,6 +268,8 @@ static UINT16 umm_assimilate_down(umm_heap *heap, UINT16 c, UINT16 freemask) {
 void umm_multi_init_heap(umm_heap *heap, void *ptr, UINT24 size) {
     /* init heap pointer and size, and memset it to 0 */
     heap->pheap = ptr;
+    memset(heap->quick, 0x00, sizeof(heap->quick));
+    memset(heap->quickCount, 0x00, sizeof(heap->quickCount));
     UMM_HEAPSIZE = size;
     UMM_NUMBLOCKS = (UMM_HEAPSIZE / UMM_BLOCKSIZE);
     memset(UMM_HEAP, 0x00, UMM_HEAPSIZE);
@@ -366,9 +372,80 @@ static void umm_free_core(umm_heap *heap, void *ptr) {
     }
 }
 
+/* ------------------------------------------------------------------------
+ * The quick lists are a front end for small sizes. A freed block of 1 to
+ * UMM_QUICK_CLASSES blocks is pushed on the list for its size, still marked
+ * as in use so that it is not merged with its neighbours, and the next malloc
+ * of that size pops it without searching the free list. The list is linked
+ * through the block's free pointers, which are not needed while it is in use.
+ *
+ * The blocks on the lists are returned to the free list when a malloc can't
+ * otherwise be met, and before the heap is walked for its statistics.
+ *
+ * Must be called only from within critical sections guarded by
+ * UMM_CRITICAL_ENTRY(id) and UMM_CRITICAL_EXIT(id).
+ */
+
+static int umm_quick_push(umm_heap *heap, UINT16 c) {
+    UINT16 blocks = UMM_NBLOCK(c) - c;
+
+    if (blocks > UMM_QUICK_CLASSES || heap->quickCount[blocks - 1] >= UMM_QUICK_DEPTH) {
+        return 0;
+    }
+    UMM_NFREE(c) = heap->quick[blocks - 1];
+    heap->quick[blocks - 1] = c;
+    heap->quickCount[blocks - 1]++;
+
+    return 1;
+}
+
+static void *umm_quick_pop(umm_heap *heap, UINT16 blocks) {
+    UINT16 c;
+
+    if (blocks > UMM_QUICK_CLASSES || (c = heap->quick[blocks - 1]) == 0) {
+        return (void *)NULL;
+    }
+    heap->quick[blocks - 1] = UMM_NFREE(c);
+    heap->quickCount[blocks - 1]--;
+
+    return (void *)&UMM_DATA(c);
+}
+
+static int umm_quick_holds(umm_heap *heap, UINT16 c) {
+    UINT16 blocks = UMM_NBLOCK(c) - c;
+    UINT16 q;
+
+    if (blocks <= UMM_QUICK_CLASSES) {
+        for (q = heap->quick[blocks - 1]; q; q = UMM_NFREE(q)) {
+            if (q == c) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int umm_quick_flush(umm_heap *heap) {
+    int flushed = 0;
+    int i;
+    void *ptr;
+
+    for (i = 0; i < UMM_QUICK_CLASSES; i++) {
+        while ((ptr = umm_quick_pop(heap, i + 1))) {
+            umm_free_core(heap, ptr);
+            flushed = 1;
+        }
+    }
+
+    return flushed;
+}
+
 /* ------------------------------------------------------------------------ */
 
 void umm_multi_free(umm_heap *heap, void *ptr) {
+    UINT16 c;
+
     UMM_CRITICAL_DECL(id_free);
 
     UMM_CHECK_INITIALIZED();
@@ -394,7 +471,21 @@ void umm_multi_free(umm_heap *heap, void *ptr) {
 
     UMM_CRITICAL_ENTRY(id_free);
 
-    umm_free_core(heap, ptr);
+    /*
+     * Nor is anything done with a pointer that is not to the data of an
+     * allocated block, or to one that is already on a quick list. This
+     * stops a double free corrupting the heap.
+     */
+
+    c = (((UINT8 *)ptr) - (UINT8 *)(&(UMM_HEAP[0]))) / UMM_BLOCKSIZE;
+
+    if ((ptr == (void *)&UMM_DATA(c)) && (c > 0) && (c < UMM_BLOCK_LAST) &&
+        !(UMM_NBLOCK(c) & UMM_FREELIST_MASK) && (UMM_NBLOCK(c) > c) && (UMM_NBLOCK(c) <= UMM_BLOCK_LAST) &&
+        (UMM_PBLOCK(c) < c) && ((UMM_NBLOCK(UMM_PBLOCK(c)) & UMM_BLOCKNO_MASK) == c) && !umm_quick_holds(heap, c)) {
+        if (!umm_quick_push(heap, c)) {
+            umm_free_core(heap, ptr);
+        }
+    }
 
     UMM_CRITICAL_EXIT(id_free);
 }
@@ -437,6 +528,10 @@ static void *umm_malloc_core(umm_heap *heap, UINT24 size) {
         if ((blockSize >= blocks) && (blockSize < bestSize)) {
             bestBlock = cf;
             bestSize = blockSize;
+            /* Nothing fits better than an exact fit, so stop looking */
+            if (blockSize == blocks) {
+                break;
+            }
         }
         #elif defined UMM_FIRST_FIT
         /* This is the first block that fits! */
@@ -541,7 +636,13 @@ void *umm_multi_malloc(umm_heap *heap, UINT24 size) {
 
     UMM_CRITICAL_ENTRY(id_malloc);
 
-    ptr = umm_malloc_core(heap, size);
+    ptr = umm_quick_pop(heap, umm_blocks(size));
+    if (!ptr) {
+        ptr = umm_malloc_core(heap, size);
+    }
+    if (!ptr && umm_quick_flush(heap)) {
+        ptr = umm_malloc_core(heap, size);
+    }
 
     UMM_CRITICAL_EXIT(id_malloc);
 
@@ -711,7 +812,7 @@ void *umm_multi_realloc(umm_heap *heap, void *ptr, UINT24 size) {
     } else {
         //DBGLOG_DEBUG("realloc a completely new block %i\n", blocks);
         oldptr = ptr;
-        if ((ptr = umm_malloc_core(heap, size))) {
+        if ((ptr = umm_malloc_core(heap, size)) || (umm_quick_flush(heap) && (ptr = umm_malloc_core(heap, size)))) {
             //DBGLOG_DEBUG("realloc %i to a bigger block %i, copy, and free the old\n", blockSize, blocks);
             memcpy(ptr, oldptr, curSize);
             umm_free_core(heap, oldptr);
@@ -754,6 +855,50 @@ void *umm_multi_calloc(umm_heap *heap, UINT24 num, UINT24 item_size) {
 
 /* ------------------------------------------------------------------------ */
 
+void umm_multi_stats(umm_heap *heap, umm_stats *stats) {
+    UINT16 c;
+    UINT16 n;
+    UINT16 blockSize;
+    UINT16 largest = 0;
+
+    UMM_CRITICAL_DECL(id_stats);
+
+    memset(stats, 0x00, sizeof(umm_stats));
+    stats->total = heap->heap_size;
+
+    UMM_CRITICAL_ENTRY(id_stats);
+
+    /* Blocks kept on the quick lists are free, so put them back on the free list first */
+
+    umm_quick_flush(heap);
+
+    /* Walk every block from umm_block[1] up to the last one, which has no next block */
+
+    for (c = UMM_NBLOCK(0) & UMM_BLOCKNO_MASK; (n = UMM_NBLOCK(c) & UMM_BLOCKNO_MASK) != 0; c = n) {
+        blockSize = n - c;
+        if (UMM_NBLOCK(c) & UMM_FREELIST_MASK) {
+            stats->free += (UINT24)blockSize * UMM_BLOCKSIZE;
+            stats->fragments++;
+            if (blockSize > largest) {
+                largest = blockSize;
+            }
+        } else {
+            stats->used += (UINT24)blockSize * UMM_BLOCKSIZE;
+            stats->allocations++;
+        }
+    }
+
+    UMM_CRITICAL_EXIT(id_stats);
+
+    /* The largest request that would succeed, less the header of its first block */
+
+    if (largest) {
+        stats->largest = (UINT24)largest * UMM_BLOCKSIZE - sizeof(((umm_block *)0)->header);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+
 /* Single-heap functions */
 
 struct umm_heap_config umm_heap_current; // The global heap for single-heap use
@@ -777,3 +922,7 @@ void *umm_realloc(void *ptr, UINT24 size){
 void umm_free(void *ptr){
     umm_multi_free(&umm_heap_current, ptr);
 }
+
+void umm_stats_heap(umm_stats *stats){
+    umm_multi_stats(&umm_heap_current, stats);
+}
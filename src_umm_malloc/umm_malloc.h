@@ -17,18 +17,35 @@ extern "C" {
 
 /* ------------------------------------------------------------------------ */
 
+/* Freed blocks of 1 to UMM_QUICK_CLASSES blocks are kept for reuse, up to UMM_QUICK_DEPTH of each size */
+
+#define UMM_QUICK_CLASSES 4
+#define UMM_QUICK_DEPTH   8
+
 typedef struct umm_heap_config {
     void *pheap;
     UINT24 heap_size;
     UINT16 numblocks;
+    UINT16 quick[UMM_QUICK_CLASSES];        /* First block on each size's list, 0 if it is empty */
+    UINT8 quickCount[UMM_QUICK_CLASSES];
 } umm_heap;
 
+typedef struct umm_heap_stats {
+    UINT24 total;           /* Size of the heap in bytes */
+    UINT24 used;            /* Bytes in allocated blocks, including headers */
+    UINT24 free;            /* Bytes in free blocks */
+    UINT24 largest;         /* Largest allocation that would succeed */
+    UINT24 allocations;     /* Number of allocated blocks */
+    UINT24 fragments;       /* Number of free blocks */
+} umm_stats;
+
 extern void  umm_multi_init_heap(umm_heap *heap, void *ptr, UINT24 size);
 
 extern void *umm_multi_malloc(umm_heap *heap, UINT24 size);
 extern void *umm_multi_calloc(umm_heap *heap, UINT24 num, UINT24 size);
 extern void *umm_multi_realloc(umm_heap *heap, void *ptr, UINT24 size);
 extern void  umm_multi_free(umm_heap *heap, void *ptr);
+extern void  umm_multi_stats(umm_heap *heap, umm_stats *stats);
 
 /* ------------------------------------------------------------------------ */
 
@@ -38,6 +55,7 @@ extern void *umm_malloc(UINT24 size);
 extern void *umm_calloc(UINT24 num, UINT24 size);
 extern void *umm_realloc(void *ptr, UINT24 size);
 extern void  umm_free(void *ptr);
+extern void  umm_stats_heap(umm_stats *stats);
 
 /* ------------------------------------------------------------------------ */
 
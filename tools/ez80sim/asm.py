@@ -0,0 +1,1402 @@
+#!/usr/bin/env python3
+#
+# Title:	AGON MOS - Host eZ80 assembler and linker
+# Author:	Agon MOS contributors
+# Created:	17/10/2026
+# Last Updated:	17/10/2026
+#
+# Modinfo:
+#
+# Assembles the MOS assembler sources (src/*.asm, src_startup/*.asm) on the host, so that the
+# hand-written routines can be run and timed by the eZ80 model in cpu.py without ZDS II.
+# It takes the part of the ZDS II syntax those files use: XDEF / XREF, DEFINE / SEGMENT,
+# .ASSUME ADL, EQU, MACRO with & concatenation, IF / ELSE / ENDIF, SCOPE with $ labels,
+# $$ anonymous labels with $F / $B, and the eZ80 instructions with their .SIS .LIS .SIL .LIL
+# suffixes. The eZ80F92 register names in ez80F92.inc, a ZDS system include, are built in.
+#
+# Each file given is a module; labels are local to it unless it XDEFs them. The linker lays
+# the segments out in flash and RAM, and can bind the symbols no module defines (the C
+# functions and variables) to stubs, which the caller can trap; see bench.py.
+#
+# Usage: python3 tools/ez80sim/asm.py [-o image.bin] [--map] [--stubs] <file.asm> ...
+
+import argparse
+import os
+import re
+import sys
+
+class AsmError(Exception):
+	pass
+
+# The eZ80F92 on-chip peripheral registers, as in the ZDS include file ez80F92.inc
+#
+F92_REGISTERS = {
+	"TMR0_CTL": 0x80, "TMR0_DR_L": 0x81, "TMR0_RR_L": 0x81, "TMR0_DR_H": 0x82, "TMR0_RR_H": 0x82,
+	"TMR1_CTL": 0x83, "TMR1_DR_L": 0x84, "TMR1_RR_L": 0x84, "TMR1_DR_H": 0x85, "TMR1_RR_H": 0x85,
+	"TMR2_CTL": 0x86, "TMR2_DR_L": 0x87, "TMR2_RR_L": 0x87, "TMR2_DR_H": 0x88, "TMR2_RR_H": 0x88,
+	"TMR3_CTL": 0x89, "TMR3_DR_L": 0x8A, "TMR3_RR_L": 0x8A, "TMR3_DR_H": 0x8B, "TMR3_RR_H": 0x8B,
+	"TMR4_CTL": 0x8C, "TMR4_DR_L": 0x8D, "TMR4_RR_L": 0x8D, "TMR4_DR_H": 0x8E, "TMR4_RR_H": 0x8E,
+	"TMR5_CTL": 0x8F, "TMR5_DR_L": 0x90, "TMR5_RR_L": 0x90, "TMR5_DR_H": 0x91, "TMR5_RR_H": 0x91,
+	"TMR_ISS": 0x92,
+	"WDT_CTL": 0x93, "WDT_RR": 0x94,
+	"PB_DR": 0x9A, "PB_DDR": 0x9B, "PB_ALT1": 0x9C, "PB_ALT2": 0x9D,
+	"PC_DR": 0x9E, "PC_DDR": 0x9F, "PC_ALT1": 0xA0, "PC_ALT2": 0xA1,
+	"PD_DR": 0xA2, "PD_DDR": 0xA3, "PD_ALT1": 0xA4, "PD_ALT2": 0xA5,
+	"CS0_LBR": 0xA8, "CS0_UBR": 0xA9, "CS0_CTL": 0xAA,
+	"CS1_LBR": 0xAB, "CS1_UBR": 0xAC, "CS1_CTL": 0xAD,
+	"CS2_LBR": 0xAE, "CS2_UBR": 0xAF, "CS2_CTL": 0xB0,
+	"CS3_LBR": 0xB1, "CS3_UBR": 0xB2, "CS3_CTL": 0xB3,
+	"RAM_CTL": 0xB4, "RAM_CTL0": 0xB4, "RAM_ADDR_U": 0xB5, "MBIST_GPR": 0xB6, "MBIST_EMR": 0xB7,
+	"SPI_BRG_L": 0xB8, "SPI_BRG_H": 0xB9, "SPI_CTL": 0xBA, "SPI_SR": 0xBB, "SPI_TSR": 0xBC, "SPI_RBR": 0xBC,
+	"UART0_RBR": 0xC0, "UART0_THR": 0xC0, "UART0_BRG_L": 0xC0, "UART0_IER": 0xC1, "UART0_BRG_H": 0xC1,
+	"UART0_IIR": 0xC2, "UART0_FCTL": 0xC2, "UART0_LCTL": 0xC3, "UART0_MCTL": 0xC4, "UART0_LSR": 0xC5,
+	"UART0_MSR": 0xC6, "UART0_SPR": 0xC7,
+	"I2C_SAR": 0xC8, "I2C_XSAR": 0xC9, "I2C_DR": 0xCA, "I2C_CTL": 0xCB, "I2C_SR": 0xCC, "I2C_CCR": 0xCC,
+	"I2C_SRR": 0xCD,
+	"UART1_RBR": 0xD0, "UART1_THR": 0xD0, "UART1_BRG_L": 0xD0, "UART1_IER": 0xD1, "UART1_BRG_H": 0xD1,
+	"UART1_IIR": 0xD2, "UART1_FCTL": 0xD2, "UART1_LCTL": 0xD3, "UART1_MCTL": 0xD4, "UART1_LSR": 0xD5,
+	"UART1_MSR": 0xD6, "UART1_SPR": 0xD7,
+	"IR_CTL": 0xBF,
+	"CLK_PPD1": 0xDB, "CLK_PPD2": 0xDC,
+	"RTC_SEC": 0xE0, "RTC_MIN": 0xE1, "RTC_HRS": 0xE2, "RTC_DOW": 0xE3, "RTC_DOM": 0xE4, "RTC_MON": 0xE5,
+	"RTC_YR": 0xE6, "RTC_CEN": 0xE7, "RTC_ASEC": 0xE8, "RTC_AMIN": 0xE9, "RTC_AHRS": 0xEA, "RTC_ADOW": 0xEB,
+	"RTC_ACTRL": 0xEC, "RTC_CTRL": 0xED,
+	"CS0_BMC": 0xF0, "CS1_BMC": 0xF1, "CS2_BMC": 0xF2, "CS3_BMC": 0xF3,
+	"FLASH_KEY": 0xF5, "FLASH_DATA": 0xF6, "FLASH_ADDR_U": 0xF7, "FLASH_CTRL": 0xF8, "FLASH_FDIV": 0xF9,
+	"FLASH_PROT": 0xFA, "FLASH_IRQ": 0xFB, "FLASH_PAGE": 0xFC, "FLASH_ROW": 0xFD, "FLASH_COL": 0xFE,
+	"FLASH_PGCTL": 0xFF,
+}
+
+# Expressions
+#
+BINARY_OPS = [
+	["||"], ["&&"], ["|"], ["^"], ["&"], ["==", "=", "!=", "<>"], ["<", "<=", ">", ">="],
+	["<<", ">>"], ["+", "-"], ["*", "/", "%"],
+]
+TOKEN_RE = re.compile(r"\s*(?:(\"(?:[^\"\\]|\\.)*\"|'(?:[^'\\]|\\.)')|(<<|>>|<=|>=|==|!=|<>|&&|\|\||[-+*/%&|^~!()<>=])|([A-Za-z0-9_.?$]+))")
+NAME_RE = re.compile(r"[A-Za-z_.?$][A-Za-z0-9_.?$]*$")
+HEX_H_RE = re.compile(r"[0-9A-Fa-f]+[hH]$")
+
+def parse_number(text):
+	"""Return the value of a number in any of the forms ZDS takes, or None"""
+	t = text
+	if t[0] == "%" and len(t) > 1 and re.match(r"[0-9A-Fa-f]+$", t[1:]):
+		return int(t[1:], 16)
+	if not t[0].isdigit():
+		return None
+	if t.lower().startswith("0x") and len(t) > 2:
+		return int(t[2:], 16)
+	if HEX_H_RE.match(t):
+		return int(t[:-1], 16)
+	if re.match(r"[01]+[bB]$", t):
+		return int(t[:-1], 2)
+	if t.isdigit():
+		return int(t, 10)
+	return None
+
+def tokenize(text):
+	tokens = []
+	pos = 0
+	text = text.rstrip()
+	while pos < len(text):
+		m = TOKEN_RE.match(text, pos)
+		if not m or m.end() == pos:
+			raise AsmError("Bad expression: %s" % text)
+		pos = m.end()
+		s, op, word = m.group(1), m.group(2), m.group(3)
+		value_before = tokens and (tokens[-1][0] in ("num", "sym", "str") or tokens[-1] == ("op", ")"))
+		if s:
+			tokens.append(("str", s[1:-1]))
+		elif op:
+			# % before a hex digit, where a value is expected, is a hex number
+			if op == "%" and not value_before:
+				m2 = re.match(r"[0-9A-Fa-f]+", text[pos:])
+				if m2:
+					tokens.append(("num", int(m2.group(0), 16)))
+					pos += m2.end()
+					continue
+			tokens.append(("op", op))
+		else:
+			n = parse_number(word)
+			if n is not None:
+				tokens.append(("num", n))
+			elif word == "$":
+				tokens.append(("here", None))
+			else:
+				tokens.append(("sym", word))
+	return tokens
+
+class Parser:
+	def __init__(self, tokens, text):
+		self.tokens = tokens
+		self.pos = 0
+		self.text = text
+
+	def peek(self):
+		return self.tokens[self.pos] if self.pos < len(self.tokens) else (None, None)
+
+	def take(self):
+		t = self.peek()
+		self.pos += 1
+		return t
+
+	def parse(self, level=0):
+		if level == len(BINARY_OPS):
+			return self.unary()
+		left = self.parse(level + 1)
+		while True:
+			kind, op = self.peek()
+			if kind == "op" and op in BINARY_OPS[level]:
+				self.take()
+				left = ("bin", op, left, self.parse(level + 1))
+			else:
+				return left
+
+	def unary(self):
+		kind, val = self.peek()
+		if kind == "op" and val in ("-", "+", "~", "!"):
+			self.take()
+			return ("un", val, self.unary())
+		return self.primary()
+
+	def primary(self):
+		kind, val = self.take()
+		if kind == "num":
+			return ("num", val)
+		if kind == "here":
+			return ("here",)
+		if kind == "sym":
+			return ("sym", val)
+		if kind == "str":
+			s = unescape(val)
+			if len(s) != 1:
+				raise AsmError("String used as a number: %s" % self.text)
+			return ("num", s[0])
+		if kind == "op" and val == "(":
+			e = self.parse()
+			if self.take() != ("op", ")"):
+				raise AsmError("Missing ) in %s" % self.text)
+			return e
+		raise AsmError("Bad expression: %s" % self.text)
+
+def parse_expr(text):
+	text = text.strip()
+	if not text:
+		raise AsmError("Missing expression")
+	p = Parser(tokenize(text), text)
+	e = p.parse()
+	if p.pos != len(p.tokens):
+		raise AsmError("Bad expression: %s" % text)
+	return e
+
+def unescape(s):
+	out = bytearray()
+	i = 0
+	while i < len(s):
+		c = s[i]
+		if c == "\\" and i + 1 < len(s):
+			i += 1
+			c = {"n": "\n", "r": "\r", "t": "\t", "0": "\0", "\\": "\\", "'": "'", '"': '"'}.get(s[i], s[i])
+		out.append(ord(c) & 0xFF)
+		i += 1
+	return bytes(out)
+
+def trunc_div(a, b):
+	if b == 0:
+		raise AsmError("Division by zero")
+	q = abs(a) // abs(b)
+	return q if (a < 0) == (b < 0) else -q
+
+def evaluate(e, lookup, here):
+	kind = e[0]
+	if kind == "num":
+		return e[1]
+	if kind == "sym":
+		return lookup(e[1])
+	if kind == "here":
+		if here is None:
+			raise AsmError("$ is not known here")
+		return here()
+	if kind == "un":
+		v = evaluate(e[2], lookup, here)
+		return {"-": -v, "+": v, "~": ~v, "!": int(not v)}[e[1]]
+	op, a, b = e[1], evaluate(e[2], lookup, here), evaluate(e[3], lookup, here)
+	if op == "+": return a + b
+	if op == "-": return a - b
+	if op == "*": return a * b
+	if op == "/": return trunc_div(a, b)
+	if op == "%": return a - trunc_div(a, b) * b
+	if op == "<<": return a << b
+	if op == ">>": return a >> b
+	if op == "&": return a & b
+	if op == "|": return a | b
+	if op == "^": return a ^ b
+	if op == "&&": return int(bool(a) and bool(b))
+	if op == "||": return int(bool(a) or bool(b))
+	if op in ("==", "="): return int(a == b)
+	if op in ("!=", "<>"): return int(a != b)
+	if op == "<": return int(a < b)
+	if op == "<=": return int(a <= b)
+	if op == ">": return int(a > b)
+	if op == ">=": return int(a >= b)
+	raise AsmError("Bad operator %s" % op)
+
+# Source lines
+#
+def strip_comment(line):
+	"""Remove a ; comment, leaving any ; inside quotes; AF' is not a quote"""
+	quote = None
+	i = 0
+	while i < len(line):
+		c = line[i]
+		if quote:
+			if c == "\\":
+				i += 1
+			elif c == quote:
+				quote = None
+		elif c == ";":
+			return line[:i]
+		elif c == '"':
+			quote = c
+		elif c == "'" and not line[max(0, i - 2):i].upper() == "AF":
+			quote = c
+		i += 1
+	return line
+
+def split_operands(text):
+	"""Split on the commas that are not inside brackets or quotes"""
+	out = []
+	depth = 0
+	quote = None
+	cur = ""
+	i = 0
+	while i < len(text):
+		c = text[i]
+		if quote:
+			cur += c
+			if c == "\\" and i + 1 < len(text):
+				i += 1
+				cur += text[i]
+			elif c == quote:
+				quote = None
+		elif c in "\"'" and not (c == "'" and cur.strip().upper().endswith("AF")):
+			quote = c
+			cur += c
+		elif c == "(":
+			depth += 1
+			cur += c
+		elif c == ")":
+			depth -= 1
+			cur += c
+		elif c == "," and depth == 0:
+			out.append(cur.strip())
+			cur = ""
+		else:
+			cur += c
+		i += 1
+	if cur.strip() or out:
+		out.append(cur.strip())
+	return out
+
+DIRECTIVES = {
+	"INCLUDE", "XDEF", "XREF", "DEFINE", "SEGMENT", "SECTION", ".ASSUME", "EQU", ".EQU", "DB", "DEFB",
+	"BYTE", "ASCII", "DW", "DEFW", "WORD", "DL", "DW24", "DS", "DEFS", "BLKB", "ALIGN", "END", "SCOPE",
+	"MACRO", "ENDMACRO", "MACEND", "ENDM", "IF", "IFDEF", "IFNDEF", "ELSE", "ENDIF", "ERROR", "LIST",
+	"NOLIST", ".LIST", ".NOLIST", "PAGE", "TITLE", ".DEF", ".ENDEF",
+}
+
+MNEMONICS = {
+	"ADC", "ADD", "AND", "BIT", "CALL", "CCF", "CP", "CPD", "CPDR", "CPI", "CPIR", "CPL", "DAA", "DEC", "DI",
+	"DJNZ", "EI", "EX", "EXX", "HALT", "IM", "IN", "IN0", "INC", "IND", "INDR", "INI", "INIR", "JP", "JR",
+	"LD", "LDD", "LDDR", "LDI", "LDIR", "LEA", "MLT", "NEG", "NOP", "OR", "OTDR", "OTIR", "OUT", "OUT0",
+	"OUTD", "OUTI", "PEA", "POP", "PUSH", "RES", "RET", "RETI", "RETN", "RL", "RLA", "RLC", "RLCA", "RLD",
+	"RR", "RRA", "RRC", "RRCA", "RRD", "RSMIX", "RST", "SBC", "SCF", "SET", "SLA", "SLP", "SRA", "SRL",
+	"STMIX", "SUB", "TST", "TSTIO", "XOR",
+}
+
+LINE_RE = re.compile(r"^(\s*)([A-Za-z_.?$][A-Za-z0-9_.?$]*)(:?)")
+
+class Statement:
+	__slots__ = ("label", "op", "args", "file", "line", "scope", "text", "paren_args")
+
+	def __init__(self, label, op, args, file, line, scope, text, paren_args=False):
+		self.label = label
+		self.op = op
+		self.args = args
+		self.file = file
+		self.line = line
+		self.scope = scope
+		self.text = text
+		self.paren_args = paren_args
+
+	def where(self):
+		return "%s:%d" % (self.file, self.line)
+
+def parse_line(raw):
+	"""Split a line into label, operation and operand text"""
+	line = strip_comment(raw).rstrip()
+	if not line.strip():
+		return None, None, ""
+	label = None
+	m = LINE_RE.match(line)
+	rest = line
+	if m:
+		indent, word, colon = m.group(1), m.group(2), m.group(3)
+		if colon or (not indent and word.upper().split(".")[0] not in MNEMONICS and word.upper() not in DIRECTIVES):
+			label = word
+			rest = line[m.end():]
+	rest = rest.strip()
+	if not rest:
+		return label, None, ""
+	m = re.match(r"[A-Za-z_.?$][A-Za-z0-9_.?$]*", rest)
+	if not m:
+		raise AsmError("Cannot parse: %s" % raw.strip())
+	return label, m.group(0), rest[m.end():].strip()
+
+# Instruction encoding
+#
+R8 = {"B": 0, "C": 1, "D": 2, "E": 3, "H": 4, "L": 5, "A": 7}
+IR8 = {"IXH": (0xDD, 4), "IXL": (0xDD, 5), "IYH": (0xFD, 4), "IYL": (0xFD, 5)}
+RP = {"BC": 0, "DE": 1, "HL": 2, "SP": 3}
+RP2 = {"BC": 0, "DE": 1, "HL": 2, "AF": 3}
+CC = {"NZ": 0, "Z": 1, "NC": 2, "C": 3, "PO": 4, "PE": 5, "P": 6, "M": 7}
+IDX = {"IX": 0xDD, "IY": 0xFD}
+SUFFIXES = {"SIS": (0, 0), "LIS": (1, 0), "SIL": (0, 1), "LIL": (1, 1)}
+SUFFIX_PREFIX = {(0, 0): 0x40, (1, 0): 0x49, (0, 1): 0x52, (1, 1): 0x5B}
+ALU = {"ADD": 0, "ADC": 1, "SUB": 2, "SBC": 3, "AND": 4, "XOR": 5, "OR": 6, "CP": 7}
+ROT = {"RLC": 0, "RRC": 1, "RL": 2, "RR": 3, "SLA": 4, "SRA": 5, "SRL": 7}
+NOARGS = {
+	"NOP": [0x00], "HALT": [0x76], "DI": [0xF3], "EI": [0xFB], "EXX": [0xD9], "CPL": [0x2F], "SCF": [0x37],
+	"CCF": [0x3F], "DAA": [0x27], "RLCA": [0x07], "RRCA": [0x0F], "RLA": [0x17], "RRA": [0x1F],
+	"NEG": [0xED, 0x44], "RETI": [0xED, 0x4D], "RETN": [0xED, 0x45], "RLD": [0xED, 0x6F], "RRD": [0xED, 0x67],
+	"LDI": [0xED, 0xA0], "LDIR": [0xED, 0xB0], "LDD": [0xED, 0xA8], "LDDR": [0xED, 0xB8],
+	"CPI": [0xED, 0xA1], "CPIR": [0xED, 0xB1], "CPD": [0xED, 0xA9], "CPDR": [0xED, 0xB9],
+	"INI": [0xED, 0xA2], "INIR": [0xED, 0xB2], "IND": [0xED, 0xAA], "INDR": [0xED, 0xBA],
+	"OUTI": [0xED, 0xA3], "OTIR": [0xED, 0xB3], "OUTD": [0xED, 0xAB], "OTDR": [0xED, 0xBB],
+	"SLP": [0xED, 0x76], "STMIX": [0xED, 0x7D], "RSMIX": [0xED, 0x7E],
+}
+
+def operand(text):
+	"""Classify an operand; expressions are parsed but not evaluated"""
+	t = text.strip()
+	u = t.upper().replace(" ", "").replace("\t", "")
+	if u in R8:
+		return ("r", R8[u])
+	if u in IR8:
+		return ("ir",) + IR8[u]
+	if u in ("BC", "DE", "HL", "SP", "AF", "IX", "IY"):
+		return ("rp", u)
+	if u == "AF'":
+		return ("rp", "AF'")
+	if u in ("I", "R", "MB"):
+		return ("spec", u)
+	if u in ("(HL)", "(BC)", "(DE)", "(SP)", "(C)", "(BC)"):
+		return ("ind", u[1:-1])
+	m = re.match(r"^\((IX|IY)\)$", u)
+	if m:
+		return ("idx", IDX[m.group(1)], ("num", 0), True)
+	m = re.match(r"^\(\s*(IX|IY)\s*([-+].*)\)$", t, re.I)
+	if m:
+		return ("idx", IDX[m.group(1).upper()], parse_expr("0" + m.group(2)), False)
+	m = re.match(r"^(IX|IY)\s*([-+].*)$", t, re.I)
+	if m:
+		return ("off", IDX[m.group(1).upper()], parse_expr("0" + m.group(2)))
+	if t.startswith("(") and t.endswith(")") and matching_paren(t) == len(t) - 1:
+		return ("mem", parse_expr(t[1:-1]))
+	return ("imm", parse_expr(t))
+
+def matching_paren(t):
+	depth = 0
+	for i, c in enumerate(t):
+		if c == "(":
+			depth += 1
+		elif c == ")":
+			depth -= 1
+			if depth == 0:
+				return i
+	return -1
+
+def cond(text):
+	u = text.strip().upper()
+	if u not in CC:
+		raise AsmError("Bad condition %s" % text)
+	return CC[u]
+
+def encode(op, args, adl):
+	"""Encode an instruction as a list of bytes and (kind, expression) fields to fill in at link time
+	Kinds: b (8 bit), d (signed displacement), w (16 bit), l (24 bit), r (JR offset)"""
+	base, _, sfx = op.upper().partition(".")
+	L, IL = adl, adl
+	out = []
+	if sfx:
+		if sfx in SUFFIXES:
+			L, IL = SUFFIXES[sfx]
+		elif sfx == "S":
+			L = 0
+		elif sfx == "L":
+			L = 1
+		elif sfx == "IS":
+			IL = 0
+		elif sfx == "IL":
+			IL = 1
+		else:
+			raise AsmError("Bad suffix .%s" % sfx)
+		out.append(SUFFIX_PREFIX[(L, IL)])
+	nn = "l" if IL else "w"
+	ops = [operand(a) for a in args] if base not in ("JP", "JR", "CALL", "RET", "DJNZ") else None
+	n = len(args)
+
+	def hl_form(o, opcode, extra=()):
+		"""An instruction on (HL) / r, given the register code in opcode already"""
+		return out + [opcode] + list(extra)
+
+	if base in NOARGS and n == 0:
+		return out + NOARGS[base]
+
+	if base == "LD":
+		return out + encode_ld(ops, nn)
+
+	if base in ALU:
+		k = ALU[base]
+		if n == 2 and ops[0] == ("r", 7) and base not in ("ADD", "ADC", "SBC") or (n == 2 and ops[0] == ("r", 7)):
+			src = ops[1]
+		elif n == 1:
+			src = ops[0]
+		elif n == 2 and ops[0][0] == "rp":
+			return out + encode_alu16(base, ops)
+		else:
+			raise AsmError("Bad operands for %s" % base)
+		return out + encode_src8(0x80 + k * 8, 0xC6 + k * 8, src)
+
+	if base == "TST":
+		src = ops[1] if n == 2 else ops[0]
+		if n == 2 and ops[0] != ("r", 7):
+			raise AsmError("TST takes A")
+		if src[0] == "r":
+			return out + [0xED, 0x04 + src[1] * 8]
+		if src == ("ind", "HL"):
+			return out + [0xED, 0x34]
+		if src[0] == "imm":
+			return out + [0xED, 0x64, ("b", src[1])]
+		raise AsmError("Bad operand for TST")
+
+	if base == "TSTIO":
+		return out + [0xED, 0x74, ("b", ops[0][1])]
+
+	if base in ("INC", "DEC"):
+		o = ops[0]
+		d = 0 if base == "INC" else 1
+		if o[0] == "r":
+			return out + [0x04 + d + o[1] * 8]
+		if o == ("ind", "HL"):
+			return out + [0x34 + d]
+		if o[0] == "ir":
+			return out + [o[1], 0x04 + d + o[2] * 8]
+		if o[0] == "idx":
+			return out + [o[1], 0x34 + d, ("d", o[2])]
+		if o[0] == "rp" and o[1] in RP:
+			return out + [0x03 + d * 8 + RP[o[1]] * 16]
+		if o[0] == "rp" and o[1] in IDX:
+			return out + [IDX[o[1]], 0x23 + d * 8]
+		raise AsmError("Bad operand for %s" % base)
+
+	if base in ROT or base in ("BIT", "RES", "SET"):
+		if base in ROT:
+			k, o = ROT[base] * 8, ops[0]
+		else:
+			b = ops[0]
+			if b[0] != "imm":
+				raise AsmError("Bad bit number")
+			k, o = ({"BIT": 0x40, "RES": 0x80, "SET": 0xC0}[base], b[1]), ops[1]
+		if isinstance(k, tuple):
+			kbase, bexpr = k
+			code = ("bit", kbase, bexpr)
+		else:
+			code = k
+		if o[0] == "r":
+			return out + [0xCB, cb_code(code, o[1])]
+		if o == ("ind", "HL"):
+			return out + [0xCB, cb_code(code, 6)]
+		if o[0] == "idx":
+			return out + [o[1], 0xCB, ("d", o[2]), cb_code(code, 6)]
+		raise AsmError("Bad operand for %s" % base)
+
+	if base in ("JP", "JR", "CALL", "RET", "DJNZ", "RST"):
+		return out + encode_flow(base, args, nn)
+
+	if base in ("PUSH", "POP"):
+		o = ops[0]
+		k = 0xC5 if base == "PUSH" else 0xC1
+		if o[0] == "rp" and o[1] in RP2:
+			return out + [k + RP2[o[1]] * 16]
+		if o[0] == "rp" and o[1] in IDX:
+			return out + [IDX[o[1]], k + 0x20]
+		raise AsmError("Bad operand for %s" % base)
+
+	if base == "EX":
+		a, b = [x.upper().replace(" ", "") for x in args]
+		if (a, b) in (("AF", "AF'"), ("AF", "AF_")):
+			return out + [0x08]
+		if (a, b) in (("DE", "HL"), ("HL", "DE")):
+			return out + [0xEB]
+		if a == "(SP)" and b == "HL":
+			return out + [0xE3]
+		if a == "(SP)" and b in IDX:
+			return out + [IDX[b], 0xE3]
+		raise AsmError("Bad operands for EX")
+
+	if base == "IM":
+		return out + [0xED, {0: 0x46, 1: 0x56, 2: 0x5E}[const(ops[0])]]
+
+	if base in ("IN0", "OUT0"):
+		if base == "IN0":
+			r, p = ops
+		else:
+			p, r = ops
+		if r[0] != "r" or p[0] != "mem":
+			raise AsmError("Bad operands for %s" % base)
+		return out + [0xED, (0x00 if base == "IN0" else 0x01) + r[1] * 8, ("b", p[1])]
+
+	if base == "IN":
+		r, p = ops
+		if p == ("ind", "C") and r[0] == "r":
+			return out + [0xED, 0x40 + r[1] * 8]
+		if r == ("r", 7) and p[0] == "mem":
+			return out + [0xDB, ("b", p[1])]
+		raise AsmError("Bad operands for IN")
+
+	if base == "OUT":
+		p, r = ops
+		if p == ("ind", "C") and r[0] == "r":
+			return out + [0xED, 0x41 + r[1] * 8]
+		if r == ("r", 7) and p[0] == "mem":
+			return out + [0xD3, ("b", p[1])]
+		raise AsmError("Bad operands for OUT")
+
+	if base == "MLT":
+		o = ops[0]
+		if o[0] == "rp" and o[1] in RP:
+			return out + [0xED, 0x4C + RP[o[1]] * 16]
+		raise AsmError("Bad operand for MLT")
+
+	if base == "LEA":
+		d, s = ops
+		if s[0] != "off" or d[0] != "rp":
+			raise AsmError("Bad operands for LEA")
+		src = s[1]
+		if d[1] in ("BC", "DE", "HL"):
+			return out + [0xED, (0x02 if src == 0xDD else 0x03) + RP[d[1]] * 16, ("d", s[2])]
+		table = {("IX", 0xDD): 0x32, ("IY", 0xFD): 0x33, ("IX", 0xFD): 0x54, ("IY", 0xDD): 0x55}
+		return out + [0xED, table[(d[1], src)], ("d", s[2])]
+
+	if base == "PEA":
+		s = ops[0]
+		if s[0] != "off":
+			raise AsmError("Bad operand for PEA")
+		return out + [0xED, 0x65 if s[1] == 0xDD else 0x66, ("d", s[2])]
+
+	raise AsmError("Unknown instruction %s" % op)
+
+def const(o):
+	if o[0] != "imm" or o[1][0] != "num":
+		raise AsmError("Expected a constant")
+	return o[1][1]
+
+def cb_code(code, r):
+	if isinstance(code, tuple):
+		return ("cb", code[1], code[2], r)
+	return code + r
+
+def encode_src8(reg_op, imm_op, src):
+	if src[0] == "r":
+		return [reg_op + src[1]]
+	if src == ("ind", "HL"):
+		return [reg_op + 6]
+	if src[0] == "ir":
+		return [src[1], reg_op + src[2]]
+	if src[0] == "idx":
+		return [src[1], reg_op + 6, ("d", src[2])]
+	if src[0] in ("imm", "mem"):
+		return [imm_op, ("b", src[1])]
+	raise AsmError("Bad 8 bit operand")
+
+def encode_alu16(base, ops):
+	d, s = ops
+	if d[1] == "HL" and s[0] == "rp" and s[1] in RP:
+		if base == "ADD":
+			return [0x09 + RP[s[1]] * 16]
+		if base == "ADC":
+			return [0xED, 0x4A + RP[s[1]] * 16]
+		if base == "SBC":
+			return [0xED, 0x42 + RP[s[1]] * 16]
+	if d[1] in IDX and base == "ADD" and s[0] == "rp":
+		r = {"BC": 0, "DE": 1, d[1]: 2, "SP": 3}.get(s[1])
+		if r is not None:
+			return [IDX[d[1]], 0x09 + r * 16]
+	raise AsmError("Bad operands for %s" % base)
+
+def encode_ld(ops, nn):
+	if len(ops) != 2:
+		raise AsmError("LD takes two operands")
+	d, s = ops
+	# 8 bit register and memory moves
+	if d[0] == "r" and s[0] == "r":
+		return [0x40 + d[1] * 8 + s[1]]
+	if d[0] == "r" and s == ("ind", "HL"):
+		return [0x46 + d[1] * 8]
+	if d == ("ind", "HL") and s[0] == "r":
+		return [0x70 + s[1]]
+	if d[0] == "r" and s[0] == "idx":
+		return [s[1], 0x46 + d[1] * 8, ("d", s[2])]
+	if d[0] == "idx" and s[0] == "r":
+		return [d[1], 0x70 + s[1], ("d", d[2])]
+	if d[0] == "ir" and s[0] in ("r", "ir"):
+		sr = s[2] if s[0] == "ir" else s[1]
+		if s[0] == "ir" and s[1] != d[1] or sr in (4, 5) and s[0] == "r":
+			raise AsmError("Bad index register move")
+		return [d[1], 0x40 + d[2] * 8 + sr]
+	if d[0] == "r" and s[0] == "ir":
+		if d[1] in (4, 5):
+			raise AsmError("Bad index register move")
+		return [s[1], 0x40 + d[1] * 8 + s[2]]
+	if d[0] == "r" and (s[0] == "imm" or s[0] == "mem" and d[1] != 7):
+		return [0x06 + d[1] * 8, ("b", s[1])]
+	if d[0] == "ir" and s[0] == "imm":
+		return [d[1], 0x06 + d[2] * 8, ("b", s[1])]
+	if d == ("ind", "HL") and s[0] == "imm":
+		return [0x36, ("b", s[1])]
+	if d[0] == "idx" and s[0] == "imm":
+		return [d[1], 0x36, ("d", d[2]), ("b", s[1])]
+	if d == ("r", 7) and s[0] == "ind" and s[1] in ("BC", "DE"):
+		return [0x0A if s[1] == "BC" else 0x1A]
+	if s == ("r", 7) and d[0] == "ind" and d[1] in ("BC", "DE"):
+		return [0x02 if d[1] == "BC" else 0x12]
+	if d == ("r", 7) and s[0] == "mem":
+		return [0x3A, (nn, s[1])]
+	if s == ("r", 7) and d[0] == "mem":
+		return [0x32, (nn, d[1])]
+	# Special registers
+	if d == ("spec", "I") and s == ("r", 7):
+		return [0xED, 0x47]
+	if d == ("spec", "R") and s == ("r", 7):
+		return [0xED, 0x4F]
+	if d == ("r", 7) and s == ("spec", "I"):
+		return [0xED, 0x57]
+	if d == ("r", 7) and s == ("spec", "R"):
+		return [0xED, 0x5F]
+	if d == ("spec", "MB") and s == ("r", 7):
+		return [0xED, 0x6D]
+	if d == ("r", 7) and s == ("spec", "MB"):
+		return [0xED, 0x6E]
+	if d == ("spec", "I") and s == ("rp", "HL"):
+		return [0xED, 0xC7]
+	if d == ("rp", "HL") and s == ("spec", "I"):
+		return [0xED, 0xD7]
+	# 16 and 24 bit
+	if d[0] == "rp" and s[0] == "imm":
+		if d[1] in RP:
+			return [0x01 + RP[d[1]] * 16, (nn, s[1])]
+		if d[1] in IDX:
+			return [IDX[d[1]], 0x21, (nn, s[1])]
+	if d[0] == "rp" and s[0] == "mem":
+		if d[1] == "HL":
+			return [0x2A, (nn, s[1])]
+		if d[1] in RP:
+			return [0xED, 0x4B + RP[d[1]] * 16, (nn, s[1])]
+		if d[1] in IDX:
+			return [IDX[d[1]], 0x2A, (nn, s[1])]
+	if s[0] == "rp" and d[0] == "mem":
+		if s[1] == "HL":
+			return [0x22, (nn, d[1])]
+		if s[1] in RP:
+			return [0xED, 0x43 + RP[s[1]] * 16, (nn, d[1])]
+		if s[1] in IDX:
+			return [IDX[s[1]], 0x22, (nn, d[1])]
+	if d == ("rp", "SP") and s[0] == "rp" and s[1] in ("HL", "IX", "IY"):
+		return [0xF9] if s[1] == "HL" else [IDX[s[1]], 0xF9]
+	# eZ80 loads of a register pair through (HL) and (IX+d)
+	if d[0] == "rp" and s == ("ind", "HL"):
+		code = {"BC": 0x07, "DE": 0x17, "HL": 0x27, "IX": 0x37, "IY": 0x31}.get(d[1])
+		if code is not None:
+			return [0xED, code]
+	if d == ("ind", "HL") and s[0] == "rp":
+		code = {"BC": 0x0F, "DE": 0x1F, "HL": 0x2F, "IX": 0x3F, "IY": 0x3E}.get(s[1])
+		if code is not None:
+			return [0xED, code]
+	if d[0] == "rp" and s[0] == "idx":
+		same = "IX" if s[1] == 0xDD else "IY"
+		other = "IY" if same == "IX" else "IX"
+		code = {"BC": 0x07, "DE": 0x17, "HL": 0x27, same: 0x37, other: 0x31}.get(d[1])
+		if code is not None:
+			return [s[1], code, ("d", s[2])]
+	if d[0] == "idx" and s[0] == "rp":
+		same = "IX" if d[1] == 0xDD else "IY"
+		other = "IY" if same == "IX" else "IX"
+		code = {"BC": 0x0F, "DE": 0x1F, "HL": 0x2F, same: 0x3F, other: 0x3E}.get(s[1])
+		if code is not None:
+			return [d[1], code, ("d", d[2])]
+	# LD rr, rr' is not an eZ80 instruction; ZDS takes it as PUSH rr' / POP rr
+	if d[0] == "rp" and s[0] == "rp" and d[1] != "SP" and s[1] != "SP":
+		push = encode("PUSH", [s[1]], 1)
+		pop = encode("POP", [d[1]], 1)
+		return push + pop
+	raise AsmError("Bad operands for LD")
+
+def encode_flow(base, args, nn):
+	n = len(args)
+	if base == "RET":
+		if n == 0:
+			return [0xC9]
+		return [0xC0 + cond(args[0]) * 8]
+	if base == "RST":
+		v = evaluate(parse_expr(args[0]), lambda s: (_ for _ in ()).throw(AsmError("RST takes a constant")), None)
+		if v & ~0x38:
+			raise AsmError("Bad RST address")
+		return [0xC7 + v]
+	if base == "DJNZ":
+		return [0x10, ("r", parse_expr(args[0]))]
+	if base == "JR":
+		if n == 1:
+			return [0x18, ("r", parse_expr(args[0]))]
+		c = cond(args[0])
+		if c > 3:
+			raise AsmError("JR only takes NZ, Z, NC and C")
+		return [0x20 + c * 8, ("r", parse_expr(args[1]))]
+	if base == "JP":
+		if n == 1:
+			u = args[0].upper().replace(" ", "")
+			if u == "(HL)":
+				return [0xE9]
+			if u in ("(IX)", "(IY)"):
+				return [IDX[u[1:3]], 0xE9]
+			return [0xC3, (nn, parse_expr(args[0]))]
+		return [0xC2 + cond(args[0]) * 8, (nn, parse_expr(args[1]))]
+	if base == "CALL":
+		if n == 1:
+			return [0xCD, (nn, parse_expr(args[0]))]
+		return [0xC4 + cond(args[0]) * 8, (nn, parse_expr(args[1]))]
+	raise AsmError("Bad %s" % base)
+
+FIELD_SIZE = {"b": 1, "d": 1, "w": 2, "l": 3, "r": 1, "cb": 1}
+
+def template_size(t):
+	return sum(1 if isinstance(x, int) else FIELD_SIZE[x[0]] for x in t)
+
+# Modules
+#
+class Macro:
+	def __init__(self, name, params, body):
+		self.name = name
+		self.params = params
+		self.body = body
+
+class Item:
+	"""An instruction or data statement; index is its position among the module's items in seg"""
+	__slots__ = ("seg", "index", "size", "template", "stmt", "anon", "long")
+
+	def __init__(self, seg, index, size, template, stmt, anon, long=None):
+		self.seg = seg
+		self.index = index
+		self.size = size
+		self.template = template
+		self.stmt = stmt
+		self.anon = anon
+		self.long = long
+
+def widen(template, adl):
+	"""The JP form of a JR or DJNZ, which ZDS substitutes when the target is out of range (sdiopt)"""
+	nn = "l" if adl else "w"
+	op, target = template[0], template[1][1]
+	if op == 0x18:
+		return [0xC3, (nn, target)]
+	if op == 0x10:
+		return [0x05, 0xC2, (nn, target)]	# DEC B; JP NZ
+	return [0xC2 + (op - 0x20), (nn, target)]
+
+class Module:
+	def __init__(self, path, assembler):
+		self.path = path
+		self.name = os.path.splitext(os.path.basename(path))[0]
+		self.asm = assembler
+		self.labels = {}		# Name: (segment, item index)
+		self.equs = {}			# Name: (expression, segment, item index, scope, anon)
+		self.xdefs = set()
+		self.xrefs = set()
+		self.anons = []			# (segment, item index) of each $$ label in order
+		self.items = []
+		self.segitems = {}		# Segment: items in it
+		self.offsets = {}		# Segment: offset of each item, and the size at the end
+		self.sizes = {}			# Segment: bytes used by this module
+		self.seg = "CODE"
+		self.adl = 1
+		self.scope = 0
+		self.macros = {}
+		self.macro_count = 0
+		self.resolving = set()
+
+	# Symbols
+	#
+	def key(self, name, scope):
+		if name.startswith("$") and not name.startswith("$$"):
+			return "%s@%d" % (name, scope)
+		return name
+
+	def define_label(self, name, stmt):
+		k = self.key(name, stmt.scope)
+		if k in self.labels or k in self.equs:
+			raise AsmError("%s defined twice" % name)
+		self.labels[k] = self.pos()
+
+	def define_equ(self, name, expr, stmt):
+		k = self.key(name, stmt.scope)
+		entry = (expr,) + self.pos() + (stmt.scope, len(self.anons))
+		if k in self.labels:
+			raise AsmError("%s defined twice" % name)
+		if k in self.equs:
+			try:
+				old = self.const_value(k)
+				new = evaluate(expr, lambda s: self.lookup(s, stmt.scope, len(self.anons), None, True), None)
+			except AsmError:
+				raise AsmError("%s defined twice" % name)
+			if old != new:
+				raise AsmError("%s defined twice, as %d and %d" % (name, old, new))
+			return
+		self.equs[k] = entry
+
+	def const_value(self, k):
+		expr, seg, off, scope, anon = self.equs[k]
+		return evaluate(expr, lambda s: self.lookup(s, scope, anon, None, True), None)
+
+	def lookup(self, name, scope, anon, here, const_only=False):
+		"""The value of a symbol; with const_only, only symbols known before linking"""
+		u = name.upper()
+		if u in ("$F", "$B"):
+			if const_only:
+				raise AsmError("%s is not a constant" % name)
+			i = anon if u == "$F" else anon - 1
+			if i < 0 or i >= len(self.anons):
+				raise AsmError("No anonymous label for %s" % name)
+			return self.asm.address(self, *self.anons[i])
+		k = self.key(name, scope)
+		if k in self.equs:
+			if k in self.resolving:
+				raise AsmError("%s is defined in terms of itself" % name)
+			self.resolving.add(k)
+			try:
+				expr, seg, off, escope, eanon = self.equs[k]
+				h = (lambda: self.asm.address(self, seg, off)) if not const_only else None
+				return evaluate(expr, lambda s: self.lookup(s, escope, eanon, h, const_only), h)
+			finally:
+				self.resolving.discard(k)
+		if k in self.labels:
+			if const_only:
+				raise AsmError("%s is not a constant" % name)
+			return self.asm.address(self, *self.labels[k])
+		if not const_only:
+			v = self.asm.global_value(name, False)
+			if v is not None:
+				return v
+		if HEX_H_RE.match(name):
+			return int(name[:-1], 16)
+		if not const_only:
+			v = self.asm.global_value(name, True)
+			if v is not None:
+				return v
+		if const_only:
+			raise AsmError("%s is not a constant" % name)
+		raise AsmError("Undefined symbol %s" % name)
+
+	def const(self, expr, stmt):
+		return evaluate(expr, lambda s: self.lookup(s, stmt.scope, len(self.anons), None, True), None)
+
+	# Pass 1
+	#
+	def pos(self):
+		return (self.seg, len(self.segitems.setdefault(self.seg, [])))
+
+	def emit(self, template, stmt, size=None):
+		seg, index = self.pos()
+		long = None
+		if template and isinstance(template[-1], tuple) and template[-1][0] == "r":
+			long = widen(template, self.adl)
+		item = Item(seg, index, template_size(template) if size is None else size, template, stmt, len(self.anons), long)
+		self.items.append(item)
+		self.segitems[seg].append(item)
+		self.sizes[seg] = self.sizes.get(seg, 0) + item.size
+
+	def reserve(self, size, stmt):
+		self.emit(None, stmt, size)
+
+	def offset(self, seg, index):
+		return self.offsets[seg][index]
+
+	def relayout(self):
+		for seg, items in self.segitems.items():
+			offs = [0]
+			for item in items:
+				offs.append(offs[-1] + item.size)
+			self.offsets[seg] = offs
+			self.sizes[seg] = offs[-1]
+
+	def widen_jumps(self):
+		"""Turn the relative jumps whose targets are out of range into JPs; True if any changed"""
+		changed = False
+		for item in self.items:
+			if item.long is None or item.template is item.long:
+				continue
+			start = self.asm.address(self, item.seg, item.index)
+			here = lambda: start
+			stmt = item.stmt
+			try:
+				v = evaluate(item.template[-1][1], lambda s: self.lookup(s, stmt.scope, item.anon, here), here)
+			except AsmError as e:
+				raise AsmError("%s: %s" % (stmt.where(), e))
+			if not -128 <= v - (start + item.size) <= 127:
+				item.template = item.long
+				item.size = template_size(item.long)
+				changed = True
+		return changed
+
+	def read(self, path, scope_holder=None):
+		lines = self.asm.read_file(path)
+		self.process(lines, path, 0, {})
+
+	def process(self, lines, path, depth, subst):
+		"""Run the statements in lines, which come from path (or a macro expanded there)"""
+		i = 0
+		cond_stack = []			# (active, seen_true) for each IF
+		while i < len(lines):
+			lineno, raw = lines[i]
+			i += 1
+			try:
+				label, op, rest = parse_line(raw)
+			except AsmError as e:
+				raise AsmError("%s:%d: %s" % (path, lineno, e))
+			uop = op.upper() if op else None
+			active = all(c[0] for c in cond_stack)
+			if uop in ("IF", "IFDEF", "IFNDEF"):
+				if active:
+					stmt = Statement(label, op, rest, path, lineno, self.scope, raw)
+					try:
+						if uop == "IF":
+							v = bool(self.const(parse_expr(rest), stmt))
+						else:
+							defined = rest.strip() in self.equs or rest.strip() in self.labels
+							v = defined if uop == "IFDEF" else not defined
+					except AsmError as e:
+						raise AsmError("%s:%d: %s" % (path, lineno, e))
+					cond_stack.append([v, v])
+				else:
+					cond_stack.append([False, True])
+				continue
+			if uop == "ELSE":
+				if not cond_stack:
+					raise AsmError("%s:%d: ELSE without IF" % (path, lineno))
+				c = cond_stack[-1]
+				c[0] = not c[1]
+				c[1] = True
+				continue
+			if uop == "ENDIF":
+				if not cond_stack:
+					raise AsmError("%s:%d: ENDIF without IF" % (path, lineno))
+				cond_stack.pop()
+				continue
+			if not active:
+				continue
+			if uop == "MACRO":
+				body = []
+				while True:
+					if i >= len(lines):
+						raise AsmError("%s:%d: MACRO without ENDMACRO" % (path, lineno))
+					ln, r = lines[i]
+					i += 1
+					_, o, _ = parse_line(r)
+					if o and o.upper() in ("ENDMACRO", "MACEND", "ENDM"):
+						break
+					body.append((ln, r))
+				params = [p.strip() for p in rest.split(",") if p.strip()]
+				self.macros[label.upper()] = Macro(label, params, body)
+				continue
+			if uop == "END":
+				return
+			stmt = Statement(label, op, rest, path, lineno, self.scope, raw)
+			try:
+				self.statement(stmt, depth)
+			except AsmError as e:
+				msg = str(e)
+				if not re.match(r"^\S+:\d+: ", msg):
+					msg = "%s: %s" % (stmt.where(), msg)
+				raise AsmError(msg)
+		if cond_stack:
+			raise AsmError("%s: IF without ENDIF" % path)
+
+	def expand(self, macro, args, stmt, depth):
+		if depth > 20:
+			raise AsmError("Macros nested too deeply")
+		self.macro_count += 1
+		n = self.macro_count
+		values = dict(zip([p.upper() for p in macro.params], args))
+		out = []
+		for ln, raw in macro.body:
+			line = raw
+			for p in macro.params:
+				v = values.get(p.upper(), "")
+				line = re.sub(r"&?(?<![A-Za-z0-9_?$])" + re.escape(p) + r"(?![A-Za-z0-9_?])&?", lambda m: v, line)
+			line = re.sub(r"\$\$([A-Za-z_][A-Za-z0-9_]*)", lambda m: "__m%d_%s" % (n, m.group(1)), line)
+			out.append((stmt.line, line))
+		self.process(out, stmt.file, depth + 1, {})
+
+	def statement(self, stmt, depth):
+		label, op, rest = stmt.label, stmt.op, stmt.args
+		uop = op.upper() if op else None
+		if uop in ("EQU", ".EQU"):
+			if not label:
+				raise AsmError("EQU without a name")
+			self.define_equ(label, parse_expr(rest), stmt)
+			return
+		if label:
+			if label == "$$":
+				self.anons.append(self.pos())
+			else:
+				self.define_label(label, stmt)
+		if not op:
+			return
+		macro = self.macros.get(uop)
+		if macro is None and "(" in op:
+			macro = None
+		if macro is not None:
+			args = split_operands(rest)
+			self.expand(macro, args, stmt, depth)
+			return
+		if uop == "INCLUDE":
+			name = unescape(rest.strip().strip('"').strip("'")).decode()
+			lines = self.asm.include(name, os.path.dirname(stmt.file))
+			if lines is not None:
+				self.process(lines, self.asm.include_path(name, os.path.dirname(stmt.file)), depth + 1, {})
+			return
+		if uop == "XDEF":
+			self.xdefs.update(a.strip() for a in rest.split(","))
+			return
+		if uop == "XREF":
+			self.xrefs.update(a.strip() for a in rest.split(","))
+			return
+		if uop == "DEFINE":
+			parts = split_operands(rest)
+			name = parts[0]
+			attrs = {}
+			for p in parts[1:]:
+				k, _, v = p.partition("=")
+				attrs[k.strip().upper()] = v.strip()
+			space = attrs.get("SPACE", "ROM").upper()
+			align = self.const(parse_expr(attrs["ALIGN"]), stmt) if "ALIGN" in attrs else 1
+			self.asm.define_segment(name, space, align)
+			return
+		if uop in ("SEGMENT", "SECTION"):
+			self.seg = rest.strip()
+			self.asm.define_segment(self.seg, None, None)
+			return
+		if uop == ".ASSUME":
+			k, _, v = rest.partition("=")
+			if k.strip().upper() == "ADL":
+				self.adl = 1 if self.const(parse_expr(v), stmt) else 0
+			return
+		if uop == "SCOPE":
+			self.asm.scopes += 1
+			self.scope = self.asm.scopes
+			return
+		if uop in ("DB", "DEFB", "BYTE", "ASCII"):
+			t = []
+			for a in split_operands(rest):
+				if a[:1] == '"' or (a[:1] == "'" and len(unescape(a[1:-1])) != 1):
+					t.extend(unescape(a[1:-1]))
+				else:
+					t.append(("b", parse_expr(a)))
+			self.emit(t, stmt)
+			return
+		if uop in ("DW", "DEFW", "WORD"):
+			self.emit([("w", parse_expr(a)) for a in split_operands(rest)], stmt)
+			return
+		if uop in ("DL", "DW24"):
+			self.emit([("l", parse_expr(a)) for a in split_operands(rest)], stmt)
+			return
+		if uop in ("DS", "DEFS", "BLKB"):
+			parts = split_operands(rest)
+			n = self.const(parse_expr(parts[0]), stmt)
+			fill = self.const(parse_expr(parts[1]), stmt) & 0xFF if len(parts) > 1 else 0
+			if self.asm.space(self.seg) == "RAM" and len(parts) == 1:
+				self.reserve(n, stmt)
+			else:
+				self.emit([fill] * n, stmt)
+			return
+		if uop == "ALIGN":
+			n = self.const(parse_expr(rest), stmt)
+			pad = (-self.sizes.get(self.seg, 0)) % n
+			self.emit([0] * pad, stmt)
+			return
+		if uop == "ERROR":
+			raise AsmError("ERROR: %s" % (rest or "in source"))
+		if uop in ("LIST", "NOLIST", ".LIST", ".NOLIST", "PAGE", "TITLE", ".DEF", ".ENDEF"):
+			return
+		# A macro called as NAME(args)
+		m = re.match(r"([A-Za-z_.?$][A-Za-z0-9_.?$]*)$", op)
+		if uop.split(".")[0] in MNEMONICS:
+			args = split_operands(rest)
+			self.emit(encode(op, args, self.adl), stmt)
+			return
+		raise AsmError("Unknown instruction or macro %s" % op)
+
+	# Pass 2
+	#
+	def link_items(self, image):
+		for item in self.items:
+			if item.template is None:
+				continue
+			stmt = item.stmt
+			start = self.asm.address(self, item.seg, item.index)
+			here = lambda start=start: start
+			look = lambda s, stmt=stmt, item=item, here=here: self.lookup(s, stmt.scope, item.anon, here)
+			out = bytearray()
+			try:
+				for f in item.template:
+					if isinstance(f, int):
+						out.append(f)
+						continue
+					kind = f[0]
+					if kind == "cb":
+						b = evaluate(f[2], look, here)
+						if not 0 <= b <= 7:
+							raise AsmError("Bad bit number %d" % b)
+						out.append(f[1] + b * 8 + f[3])
+						continue
+					v = evaluate(f[1], look, here)
+					if kind == "b":
+						if not -256 <= v <= 255:
+							raise AsmError("Value %d out of range" % v)
+						out.append(v & 0xFF)
+					elif kind == "d":
+						if not -128 <= v <= 127:
+							raise AsmError("Displacement %d out of range" % v)
+						out.append(v & 0xFF)
+					elif kind == "w":
+						out += bytes([v & 0xFF, (v >> 8) & 0xFF])
+					elif kind == "l":
+						out += bytes([v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF])
+					elif kind == "r":
+						d = v - (start + item.size)
+						if not -128 <= d <= 127:
+							raise AsmError("Relative jump out of range (%d)" % d)
+						out.append(d & 0xFF)
+			except AsmError as e:
+				raise AsmError("%s: %s" % (stmt.where(), e))
+			image.write(start, out)
+
+class Image:
+	"""Memory contents from the linker, as runs of bytes, with the symbol tables"""
+
+	def __init__(self):
+		self.chunks = {}
+		self.symbols = {}		# Exported and linker symbols
+		self.labels = []		# (address, module, name) of every label, for profiling
+		self.segments = {}		# Name: (base, size, space)
+		self.stubs = {}			# Name: address of each stub
+
+	def write(self, addr, data):
+		self.chunks[addr] = bytes(data)
+
+	def load(self, mem):
+		for a, d in self.chunks.items():
+			mem[a:a + len(d)] = d
+
+	def flat(self, start, end, fill=0xFF):
+		out = bytearray([fill]) * (end - start)
+		for a, d in self.chunks.items():
+			if a >= start and a + len(d) <= end:
+				out[a - start:a - start + len(d)] = d
+		return out
+
+	def __getitem__(self, name):
+		return self.symbols[name]
+
+	def name_at(self, addr):
+		"""The label at or before addr, for reports"""
+		best = None
+		for a, mod, name in self.labels:
+			if a <= addr and (best is None or a > best[0]):
+				best = (a, mod, name)
+		return best
+
+class Assembler:
+	def __init__(self, include_dirs=()):
+		self.include_dirs = list(include_dirs)
+		self.modules = []
+		self.segdefs = {}		# Name: [space, align]
+		self.seg_order = []
+		self.scopes = 0
+		self.bases = {}			# (module, segment): address
+		self.globals = {}
+		self.extra = {}			# Symbols given by the linker
+		self.stub_names = {}
+		self.stub_base = None
+		self.stub_next = None
+		self.file_cache = {}
+
+	def read_file(self, path):
+		if path not in self.file_cache:
+			with open(path, "rb") as f:
+				text = f.read().decode("latin-1")
+			self.file_cache[path] = [(i + 1, l.replace("\r", "")) for i, l in enumerate(text.split("\n"))]
+		return self.file_cache[path]
+
+	def include_path(self, name, here):
+		for d in [here] + self.include_dirs:
+			p = os.path.normpath(os.path.join(d, name))
+			if os.path.exists(p):
+				return p
+		return name
+
+	def include(self, name, here):
+		p = self.include_path(name, here)
+		if os.path.exists(p):
+			return self.read_file(p)
+		if os.path.basename(name).lower() == "ez80f92.inc":
+			return [(i + 1, "%s\tEQU\t%d" % (k, v)) for i, (k, v) in enumerate(F92_REGISTERS.items())]
+		raise AsmError("Cannot find include file %s" % name)
+
+	def define_segment(self, name, space, align):
+		if name not in self.segdefs:
+			default = "RAM" if name.upper() in ("DATA", "BSS") else "ROM"
+			self.segdefs[name] = [space or default, align or 1]
+			self.seg_order.append(name)
+		elif space is not None:
+			self.segdefs[name] = [space, align or 1]
+
+	def space(self, seg):
+		if seg not in self.segdefs:
+			self.define_segment(seg, None, None)
+		return self.segdefs[seg][0]
+
+	def add(self, path):
+		"""Assemble a file as a module"""
+		m = Module(path, self)
+		self.define_segment("CODE", None, None)
+		m.read(path)
+		self.modules.append(m)
+		return m
+
+	def address(self, module, seg, index):
+		try:
+			return self.bases[(module, seg)] + module.offset(seg, index)
+		except KeyError:
+			raise AsmError("Segment %s is not placed yet" % seg)
+
+	def global_value(self, name, stub):
+		if name in self.extra:
+			return self.extra[name]
+		g = self.globals.get(name)
+		if g is not None:
+			return g.lookup(name, 0, 0, None)
+		if stub and self.stub_base is not None:
+			if name not in self.stub_names:
+				self.stub_names[name] = self.stub_next
+				self.stub_next += 16
+			return self.stub_names[name]
+		return None
+
+	def place(self, image, rom, ram, order, symbols):
+		"""Lay the segments out, each module's part of a segment after the one before"""
+		segs = [s for s in order if s in self.segdefs] + [s for s in self.seg_order if s not in order]
+		addr = {"ROM": rom, "RAM": ram}
+		for seg in segs:
+			space, align = self.segdefs[seg]
+			a = addr[space]
+			a = (a + align - 1) // align * align
+			base = a
+			for m in self.modules:
+				size = m.sizes.get(seg, 0)
+				if size:
+					a = (a + align - 1) // align * align
+					self.bases[(m, seg)] = a
+					a += size
+				else:
+					self.bases[(m, seg)] = a
+			image.segments[seg] = (base, a - base, space)
+			if "__low_" + seg.lstrip(".").lower() not in symbols:
+				self.extra["__low_" + seg.lstrip(".").lower()] = base
+				self.extra["__len_" + seg.lstrip(".").lower()] = a - base
+			addr[space] = a
+
+	def link(self, rom=0x000000, ram=0x0B0000, order=(".RESET", ".IVECTS", ".STARTUP", "CODE", "TEXT"),
+		 symbols=None, stubs=None):
+		"""Place the segments and resolve every reference
+		rom, ram: Where the ROM and RAM segments start
+		symbols: Symbols the linker defines, such as __stack
+		stubs: If set, the address of a RAM area where each undefined symbol gets 16 zero bytes,
+		       which read as a zero variable or, called, can be trapped"""
+		self.extra = dict(symbols or {})
+		self.globals = {}
+		for m in self.modules:
+			for name in m.xdefs:
+				if name in self.globals and self.globals[name] is not m:
+					raise AsmError("%s is defined in %s and %s" % (name, self.globals[name].path, m.path))
+				if name not in m.labels and name not in m.equs:
+					raise AsmError("%s: %s is XDEFed but not defined" % (m.path, name))
+				self.globals[name] = m
+		image = Image()
+		if stubs is not None:
+			self.stub_base = self.stub_next = stubs
+		for m in self.modules:
+			m.relayout()
+		while True:
+			self.place(image, rom, ram, order, symbols or {})
+			if not any([m.widen_jumps() for m in self.modules]):
+				break
+			for m in self.modules:
+				m.relayout()
+		for m in self.modules:
+			m.link_items(image)
+		for name, m in self.globals.items():
+			image.symbols[name] = m.lookup(name, 0, 0, None)
+		for name, v in self.extra.items():
+			image.symbols.setdefault(name, v)
+		for m in self.modules:
+			for k, (seg, index) in m.labels.items():
+				if "@" not in k and not k.startswith("__m"):
+					image.labels.append((self.address(m, seg, index), m.name, k))
+		image.labels.sort()
+		image.stubs = dict(self.stub_names)
+		for name, a in self.stub_names.items():
+			image.write(a, bytes(16))
+			image.symbols.setdefault(name, a)
+		return image
+
+def main():
+	p = argparse.ArgumentParser(description="Assemble and link MOS assembler files on the host")
+	p.add_argument("files", nargs="+")
+	p.add_argument("-I", dest="include", action="append", default=[], help="Include directory")
+	p.add_argument("-o", dest="output", help="Write the flash image (from 0) to this file")
+	p.add_argument("--map", action="store_true", help="List the segments and exported symbols")
+	p.add_argument("--stubs", action="store_true", help="Bind undefined symbols to stubs rather than failing")
+	p.add_argument("-D", dest="define", action="append", default=[], help="Define a linker symbol, NAME=VALUE")
+	args = p.parse_args()
+	asm = Assembler(args.include)
+	try:
+		for f in args.files:
+			asm.add(f)
+		symbols = dict((k, int(v, 0)) for k, _, v in (d.partition("=") for d in args.define))
+		image = asm.link(symbols=symbols, stubs=0x0BF000 if args.stubs else None)
+	except AsmError as e:
+		print("asm: %s" % e, file=sys.stderr)
+		return 1
+	if args.map:
+		for seg, (base, size, space) in image.segments.items():
+			print("%-12s %s %06X %6d" % (seg, space, base, size))
+		for name in sorted(image.symbols):
+			print("%-32s %06X%s" % (name, image.symbols[name], "  (stub)" if name in image.stubs else ""))
+	if args.output:
+		end = max((b + s for b, s, sp in image.segments.values() if sp == "ROM"), default=0)
+		with open(args.output, "wb") as f:
+			f.write(image.flat(0, end))
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,355 @@
+#!/usr/bin/env python3
+#
+# Title:	AGON MOS - Host benchmarks for the assembler routines
+# Author:	Agon MOS contributors
+# Created:	17/10/2026
+# Last Updated:	17/10/2026
+#
+# Modinfo:
+#
+# Assembles the MOS assembler modules that do the hot work (sd.asm, spi.asm, crc32.asm, the
+# handlers in interrupts.asm and vdp_protocol.asm, iram.asm) with asm.py, runs them on the
+# eZ80F92 model against an SD card image (sdcard.py) and the VDP stand-in (vdp.py), and
+# reports cycles for each:
+#
+#	crc32_block		cycles per byte, checked against zlib
+#	SD_init, SD_readBlocks,	cycles and KB/s, the data checked against the card image
+#	SD_writeBlocks, SD_flush
+#	UART0 and VBLANK	cycles per interrupt, handler included
+#	VDP queries		round trip of VDU 23,0,&82 and the wait_ESP32 poll, at several
+#				latencies and baud rates, against a time budget
+#
+# Each is run twice: with the routines in internal SRAM as MOS runs them (iram_install), and
+# from flash (iram_bypass). The C functions these modules call are stubs that return at once.
+# The figures come from the model's cycle count, not a board; see cpu.py for what it counts.
+#
+# --save writes the figures to a file and --check compares against one, failing if any has
+# grown by more than --tolerance percent. The exit status is 1 if anything failed.
+#
+# Usage: python3 tools/ez80sim/bench.py [--json] [--save file] [--check file] [--budget us]
+
+import argparse
+import json
+import os
+import random
+import sys
+import zlib
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.normpath(os.path.join(HERE, "..", ".."))
+sys.path.insert(0, HERE)
+
+from asm import Assembler, AsmError
+from cpu import CPUError
+import f92
+from sdcard import SDCard
+from vdp import SimVDP
+
+SOURCES = [
+	"src_startup/vectors16.asm", "src_startup/globals.asm", "src/interrupts.asm",
+	"src/vdp_protocol.asm", "src/keyboard.asm", "src/iram.asm", "src/crc32.asm",
+	"src/spi.asm", "src/serial.asm", "src/misc.asm", "src/sd.asm", "src/gpio.asm",
+	"tools/ez80sim/harness.asm",
+]
+
+RAM = 0x0B0000			# Where the RAM segments are linked
+STUBS = 0x0AF000		# The undefined symbols
+RETURN = 0x0AE000		# The return address calls from the bench come back to
+STACK = 0x0BFF00
+BUFFER = 0x080000		# Data for crc32_block and the SD transfers
+
+VDPP_FLAG_CURSOR = 0x01
+
+UART0_IVECT = 0x18
+PORTB1_IVECT = 0x32
+
+class Timeout(Exception):
+	pass
+
+_image = None
+
+def build():
+	global _image
+	if _image is None:
+		asm = Assembler([os.path.join(ROOT, "src")])
+		for s in SOURCES:
+			asm.add(os.path.join(ROOT, s))
+		_image = asm.link(rom=0x000000, ram=RAM, stubs=STUBS)
+	return _image
+
+class Machine:
+	"""An F92 with the image loaded, set up as MOS sets itself up before main"""
+
+	def __init__(self, iram=True, card=None, latency_us=100, vdp_baud=1152000, uart_baud=1152000):
+		self.image = build()
+		self.m = f92.F92()
+		self.cpu = self.m.cpu
+		self.m.memmap.setup_agon()
+		self.m.load(self.image)
+		self.m.mem[0x040000:0x0C0000] = bytes(0x80000)
+		self.image.load(self.m.mem)
+		self.stub_calls = {}
+		for name, addr in self.image.stubs.items():
+			self.cpu.traps[addr] = self.stub(name)
+		c = self.cpu
+		c.adl = c.madl = 1
+		c.spl = STACK
+		if card:
+			self.m.attach_sd(card)
+		self.vdp = SimVDP(self.m, latency_us, vdp_baud)
+		self.open_uart0(uart_baud)
+		self.call("__init_default_vectors")
+		self.call("_iram_install")
+		if not iram:
+			self.call("_iram_bypass")
+		self.call("_set_vector", UART0_IVECT, self.image["_uart0_handler"])
+		self.call("_set_vector", PORTB1_IVECT, self.image["_vblank_handler"])
+		self.vblank_mode()
+		self.poke("_serialFlags", 0x03)		# UART0 on with flow control, as main sets it
+		c.iff1 = c.iff2 = 1
+
+	def stub(self, name):
+		def ret(cpu):
+			self.stub_calls[name] = self.stub_calls.get(name, 0) + 1
+			mem = cpu.mem
+			sp = cpu.spl
+			cpu.pc = mem[sp] | (mem[sp + 1] << 8) | (mem[sp + 2] << 16)
+			cpu.spl = sp + 3
+			cpu.a = 0
+			cpu.xr[0] = 0
+		return ret
+
+	def open_uart0(self, baud):
+		"""What open_UART0 in uart.c does"""
+		io = self.m.bus.io_write
+		brg = int(f92.CLOCK / (16 * baud))
+		io(0xC3, 0x83, 0)
+		io(0xC0, brg & 0xFF, 0)
+		io(0xC1, brg >> 8, 0)
+		io(0xC3, 0x03, 0)
+		io(0xC4, 0x00, 0)
+		io(0xC2, 0x07, 0)
+		io(0xC1, 0x01, 0)
+
+	def vblank_mode(self):
+		"""PB1 as a rising edge interrupt, as GPIOB_SETMODE 9 leaves it"""
+		io = self.m.bus.io_write
+		pb = self.m.pb
+		io(0x9A, pb.dr | 0x02, 0)
+		io(0x9B, pb.ddr | 0x02, 0)
+		io(0x9C, pb.alt1 | 0x02, 0)
+		io(0x9D, pb.alt2 | 0x02, 0)
+
+	def poke(self, name, v, size=1):
+		a = self.image[name]
+		for i in range(size):
+			self.m.mem[a + i] = (v >> (8 * i)) & 0xFF
+
+	def peek(self, name, size=1):
+		a = self.image[name]
+		return sum(self.m.mem[a + i] << (8 * i) for i in range(size))
+
+	def push(self, v):
+		c = self.cpu
+		c.spl -= 3
+		c.mem[c.spl:c.spl + 3] = bytes([v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF])
+
+	def call(self, name, *args, limit_us=2000000):
+		"""Call a C convention function; each argument is one 3 byte slot
+		Returns the cycles taken"""
+		c = self.cpu
+		target = self.image[name] if isinstance(name, str) else name
+		sp = c.spl
+		for a in reversed(args):
+			self.push(a)
+		self.push(RETURN)
+		c.adl = 1
+		c.halted = False
+		c.pc = target
+		start = c.cycles
+		c.run(cycles=start + f92.us(limit_us), until=RETURN)
+		if c.pc != RETURN:
+			c.spl = sp
+			raise Timeout("%s did not return in %dus" % (name, limit_us))
+		c.spl = sp
+		return c.cycles - start
+
+	def idle(self, us):
+		"""Run the harness's HALT loop with interrupts on"""
+		try:
+			self.call("_bench_halt", limit_us=us)
+		except Timeout:
+			pass
+
+	def hl(self):
+		return self.cpu.xr[0]
+
+	def vector_target(self, vector):
+		"""Where IM 2 goes for a vector: its entry in the first jump table"""
+		a = (self.cpu.i << 8) | vector
+		return self.m.mem[a] | (self.m.mem[a + 1] << 8)
+
+def dword(v):
+	"""A DWORD argument as its two slots, low 24 bits first"""
+	return (v & 0xFFFFFF, (v >> 24) & 0xFF)
+
+def kbs(nbytes, cycles):
+	return nbytes / 1024.0 / (cycles / float(f92.CLOCK))
+
+# The cases
+#
+def bench_crc32(results, checks, iram):
+	m = Machine(iram)
+	rnd = random.Random(1)
+	data = bytes(rnd.randrange(256) for _ in range(4096))
+	m.m.mem[BUFFER:BUFFER + len(data)] = data
+	lo, hi = dword(0xFFFFFFFF)
+	cycles = m.call("_crc32_block", lo, hi, BUFFER, len(data))
+	crc = (((m.cpu.de & 0xFF) << 24) | (m.hl() & 0xFFFFFF)) ^ 0xFFFFFFFF
+	checks.append(("crc32_block matches zlib", crc == zlib.crc32(data) & 0xFFFFFFFF))
+	results["crc32_block cycles/byte"] = round(cycles / float(len(data)), 2)
+
+def bench_sd(results, checks, iram, read_us, busy_us):
+	rnd = random.Random(2)
+	disk = bytearray(rnd.randrange(256) for _ in range(64 * 512))
+	card = SDCard(disk, read_us=read_us, busy_us=busy_us)
+	m = Machine(iram, card)
+	m.call("_init_spi")
+	cycles = m.call("_SD_init")
+	checks.append(("SD_init succeeds", m.cpu.a == 0))
+	results["SD_init us"] = round(f92.to_us(cycles))
+
+	for n in (1, 8):
+		lo, hi = dword(4)
+		cycles = m.call("_SD_readBlocks", lo, hi, BUFFER, n)
+		ok = m.cpu.a == 0 and m.m.mem[BUFFER:BUFFER + n * 512] == disk[4 * 512:(4 + n) * 512]
+		checks.append(("SD_readBlocks %d block(s) reads the image" % n, ok))
+		results["SD_readBlocks x%d cycles" % n] = cycles
+		results["SD_readBlocks x%d KB/s" % n] = round(kbs(n * 512, cycles), 1)
+
+	for n in (1, 8):
+		data = bytes(rnd.randrange(256) for _ in range(n * 512))
+		m.m.mem[BUFFER:BUFFER + len(data)] = data
+		lo, hi = dword(16)
+		cycles = m.call("_SD_writeBlocks", lo, hi, BUFFER, n)
+		ok = m.cpu.a == 0
+		flush = m.call("_SD_flush")
+		ok = ok and m.cpu.a == 0 and card.data[16 * 512:(16 + n) * 512] == data
+		checks.append(("SD_writeBlocks %d block(s) writes the image" % n, ok))
+		results["SD_writeBlocks x%d cycles" % n] = cycles
+		results["SD_writeBlocks x%d KB/s, with SD_flush" % n] = round(kbs(n * 512, cycles + flush), 1)
+	counters = m.image["_sd_counters"]
+	timeouts = m.m.mem[counters + 6:counters + 12]
+	checks.append(("no SD waits timed out", not any(timeouts)))
+
+def bench_isr(results, checks, iram):
+	m = Machine(iram)
+	c = m.cpu
+	c.calls = []
+	c.inclusive = {}
+	before = m.vdp.vblanks
+	m.idle(f92.to_us((before + 6) * m.vdp.vblank_period - c.cycles) + 1000)
+	vblank = c.inclusive.get(m.vector_target(PORTB1_IVECT), [0, 0])
+	checks.append(("VBLANK taken once for each edge", vblank[0] == m.vdp.vblanks - before == 6))
+	if vblank[0]:
+		results["VBLANK handler cycles"] = vblank[1] // vblank[0]
+	c.inclusive = {}
+	m.call("_bench_query", 0x86, 0x10)
+	uart = c.inclusive.get(m.vector_target(UART0_IVECT), [0, 0])
+	checks.append(("UART0 interrupt for every byte of the mode packet", uart[0] == 10))
+	if uart[0]:
+		results["UART0 handler cycles/byte"] = uart[1] // uart[0]
+	checks.append(("mode packet parsed", m.peek("_scrwidth", 2) == 640 and m.peek("_scrmode") == 0))
+
+def bench_round_trips(results, checks, iram, budget_us):
+	"""The cursor query and the general poll against the budget, at latencies and baud rates"""
+	cases = [
+		(0, 1152000, 1152000, True),
+		(100, 1152000, 1152000, True),
+		(1000, 1152000, 1152000, True),
+		(100, 384000, 384000, True),
+		(budget_us * 2, 1152000, 1152000, False),	# Too slow: must show as over budget
+		(100, 384000, 1152000, False),			# Baud rates differ: no reply at all
+	]
+	for latency, vdp_baud, uart_baud, expect in cases:
+		m = Machine(iram, latency_us=latency, vdp_baud=vdp_baud, uart_baud=uart_baud)
+		name = "%dus VDP at %d, UART0 at %d" % (latency, vdp_baud, uart_baud)
+		try:
+			cycles = m.call("_bench_query", 0x82, VDPP_FLAG_CURSOR, limit_us=budget_us)
+			rt = f92.to_us(cycles)
+			within = True
+		except Timeout:
+			rt = None
+			within = False
+		results["cursor round trip us, " + name] = round(rt) if rt is not None else None
+		checks.append(("cursor round trip %s budget, %s" % ("within" if expect else "over", name), within == expect))
+		if expect:
+			trips = m.vdp.vdp.requests.get(0x82, 0)
+			checks.append(("one request and one reply, " + name, trips == 1 and len(m.vdp.log) == 1))
+			try:
+				cycles = m.call("_bench_gp", 1, limit_us=budget_us)
+				results["general poll round trip us, " + name] = round(f92.to_us(cycles))
+				checks.append(("general poll echoed, " + name, m.peek("_gp") == 1))
+			except Timeout:
+				checks.append(("general poll echoed, " + name, False))
+
+def run(args):
+	results = {}
+	checks = []
+	for iram in (True, False):
+		r = {}
+		bench_crc32(r, checks, iram)
+		bench_sd(r, checks, iram, args.read_us, args.busy_us)
+		bench_isr(r, checks, iram)
+		if iram:
+			bench_round_trips(r, checks, iram, args.budget)
+		results["iram_install" if iram else "iram_bypass"] = r
+	return results, checks
+
+def main():
+	p = argparse.ArgumentParser(description="Time the MOS assembler routines on the eZ80F92 model")
+	p.add_argument("--json", action="store_true", help="Print the figures as JSON")
+	p.add_argument("--save", help="Write the figures to this file")
+	p.add_argument("--check", help="Fail if any figure is worse than in this file")
+	p.add_argument("--tolerance", type=float, default=2.0, help="Percent a figure may grow by for --check")
+	p.add_argument("--budget", type=int, default=20000, help="Round trip budget in microseconds")
+	p.add_argument("--read-us", dest="read_us", type=int, default=100, help="SD card read latency")
+	p.add_argument("--busy-us", dest="busy_us", type=int, default=500, help="SD card programming time per block")
+	args = p.parse_args()
+	try:
+		results, checks = run(args)
+	except (AsmError, CPUError) as e:
+		print("bench: %s" % e, file=sys.stderr)
+		return 1
+
+	if args.check:
+		with open(args.check) as f:
+			base = json.load(f)
+		for mode, r in results.items():
+			for k, v in r.items():
+				old = base.get(mode, {}).get(k)
+				if old is None or v is None:
+					continue
+				worse = v < old if "KB/s" in k else v > old
+				if worse and abs(v - old) > abs(old) * args.tolerance / 100.0:
+					checks.append(("%s: %s was %s, now %s" % (mode, k, old, v), False))
+	if args.save:
+		with open(args.save, "w") as f:
+			json.dump(results, f, indent=1, sort_keys=True)
+
+	if args.json:
+		print(json.dumps(results, indent=1, sort_keys=True))
+	else:
+		keys = sorted(set(k for r in results.values() for k in r))
+		modes = list(results)
+		print("%-56s %14s %14s" % ("", modes[0], modes[1]))
+		for k in keys:
+			print("%-56s %14s %14s" % (k, results[modes[0]].get(k, "-"), results[modes[1]].get(k, "-")))
+	failed = [name for name, ok in checks if not ok]
+	for name in failed:
+		print("FAIL: %s" % name, file=sys.stderr)
+	print("%d checks, %d failed" % (len(checks), len(failed)), file=sys.stderr)
+	return 1 if failed else 0
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,1028 @@
+#
+# Title:	AGON MOS - Host eZ80 model
+# Author:	Agon MOS contributors
+# Created:	17/10/2026
+# Last Updated:	17/10/2026
+#
+# Modinfo:
+#
+# An eZ80 core for running the MOS assembler routines on the host, with a cycle count.
+# It runs the Z80 instruction set with the eZ80 additions (LEA, PEA, MLT, TST, IN0 / OUT0,
+# LD rr,(HL) and (IX+d) forms, MB, STMIX) in ADL and Z80 mode, the .SIS .LIS .SIL .LIL
+# suffixes with mixed-mode CALL, RST, RET and interrupts, and interrupt mode 2.
+#
+# The cycle count is a model, not a measurement: every opcode or operand fetch, memory read
+# or write costs one cycle plus the wait states of the 4K page it falls in (set by the bus,
+# see f92.py), an I/O access costs one cycle, a taken jump, call or return one more, and
+# MLT, the block instructions and an interrupt acknowledge have fixed extra cycles. This
+# is close to the figures in the eZ80 CPU user manual (UM0077) for the common instructions,
+# but not exact for all of them, and it has not been checked against a board; use it to
+# compare one version of a routine with another, not as the time on the Agon.
+
+CARRY = 0x01
+SUBTRACT = 0x02
+PARITY = 0x04
+HALF = 0x10
+ZERO = 0x40
+SIGN = 0x80
+
+SZ = [(v & 0xA8) | (ZERO if v == 0 else 0) for v in range(256)]
+SZP = [SZ[v] | (0 if bin(v).count("1") & 1 else PARITY) for v in range(256)]
+
+SUFFIX_MODES = {0x40: (0, 0), 0x49: (1, 0), 0x52: (0, 1), 0x5B: (1, 1)}
+
+class CPUError(Exception):
+	pass
+
+class Stop(Exception):
+	"""Raised by a trap to end a run"""
+	pass
+
+class CPU:
+	def __init__(self, bus):
+		self.bus = bus
+		self.mem = bus.mem
+		self.ws = bus.ws
+		self.ro = bus.ro
+		self.traps = {}			# PC: function(cpu), run before the instruction there
+		self.profile = None		# PC: cycles, if profiling
+		self.calls = None		# Shadow call stack, if profiling calls
+		self.inclusive = None		# Entry point: [calls, cycles]
+		self.reset()
+		self.build()
+
+	def reset(self):
+		self.a = self.f = 0
+		self.bc = self.de = 0
+		self.xr = [0, 0, 0]		# HL, IX, IY
+		self.spl = self.sps = 0
+		self.pc = 0
+		self.af_ = self.bc_ = self.de_ = self.hl_ = 0
+		self.i = self.r = self.mb = 0
+		self.adl = self.madl = 0
+		self.iff1 = self.iff2 = 0
+		self.im = 0
+		self.halted = False
+		self.inhibit = False
+		self.L = self.IL = 0
+		self.suffixed = False
+		self.ipc = 0
+		self.cycles = 0
+		self.instructions = 0
+		self.irq = False
+
+	# Registers
+	#
+	def get_hl(self):
+		return self.xr[0]
+
+	def set_hl(self, v):
+		self.xr[0] = v
+
+	hl = property(get_hl, set_hl)
+
+	def get_ix(self):
+		return self.xr[1]
+
+	def set_ix(self, v):
+		self.xr[1] = v
+
+	ix = property(get_ix, set_ix)
+
+	def get_iy(self):
+		return self.xr[2]
+
+	def set_iy(self, v):
+		self.xr[2] = v
+
+	iy = property(get_iy, set_iy)
+
+	def get_sp(self):
+		return self.spl if self.adl else self.sps
+
+	def set_sp(self, v):
+		if self.adl:
+			self.spl = v & 0xFFFFFF
+		else:
+			self.sps = v & 0xFFFF
+
+	sp = property(get_sp, set_sp)
+
+	def mask(self):
+		return 0xFFFFFF if self.L else 0xFFFF
+
+	def g8(self, r, x):
+		if r == 7:
+			return self.a
+		if r < 2:
+			return (self.bc >> 8) & 0xFF if r == 0 else self.bc & 0xFF
+		if r < 4:
+			return (self.de >> 8) & 0xFF if r == 2 else self.de & 0xFF
+		v = self.xr[x]
+		return (v >> 8) & 0xFF if r == 4 else v & 0xFF
+
+	def s8(self, r, x, v):
+		if r == 7:
+			self.a = v
+		elif r == 0:
+			self.bc = (self.bc & 0xFF00FF) | (v << 8)
+		elif r == 1:
+			self.bc = (self.bc & 0xFFFF00) | v
+		elif r == 2:
+			self.de = (self.de & 0xFF00FF) | (v << 8)
+		elif r == 3:
+			self.de = (self.de & 0xFFFF00) | v
+		elif r == 4:
+			self.xr[x] = (self.xr[x] & 0xFF00FF) | (v << 8)
+		else:
+			self.xr[x] = (self.xr[x] & 0xFFFF00) | v
+
+	def grp(self, p, x):
+		"""Register pair p (BC, DE, HL, SP), with HL replaced by IX or IY"""
+		if p == 0:
+			return self.bc
+		if p == 1:
+			return self.de
+		if p == 2:
+			return self.xr[x]
+		return self.spl if self.L else self.sps
+
+	def srp(self, p, x, v):
+		v &= 0xFFFFFF if self.L else 0xFFFF
+		if p == 0:
+			self.bc = v
+		elif p == 1:
+			self.de = v
+		elif p == 2:
+			self.xr[x] = v
+		elif self.L:
+			self.spl = v
+		else:
+			self.sps = v
+
+	# Memory and I/O
+	#
+	def ad(self, x):
+		"""The 24-bit address for x, by the data width of the instruction"""
+		return x & 0xFFFFFF if self.L else (self.mb << 16) | (x & 0xFFFF)
+
+	def rd(self, a):
+		self.cycles += self.ws[a >> 12]
+		return self.mem[a]
+
+	def wr(self, a, v):
+		self.cycles += self.ws[a >> 12]
+		if not self.ro[a >> 12]:
+			self.mem[a] = v
+
+	def rdw(self, a):
+		"""Read a word at address a: 3 bytes if L, else 2"""
+		v = self.rd(a) | (self.rd((a + 1) & 0xFFFFFF) << 8)
+		if self.L:
+			v |= self.rd((a + 2) & 0xFFFFFF) << 16
+		return v
+
+	def wrw(self, a, v):
+		self.wr(a, v & 0xFF)
+		self.wr((a + 1) & 0xFFFFFF, (v >> 8) & 0xFF)
+		if self.L:
+			self.wr((a + 2) & 0xFFFFFF, (v >> 16) & 0xFF)
+
+	def fetch(self):
+		pc = self.pc
+		if self.adl:
+			self.pc = (pc + 1) & 0xFFFFFF
+		else:
+			self.pc = (pc + 1) & 0xFFFF
+			pc |= self.mb << 16
+		self.cycles += self.ws[pc >> 12]
+		return self.mem[pc]
+
+	def fetch_d(self):
+		d = self.fetch()
+		return d - 256 if d & 0x80 else d
+
+	def fetch_nn(self):
+		v = self.fetch() | (self.fetch() << 8)
+		if self.IL:
+			v |= self.fetch() << 16
+		return v
+
+	def io_in(self, port):
+		self.cycles += 1
+		return self.bus.io_read(port & 0xFFFF, self.cycles)
+
+	def io_out(self, port, v):
+		self.cycles += 1
+		self.bus.io_write(port & 0xFFFF, v, self.cycles)
+
+	# Stack
+	#
+	def push_byte(self, v, long):
+		if long:
+			self.spl = (self.spl - 1) & 0xFFFFFF
+			self.wr(self.spl, v & 0xFF)
+		else:
+			self.sps = (self.sps - 1) & 0xFFFF
+			self.wr((self.mb << 16) | self.sps, v & 0xFF)
+
+	def pop_byte(self, long):
+		if long:
+			v = self.rd(self.spl)
+			self.spl = (self.spl + 1) & 0xFFFFFF
+		else:
+			v = self.rd((self.mb << 16) | self.sps)
+			self.sps = (self.sps + 1) & 0xFFFF
+		return v
+
+	def push(self, v):
+		if self.L:
+			self.push_byte(v >> 16, True)
+		self.push_byte(v >> 8, self.L)
+		self.push_byte(v, self.L)
+
+	def pop(self):
+		v = self.pop_byte(self.L)
+		v |= self.pop_byte(self.L) << 8
+		if self.L:
+			v |= self.pop_byte(True) << 16
+		return v
+
+	# Control transfer
+	#
+	def jump(self, target):
+		if self.suffixed:
+			self.adl = self.IL
+		self.pc = target & (0xFFFFFF if self.adl else 0xFFFF)
+		self.cycles += 1
+
+	def call(self, target, mixed=None):
+		"""Push the return address and jump; mixed follows the suffix, or MADL for interrupts"""
+		if mixed is None:
+			mixed = self.suffixed
+		if self.calls is not None:
+			self.note_call(target)
+		if self.adl:
+			self.push_byte(self.pc >> 16, True)
+		self.push_byte(self.pc >> 8, self.adl)
+		self.push_byte(self.pc, self.adl)
+		if mixed:
+			self.push_byte(self.adl, True)
+			self.adl = self.IL
+		self.pc = target & (0xFFFFFF if self.adl else 0xFFFF)
+		self.cycles += 1
+
+	def ret(self, mixed=None):
+		if mixed is None:
+			mixed = self.suffixed
+		if mixed:
+			self.adl = self.pop_byte(True) & 1
+		pc = self.pop_byte(self.adl)
+		pc |= self.pop_byte(self.adl) << 8
+		if self.adl:
+			pc |= self.pop_byte(True) << 16
+		self.pc = pc
+		self.cycles += 2
+		if self.calls is not None:
+			self.note_return()
+
+	def interrupt(self, vector):
+		self.halted = False
+		self.iff1 = self.iff2 = 0
+		self.cycles += 2
+		self.suffixed = False
+		if self.im == 2:
+			self.IL = self.L = 1 if self.madl else self.adl
+			table = ((self.i << 8) | vector) & 0xFFFFFF
+			lo = self.rd(table)
+			hi = self.rd((table + 1) & 0xFFFFFF)
+			target = lo | (hi << 8)
+			self.call(target, bool(self.madl))
+		else:
+			self.IL = self.L = 1 if self.madl else self.adl
+			self.call(0x38, bool(self.madl))
+
+	# Profiling
+	#
+	def note_call(self, target):
+		self.calls.append((target, self.cycles, self.spl, self.sps))
+
+	def note_return(self):
+		"""Close every call whose return address is now off both stacks"""
+		while self.calls and self.spl >= self.calls[-1][2] and self.sps >= self.calls[-1][3]:
+			target, start, _, _ = self.calls.pop()
+			rec = self.inclusive.setdefault(target, [0, 0])
+			rec[0] += 1
+			rec[1] += self.cycles - start
+
+	# Running
+	#
+	def step(self):
+		self.ipc = self.pc
+		self.L = self.IL = self.adl
+		self.suffixed = False
+		op = self.fetch()
+		self.main[op](op, 0)
+		self.instructions += 1
+
+	def run(self, cycles=None, until=None):
+		"""Run until a trap raises Stop, the cycle count reaches cycles, or PC is until"""
+		bus = self.bus
+		traps = self.traps
+		limit = cycles if cycles is not None else float("inf")
+		profile = self.profile
+		try:
+			while True:
+				if self.cycles >= bus.next_event:
+					bus.run_events(self.cycles)
+				if self.irq and self.iff1 and not self.inhibit:
+					v = bus.acknowledge()
+					if v is not None:
+						self.interrupt(v)
+				self.inhibit = False
+				if self.halted:
+					if bus.next_event == float("inf"):
+						raise CPUError("Halted with no interrupt to come at %06X" % self.pc)
+					self.cycles = max(self.cycles, min(bus.next_event, limit))
+					if self.cycles >= limit:
+						return
+					continue
+				pc = self.pc
+				if pc == until:
+					return
+				if pc in traps:
+					traps[pc](self)
+					if self.pc != pc:
+						continue
+				if self.cycles >= limit:
+					return
+				if profile is not None:
+					start = self.cycles
+					self.step()
+					profile[pc] = profile.get(pc, 0) + self.cycles - start
+				else:
+					self.step()
+		except Stop:
+			return
+
+	# Instruction tables
+	#
+	def build(self):
+		m = [self.op_bad] * 256
+		for op in range(256):
+			x, y, z = op >> 6, (op >> 3) & 7, op & 7
+			p, q = y >> 1, y & 1
+			if x == 0:
+				if z == 0:
+					m[op] = [self.op_nop, self.op_exaf, self.op_djnz, self.op_jr][y] if y < 4 else self.op_jrcc
+				elif z == 1:
+					m[op] = self.op_ldrpnn if q == 0 else self.op_addhl
+				elif z == 2:
+					m[op] = self.op_ldind
+				elif z == 3:
+					m[op] = self.op_incdecrp
+				elif z == 4 or z == 5:
+					m[op] = self.op_incdec8
+				elif z == 6:
+					m[op] = self.op_ld8n
+				else:
+					m[op] = self.op_accflags
+			elif x == 1:
+				m[op] = self.op_halt if op == 0x76 else self.op_ld8
+			elif x == 2:
+				m[op] = self.op_alur
+			else:
+				if z == 0:
+					m[op] = self.op_retcc
+				elif z == 1:
+					m[op] = self.op_pop if q == 0 else [self.op_ret, self.op_exx, self.op_jphl, self.op_ldsphl][p]
+				elif z == 2:
+					m[op] = self.op_jpcc
+				elif z == 3:
+					m[op] = [self.op_jp, self.op_cb, self.op_outna, self.op_inan, self.op_exsphl,
+						 self.op_exdehl, self.op_di, self.op_ei][y]
+				elif z == 4:
+					m[op] = self.op_callcc
+				elif z == 5:
+					m[op] = self.op_push if q == 0 else [self.op_call, self.op_index, self.op_ed, self.op_index][p]
+				elif z == 6:
+					m[op] = self.op_alun
+				else:
+					m[op] = self.op_rst
+		for op in SUFFIX_MODES:
+			m[op] = self.op_suffix
+		self.main = m
+
+	def op_bad(self, op, x):
+		raise CPUError("Unimplemented opcode %02X at %06X" % (op, self.ipc))
+
+	def op_suffix(self, op, x):
+		if x:
+			raise CPUError("Suffix after an index prefix at %06X" % self.ipc)
+		L, IL = SUFFIX_MODES[op]
+		self.L, self.IL = L, IL
+		self.suffixed = True
+		op = self.fetch()
+		if op in SUFFIX_MODES:
+			raise CPUError("Two suffixes at %06X" % self.ipc)
+		self.main[op](op, 0)
+
+	def op_index(self, op, x):
+		x = 1 if op == 0xDD else 2
+		op = self.fetch()
+		if op in (0xDD, 0xFD, 0xED):
+			raise CPUError("Prefix %02X after an index prefix at %06X" % (op, self.ipc))
+		# eZ80 loads of register pairs through (IX+d) / (IY+d)
+		if op in (0x07, 0x17, 0x27, 0x37, 0x31):
+			d = self.fetch_d()
+			v = self.rdw(self.ad(self.xr[x] + d))
+			if op == 0x37:
+				self.xr[x] = v
+			elif op == 0x31:
+				self.xr[3 - x] = v
+			else:
+				self.srp(op >> 4, 0, v)
+			return
+		if op in (0x0F, 0x1F, 0x2F, 0x3F, 0x3E):
+			d = self.fetch_d()
+			if op == 0x3F:
+				v = self.xr[x]
+			elif op == 0x3E:
+				v = self.xr[3 - x]
+			else:
+				v = self.grp(op >> 4, 0)
+			self.wrw(self.ad(self.xr[x] + d), v)
+			return
+		self.main[op](op, x)
+
+	def ea(self, x):
+		"""The address for (HL), or (IX+d) / (IY+d) with its displacement fetched"""
+		if x == 0:
+			return self.ad(self.xr[0])
+		d = self.fetch_d()
+		return self.ad(self.xr[x] + d)
+
+	def op_nop(self, op, x):
+		pass
+
+	def op_exaf(self, op, x):
+		af = (self.a << 8) | self.f
+		self.a, self.f = self.af_ >> 8, self.af_ & 0xFF
+		self.af_ = af
+
+	def op_exx(self, op, x):
+		self.bc, self.bc_ = self.bc_, self.bc
+		self.de, self.de_ = self.de_, self.de
+		self.xr[0], self.hl_ = self.hl_, self.xr[0]
+
+	def op_djnz(self, op, x):
+		d = self.fetch_d()
+		b = (((self.bc >> 8) & 0xFF) - 1) & 0xFF
+		self.bc = (self.bc & 0xFF00FF) | (b << 8)
+		self.cycles += 1
+		if b:
+			self.pc = (self.pc + d) & (0xFFFFFF if self.adl else 0xFFFF)
+			self.cycles += 1
+
+	def op_jr(self, op, x):
+		d = self.fetch_d()
+		self.pc = (self.pc + d) & (0xFFFFFF if self.adl else 0xFFFF)
+		self.cycles += 1
+
+	def cond(self, c):
+		f = self.f
+		if c == 0:
+			return not f & ZERO
+		if c == 1:
+			return f & ZERO
+		if c == 2:
+			return not f & CARRY
+		if c == 3:
+			return f & CARRY
+		if c == 4:
+			return not f & PARITY
+		if c == 5:
+			return f & PARITY
+		if c == 6:
+			return not f & SIGN
+		return f & SIGN
+
+	def op_jrcc(self, op, x):
+		d = self.fetch_d()
+		if self.cond((op >> 3) & 3):
+			self.pc = (self.pc + d) & (0xFFFFFF if self.adl else 0xFFFF)
+			self.cycles += 1
+
+	def op_ldrpnn(self, op, x):
+		self.srp((op >> 4) & 3, x, self.fetch_nn())
+
+	def op_addhl(self, op, x):
+		a = self.xr[x]
+		b = self.grp((op >> 4) & 3, x)
+		mask = self.mask()
+		a &= mask
+		b &= mask
+		r = a + b
+		self.f = (self.f & (SIGN | ZERO | PARITY)) | (((a ^ b ^ r) >> 8) & HALF) | (1 if r > mask else 0)
+		self.xr[x] = r & mask
+		self.cycles += 1
+
+	def op_ldind(self, op, x):
+		p, q = (op >> 4) & 3, (op >> 3) & 1
+		if p == 0 or p == 1:
+			a = self.ad(self.bc if p == 0 else self.de)
+			if q:
+				self.a = self.rd(a)
+			else:
+				self.wr(a, self.a)
+		elif p == 2:
+			a = self.ad(self.fetch_nn())
+			if q:
+				self.xr[x] = self.rdw(a)
+			else:
+				self.wrw(a, self.xr[x])
+		else:
+			a = self.ad(self.fetch_nn())
+			if q:
+				self.a = self.rd(a)
+			else:
+				self.wr(a, self.a)
+
+	def op_incdecrp(self, op, x):
+		p = (op >> 4) & 3
+		d = -1 if op & 8 else 1
+		self.srp(p, x, self.grp(p, x) + d)
+
+	def inc8(self, v):
+		r = (v + 1) & 0xFF
+		self.f = (self.f & CARRY) | SZ[r] | (HALF if (v & 0xF) == 0xF else 0) | (PARITY if v == 0x7F else 0)
+		return r
+
+	def dec8(self, v):
+		r = (v - 1) & 0xFF
+		self.f = (self.f & CARRY) | SZ[r] | SUBTRACT | (HALF if (v & 0xF) == 0 else 0) | (PARITY if v == 0x80 else 0)
+		return r
+
+	def op_incdec8(self, op, x):
+		y = (op >> 3) & 7
+		f = self.dec8 if op & 1 else self.inc8
+		if y == 6:
+			a = self.ea(x)
+			self.wr(a, f(self.rd(a)))
+		else:
+			self.s8(y, x, f(self.g8(y, x)))
+
+	def op_ld8n(self, op, x):
+		y = (op >> 3) & 7
+		if y == 6:
+			a = self.ea(x)
+			self.wr(a, self.fetch())
+		else:
+			self.s8(y, x, self.fetch())
+
+	def op_accflags(self, op, x):
+		y = (op >> 3) & 7
+		a, f = self.a, self.f
+		keep = f & (SIGN | ZERO | PARITY)
+		if y == 0:
+			c = a >> 7
+			self.a = ((a << 1) | c) & 0xFF
+			self.f = keep | c
+		elif y == 1:
+			c = a & 1
+			self.a = (a >> 1) | (c << 7)
+			self.f = keep | c
+		elif y == 2:
+			c = a >> 7
+			self.a = ((a << 1) | (f & 1)) & 0xFF
+			self.f = keep | c
+		elif y == 3:
+			c = a & 1
+			self.a = (a >> 1) | ((f & 1) << 7)
+			self.f = keep | c
+		elif y == 4:
+			corr, c = 0, f & CARRY
+			if f & HALF or (a & 0xF) > 9:
+				corr |= 6
+			if c or a > 0x99:
+				corr |= 0x60
+				c = 1
+			if f & SUBTRACT:
+				h = f & HALF and (a & 0xF) < 6
+				r = (a - corr) & 0xFF
+			else:
+				h = (a & 0xF) > 9
+				r = (a + corr) & 0xFF
+			self.a = r
+			self.f = SZP[r] | (f & SUBTRACT) | c | (HALF if h else 0)
+		elif y == 5:
+			self.a = a ^ 0xFF
+			self.f = f | HALF | SUBTRACT
+		elif y == 6:
+			self.f = keep | CARRY
+		else:
+			self.f = keep | ((f & CARRY) << 4) | (f & CARRY ^ 1)
+
+	def op_halt(self, op, x):
+		self.halted = True
+
+	def op_ld8(self, op, x):
+		y, z = (op >> 3) & 7, op & 7
+		if z == 6:
+			self.s8(y, 0, self.rd(self.ea(x)))
+		elif y == 6:
+			a = self.ea(x)
+			self.wr(a, self.g8(z, 0))
+		else:
+			self.s8(y, x, self.g8(z, x))
+
+	def alu(self, y, v):
+		a = self.a
+		if y <= 1:
+			r = a + v + (self.f & CARRY if y == 1 else 0)
+			self.f = SZ[r & 0xFF] | ((a ^ v ^ r) & HALF) | (((a ^ ~v) & (a ^ r) & 0x80) >> 5) | (r >> 8)
+			self.a = r & 0xFF
+		elif y == 2 or y == 3 or y == 7:
+			r = a - v - (self.f & CARRY if y == 3 else 0)
+			self.f = SZ[r & 0xFF] | ((a ^ v ^ r) & HALF) | (((a ^ v) & (a ^ r) & 0x80) >> 5) | SUBTRACT | ((r >> 8) & 1)
+			if y != 7:
+				self.a = r & 0xFF
+		elif y == 4:
+			self.a = a & v
+			self.f = SZP[self.a] | HALF
+		elif y == 5:
+			self.a = a ^ v
+			self.f = SZP[self.a]
+		else:
+			self.a = a | v
+			self.f = SZP[self.a]
+
+	def op_alur(self, op, x):
+		z = op & 7
+		self.alu((op >> 3) & 7, self.rd(self.ea(x)) if z == 6 else self.g8(z, x))
+
+	def op_alun(self, op, x):
+		self.alu((op >> 3) & 7, self.fetch())
+
+	def op_retcc(self, op, x):
+		self.cycles += 1
+		if self.cond((op >> 3) & 7):
+			self.ret()
+
+	def op_ret(self, op, x):
+		self.ret()
+
+	def op_pop(self, op, x):
+		p = (op >> 4) & 3
+		v = self.pop()
+		if p == 3:
+			self.a, self.f = (v >> 8) & 0xFF, v & 0xFF
+		else:
+			self.srp(p, x, v)
+
+	def op_push(self, op, x):
+		p = (op >> 4) & 3
+		if p == 3:
+			v = (self.a << 8) | self.f
+		else:
+			v = self.grp(p, x)
+		self.push(v)
+
+	def op_jphl(self, op, x):
+		self.jump(self.xr[x])
+
+	def op_ldsphl(self, op, x):
+		self.srp(3, 0, self.xr[x])
+
+	def op_jpcc(self, op, x):
+		t = self.fetch_nn()
+		if self.cond((op >> 3) & 7):
+			self.jump(t)
+
+	def op_jp(self, op, x):
+		self.jump(self.fetch_nn())
+
+	def op_outna(self, op, x):
+		n = self.fetch()
+		self.io_out((self.a << 8) | n, self.a)
+
+	def op_inan(self, op, x):
+		n = self.fetch()
+		self.a = self.io_in((self.a << 8) | n)
+
+	def op_exsphl(self, op, x):
+		a = self.ad(self.spl if self.L else self.sps)
+		v = self.rdw(a)
+		self.wrw(a, self.xr[x])
+		self.xr[x] = v
+		self.cycles += 1
+
+	def op_exdehl(self, op, x):
+		self.de, self.xr[0] = self.xr[0], self.de
+
+	def op_di(self, op, x):
+		self.iff1 = self.iff2 = 0
+
+	def op_ei(self, op, x):
+		self.iff1 = self.iff2 = 1
+		self.inhibit = True
+
+	def op_callcc(self, op, x):
+		t = self.fetch_nn()
+		if self.cond((op >> 3) & 7):
+			self.call(t)
+
+	def op_call(self, op, x):
+		self.call(self.fetch_nn())
+
+	def op_rst(self, op, x):
+		self.call(op & 0x38)
+
+	# CB prefix
+	#
+	def rot(self, y, v):
+		f = self.f
+		if y == 0:
+			c = v >> 7
+			r = ((v << 1) | c) & 0xFF
+		elif y == 1:
+			c = v & 1
+			r = (v >> 1) | (c << 7)
+		elif y == 2:
+			c = v >> 7
+			r = ((v << 1) | (f & 1)) & 0xFF
+		elif y == 3:
+			c = v & 1
+			r = (v >> 1) | ((f & 1) << 7)
+		elif y == 4:
+			c = v >> 7
+			r = (v << 1) & 0xFF
+		elif y == 5:
+			c = v & 1
+			r = (v >> 1) | (v & 0x80)
+		elif y == 7:
+			c = v & 1
+			r = v >> 1
+		else:
+			raise CPUError("Unimplemented opcode CB %02X at %06X" % (0x30 + (v & 7), self.ipc))
+		self.f = SZP[r] | c
+		return r
+
+	def op_cb(self, op, x):
+		if x:
+			a = self.ad(self.xr[x] + self.fetch_d())
+			op = self.fetch()
+			z = 6
+		else:
+			op = self.fetch()
+			z = op & 7
+			a = self.ad(self.xr[0]) if z == 6 else None
+		kind, y = op >> 6, (op >> 3) & 7
+		v = self.rd(a) if z == 6 else self.g8(z, 0)
+		if kind == 1:
+			b = v & (1 << y)
+			self.f = (self.f & CARRY) | HALF | (ZERO | PARITY if not b else 0) | (SIGN if y == 7 and b else 0)
+			return
+		if kind == 0:
+			r = self.rot(y, v)
+		elif kind == 2:
+			r = v & ~(1 << y)
+		else:
+			r = v | (1 << y)
+		if z == 6:
+			self.wr(a, r)
+		else:
+			self.s8(z, 0, r)
+
+	# ED prefix
+	#
+	def op_ed(self, op, x):
+		op = self.fetch()
+		hi, z = op >> 6, op & 7
+		y = (op >> 3) & 7
+		if hi == 0:
+			if z == 0:
+				n = self.fetch()
+				v = self.io_in(n)
+				self.f = (self.f & CARRY) | SZP[v]
+				if y != 6:
+					self.s8(y, 0, v)
+				return
+			if z == 1 and y != 6:
+				self.io_out(self.fetch(), self.g8(y, 0))
+				return
+			if z == 4:
+				v = self.rd(self.ad(self.xr[0])) if y == 6 else self.g8(y, 0)
+				r = self.a & v
+				self.f = SZP[r] | HALF
+				return
+			if op in (0x02, 0x03, 0x12, 0x13, 0x22, 0x23, 0x32, 0x33):
+				src = 1 if z == 2 else 2
+				d = self.fetch_d()
+				v = (self.xr[src] + d) & self.mask()
+				if op == 0x32:
+					self.xr[1] = v
+				elif op == 0x33:
+					self.xr[2] = v
+				else:
+					self.srp(y >> 1, 0, v)
+				return
+			if op in (0x07, 0x17, 0x27, 0x37, 0x31):
+				v = self.rdw(self.ad(self.xr[0]))
+				if op == 0x37:
+					self.xr[1] = v
+				elif op == 0x31:
+					self.xr[2] = v
+				else:
+					self.srp(op >> 4, 0, v)
+				return
+			if op in (0x0F, 0x1F, 0x2F, 0x3F, 0x3E):
+				if op == 0x3F:
+					v = self.xr[1]
+				elif op == 0x3E:
+					v = self.xr[2]
+				else:
+					v = self.grp(op >> 4, 0)
+				self.wrw(self.ad(self.xr[0]), v)
+				return
+			if op == 0x34:
+				r = self.a & self.rd(self.ad(self.xr[0]))
+				self.f = SZP[r] | HALF
+				return
+		elif hi == 1:
+			if z == 0 and y != 6:
+				v = self.io_in(self.bc)
+				self.f = (self.f & CARRY) | SZP[v]
+				self.s8(y, 0, v)
+				return
+			if z == 1 and y != 6:
+				self.io_out(self.bc, self.g8(y, 0))
+				return
+			if z == 2:
+				self.adcsbc(op)
+				return
+			if z == 3:
+				p = y >> 1
+				a = self.ad(self.fetch_nn())
+				if y & 1:
+					self.srp(p, 0, self.rdw(a))
+				else:
+					self.wrw(a, self.grp(p, 0))
+				return
+			if op == 0x44:
+				a = self.a
+				self.a = 0
+				self.alu(2, a)
+				return
+			if op in (0x45, 0x4D):
+				if op == 0x45:
+					self.iff1 = self.iff2
+				self.ret(self.suffixed or None)
+				return
+			if op in (0x46, 0x56, 0x5E):
+				self.im = {0x46: 0, 0x56: 1, 0x5E: 2}[op]
+				return
+			if op == 0x47:
+				self.i = (self.i & 0xFF00) | self.a
+				return
+			if op == 0x4F:
+				self.r = self.a
+				return
+			if op == 0x57:
+				self.a = self.i & 0xFF
+				self.f = (self.f & CARRY) | SZ[self.a] | (PARITY if self.iff2 else 0)
+				return
+			if op == 0x5F:
+				self.a = self.r & 0xFF
+				self.f = (self.f & CARRY) | SZ[self.a] | (PARITY if self.iff2 else 0)
+				return
+			if z == 4 and y & 1:
+				p = y >> 1
+				v = self.grp(p, 0)
+				r = ((v >> 8) & 0xFF) * (v & 0xFF)
+				if p == 3:
+					self.srp(3, 0, r)
+				else:
+					self.srp(p, 0, r)
+				self.cycles += 4
+				return
+			if op in (0x54, 0x55):
+				d = self.fetch_d()
+				src = 2 if op == 0x54 else 1
+				self.xr[3 - src] = (self.xr[src] + d) & self.mask()
+				return
+			if op == 0x64:
+				r = self.a & self.fetch()
+				self.f = SZP[r] | HALF
+				return
+			if op in (0x65, 0x66):
+				d = self.fetch_d()
+				self.push((self.xr[1 if op == 0x65 else 2] + d) & self.mask())
+				return
+			if op == 0x67 or op == 0x6F:
+				a = self.ad(self.xr[0])
+				v = self.rd(a)
+				if op == 0x67:
+					r = ((self.a << 4) | (v >> 4)) & 0xFF
+					self.a = (self.a & 0xF0) | (v & 0x0F)
+				else:
+					r = ((v << 4) | (self.a & 0x0F)) & 0xFF
+					self.a = (self.a & 0xF0) | (v >> 4)
+				self.wr(a, r)
+				self.f = (self.f & CARRY) | SZP[self.a]
+				return
+			if op == 0x6D:
+				if not self.adl:
+					raise CPUError("LD MB,A in Z80 mode at %06X" % self.ipc)
+				self.mb = self.a
+				return
+			if op == 0x6E:
+				self.a = self.mb
+				return
+			if op == 0x74:
+				r = self.io_in(self.bc & 0xFF) & self.fetch()
+				self.f = SZP[r] | HALF
+				return
+			if op == 0x76:
+				self.halted = True
+				return
+			if op == 0x7D:
+				self.madl = 1
+				return
+			if op == 0x7E:
+				self.madl = 0
+				return
+		elif hi == 2:
+			if op in (0xA0, 0xA8, 0xB0, 0xB8):
+				self.block_ld(op)
+				return
+			if op in (0xA1, 0xA9, 0xB1, 0xB9):
+				self.block_cp(op)
+				return
+		else:
+			if op == 0xC7:
+				self.i = self.xr[0] & 0xFFFF
+				return
+			if op == 0xD7:
+				self.xr[0] = (self.mb << 16) | self.i
+				return
+		raise CPUError("Unimplemented opcode ED %02X at %06X" % (op, self.ipc))
+
+	def adcsbc(self, op):
+		mask = self.mask()
+		bits = 24 if self.L else 16
+		a = self.xr[0] & mask
+		b = self.grp((op >> 4) & 3, 0) & mask
+		c = self.f & CARRY
+		top = 1 << (bits - 1)
+		if op & 8:
+			r = a + b + c
+			v = (a ^ ~b) & (a ^ r) & top
+			f = 1 if r > mask else 0
+		else:
+			r = a - b - c
+			v = (a ^ b) & (a ^ r) & top
+			f = SUBTRACT | (1 if r < 0 else 0)
+		h = ((a ^ b ^ r) >> 8) & HALF
+		r &= mask
+		self.f = f | h | (PARITY if v else 0) | (SIGN if r & top else 0) | (ZERO if r == 0 else 0)
+		self.xr[0] = r
+		self.cycles += 1
+
+	def block_ld(self, op):
+		step = -1 if op & 8 else 1
+		repeat = op & 0x10
+		mask = self.mask()
+		bus = self.bus
+		while True:
+			v = self.rd(self.ad(self.xr[0]))
+			self.wr(self.ad(self.de), v)
+			self.xr[0] = (self.xr[0] + step) & mask
+			self.de = (self.de + step) & mask
+			self.bc = (self.bc - 1) & mask
+			self.cycles += 1
+			if not repeat or self.bc == 0:
+				break
+			if self.cycles >= bus.next_event:
+				self.pc = self.ipc
+				break
+		self.f = (self.f & (SIGN | ZERO | CARRY)) | (PARITY if self.bc else 0)
+
+	def block_cp(self, op):
+		step = -1 if op & 8 else 1
+		repeat = op & 0x10
+		mask = self.mask()
+		bus = self.bus
+		c = self.f & CARRY
+		while True:
+			v = self.rd(self.ad(self.xr[0]))
+			r = (self.a - v) & 0xFF
+			self.xr[0] = (self.xr[0] + step) & mask
+			self.bc = (self.bc - 1) & mask
+			self.cycles += 1
+			self.f = SZ[r] | ((self.a ^ v ^ r) & HALF) | SUBTRACT | c | (PARITY if self.bc else 0)
+			if not repeat or self.bc == 0 or r == 0:
+				break
+			if self.cycles >= bus.next_event:
+				self.pc = self.ipc
+				break
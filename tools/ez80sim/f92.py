@@ -0,0 +1,606 @@
+#
+# Title:	AGON MOS - Host eZ80F92 peripheral model
+# Author:	Agon MOS contributors
+# Created:	17/10/2026
+# Last Updated:	17/10/2026
+#
+# Modinfo:
+#
+# The eZ80F92 around the core in cpu.py: the memory map with its wait states, the
+# programmable reload timers, UART0 and UART1, the SPI master, GPIO ports B, C and D with
+# their interrupt modes, and the interrupt controller. Peripherals are updated lazily from
+# the cycle count, and anything that must happen at a time of its own (a timer running out,
+# a byte arriving) is an event on the bus's scheduler.
+#
+# The SD card (sdcard.py) hangs off the SPI with its chip select on PB4, and the VDP
+# stand-in (vdp.py) off UART0 with CTS on PD3, as on the Agon.
+
+import heapq
+
+CLOCK = 18432000		# Agon system clock, Hz
+
+NEVER = float("inf")
+
+# Interrupt vectors
+#
+VECTOR_PRT = 0x0A		# + 2 * timer
+VECTOR_UART0 = 0x18
+VECTOR_UART1 = 0x1A
+VECTOR_I2C = 0x1C
+VECTOR_SPI = 0x1E
+VECTOR_PB = 0x30		# + 2 * bit
+VECTOR_PC = 0x40
+VECTOR_PD = 0x50
+
+def us(t):
+	"""Microseconds to cycles"""
+	return int(round(t * CLOCK / 1000000.0))
+
+def to_us(cycles):
+	return cycles * 1000000.0 / CLOCK
+
+class Bus:
+	"""Memory, I/O dispatch, events and interrupts"""
+
+	def __init__(self):
+		self.mem = bytearray(b"\xFF" * 0x1000000)
+		self.ws = [1] * 4096		# Cycles per access, by 4K page
+		self.ro = bytearray(4096)	# Pages that are flash
+		self.readers = [None] * 256
+		self.writers = [None] * 256
+		self.ports = bytearray(256)	# Registers with no model of their own
+		self.events = []
+		self.seq = 0
+		self.next_event = NEVER
+		self.pending = set()		# Vectors asserted
+		self.cpu = None
+
+	def attach(self, cpu):
+		self.cpu = cpu
+
+	# I/O
+	#
+	def map_io(self, port, reader=None, writer=None):
+		if reader:
+			self.readers[port] = reader
+		if writer:
+			self.writers[port] = writer
+
+	def io_read(self, port, now):
+		if port > 0xFF:
+			return 0xFF
+		r = self.readers[port]
+		return r(port, now) if r else self.ports[port]
+
+	def io_write(self, port, v, now):
+		if port > 0xFF:
+			return
+		w = self.writers[port]
+		if w:
+			w(port, v, now)
+		else:
+			self.ports[port] = v
+
+	# Events
+	#
+	def schedule(self, when, fn):
+		self.seq += 1
+		heapq.heappush(self.events, (when, self.seq, fn))
+		self.next_event = self.events[0][0]
+
+	def run_events(self, now):
+		while self.events and self.events[0][0] <= now:
+			when, _, fn = heapq.heappop(self.events)
+			fn(when)
+		self.next_event = self.events[0][0] if self.events else NEVER
+
+	# Interrupts
+	#
+	def assert_irq(self, vector, on):
+		if on:
+			self.pending.add(vector)
+		else:
+			self.pending.discard(vector)
+		if self.cpu:
+			self.cpu.irq = bool(self.pending)
+
+	def acknowledge(self):
+		"""The vector to serve: the lowest one asserted"""
+		return min(self.pending) if self.pending else None
+
+class MemoryMap:
+	"""Flash, the internal SRAM and the chip selects, with their wait states"""
+
+	def __init__(self, bus):
+		self.bus = bus
+		self.regs = {
+			0xA8: 0x00, 0xA9: 0xFF, 0xAA: 0xE8,	# CS0: all of memory, 7 wait states
+			0xAB: 0x00, 0xAC: 0x00, 0xAD: 0x00,
+			0xAE: 0x00, 0xAF: 0x00, 0xB0: 0x00,
+			0xB1: 0x00, 0xB2: 0x00, 0xB3: 0x00,
+			0xB4: 0x80, 0xB5: 0xFF,			# RAM_CTL, RAM_ADDR_U
+			0xF7: 0x00, 0xF8: 0x88,			# FLASH_ADDR_U, FLASH_CTRL: 4 wait states
+		}
+		for port in self.regs:
+			bus.map_io(port, self.read, self.write)
+		self.update()
+
+	def read(self, port, now):
+		return self.regs[port]
+
+	def write(self, port, v, now):
+		self.regs[port] = v
+		self.update()
+
+	def wait_states(self, addr):
+		"""Wait states and whether it is flash, for an address"""
+		r = self.regs
+		upper = addr >> 16
+		if r[0xB4] & 0x80 and upper == r[0xB5] and addr & 0xFFFF >= 0xE000:
+			return 0, False
+		base = r[0xF7] << 16
+		if r[0xF8] & 0x08 and base <= addr < base + 0x20000:
+			return r[0xF8] >> 5, True
+		for cs in range(4):
+			lbr, ubr, ctl = r[0xA8 + cs * 3], r[0xA9 + cs * 3], r[0xAA + cs * 3]
+			if ctl & 0x08 and not ctl & 0x10 and lbr <= upper <= ubr:
+				return ctl >> 5, False
+		return 0, False
+
+	def update(self):
+		bus = self.bus
+		for page in range(4096):
+			w, flash = self.wait_states(page << 12)
+			bus.ws[page] = 1 + w
+			bus.ro[page] = 1 if flash else 0
+
+	def setup_agon(self):
+		"""The settings init_params_f92.asm makes from the linker's link control file for the Agon"""
+		self.regs.update({0xA8: 0x04, 0xA9: 0x0B, 0xAA: 0x08, 0xB4: 0x80, 0xB5: 0xB7, 0xF7: 0x00, 0xF8: 0x28})
+		self.update()
+
+class Timer:
+	"""A programmable reload timer"""
+
+	def __init__(self, bus, n):
+		self.bus = bus
+		self.n = n
+		self.ctl = 0
+		self.reload = 0
+		self.running = False
+		self.start = 0			# Cycle the count was loaded
+		self.load = 0			# Count loaded
+		self.div = 4
+		self.stopped = 0		# Count when not running
+		self.latch = 0
+		self.flag = 0
+		self.gen = 0			# Invalidates scheduled expiries
+		base = 0x80 + n * 3
+		bus.map_io(base, self.read_ctl, self.write_ctl)
+		bus.map_io(base + 1, self.read_dr_l, self.write_rr_l)
+		bus.map_io(base + 2, self.read_dr_h, self.write_rr_h)
+
+	def count(self, now):
+		if not self.running:
+			return self.stopped
+		c = self.load - (now - self.start) // self.div
+		return max(c, 0) & 0xFFFF
+
+	def arm(self, now):
+		self.gen += 1
+		gen = self.gen
+		self.bus.schedule(self.start + self.load * self.div, lambda t: self.expire(t, gen))
+
+	def expire(self, t, gen):
+		if gen != self.gen or not self.running:
+			return
+		self.flag = 1
+		if self.ctl & 0x10:
+			self.start = t
+			self.load = self.reload or 0x10000
+			self.arm(t)
+		else:
+			self.running = False
+			self.stopped = 0
+			self.ctl &= ~0x01
+		self.update_irq()
+
+	def update_irq(self):
+		self.bus.assert_irq(VECTOR_PRT + 2 * self.n, bool(self.flag and self.ctl & 0x40))
+
+	def read_ctl(self, port, now):
+		v = (self.ctl & 0x7F) | (0x80 if self.flag else 0)
+		self.flag = 0
+		self.update_irq()
+		return v
+
+	def write_ctl(self, port, v, now):
+		was = self.running
+		if was:
+			self.stopped = self.count(now)
+		self.ctl = v & 0x7D
+		self.div = (4, 16, 64, 256)[(v >> 2) & 3]
+		if v & 0x01:
+			if v & 0x02 or not was:
+				self.start = now
+				self.load = self.reload or 0x10000
+				self.running = True
+				self.arm(now)
+			elif was:
+				self.start = now
+				self.load = self.stopped
+				self.running = True
+				self.arm(now)
+		else:
+			self.running = False
+			self.gen += 1
+		self.update_irq()
+
+	def read_dr_l(self, port, now):
+		c = self.count(now)
+		self.latch = c >> 8
+		return c & 0xFF
+
+	def read_dr_h(self, port, now):
+		return self.latch
+
+	def write_rr_l(self, port, v, now):
+		self.reload = (self.reload & 0xFF00) | v
+
+	def write_rr_h(self, port, v, now):
+		self.reload = (self.reload & 0x00FF) | (v << 8)
+
+class UART:
+	"""A UART with its 16 byte FIFOs; peer is whatever is on the other end of the line"""
+
+	FIFO = 16
+
+	def __init__(self, bus, base, vector, name):
+		self.bus = bus
+		self.base = base
+		self.vector = vector
+		self.name = name
+		self.brg = 2
+		self.ier = 0
+		self.fctl = 0
+		self.lctl = 0
+		self.mctl = 0
+		self.spr = 0
+		self.rx = []
+		self.tx = []
+		self.errors = 0			# LSR bits 1-4
+		self.shifting = False
+		self.thre_int = False
+		self.peer = None
+		self.sent = 0
+		self.received = 0
+		self.framing_errors = 0
+		for port in range(base, base + 8):
+			bus.map_io(port, self.read, self.write)
+
+	def baud(self):
+		return CLOCK / (16.0 * max(self.brg, 1))
+
+	def frame_bits(self):
+		bits = 1 + 5 + (self.lctl & 3) + 1
+		if self.lctl & 0x04:
+			bits += 1
+		if self.lctl & 0x08:
+			bits += 1
+		return bits
+
+	def frame_cycles(self):
+		return 16 * max(self.brg, 1) * self.frame_bits()
+
+	def trigger(self):
+		if not self.fctl & 1:
+			return 1
+		return (1, 4, 8, 14)[self.fctl >> 6]
+
+	def update_irq(self):
+		on = bool(self.ier & 0x01 and len(self.rx) >= self.trigger())
+		on = on or bool(self.ier & 0x02 and self.thre_int)
+		on = on or bool(self.ier & 0x04 and self.errors)
+		self.bus.assert_irq(self.vector, on)
+
+	def read(self, port, now):
+		r = port - self.base
+		dlab = self.lctl & 0x80
+		if r == 0:
+			if dlab:
+				return self.brg & 0xFF
+			v = self.rx.pop(0) if self.rx else 0
+			self.update_irq()
+			return v
+		if r == 1:
+			return (self.brg >> 8) if dlab else self.ier
+		if r == 2:
+			fifo = 0xC0 if self.fctl & 1 else 0
+			if self.ier & 0x04 and self.errors:
+				return fifo | 0x06
+			if self.ier & 0x01 and len(self.rx) >= self.trigger():
+				return fifo | 0x04
+			if self.ier & 0x02 and self.thre_int:
+				self.thre_int = False
+				self.update_irq()
+				return fifo | 0x02
+			return fifo | 0x01
+		if r == 3:
+			return self.lctl
+		if r == 4:
+			return self.mctl
+		if r == 5:
+			v = self.errors
+			if self.rx:
+				v |= 0x01
+			if not self.tx:
+				v |= 0x20
+				if not self.shifting:
+					v |= 0x40
+			if self.errors:
+				v |= 0x80
+			self.errors = 0
+			self.update_irq()
+			return v
+		if r == 6:
+			return 0x10 if self.peer and getattr(self.peer, "cts", True) else 0
+		return self.spr
+
+	def write(self, port, v, now):
+		r = port - self.base
+		dlab = self.lctl & 0x80
+		if r == 0:
+			if dlab:
+				self.brg = (self.brg & 0xFF00) | v
+			else:
+				self.transmit(v, now)
+		elif r == 1:
+			if dlab:
+				self.brg = (self.brg & 0x00FF) | (v << 8)
+			else:
+				self.ier = v
+				if v & 0x02 and not self.tx:
+					self.thre_int = True
+				self.update_irq()
+		elif r == 2:
+			self.fctl = v & 0xC1
+			if v & 0x02:
+				self.rx = []
+			if v & 0x04:
+				self.tx = []
+			self.update_irq()
+		elif r == 3:
+			self.lctl = v
+		elif r == 4:
+			self.mctl = v
+		elif r == 7:
+			self.spr = v
+
+	# Transmit
+	#
+	def transmit(self, v, now):
+		depth = self.FIFO if self.fctl & 1 else 1
+		if len(self.tx) >= depth:
+			return			# Lost, as on the chip
+		self.tx.append(v)
+		self.thre_int = False
+		if not self.shifting:
+			self.shift(now)
+		self.update_irq()
+
+	def shift(self, now):
+		b = self.tx.pop(0)
+		self.shifting = True
+		done = now + self.frame_cycles()
+		self.bus.schedule(done, lambda t: self.shifted(t, b))
+		if not self.tx:
+			self.thre_int = True
+
+	def shifted(self, t, b):
+		self.shifting = False
+		self.sent += 1
+		if self.peer:
+			self.peer.uart_receive(b, t, self.baud())
+		if self.tx:
+			self.shift(t)
+		self.update_irq()
+
+	# Receive
+	#
+	def receive(self, b, when, baud):
+		"""A byte from the peer, sent at baud, finishes arriving at when"""
+		self.bus.schedule(when, lambda t: self.arrived(b, baud))
+
+	def arrived(self, b, baud):
+		mine = self.baud()
+		if abs(baud - mine) / mine > 0.03:
+			self.errors |= 0x08
+			self.framing_errors += 1
+			b = 0x00
+		if len(self.rx) >= (self.FIFO if self.fctl & 1 else 1):
+			self.errors |= 0x02
+		else:
+			self.rx.append(b)
+			self.received += 1
+		self.update_irq()
+
+class SPI:
+	"""The SPI master; a byte takes 16 * BRG cycles, and goes to the device whose select is low"""
+
+	def __init__(self, bus):
+		self.bus = bus
+		self.brg = 2
+		self.ctl = 0
+		self.sr = 0
+		self.rbr = 0xFF
+		self.busy_until = None
+		self.out = 0
+		self.devices = []		# (port, bit, device) with device.exchange(byte, when)
+		self.bytes = 0
+		bus.map_io(0xB8, self.read, self.write)
+		bus.map_io(0xB9, self.read, self.write)
+		bus.map_io(0xBA, self.read, self.write)
+		bus.map_io(0xBB, self.read, self.write)
+		bus.map_io(0xBC, self.read, self.write)
+
+	def sync(self, now):
+		if self.busy_until is not None and now >= self.busy_until:
+			when = self.busy_until
+			self.busy_until = None
+			v = 0xFF
+			for port, bit, dev in self.devices:
+				if not port.output_level(bit):
+					v &= dev.exchange(self.out, when)
+			self.rbr = v
+			self.sr |= 0x80
+			self.bytes += 1
+
+	def read(self, port, now):
+		self.sync(now)
+		if port == 0xB8:
+			return self.brg & 0xFF
+		if port == 0xB9:
+			return self.brg >> 8
+		if port == 0xBA:
+			return self.ctl
+		if port == 0xBB:
+			v = self.sr
+			self.sr &= ~0xC0
+			return v
+		return self.rbr
+
+	def write(self, port, v, now):
+		self.sync(now)
+		if port == 0xB8:
+			self.brg = (self.brg & 0xFF00) | v
+		elif port == 0xB9:
+			self.brg = (self.brg & 0x00FF) | (v << 8)
+		elif port == 0xBA:
+			self.ctl = v
+		elif port == 0xBC:
+			if self.busy_until is not None:
+				self.sr |= 0x40		# WCOL
+				return
+			if self.ctl & 0x30 == 0x30:
+				self.out = v
+				self.busy_until = now + 16 * max(self.brg, 1)
+
+class GPIO:
+	"""A GPIO port; pins holds the level driven from outside on each input"""
+
+	def __init__(self, bus, base, vector):
+		self.bus = bus
+		self.base = base
+		self.vector = vector
+		self.dr = 0
+		self.ddr = 0xFF
+		self.alt1 = 0
+		self.alt2 = 0
+		self.pins = 0xFF
+		self.latch = 0			# Edge interrupts latched
+		self.watchers = []		# (bit, function(level, now)) told when an output changes
+		bus.map_io(base, self.read, self.write)
+		bus.map_io(base + 1, self.read, self.write)
+		bus.map_io(base + 2, self.read, self.write)
+		bus.map_io(base + 3, self.read, self.write)
+
+	def mode(self, bit):
+		m = 1 << bit
+		return ((4 if self.alt2 & m else 0) | (2 if self.alt1 & m else 0) | (1 if self.ddr & m else 0))
+
+	def output_level(self, bit):
+		"""The level on a pin, driven by the port if it is an output"""
+		m = 1 << bit
+		if self.mode(bit) == 0:
+			return 1 if self.dr & m else 0
+		return 1 if self.pins & m else 0
+
+	def read(self, port, now):
+		r = port - self.base
+		if r == 0:
+			v = 0
+			for bit in range(8):
+				m = 1 << bit
+				if self.mode(bit) == 0:
+					v |= self.dr & m
+				else:
+					v |= self.pins & m
+			return v
+		return (self.dr, self.ddr, self.alt1, self.alt2)[r]
+
+	def write(self, port, v, now):
+		before = [self.output_level(bit) for bit, fn in self.watchers]
+		self.write_reg(port, v)
+		for (bit, fn), level in zip(self.watchers, before):
+			if self.output_level(bit) != level:
+				fn(1 - level, now)
+		self.update_irq()
+
+	def write_reg(self, port, v):
+		r = port - self.base
+		if r == 0:
+			edge = 0
+			for bit in range(8):
+				if self.mode(bit) == 7:
+					edge |= 1 << bit
+			self.latch &= ~(v & edge)
+			self.dr = (self.dr & edge) | (v & ~edge)
+		elif r == 1:
+			self.ddr = v
+		elif r == 2:
+			self.alt1 = v
+		else:
+			self.alt2 = v
+
+	def set_pin(self, bit, level, now=None):
+		m = 1 << bit
+		old = 1 if self.pins & m else 0
+		self.pins = (self.pins | m) if level else (self.pins & ~m)
+		if self.mode(bit) == 7 and old != level and level == (1 if self.dr & m else 0):
+			self.latch |= m
+		self.update_irq()
+
+	def update_irq(self):
+		for bit in range(8):
+			m = 1 << bit
+			mode = self.mode(bit)
+			if mode == 7:
+				on = bool(self.latch & m)
+			elif mode == 6:
+				on = bool(self.pins & m) == bool(self.dr & m)
+			else:
+				on = False
+			self.bus.assert_irq(self.vector + 2 * bit, on)
+
+class F92:
+	"""An eZ80F92 with the core, the memory map and the peripherals MOS uses"""
+
+	def __init__(self):
+		from cpu import CPU
+		self.bus = Bus()
+		self.memmap = MemoryMap(self.bus)
+		self.timers = [Timer(self.bus, n) for n in range(6)]
+		self.uart0 = UART(self.bus, 0xC0, VECTOR_UART0, "UART0")
+		self.uart1 = UART(self.bus, 0xD0, VECTOR_UART1, "UART1")
+		self.spi = SPI(self.bus)
+		self.pb = GPIO(self.bus, 0x9A, VECTOR_PB)
+		self.pc = GPIO(self.bus, 0x9E, VECTOR_PC)
+		self.pd = GPIO(self.bus, 0xA2, VECTOR_PD)
+		self.cpu = CPU(self.bus)
+		self.bus.attach(self.cpu)
+
+	@property
+	def mem(self):
+		return self.bus.mem
+
+	def now(self):
+		return self.cpu.cycles
+
+	def load(self, image):
+		"""Load an Image from asm.py; flash pages are written past their protection"""
+		image.load(self.bus.mem)
+
+	def attach_sd(self, card):
+		"""Put an SD card on the SPI, selected by PB4"""
+		self.spi.devices.append((self.pb, 4, card))
+		self.pb.watchers.append((4, card.select))
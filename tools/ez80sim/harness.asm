@@ -0,0 +1,87 @@
+;
+; Title:	AGON MOS - Host benchmark harness
+; Author:	Agon MOS contributors
+; Created:	17/10/2026
+; Last Updated:	17/10/2026
+;
+; Modinfo:
+;
+; Linked with the MOS assembler modules by bench.py, to drive them the way the C code does
+
+			INCLUDE	"macros.inc"
+			INCLUDE	"equs.inc"
+
+			.ASSUME	ADL = 1
+
+			SEGMENT CODE
+
+			XDEF	_bench_query
+			XDEF	_bench_gp
+			XDEF	_bench_halt
+
+			XREF	UART0_serial_PUTCH
+			XREF	_vpd_protocol_flags
+			XREF	_gp
+
+; Send VDU 23,0,cmd and wait for the reply, as the vdp_query callers do
+; BYTE bench_query(BYTE cmd, BYTE flag)
+; Returns:
+; - A: The flag, once set by vdp_protocol
+;
+_bench_query:		PUSH	IY
+			LD	IY, 0
+			ADD	IY, SP
+			DI
+			LD	A, (_vpd_protocol_flags)
+			LD	B, (IY+9)
+			CPL
+			OR	A, B
+			CPL
+			LD	(_vpd_protocol_flags), A
+			EI
+			LD	A, 23
+			CALL	UART0_serial_PUTCH
+			XOR	A, A
+			CALL	UART0_serial_PUTCH
+			LD	A, (IY+6)
+			CALL	UART0_serial_PUTCH
+$$:			LD	A, (_vpd_protocol_flags)
+			AND	A, (IY+9)
+			JR	Z, $B
+			LD	SP, IY
+			POP	IY
+			RET
+
+; The general poll handshake of wait_ESP32 in main.c
+; BYTE bench_gp(BYTE n)
+; Returns:
+; - A: n, once the VDP has echoed it
+;
+_bench_gp:		PUSH	IY
+			LD	IY, 0
+			ADD	IY, SP
+			XOR	A, A
+			LD	(_gp), A
+			LD	A, 23
+			CALL	UART0_serial_PUTCH
+			XOR	A, A
+			CALL	UART0_serial_PUTCH
+			LD	A, 80h
+			CALL	UART0_serial_PUTCH
+			LD	A, (IY+6)
+			CALL	UART0_serial_PUTCH
+$$:			LD	A, (_gp)
+			CP	A, (IY+6)
+			JR	NZ, $B
+			LD	SP, IY
+			POP	IY
+			RET
+
+; Wait for interrupts, for ever
+; void bench_halt(void)
+;
+_bench_halt:		EI
+			HALT
+			JR	_bench_halt
+
+			END
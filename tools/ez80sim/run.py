@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+#
+# Title:	AGON MOS - Boot MOS on the host eZ80F92 model
+# Author:	Agon MOS contributors
+# Created:	17/10/2026
+# Last Updated:	17/10/2026
+#
+# Modinfo:
+#
+# Boots a MOS image from ZDS II (MOS.hex or MOS.bin, with MOS.map for the symbols) from reset
+# on the eZ80F92 model, with an SD card image (sdcard.py) and the VDP stand-in (vdp.py), for
+# a given time on the model's clock. The text MOS sends the VDP is printed, and keys can be
+# typed at it. At the end it lists the functions that took the most cycles: flat, the cycles
+# spent in each, and inclusive, the calls to each and the cycles until they returned.
+#
+# With --asm, the image is instead built from the assembler modules by asm.py, with main a
+# stub; this runs the reset, init_params_f92.asm and cstartup.asm up to the call to main,
+# which checks the boot path of the model without a ZDS build.
+#
+# Usage: python3 tools/ez80sim/run.py [--map MOS.map] [--sd disk.img] [--seconds s]
+#	 [--keys text] [--latency us] [--baud rate] [--top n] MOS.hex | --asm
+
+import argparse
+import bisect
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.normpath(os.path.join(HERE, "..", ".."))
+sys.path.insert(0, HERE)
+
+from asm import Assembler, AsmError
+from cpu import CPUError, Stop
+import f92
+from sdcard import SDCard
+from vdp import SimVDP
+
+BOOT_SOURCES = [
+	"src_startup/vectors16.asm", "src_startup/init_params_f92.asm", "src_startup/cstartup.asm",
+	"src_startup/globals.asm", "src/interrupts.asm", "src/vdp_protocol.asm", "src/keyboard.asm",
+	"src/iram.asm", "src/crc32.asm", "src/spi.asm", "src/serial.asm", "src/misc.asm",
+	"src/sd.asm", "src/gpio.asm",
+]
+
+# The link settings in eZ80F92_AGON_Flash.ztgt and MOS.zdsproj
+#
+LINK_SYMBOLS = {
+	"__stack": 0x0C0000, "__copy_code_to_ram": 0, "__cstartup": 1, "_SYS_CLK_FREQ": f92.CLOCK,
+	"__CS0_LBR_INIT_PARAM": 0x04, "__CS0_UBR_INIT_PARAM": 0x0B, "__CS0_CTL_INIT_PARAM": 0x08, "__CS0_BMC_INIT_PARAM": 0x01,
+	"__CS1_LBR_INIT_PARAM": 0xC0, "__CS1_UBR_INIT_PARAM": 0xC7, "__CS1_CTL_INIT_PARAM": 0x08, "__CS1_BMC_INIT_PARAM": 0x00,
+	"__CS2_LBR_INIT_PARAM": 0x80, "__CS2_UBR_INIT_PARAM": 0xBF, "__CS2_CTL_INIT_PARAM": 0x08, "__CS2_BMC_INIT_PARAM": 0x00,
+	"__CS3_LBR_INIT_PARAM": 0x03, "__CS3_UBR_INIT_PARAM": 0x03, "__CS3_CTL_INIT_PARAM": 0x18, "__CS3_BMC_INIT_PARAM": 0x82,
+	"__FLASH_ADDR_U_INIT_PARAM": 0x00, "__FLASH_CTL_INIT_PARAM": 0x28,
+	"__RAM_ADDR_U_INIT_PARAM": 0xB7, "__RAM_CTL_INIT_PARAM": 0x80,
+}
+
+class Symbols:
+	"""Addresses to names, for the profile"""
+
+	def __init__(self, pairs):
+		pairs = sorted((a, n) for n, a in pairs)
+		self.addrs = [a for a, n in pairs]
+		self.names = [n for a, n in pairs]
+
+	def name(self, addr):
+		i = bisect.bisect_right(self.addrs, addr) - 1
+		if i < 0:
+			return "%06X" % addr
+		return self.names[i]
+
+def read_map(path):
+	"""The symbols in a ZDS II map file: a name followed by an address, with or without a space prefix"""
+	pat = re.compile(r"^\s*([_A-Za-z.$][\w.$]*)\s+(?:[A-Z]{1,2}:)?([0-9A-Fa-f]{6})H?\b")
+	out = []
+	with open(path, errors="replace") as f:
+		for line in f:
+			m = pat.match(line)
+			if m:
+				out.append((m.group(1), int(m.group(2), 16)))
+	return out
+
+def read_image(path, mem):
+	"""Load MOS.hex (Intel hex) or MOS.bin (flash from 0)"""
+	if path.lower().endswith(".hex"):
+		upper = 0
+		with open(path) as f:
+			for line in f:
+				line = line.strip()
+				if not line.startswith(":"):
+					continue
+				rec = bytes.fromhex(line[1:])
+				n, addr, kind, data = rec[0], (rec[1] << 8) | rec[2], rec[3], rec[4:4 + rec[0]]
+				if kind == 0:
+					a = upper + addr
+					mem[a:a + n] = data
+				elif kind == 2:
+					upper = ((data[0] << 8) | data[1]) << 4
+				elif kind == 4:
+					upper = ((data[0] << 8) | data[1]) << 16
+	else:
+		with open(path, "rb") as f:
+			data = f.read()
+		mem[0:len(data)] = data
+
+def build_boot():
+	"""The assembler modules linked as ZDS would, with the initialised data copied from flash"""
+	def link(romdata):
+		asm = Assembler([os.path.join(ROOT, "src")])
+		for s in BOOT_SOURCES:
+			asm.add(os.path.join(ROOT, s))
+		symbols = dict(LINK_SYMBOLS)
+		symbols["__low_romdata"] = romdata
+		return asm.link(rom=0x000000, ram=0x0BC000, symbols=symbols, stubs=0x0BB000)
+	image = link(0)
+	end = max(b + s for b, s, space in image.segments.values() if space == "ROM")
+	image = link(end)
+	base, size, _ = image.segments.get("DATA", (0, 0, "RAM"))
+	if size:
+		image.write(end, image.flat(base, base + size, 0))
+	return image
+
+def main():
+	p = argparse.ArgumentParser(description="Boot MOS on the eZ80F92 model")
+	p.add_argument("image", nargs="?", help="MOS.hex or MOS.bin from ZDS II")
+	p.add_argument("--map", help="The map file, for function names")
+	p.add_argument("--asm", action="store_true", help="Boot the assembler modules up to main")
+	p.add_argument("--sd", help="SD card image")
+	p.add_argument("--seconds", type=float, default=3.0, help="Time to run for, on the model's clock")
+	p.add_argument("--keys", default="", help="Keys to type once booted; \\r for Return")
+	p.add_argument("--keys-at", dest="keys_at", type=float, default=2.0, help="Seconds in to start typing")
+	p.add_argument("--latency", type=float, default=100, help="VDP reply latency in microseconds")
+	p.add_argument("--baud", type=int, default=1152000, help="VDP baud rate")
+	p.add_argument("--top", type=int, default=25, help="Functions to list")
+	args = p.parse_args()
+
+	m = f92.F92()
+	cpu = m.cpu
+	names = []
+	if args.asm:
+		try:
+			image = build_boot()
+		except AsmError as e:
+			print("run: %s" % e, file=sys.stderr)
+			return 1
+		m.load(image)
+		names = [(n, a) for a, mod, n in image.labels]
+		reached = []
+		def at_main(c):
+			reached.append(c.cycles)
+			raise Stop()
+		cpu.traps[image["_main"]] = at_main
+	else:
+		if not args.image:
+			p.error("give a MOS image, or --asm")
+		read_image(args.image, m.mem)
+		if args.map:
+			names = read_map(args.map)
+	symbols = Symbols(names)
+
+	if args.sd:
+		card = SDCard(args.sd)
+		m.attach_sd(card)
+	vdp = SimVDP(m, args.latency, args.baud)
+	text = []
+	feed = vdp.vdp.put
+	def put(c):
+		text.append(chr(c))
+		feed(c)
+	vdp.vdp.put = put
+	if args.keys:
+		vdp.keys(args.keys.replace("\\r", "\r"), f92.us(args.keys_at * 1000000))
+
+	cpu.profile = {}
+	cpu.calls = []
+	cpu.inclusive = {}
+	limit = int(args.seconds * f92.CLOCK)
+	error = None
+	try:
+		cpu.run(cycles=limit)
+	except CPUError as e:
+		error = str(e)
+
+	sys.stdout.write("".join(text))
+	print()
+	print("%d cycles (%.3fs), %d instructions" % (cpu.cycles, cpu.cycles / float(f92.CLOCK), cpu.instructions))
+	if args.asm:
+		print("reached main after %d cycles" % reached[0] if reached else "did not reach main")
+	print("VDP: %d requests, %d packets sent, %d bytes garbled" % (sum(vdp.vdp.requests.values()), len(vdp.log), vdp.garbled))
+	flat = {}
+	for pc, cycles in cpu.profile.items():
+		n = symbols.name(pc)
+		flat[n] = flat.get(n, 0) + cycles
+	print("\n%-40s %12s" % ("Flat", "cycles"))
+	for n, cycles in sorted(flat.items(), key=lambda x: -x[1])[:args.top]:
+		print("%-40s %12d" % (n, cycles))
+	print("\n%-40s %8s %12s" % ("Inclusive", "calls", "cycles"))
+	for target, (calls, cycles) in sorted(cpu.inclusive.items(), key=lambda x: -x[1][1])[:args.top]:
+		print("%-40s %8d %12d" % (symbols.name(target), calls, cycles))
+	if error:
+		print("run: %s" % error, file=sys.stderr)
+		return 1
+	if args.asm and not reached:
+		return 1
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,174 @@
+#
+# Title:	AGON MOS - Host SD card model
+# Author:	Agon MOS contributors
+# Created:	17/10/2026
+# Last Updated:	17/10/2026
+#
+# Modinfo:
+#
+# An SDHC card in SPI mode, backed by a disk image, for the SPI in f92.py. It answers the
+# commands sd.asm sends (CMD0, CMD8, CMD55 / ACMD41, CMD58, CMD17, CMD24, CMD25, CMD12) with
+# the SPI mode responses and tokens, a read latency before each data token, and a busy
+# time after each block written; the card keeps programming with chip select high, as a
+# real one does. The times are in microseconds and default to those of a typical card.
+
+import f92
+
+R1_IDLE = 0x01
+R1_ILLEGAL = 0x04
+
+class SDCard:
+	def __init__(self, image=None, blocks=65536, read_us=250, busy_us=1500, init_polls=3):
+		"""image: a bytearray or a path; otherwise an empty card of blocks blocks
+		read_us: time from a read command to its data token
+		busy_us: time the card programs each block written
+		init_polls: ACMD41s answered idle before the card is ready"""
+		if isinstance(image, str):
+			self.path = image
+			with open(image, "rb") as f:
+				self.data = bytearray(f.read())
+		else:
+			self.path = None
+			self.data = image if image is not None else bytearray(blocks * 512)
+		self.read_cycles = f92.us(read_us)
+		self.busy_cycles = f92.us(busy_us)
+		self.init_polls = init_polls
+		self.reset()
+
+	def reset(self):
+		self.idle = True
+		self.polls = 0
+		self.app = False
+		self.cmd = []
+		self.out = []			# Bytes queued to shift out
+		self.ready_at = 0		# Data token not before this
+		self.busy_until = 0
+		self.busy_due = False		# Busy starts after the data response
+		self.state = None		# None, "read_wait", "write", "write_multi"
+		self.rx = None			# Block being received
+		self.block = 0
+		self.commands = 0
+		self.reads = 0
+		self.writes = 0
+
+	def save(self):
+		if self.path:
+			with open(self.path, "wb") as f:
+				f.write(self.data)
+
+	def select(self, level, when):
+		"""Chip select changed; high deselects"""
+		if level:
+			self.deselect()
+
+	def deselect(self):
+		"""Chip select went high: a partial command is dropped; programming carries on"""
+		self.cmd = []
+		self.out = []
+		if self.state == "read_wait":
+			self.state = None
+
+	def respond(self, *data):
+		self.out.extend(data)
+
+	def exchange(self, b, when):
+		"""One byte each way on the SPI; the card drives DO as it reads DI"""
+		if self.rx is not None:
+			return self.receive_data(b)
+		if self.out:
+			v = self.out.pop(0)
+			if self.busy_due and not self.out:
+				self.busy_due = False
+				self.busy_until = when + self.busy_cycles
+		elif self.state == "read_wait":
+			if when >= self.ready_at:
+				self.state = None
+				self.respond(*self.data[self.block * 512:self.block * 512 + 512])
+				self.respond(0xFF, 0xFF)
+				return 0xFE
+			return 0xFF
+		elif self.state in ("write", "write_multi"):
+			return self.write_token(b, when)
+		elif when < self.busy_until:
+			return 0x00
+		else:
+			v = 0xFF
+		if self.cmd or b & 0xC0 == 0x40:
+			self.cmd.append(b)
+			if len(self.cmd) == 6:
+				self.command(self.cmd, when)
+				self.cmd = []
+		return v
+
+	def command(self, c, when):
+		index = c[0] & 0x3F
+		arg = (c[1] << 24) | (c[2] << 16) | (c[3] << 8) | c[4]
+		self.commands += 1
+		app, self.app = self.app, False
+		r1 = R1_IDLE if self.idle else 0x00
+		self.out = [0xFF]		# NCR: one byte before the response
+		if index == 0:
+			self.reset_state()
+			self.respond(R1_IDLE)
+		elif index == 8:
+			self.respond(r1, 0x00, 0x00, (arg >> 8) & 0x0F, arg & 0xFF)
+		elif index == 55:
+			self.app = True
+			self.respond(r1)
+		elif index == 41 and app:
+			self.polls += 1
+			if self.polls > self.init_polls:
+				self.idle = False
+			self.respond(R1_IDLE if self.idle else 0x00)
+		elif index == 58:
+			self.respond(r1, 0xC0 if not self.idle else 0x40, 0xFF, 0x80, 0x00)
+		elif index == 12:
+			self.state = None
+			self.respond(r1)
+			self.busy_until = max(self.busy_until, when)
+		elif index in (17, 24, 25) and not self.idle:
+			if (arg + 1) * 512 > len(self.data):
+				self.respond(0x40)	# Address error
+				return
+			self.block = arg
+			self.respond(0x00)
+			if index == 17:
+				self.reads += 1
+				self.state = "read_wait"
+				self.ready_at = when + self.read_cycles
+			else:
+				self.state = "write" if index == 24 else "write_multi"
+		else:
+			self.respond(r1 | R1_ILLEGAL)
+
+	def reset_state(self):
+		self.idle = True
+		self.polls = 0
+		self.state = None
+		self.rx = None
+		self.busy_until = 0
+
+	def write_token(self, b, when):
+		"""Between blocks of a write: busy, then waiting for a start or stop token"""
+		if when < self.busy_until:
+			return 0x00
+		if b == 0xFE and self.state == "write" or b == 0xFC and self.state == "write_multi":
+			self.rx = []
+		elif b == 0xFD and self.state == "write_multi":
+			self.state = None
+			self.out = [0xFF]	# One byte before busy shows
+		return 0xFF
+
+	def receive_data(self, b):
+		self.rx.append(b)
+		if len(self.rx) < 514:
+			return 0xFF
+		self.data[self.block * 512:self.block * 512 + 512] = bytes(self.rx[:512])
+		self.rx = None
+		self.writes += 1
+		self.block += 1
+		self.busy_due = True
+		self.out = [0xE5]		# Data accepted
+		if self.state == "write":
+			self.state = None
+		return 0xFF
@@ -0,0 +1,267 @@
+#!/usr/bin/env python3
+#
+# Title:	AGON MOS - Host VDP stand-in
+# Author:	Agon MOS contributors
+# Created:	17/10/2026
+# Last Updated:	17/10/2026
+#
+# Modinfo:
+#
+# Stands in for the VDP on the other end of UART0. It follows the VDU stream MOS sends, and
+# answers the VDU 23,0 requests with the 0x80+cmd packets vdp_protocol.asm parses:
+#
+#	VDU 23,0,&80,n		General poll, as in wait_ESP32	-> &80 n
+#	VDU 23,0,&82		Cursor position			-> &82 x y
+#	VDU 23,0,&83,x;y;	Character on screen		-> &83 c
+#	VDU 23,0,&84,x;y;	Pixel				-> &84 r g b index
+#	VDU 23,0,&85,...	Audio				-> &85 channel 1
+#	VDU 23,0,&86 / VDU 22,n	Screen mode			-> &86 width; height; cols rows colours mode
+#	VDU 23,0,&87,0		Read the RTC			-> &87 and 6 bytes
+#	VDU 23,0,&88,d;r;led	Keyboard state			-> &88 d; r; led
+#	VDU 23,0,&94,n		Palette entry			-> &84 r g b n
+#
+# and sends keyboard packets (&81 ascii mods vkey down) from a script. Every reply leaves after
+# a configurable latency, one byte at a time at a configurable baud rate, and a request at a
+# different baud rate from the one MOS uses is received as framing errors, as the real one
+# would be; so round trips can be counted and held to a time budget.
+#
+# In the model (f92.py) it is the peer of UART0, drives CTS (PD3) low and the VBLANK line
+# (PB1) at 60Hz. Run on its own it serves a pty or stdin / stdout in real time, for anything
+# else that speaks the protocol.
+#
+# Usage: python3 tools/ez80sim/vdp.py [--pty] [--latency us] [--baud rate] [--keys text]
+
+import argparse
+import os
+import select
+import sys
+import time
+
+VDU_LENGTHS = {
+	1: 1, 17: 1, 18: 2, 19: 5, 22: 1, 23: 9, 24: 8, 25: 5, 27: 1, 28: 4, 29: 4, 31: 2,
+}
+
+# Bytes after VDU 23,0,cmd, for the system commands
+#
+SYSTEM_LENGTHS = {
+	0x80: 1, 0x81: 1, 0x82: 0, 0x83: 4, 0x84: 4, 0x85: 7, 0x86: 0, 0x87: 1, 0x88: 5,
+	0x94: 1, 0xC0: 1, 0xFE: 1, 0xFF: 0,
+}
+
+MODES = {
+	0: (640, 480, 16), 1: (640, 480, 4), 2: (640, 480, 2), 3: (640, 240, 64),
+	4: (640, 240, 16), 8: (320, 240, 64), 9: (320, 240, 16), 12: (320, 200, 64),
+}
+
+PALETTE = [
+	(0, 0, 0), (170, 0, 0), (0, 170, 0), (170, 170, 0), (0, 0, 170), (170, 0, 170), (0, 170, 170), (170, 170, 170),
+	(85, 85, 85), (255, 0, 0), (0, 255, 0), (255, 255, 0), (0, 0, 255), (255, 0, 255), (0, 255, 255), (255, 255, 255),
+]
+
+class VDP:
+	"""The VDU parser and protocol; send(bytes) is called with each reply packet"""
+
+	def __init__(self, send):
+		self.send = send
+		self.buf = []
+		self.need = 0
+		self.mode = 0
+		self.x = self.y = 0
+		self.rtc = [26, 10, 17, 12, 0, 0]	# Year since 1980, month, day, hour, minute, second
+		self.keystate = [0xF4, 0x01, 0x21, 0x00, 0x00]
+		self.requests = {}			# Command: times asked
+		self.screen = {}			# (x, y): character
+
+	def packet(self, cmd, data):
+		self.send(bytes([0x80 | cmd, len(data)] + list(data)))
+
+	def mode_packet(self):
+		w, h, colours = MODES.get(self.mode, MODES[0])
+		cols, rows = w // 8, h // 8
+		self.packet(0x06, [w & 0xFF, w >> 8, h & 0xFF, h >> 8, cols, rows, colours, self.mode])
+
+	def key(self, ascii, vkey=0, mods=0):
+		"""A key pressed and released"""
+		self.packet(0x01, [ascii, mods, vkey, 1])
+		self.packet(0x01, [ascii, mods, vkey, 0])
+
+	def feed(self, b):
+		"""One byte from MOS"""
+		if not self.buf:
+			if b < 32 or b == 127:
+				self.buf = [b]
+				self.need = VDU_LENGTHS.get(b, 0)
+			else:
+				self.put(b)
+				return
+		else:
+			self.buf.append(b)
+			if self.buf[0] == 23 and len(self.buf) == 3 and self.buf[1] == 0:
+				self.need = SYSTEM_LENGTHS.get(b, 0) + 2
+		if len(self.buf) - 1 >= self.need:
+			vdu, self.buf = self.buf, []
+			self.vdu(vdu)
+
+	def put(self, c):
+		self.screen[(self.x, self.y)] = c
+		self.x += 1
+		cols = MODES.get(self.mode, MODES[0])[0] // 8
+		if self.x >= cols:
+			self.x = 0
+			self.y += 1
+
+	def vdu(self, v):
+		code = v[0]
+		if code == 8:
+			self.x = max(self.x - 1, 0)
+		elif code == 9:
+			self.x += 1
+		elif code == 10:
+			self.y += 1
+		elif code == 11:
+			self.y = max(self.y - 1, 0)
+		elif code == 12 or code == 30:
+			self.x = self.y = 0
+			if code == 12:
+				self.screen = {}
+		elif code == 13:
+			self.x = 0
+		elif code == 31:
+			self.x, self.y = v[1], v[2]
+		elif code == 127:
+			self.x = max(self.x - 1, 0)
+		elif code == 22:
+			self.mode = v[1]
+			self.x = self.y = 0
+			self.mode_packet()
+		elif code == 23 and v[1] == 0:
+			self.system(v[2], v[3:])
+
+	def system(self, cmd, args):
+		self.requests[cmd] = self.requests.get(cmd, 0) + 1
+		if cmd == 0x80:
+			self.packet(0x00, [args[0]])
+		elif cmd == 0x82:
+			self.packet(0x02, [self.x, self.y])
+		elif cmd == 0x83:
+			x, y = args[0] | (args[1] << 8), args[2] | (args[3] << 8)
+			self.packet(0x03, [self.screen.get((x, y), 32)])
+		elif cmd == 0x84:
+			self.packet(0x04, [0, 0, 0, 0])
+		elif cmd == 0x85:
+			self.packet(0x05, [args[0], 1])
+		elif cmd == 0x86:
+			self.mode_packet()
+		elif cmd == 0x87:
+			if args[0] == 0:
+				self.packet(0x07, self.rtc)
+		elif cmd == 0x88:
+			self.keystate = list(args)
+			self.packet(0x08, self.keystate)
+		elif cmd == 0x94:
+			r, g, b = PALETTE[args[0] & 15]
+			self.packet(0x04, [r, g, b, args[0]])
+
+class SimVDP:
+	"""The stand-in on UART0 of an F92 from f92.py, in model time
+
+	latency_us: from the last byte of a request to the first of its reply
+	baud: the rate it talks at; MOS normally uses 1152000
+	"""
+
+	def __init__(self, f92, latency_us=100, baud=1152000, vblank=True):
+		import f92 as model
+		self.f92 = f92
+		self.model = model
+		self.baud = baud
+		self.latency = model.us(latency_us)
+		self.frame = int(round(10 * model.CLOCK / float(baud)))
+		self.line_free = 0		# When the line back to MOS is next free
+		self.now = 0
+		self.cts = True
+		self.garbled = 0
+		self.vblanks = 0
+		self.log = []			# (time the request ended, time the reply ended, command)
+		self.vdp = VDP(self.send)
+		f92.uart0.peer = self
+		f92.pd.set_pin(3, 0)		# CTS
+		if vblank:
+			f92.pb.set_pin(1, 0)
+			self.vblank_period = model.CLOCK // 60
+			f92.bus.schedule(self.vblank_period, self.vblank)
+
+	def vblank(self, t):
+		pb = self.f92.pb
+		self.vblanks += 1
+		pb.set_pin(1, 1, t)
+		self.f92.bus.schedule(t + self.model.us(100), lambda t: pb.set_pin(1, 0, t))
+		self.f92.bus.schedule(t + self.vblank_period, self.vblank)
+
+	def uart_receive(self, b, t, baud):
+		"""A byte from MOS has finished arriving"""
+		if abs(baud - self.baud) / float(self.baud) > 0.03:
+			self.garbled += 1
+			return
+		self.now = t
+		self.vdp.feed(b)
+
+	def send(self, data):
+		t = max(self.now + self.latency, self.line_free)
+		for b in data:
+			t += self.frame
+			self.f92.uart0.receive(b, t, self.baud)
+		self.line_free = t
+		self.log.append((self.now, t, data[0] & 0x7F))
+
+	def keys(self, text, at, gap_us=20000):
+		"""Type text from time at, one key every gap_us"""
+		for i, c in enumerate(text):
+			def press(t, c=c):
+				self.now = t
+				self.vdp.key(ord(c))
+			self.f92.bus.schedule(at + i * self.model.us(gap_us), press)
+
+class LineVDP:
+	"""The stand-in on a file descriptor, in real time"""
+
+	def __init__(self, fd_in, fd_out, latency_us, baud):
+		self.fd_in = fd_in
+		self.fd_out = fd_out
+		self.latency = latency_us / 1000000.0
+		self.byte_time = 10.0 / baud
+		self.vdp = VDP(self.send)
+
+	def send(self, data):
+		time.sleep(self.latency)
+		for b in data:
+			os.write(self.fd_out, bytes([b]))
+			time.sleep(self.byte_time)
+
+	def run(self, keys=""):
+		for c in keys:
+			self.vdp.key(ord(c))
+		while True:
+			r, _, _ = select.select([self.fd_in], [], [])
+			data = os.read(self.fd_in, 256)
+			if not data:
+				return
+			for b in data:
+				self.vdp.feed(b)
+
+def main():
+	p = argparse.ArgumentParser(description="Stand in for the Agon VDP")
+	p.add_argument("--pty", action="store_true", help="Serve a new pty rather than stdin and stdout")
+	p.add_argument("--latency", type=float, default=100, help="Reply latency in microseconds")
+	p.add_argument("--baud", type=int, default=1152000, help="Baud rate the replies are paced at")
+	p.add_argument("--keys", default="", help="Keys to send at the start")
+	args = p.parse_args()
+	if args.pty:
+		master, slave = os.openpty()
+		print(os.ttyname(slave), file=sys.stderr)
+		LineVDP(master, master, args.latency, args.baud).run(args.keys)
+	else:
+		LineVDP(sys.stdin.fileno(), sys.stdout.fileno(), args.latency, args.baud).run(args.keys)
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main())
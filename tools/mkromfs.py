@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+#
+# Title:	AGON MOS - ROM filesystem image builder
+# Author:	Agon MOS contributors
+# Created:	17/10/2026
+# Last Updated:	17/10/2026
+#
+# Modinfo:
+#
+# Packs a folder laid out like the root of the SD card (for example mos/hexload.bin,
+# bin/nano.bin, autoexec.txt) into src/romfs_image.asm, which is linked into the spare
+# internal flash. Files that get smaller are compressed with LZSS; see romfs_unpack in
+# src/romfs.c for the format.
+#
+# Usage: python3 tools/mkromfs.py [-o src/romfs_image.asm] [<folder>]
+# With no folder an empty image is written.
+
+import argparse
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = b"ROMF"
+VERSION = 1
+NAME_LENGTH = 32				# Including the terminator
+HEADER_SIZE = 9
+ENTRY_SIZE = NAME_LENGTH + 3 + 3 + 3 + 1 + 4
+MAX_LENGTH = 0x10000			# Largest file; the spare flash is well under this anyway
+
+STORED = 0
+LZSS = 1
+
+WINDOW = 4096
+MIN_MATCH = 3
+MAX_MATCH = 18
+
+
+def lzss(data):
+	"""Compress with LZSS: a flag byte then eight items, least significant bit first.
+	A set bit is a literal byte; a clear bit is a reference to an earlier run, two bytes
+	holding offset - 1 (12 bits, low byte first) and length - 3 (top 4 bits)."""
+	out = bytearray()
+	chains = {}
+	i = 0
+	n = len(data)
+	while i < n:
+		flag_pos = len(out)
+		out.append(0)
+		flags = 0
+		for bit in range(8):
+			if i >= n:
+				break
+			best_len, best_off = 0, 0
+			key = data[i:i + MIN_MATCH]
+			if len(key) == MIN_MATCH:
+				for j in reversed(chains.get(key, [])):
+					if i - j > WINDOW:
+						break
+					k = MIN_MATCH
+					while k < MAX_MATCH and i + k < n and data[j + k] == data[i + k]:
+						k += 1
+					if k > best_len:
+						best_len, best_off = k, i - j
+						if k == MAX_MATCH:
+							break
+			if best_len >= MIN_MATCH:
+				o = best_off - 1
+				out.append(o & 0xFF)
+				out.append(((best_len - MIN_MATCH) << 4) | (o >> 8))
+				step = best_len
+			else:
+				flags |= 1 << bit
+				out.append(data[i])
+				step = 1
+			for p in range(i, i + step):
+				chains.setdefault(data[p:p + MIN_MATCH], []).append(p)
+			i += step
+		out[flag_pos] = flags
+	return bytes(out)
+
+
+def unlzss(packed, length):
+	"""Reference unpacker, used to check each file before it goes in the image."""
+	out = bytearray()
+	src = 0
+	while len(out) < length:
+		flags = packed[src]
+		src += 1
+		for bit in range(8):
+			if len(out) >= length:
+				break
+			if flags & (1 << bit):
+				out.append(packed[src])
+				src += 1
+			else:
+				o = packed[src] | ((packed[src + 1] & 0x0F) << 8)
+				k = (packed[src + 1] >> 4) + MIN_MATCH
+				src += 2
+				for _ in range(k):
+					out.append(out[-o - 1])
+	return bytes(out[:length])
+
+
+def collect(folder):
+	files = []
+	for root, dirs, names in os.walk(folder):
+		dirs.sort()
+		for name in sorted(names):
+			path = os.path.join(root, name)
+			rel = os.path.relpath(path, folder).replace(os.sep, "/")
+			if len(rel) >= NAME_LENGTH:
+				sys.exit("%s: path longer than %d characters" % (rel, NAME_LENGTH - 1))
+			with open(path, "rb") as f:
+				data = f.read()
+			if len(data) >= MAX_LENGTH:
+				sys.exit("%s: too big for the ROM filesystem" % rel)
+			files.append((rel, data))
+	if len(files) > 255:
+		sys.exit("Too many files for the ROM filesystem")
+	return files
+
+
+def build(files):
+	directory = bytearray()
+	blobs = bytearray()
+	offset = HEADER_SIZE + ENTRY_SIZE * len(files)
+	for name, data in files:
+		packed = lzss(data)
+		if len(packed) < len(data) and unlzss(packed, len(data)) == data:
+			method = LZSS
+		else:
+			packed, method = data, STORED
+		directory += name.encode("ascii").ljust(NAME_LENGTH, b"\0")
+		directory += struct.pack("<I", offset + len(blobs))[:3]
+		directory += struct.pack("<I", len(data))[:3]
+		directory += struct.pack("<I", len(packed))[:3]
+		directory += struct.pack("<BI", method, zlib.crc32(packed) & 0xFFFFFFFF)
+		blobs += packed
+		print("%-31s %6d %6d %s" % (name, len(data), len(packed), "lzss" if method == LZSS else "stored"))
+	length = HEADER_SIZE + len(directory) + len(blobs)
+	header = MAGIC + bytes([VERSION, len(files)]) + struct.pack("<I", length)[:3]
+	return header + directory + blobs
+
+
+def write_asm(path, image, source):
+	lines = [
+		";",
+		"; Title:\tAGON MOS - ROM filesystem image",
+		"; Author:\tAgon MOS contributors",
+		"; Created:\t17/10/2026",
+		"; Last Updated:\t17/10/2026",
+		";",
+		"; Modinfo:",
+		";",
+		"; Generated by tools/mkromfs.py %s; do not edit" % source,
+		"",
+		"\t\t\t.ASSUME\tADL = 1",
+		"",
+		"\t\t\tDEFINE ROMFS, SPACE = ROM",
+		"\t\t\tSEGMENT ROMFS",
+		"",
+		"\t\t\tXDEF\t_romfs_image",
+		"",
+		"_romfs_image:",
+	]
+	for i in range(0, len(image), 16):
+		lines.append("\t\t\tDB\t" + ", ".join("%03Xh" % b for b in image[i:i + 16]))
+	lines += ["", "\t\t\tEND", ""]
+	with open(path, "w", newline="\r\n") as f:
+		f.write("\n".join(lines))
+
+
+def main():
+	parser = argparse.ArgumentParser(description="Build the MOS ROM filesystem image")
+	parser.add_argument("folder", nargs="?", help="folder laid out like the root of the SD card")
+	parser.add_argument("-o", "--output", default=os.path.join("src", "romfs_image.asm"))
+	args = parser.parse_args()
+
+	files = collect(args.folder) if args.folder else []
+	image = build(files)
+	write_asm(args.output, image, "from " + args.folder if args.folder else "with no files")
+	print("%d files, %d bytes" % (len(files), len(image)))
+
+
+if __name__ == "__main__":
+	main()